@@ -0,0 +1,80 @@
+// Arrange scheduling: the keyboard hook's filter, which turns a held chord
+// into a single press, and the single-slot scheduler that folds arrange
+// requests into one pending run, latest wins. Kept free of Windows headers
+// and of the tool's globals so the tests can drive a repeat storm on their
+// own state: whether a chord is handled by the hook is passed in, and the
+// caller posts the message that serves the slot.
+#pragma once
+
+// What the keyboard hook does with an event of a key that has hooked chords
+#define HOTKEY_EVENT_PASS 0      // Not a bound chord: let it through
+#define HOTKEY_EVENT_DISPATCH 1  // New press of a bound chord: run its action
+#define HOTKEY_EVENT_SWALLOW 2   // Auto-repeat of a bound chord: drop it
+
+// What a new arrange request does to the slot
+#define ARRANGE_REQUEST_DROPPED 0  // Folded into the request already pending
+#define ARRANGE_REQUEST_QUEUED 1   // Pending; the running arrange posts it when it returns
+#define ARRANGE_REQUEST_POST 2     // Pending; the caller posts the message that serves it
+
+// Hooked keys that are held, to tell auto-repeat from a new press
+struct HotkeyKeyState
+{
+    bool down[256] = {};
+};
+
+// Arrange scheduler: one pending slot, the latest request wins
+struct ArrangeScheduler
+{
+    bool pending = false;        // A request is waiting to be served
+    bool running = false;        // An arrange is on the stack (it may pump messages)
+};
+
+// Function to decide what the keyboard hook does with an event of a key
+// that has hooked chords. Like a hotkey registered with MOD_NOREPEAT, only
+// the first key-down after the key was up runs the action; auto-repeats of
+// a bound chord are swallowed with it. hooked tells whether the chord of
+// the event is handled by the hook.
+inline int FilterHotkeyEvent(HotkeyKeyState& keys, unsigned int vk, bool down, bool hooked)
+{
+    bool repeat = down && keys.down[vk & 0xFF];
+    keys.down[vk & 0xFF] = down;
+    if (!down || !hooked)
+        return HOTKEY_EVENT_PASS;
+    return repeat ? HOTKEY_EVENT_SWALLOW : HOTKEY_EVENT_DISPATCH;
+}
+
+// Function to add an arrange request to the slot; returns ARRANGE_REQUEST_*
+inline int AddArrangeRequest(ArrangeScheduler& scheduler)
+{
+    if (scheduler.pending)
+        return ARRANGE_REQUEST_DROPPED;
+    scheduler.pending = true;
+    return scheduler.running ? ARRANGE_REQUEST_QUEUED : ARRANGE_REQUEST_POST;
+}
+
+// Function to take the pending request and mark the arrange running.
+// Returns false if there is none, or an arrange is already running: a
+// message box inside it pumps messages, and the request waits for it.
+inline bool BeginPendingArrange(ArrangeScheduler& scheduler)
+{
+    if (scheduler.running || !scheduler.pending)
+        return false;
+    scheduler.pending = false;
+    scheduler.running = true;
+    return true;
+}
+
+// Function to mark the arrange finished. Returns true if a request came in
+// meanwhile; it gets its own run, which the caller posts.
+inline bool EndArrange(ArrangeScheduler& scheduler)
+{
+    scheduler.running = false;
+    return scheduler.pending;
+}
+
+// Function to check whether the running arrange is superseded by a newer
+// request, in which case it is abandoned before its next commit
+inline bool IsArrangeSuperseded(const ArrangeScheduler& scheduler)
+{
+    return scheduler.pending;
+}
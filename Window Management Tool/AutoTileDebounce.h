@@ -0,0 +1,74 @@
+// Debounce of the auto-tiling daemon: which window events change the
+// captured list, and when the relayout for a burst of them runs. Kept free
+// of Windows headers so the tests can drive it on other platforms with a
+// simulated clock and list: times are tick counts in milliseconds, and
+// whether a window matches the capture rules is passed in.
+#pragma once
+
+#include <cstdint>
+
+// Auto-tiling debounce: a relayout runs once no new event arrived for
+// AUTO_TILE_DEBOUNCE_MS, but never later than AUTO_TILE_MAX_DELAY_MS after the
+// first event of a burst, so a steady event stream cannot starve the layout.
+#define AUTO_TILE_DEBOUNCE_MS 250
+#define AUTO_TILE_MAX_DELAY_MS 1000
+
+// Window events the daemon looks at
+#define AUTO_TILE_EVENT_OTHER 0
+#define AUTO_TILE_EVENT_SHOW 1
+#define AUTO_TILE_EVENT_DESTROY 2
+
+// What a window event does to the captured list
+#define AUTO_TILE_LIST_UNCHANGED 0
+#define AUTO_TILE_LIST_ADD 1
+#define AUTO_TILE_LIST_REMOVE 2
+
+// Relayout pending for the current burst of list changes
+struct AutoTileBurst
+{
+    bool relayoutPending = false;
+    uint32_t start = 0;            // Tick count of the first event in the burst
+    int events = 0;                // List changes coalesced into the pending relayout
+};
+
+// Function to get what a window event does to the captured list. Windows
+// are usually created hidden, so they are captured once they are shown, if
+// they match; a listed window leaves the list when it is destroyed.
+// matches() is only called for a shown window that is not listed yet.
+template <typename Matches>
+int GetAutoTileListChange(int event, bool listed, Matches matches)
+{
+    if (event == AUTO_TILE_EVENT_DESTROY)
+        return listed ? AUTO_TILE_LIST_REMOVE : AUTO_TILE_LIST_UNCHANGED;
+    if (event == AUTO_TILE_EVENT_SHOW && !listed && matches())
+        return AUTO_TILE_LIST_ADD;
+    return AUTO_TILE_LIST_UNCHANGED;
+}
+
+// Function to add a list change at tick count now to the burst of the
+// pending relayout, starting a burst if none is pending. Returns true if
+// the debounce deadline moves to now + AUTO_TILE_DEBOUNCE_MS.
+inline bool AddAutoTileBurstEvent(AutoTileBurst& burst, uint32_t now)
+{
+    if (!burst.relayoutPending)
+    {
+        burst.relayoutPending = true;
+        burst.start = now;
+        burst.events = 0;
+    }
+    burst.events++;
+
+    // Push the deadline back with every event until the burst gets too old;
+    // after that the already running timer fires before the maximum delay
+    uint32_t elapsed = now - burst.start;
+    return elapsed + AUTO_TILE_DEBOUNCE_MS <= AUTO_TILE_MAX_DELAY_MS;
+}
+
+// Function to take the pending relayout when the debounce timer fires
+inline bool TakeAutoTileRelayout(AutoTileBurst& burst)
+{
+    if (!burst.relayoutPending)
+        return false;
+    burst.relayoutPending = false;
+    return true;
+}
@@ -0,0 +1,128 @@
+// Epoch-based reclamation for data that one writer thread replaces and any
+// thread reads without a lock. Kept free of Windows headers so the tests
+// can run the same code on other platforms.
+//
+// A reader stores the current epoch in its slot while it holds the data.
+// The writer swaps in the new data, retires the old with the next epoch,
+// and frees whatever was retired at or before the oldest epoch still held.
+// A process uses one EpochReaders; each thread gets one slot in it.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Most threads that may read at the same time
+#define MAX_EPOCH_READERS 64
+
+struct EpochReaders
+{
+    std::atomic<uint64_t> epoch;
+    std::atomic<uint64_t> readerEpochs[MAX_EPOCH_READERS]; // 0 = not reading
+    std::atomic<bool> slotsUsed[MAX_EPOCH_READERS];
+
+    EpochReaders() : epoch(1)
+    {
+        for (int i = 0; i < MAX_EPOCH_READERS; ++i)
+        {
+            readerEpochs[i].store(0);
+            slotsUsed[i].store(false);
+        }
+    }
+};
+
+// A thread's reader slot, given back when the thread exits
+struct EpochReaderSlot
+{
+    EpochReaders* readers = nullptr;
+    int index = -1;
+    int depth = 0;   // Nested reads on this thread share the outer read's epoch
+
+    ~EpochReaderSlot()
+    {
+        if (index >= 0)
+        {
+            readers->readerEpochs[index].store(0);
+            readers->slotsUsed[index].store(false);
+        }
+    }
+};
+
+inline EpochReaderSlot& GetEpochReaderSlot()
+{
+    static thread_local EpochReaderSlot slot;
+    return slot;
+}
+
+// Function to start a read on this thread. Data loaded after this call
+// stays valid until the matching LeaveEpochRead.
+inline void EnterEpochRead(EpochReaders& readers)
+{
+    EpochReaderSlot& slot = GetEpochReaderSlot();
+    if (slot.index < 0)
+    {
+        // Claim a free slot for this thread; wait if every slot is taken
+        for (int i = 0; slot.index < 0; i = (i + 1) % MAX_EPOCH_READERS)
+        {
+            bool expected = false;
+            if (readers.slotsUsed[i].compare_exchange_strong(expected, true))
+            {
+                slot.readers = &readers;
+                slot.index = i;
+            }
+            else if (i == MAX_EPOCH_READERS - 1)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    if (slot.depth++ == 0)
+        readers.readerEpochs[slot.index].store(readers.epoch.load());
+}
+
+// Function to end the read started by EnterEpochRead
+inline void LeaveEpochRead(EpochReaders& readers)
+{
+    EpochReaderSlot& slot = GetEpochReaderSlot();
+    if (--slot.depth == 0)
+        readers.readerEpochs[slot.index].store(0);
+}
+
+// Function for the writer, after swapping in new data: starts the next
+// epoch and returns it, to retire the replaced data with
+inline uint64_t AdvanceEpoch(EpochReaders& readers)
+{
+    return readers.epoch.fetch_add(1) + 1;
+}
+
+// Function to get the oldest epoch a reader still holds, or UINT64_MAX
+inline uint64_t GetOldestReaderEpoch(const EpochReaders& readers)
+{
+    uint64_t oldest = UINT64_MAX;
+    for (int i = 0; i < MAX_EPOCH_READERS; ++i)
+    {
+        uint64_t epoch = readers.readerEpochs[i].load();
+        if (epoch != 0 && epoch < oldest)
+            oldest = epoch;
+    }
+    return oldest;
+}
+
+// Function to free the retired items no reader can hold any more: those
+// retired at or before the oldest epoch held. The rest are kept in order.
+template <typename T, typename Free>
+void ReclaimRetired(std::vector<std::pair<T, uint64_t>>& retired, uint64_t oldestReader, Free free)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < retired.size(); ++i)
+    {
+        if (retired[i].second <= oldestReader)
+            free(retired[i].first);
+        else if (kept++ != i)
+            retired[kept - 1] = std::move(retired[i]);
+    }
+    retired.erase(retired.begin() + kept, retired.end());
+}
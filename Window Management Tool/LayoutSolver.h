@@ -0,0 +1,1362 @@
+// Layout solvers: the grid, grouped, all-monitors and custom layouts, the
+// linked reflow of a grid while one of its windows is resized, the layout
+// language the custom layouts are written in, and the reference solver and
+// tiling invariants the self-check holds them to. Kept free of
+// Windows headers so the tests can run the same code on other platforms:
+// the rectangle type is a template parameter that only needs left, top,
+// right and bottom, and the windows, groups, monitors and layouts a solve
+// looks at are passed in, never read from globals.
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cwctype>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Layout modes cycled through by HOTKEY_CYCLE_LAYOUT
+#define LAYOUT_GRID 0     // Best-fitting grid (default)
+#define LAYOUT_COLUMNS 1  // All windows side by side
+#define LAYOUT_ROWS 2     // All windows stacked
+#define LAYOUT_GROUPED 3  // One region per process or capture rule, tiled inside
+#define LAYOUT_CUSTOM 4   // A layout from the layouts file
+#define LAYOUT_COUNT 5
+
+// Limits of one compiled layout
+#define MAX_LAYOUT_INSTRUCTIONS 64
+#define MAX_LAYOUT_REGIONS 32
+#define MAX_LAYOUT_SPLIT_CHILDREN 16
+#define MAX_LAYOUT_GRID 16
+#define MAX_LAYOUT_WEIGHT 1000
+#define MAX_LAYOUT_GAP 200
+#define MAX_LAYOUT_RULES 4096   // Highest capture rule number a binding can name
+
+// Smallest width or height a neighbor cell is squeezed to by linked resizing
+#define MIN_LINKED_CELL_SIZE 50
+
+// Layout instructions
+#define LAYOUT_OP_COLUMNS 0   // Split side by side among the children
+#define LAYOUT_OP_ROWS 1      // Split top to bottom among the children
+#define LAYOUT_OP_REGION 2    // Tile windows into the region
+
+// What a region of a layout is bound to with "for"
+#define LAYOUT_BIND_NONE 0      // Any window, in list order
+#define LAYOUT_BIND_PROCESS 1   // Windows of an executable, e.g. devenv.exe
+#define LAYOUT_BIND_CLASS 2     // Windows of a window class
+#define LAYOUT_BIND_RULE 3      // Windows taken by a capture rule, numbered from 1
+
+// Inputs of a layout, read once per arrange
+template <typename Rect>
+struct LayoutInputs
+{
+    Rect workArea;
+    int pixelFixX;
+    int pixelFixY;
+    int minSpacingY;
+    int layoutMode;            // LAYOUT_*
+    bool allMonitors;          // Spread the windows over every monitor
+};
+
+// Geometry of a solved grid
+struct GridGeometry
+{
+    bool valid = false;
+    int rows = 0;
+    int columns = 0;
+    std::vector<int> columnX;      // Left edge of each column
+    std::vector<int> columnWidths;
+    std::vector<int> rowY;         // Top edge of each row
+    std::vector<int> rowHeights;
+};
+
+// One monitor of the all-monitors layout
+template <typename Rect>
+struct LayoutMonitor
+{
+    Rect workArea;
+    unsigned int dpi;          // Effective DPI, 0 if unknown
+};
+
+// One region of the grouped layout: the windows of one process or capture
+// rule. The region is sized for a capacity with some slack over the window
+// count; the cells only depend on the region, the window count and the
+// spacing, so they are reused until one of those changes.
+template <typename Rect>
+struct LayoutGroupRegion
+{
+    int key = -1;              // Group key of the windows
+    int count = 0;
+    int capacity = 0;          // Window count the region is sized for
+    Rect region;
+    int spacing = 0;
+    bool solved = false;
+    std::vector<Rect> cells;
+};
+
+// One instruction of a compiled layout. A layout is stored as its tree in
+// preorder, so a split's children follow it and next skips its subtree.
+struct LayoutInstruction
+{
+    unsigned char op;            // LAYOUT_OP_*
+    unsigned char childCount;    // Splits: number of children
+    unsigned short weight;       // Share of the parent split
+    unsigned short rows;         // Fixed grid regions: grid size, otherwise 0
+    unsigned short columns;
+    unsigned short next;         // Index of the instruction after this subtree
+    unsigned short firstRegion;  // Regions of this subtree, in order
+    unsigned short endRegion;
+};
+
+// What one region of a layout is bound to
+struct LayoutBinding
+{
+    int kind = LAYOUT_BIND_NONE;   // LAYOUT_BIND_*
+    std::wstring value;            // Lower-case process or class name
+    int rule = -1;                 // Index in the capture rules
+};
+
+// The names of a window that layout bindings test, looked up once per arrange
+struct LayoutWindowNames
+{
+    std::wstring process;
+    std::wstring className;
+    int rule = -1;                 // Capture rule that took the window, -1 = none
+};
+
+// A compiled layout. Windows bound to a region go there first, in list
+// order, up to its capacity; the other windows fill the unbound regions in
+// order, each up to its capacity; the rest go to the "auto" region, or to
+// the last unbound region if there is none. A layout without an unbound
+// region has nowhere to put the rest and does not compile. Splits give the
+// space of regions without windows to their siblings. Everything is
+// fixed-size, so evaluating a layout does not allocate.
+struct LayoutProgram
+{
+    std::wstring name;
+    std::wstring source;       // Line it was compiled from, recorded in traces
+    int gap = 0;
+    int codeLength = 0;
+    int regionCount = 0;
+    int overflowRegion = -1;
+    LayoutInstruction code[MAX_LAYOUT_INSTRUCTIONS];
+    int regionCapacity[MAX_LAYOUT_REGIONS];
+    int boundRegions = 0;
+    LayoutBinding binding[MAX_LAYOUT_REGIONS];
+};
+
+// Function to make a rectangle of any type from its edges
+template <typename Rect>
+inline Rect MakeLayoutRect(int left, int top, int right, int bottom)
+{
+    Rect rect = Rect();
+    rect.left = left;
+    rect.top = top;
+    rect.right = right;
+    rect.bottom = bottom;
+    return rect;
+}
+
+// Function to check whether two rectangles share at least one pixel; an
+// empty rectangle shares none
+template <typename Rect>
+inline bool LayoutRectsOverlap(const Rect& a, const Rect& b)
+{
+    return (std::max)(a.left, b.left) < (std::min)(a.right, b.right) &&
+        (std::max)(a.top, b.top) < (std::min)(a.bottom, b.bottom);
+}
+
+// Function to compare two rectangles edge by edge
+template <typename Rect>
+inline bool LayoutRectsEqual(const Rect& a, const Rect& b)
+{
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+// Function to get the area the layouts tile once the pixel fixes are applied
+template <typename Rect>
+Rect GetFixedWorkArea(const LayoutInputs<Rect>& params)
+{
+    Rect area = params.workArea;
+    area.left += params.pixelFixX;
+    area.right += params.pixelFixX;
+    area.bottom -= params.pixelFixY;
+    return area;
+}
+
+// Function to find the row count whose grid aspect ratio (columns / rows)
+// is closest to the given one. ceil(count / rows) / rows strictly decreases
+// as rows grows, so the best count is at the crossing point, found by
+// binary search, or the one before it; the smaller count wins a tie.
+inline int FindBestRowCount(int count, double aspectRatio)
+{
+    if (count <= 1)
+        return 1;
+
+    // Smallest row count whose grid is no wider than the target
+    int low = 1;
+    int high = count;
+    while (low < high)
+    {
+        int rows = low + (high - low) / 2;
+        double gridAspectRatio = static_cast<double>((count + rows - 1) / rows) / rows;
+        if (gridAspectRatio <= aspectRatio)
+            high = rows;
+        else
+            low = rows + 1;
+    }
+
+    int best = low;
+    if (best > 1)
+    {
+        double above = fabs(static_cast<double>((count + best - 2) / (best - 1)) / (best - 1) - aspectRatio);
+        double below = fabs(static_cast<double>((count + best - 1) / best) / best - aspectRatio);
+        if (above <= below)
+            best--;
+    }
+    return best;
+}
+
+// Function to compute one cell per window for the equal-size grid layout.
+// Returns false if the work area has no vertical space left for the windows.
+template <typename Rect>
+bool ComputeGridLayout(const LayoutInputs<Rect>& params, int numWindows, std::vector<Rect>& cells, GridGeometry* grid = nullptr)
+{
+    cells.clear();
+    if (grid)
+        grid->valid = false;
+    if (numWindows <= 0)
+        return true;
+
+    const Rect& workArea = params.workArea;
+    int workWidth = static_cast<int>(workArea.right - workArea.left);
+    int workHeight = static_cast<int>(workArea.bottom - workArea.top);
+
+    // Apply pixelFixX to starting X position
+    int startXPos = static_cast<int>(workArea.left) + params.pixelFixX;
+
+    // Apply pixelFixY to available height by reserving space at the bottom
+    int totalSpacingY = (numWindows > 1) ? (numWindows - 1) * params.minSpacingY : 0;
+    int availableHeight = workHeight - params.pixelFixY - totalSpacingY;
+
+    // Ensure availableHeight is positive
+    if (availableHeight <= 0)
+        return false;
+
+    // Calculate the best grid layout (rows and columns) to minimize gaps
+    double aspectRatio = static_cast<double>(workWidth) / (availableHeight);
+
+    int bestRows = 1;
+    int bestCols = numWindows;
+
+    if (params.layoutMode == LAYOUT_ROWS)
+    {
+        bestRows = numWindows;
+        bestCols = 1;
+    }
+    else if (params.layoutMode == LAYOUT_GRID)
+    {
+        bestRows = FindBestRowCount(numWindows, aspectRatio);
+        bestCols = (numWindows + bestRows - 1) / bestRows; // Ceiling division
+    }
+
+    // Recalculate total spacing based on bestRows
+    totalSpacingY = (bestRows - 1) * params.minSpacingY;
+    availableHeight = workHeight - params.pixelFixY - totalSpacingY;
+
+    // Calculate window sizes
+    int windowHeight = availableHeight / bestRows;
+    int extraPixelsHeight = availableHeight % bestRows;
+
+    // Distribute extra pixels to the top rows to eliminate gaps
+    std::vector<int> rowHeights(bestRows, windowHeight);
+    for (int row = 0; row < extraPixelsHeight; ++row)
+    {
+        rowHeights[row]++;
+    }
+
+    // Calculate window widths
+    int windowWidth = workWidth / bestCols;
+    int extraPixelsWidth = workWidth % bestCols;
+
+    std::vector<int> columnWidths(bestCols, windowWidth);
+    for (int col = 0; col < extraPixelsWidth; ++col)
+    {
+        columnWidths[col]++;
+    }
+
+    // Emit the cells row by row
+    cells.reserve(numWindows);
+    int yPos = static_cast<int>(workArea.top); // Start at the top of the work area
+    for (int row = 0; row < bestRows && static_cast<int>(cells.size()) < numWindows; ++row)
+    {
+        int xPos = startXPos;
+        for (int col = 0; col < bestCols && static_cast<int>(cells.size()) < numWindows; ++col)
+        {
+            cells.push_back(MakeLayoutRect<Rect>(xPos, yPos, xPos + columnWidths[col], yPos + rowHeights[row]));
+
+            // Move to the next column position
+            xPos += columnWidths[col];
+        }
+        // After arranging a row, move Y position down by row height + spacing
+        yPos += rowHeights[row] + params.minSpacingY;
+    }
+
+    // Hand out the grid geometry for linked resizing
+    if (grid)
+    {
+        grid->valid = true;
+        grid->rows = bestRows;
+        grid->columns = bestCols;
+        grid->columnWidths = columnWidths;
+        grid->rowHeights = rowHeights;
+        grid->columnX.resize(bestCols);
+        grid->rowY.resize(bestRows);
+        for (int col = 0, x = startXPos; col < bestCols; x += columnWidths[col], ++col)
+        {
+            grid->columnX[col] = x;
+        }
+        for (int row = 0, y = static_cast<int>(workArea.top); row < bestRows; y += rowHeights[row] + params.minSpacingY, ++row)
+        {
+            grid->rowY[row] = y;
+        }
+    }
+    return true;
+}
+
+// Function to compute the grid layout the way the original arrange did:
+// every row count is tried and the columns are filled cell by cell. It is
+// kept unoptimized as the reference the grid solver is compared with.
+template <typename Rect>
+bool ComputeReferenceGridLayout(const LayoutInputs<Rect>& params, int numWindows, std::vector<Rect>& cells)
+{
+    cells.clear();
+    if (numWindows <= 0)
+        return true;
+
+    int workWidth = static_cast<int>(params.workArea.right - params.workArea.left);
+    int workHeight = static_cast<int>(params.workArea.bottom - params.workArea.top);
+    int availableHeight = workHeight - params.pixelFixY - (numWindows - 1) * params.minSpacingY;
+    if (availableHeight <= 0)
+        return false;
+
+    double aspectRatio = static_cast<double>(workWidth) / availableHeight;
+    int bestRows = 1;
+    int bestCols = numWindows;
+    if (params.layoutMode == LAYOUT_ROWS)
+    {
+        bestRows = numWindows;
+        bestCols = 1;
+    }
+    else if (params.layoutMode == LAYOUT_GRID)
+    {
+        double minDifference = DBL_MAX;
+        for (int rows = 1; rows <= numWindows; ++rows)
+        {
+            int cols = (numWindows + rows - 1) / rows;
+            double difference = fabs(static_cast<double>(cols) / rows - aspectRatio);
+            if (difference < minDifference)
+            {
+                minDifference = difference;
+                bestRows = rows;
+                bestCols = cols;
+            }
+        }
+    }
+
+    availableHeight = workHeight - params.pixelFixY - (bestRows - 1) * params.minSpacingY;
+    for (int window = 0; window < numWindows; ++window)
+    {
+        int row = window / bestCols;
+        int col = window % bestCols;
+        int top = static_cast<int>(params.workArea.top) + row * (availableHeight / bestRows + params.minSpacingY) + (std::min)(row, availableHeight % bestRows);
+        int left = static_cast<int>(params.workArea.left) + params.pixelFixX + col * (workWidth / bestCols) + (std::min)(col, workWidth % bestCols);
+        cells.push_back(MakeLayoutRect<Rect>(left, top, left + workWidth / bestCols + (col < workWidth % bestCols ? 1 : 0),
+            top + availableHeight / bestRows + (row < availableHeight % bestRows ? 1 : 0)));
+    }
+    return true;
+}
+
+// Function to check that grid cells tile the work area exactly: rows run
+// left to right without gaps, every row but the last is full, every grid
+// column holds windows, the grid's rows are stacked with the requested
+// spacing down to the bottom (a short last row can leave whole grid rows
+// empty, but only below it), and leftover pixels are spread so sizes
+// differ by at most one. The cells, the spacing, the end of a short last
+// row and the empty rows must then add up to the whole work area.
+// Returns the first broken invariant, or NULL.
+template <typename Rect>
+const wchar_t* CheckGridLayoutInvariants(const LayoutInputs<Rect>& params, int numWindows, const std::vector<Rect>& cells, const GridGeometry& grid)
+{
+    if (static_cast<int>(cells.size()) != numWindows)
+        return L"wrong number of cells";
+    if (!grid.valid || grid.rows * grid.columns < numWindows)
+        return L"grid has fewer cells than windows";
+
+    int left = static_cast<int>(params.workArea.left) + params.pixelFixX;
+    int right = static_cast<int>(params.workArea.right) + params.pixelFixX;
+    int bottom = static_cast<int>(params.workArea.bottom) - params.pixelFixY;
+    int x = left;
+    int rowTop = static_cast<int>(params.workArea.top);
+    int rowBottom = rowTop;
+    int rowCells = 0;
+    int rowCount = 0;
+    int columns = 0;
+    long long coveredArea = 0;
+    int minWidth = INT_MAX, maxWidth = INT_MIN, minHeight = INT_MAX, maxHeight = INT_MIN;
+    for (int i = 0; i < numWindows; ++i)
+    {
+        const Rect& cell = cells[i];
+        if (cell.right <= cell.left)
+            return L"cell without width";
+        if (cell.bottom < cell.top)
+            return L"cell with negative height";
+
+        if (i == 0 || cell.left != x)
+        {
+            // A new row starts at the left edge, below the previous one
+            if (cell.left != left)
+                return L"cells overlap or leave a gap in a row";
+            if (i == 0 && cell.top != params.workArea.top)
+                return L"first row does not start at the top";
+            if (i > 0)
+            {
+                if (x != right)
+                    return L"row leaves pixels unused on the right";
+                if (columns == 0)
+                    columns = rowCells;
+                else if (rowCells != columns)
+                    return L"rows have different column counts";
+                if (cell.top != rowBottom + params.minSpacingY)
+                    return L"rows overlap or are not spaced as requested";
+            }
+            rowTop = static_cast<int>(cell.top);
+            rowBottom = static_cast<int>(cell.bottom);
+            rowCells = 0;
+            rowCount++;
+        }
+        else if (cell.top != rowTop || cell.bottom != rowBottom)
+        {
+            return L"cell not aligned with its row";
+        }
+
+        x = static_cast<int>(cell.right);
+        rowCells++;
+        coveredArea += static_cast<long long>(cell.right - cell.left) * (cell.bottom - cell.top);
+        minWidth = (std::min)(minWidth, static_cast<int>(cell.right - cell.left));
+        maxWidth = (std::max)(maxWidth, static_cast<int>(cell.right - cell.left));
+        minHeight = (std::min)(minHeight, static_cast<int>(cell.bottom - cell.top));
+        maxHeight = (std::max)(maxHeight, static_cast<int>(cell.bottom - cell.top));
+    }
+
+    if (columns == 0)
+        columns = rowCells;
+    if (rowCells > columns)
+        return L"last row has more cells than the others";
+    if (x > right)
+        return L"last row runs past the right edge";
+    if (columns != grid.columns)
+        return L"grid columns are left empty";
+    if (rowCount != (numWindows + columns - 1) / columns || rowCount > grid.rows)
+        return L"grid rows are left empty above the last window";
+    if (rowBottom > bottom)
+        return L"last row runs past the bottom";
+
+    int gridBottom = static_cast<int>(params.workArea.top) + (grid.rows - 1) * params.minSpacingY;
+    for (int height : grid.rowHeights)
+    {
+        gridBottom += height;
+        minHeight = (std::min)(minHeight, height);
+        maxHeight = (std::max)(maxHeight, height);
+    }
+    if (gridBottom != bottom)
+        return L"rows do not reach the bottom of the work area";
+
+    // Nothing overlaps, so the cells cover the area if the sizes add up
+    long long spacingArea = static_cast<long long>(rowCount - 1) * params.minSpacingY * (right - left);
+    long long lastRowGap = static_cast<long long>(right - x) * (rowBottom - rowTop);
+    long long emptyRowsArea = static_cast<long long>(bottom - rowBottom) * (right - left);
+    if (coveredArea + spacingArea + lastRowGap + emptyRowsArea != static_cast<long long>(right - left) * (bottom - params.workArea.top))
+        return L"cells do not cover the work area";
+    if (maxWidth - minWidth > 1 || maxHeight - minHeight > 1)
+        return L"leftover pixels are not spread evenly";
+    return NULL;
+}
+
+// Function to check cells that need not form one grid: none has a negative
+// size, lies outside the area or overlaps another. Returns the problem, or NULL.
+template <typename Rect>
+const wchar_t* CheckCellsInsideArea(const Rect& area, const Rect* cells, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        const Rect& cell = cells[i];
+        if (cell.right < cell.left || cell.bottom < cell.top)
+            return L"cell with a negative size";
+        if (cell.left < area.left || cell.top < area.top || cell.right > area.right || cell.bottom > area.bottom)
+            return L"cell outside its area";
+        for (int j = 0; j < i; ++j)
+        {
+            if (LayoutRectsOverlap(cell, cells[j]))
+                return L"cells overlap";
+        }
+    }
+    return NULL;
+}
+
+// Function to get the window count a group's region is sized for. A new
+// capacity leaves slack both ways, and it is kept while the count stays
+// within that slack, so windows coming and going in one group do not
+// resize the regions of the others. Shares of the area are off by at most
+// the slack, an eighth of the count plus one window.
+inline int GetGroupCapacity(int count, int previous)
+{
+    int slack = count / 8 + 1;
+    if (previous >= count && previous <= count + 2 * slack)
+        return previous;
+    return count + slack;
+}
+
+// Function to lay out windows in two levels: the groups share the work
+// area in strips sized by their capacities (see GetGroupCapacity), and
+// each group is tiled as a grid inside its region. windowKeys holds the
+// group key of every window, in list order; keys are small non-negative
+// ids. groups is the region cache: groups keep their order and capacity
+// from the previous solve, and groups whose region and count are unchanged
+// keep their cells, so a window moving between two groups re-solves those
+// two unless a capacity leaves its slack. regionsSolved, if given, is set
+// to the number of regions that were tiled afresh.
+template <typename Rect>
+bool ComputeGroupedLayout(const LayoutInputs<Rect>& params, const std::vector<int>& windowKeys, std::vector<LayoutGroupRegion<Rect>>& groups,
+    std::vector<Rect>& cells, int* regionsSolved = nullptr)
+{
+    cells.clear();
+    if (regionsSolved)
+        *regionsSolved = 0;
+    int numWindows = static_cast<int>(windowKeys.size());
+    if (numWindows == 0)
+        return true;
+
+    // Group the windows in order of first appearance, keeping list order inside groups
+    std::vector<int> groupOf; // Group of each key, -1 = none yet
+    std::vector<int> keys;
+    std::vector<int> counts;
+    std::vector<int> windowGroup(numWindows);
+    std::vector<int> windowSlot(numWindows);
+    for (int i = 0; i < numWindows; ++i)
+    {
+        int key = windowKeys[i];
+        if (key >= static_cast<int>(groupOf.size()))
+            groupOf.resize(key + 1, -1);
+        int group = groupOf[key];
+        if (group < 0)
+        {
+            group = static_cast<int>(keys.size());
+            groupOf[key] = group;
+            keys.push_back(key);
+            counts.push_back(0);
+        }
+        windowGroup[i] = group;
+        windowSlot[i] = counts[group]++;
+    }
+
+    // Groups seen before keep their order, new ones follow in order of appearance
+    int numGroups = static_cast<int>(keys.size());
+    std::unordered_map<int, size_t> cached;
+    for (size_t i = 0; i < groups.size(); ++i)
+    {
+        cached.emplace(groups[i].key, i);
+    }
+    std::vector<size_t> rank(numGroups);
+    for (int group = 0; group < numGroups; ++group)
+    {
+        auto it = cached.find(keys[group]);
+        rank[group] = (it != cached.end()) ? it->second : groups.size() + group;
+    }
+    std::vector<int> order(numGroups);
+    for (int group = 0; group < numGroups; ++group)
+    {
+        order[group] = group;
+    }
+    std::sort(order.begin(), order.end(), [&rank](int a, int b) { return rank[a] < rank[b]; });
+
+    std::vector<int> position(numGroups);
+    std::vector<int> orderedKeys(numGroups);
+    std::vector<int> orderedCounts(numGroups);
+    std::vector<int> capacities(numGroups);
+    int totalCapacity = 0;
+    for (int i = 0; i < numGroups; ++i)
+    {
+        int group = order[i];
+        position[group] = i;
+        orderedKeys[i] = keys[group];
+        orderedCounts[i] = counts[group];
+        auto it = cached.find(keys[group]);
+        capacities[i] = GetGroupCapacity(counts[group], (it != cached.end()) ? groups[it->second].capacity : 0);
+        totalCapacity += capacities[i];
+    }
+    keys.swap(orderedKeys);
+    counts.swap(orderedCounts);
+    for (int i = 0; i < numWindows; ++i)
+    {
+        windowGroup[i] = position[windowGroup[i]];
+    }
+
+    // The area left after the pixel fixes
+    Rect area = GetFixedWorkArea(params);
+    int areaWidth = static_cast<int>(area.right - area.left);
+    int areaHeight = static_cast<int>(area.bottom - area.top);
+    if (areaWidth <= 0 || areaHeight <= 0)
+        return false;
+
+    // Strips of groups; a strip's height and a group's width follow capacities
+    int strips = FindBestRowCount(numGroups, static_cast<double>(areaWidth) / areaHeight);
+    int groupsPerStrip = (numGroups + strips - 1) / strips;
+    strips = (numGroups + groupsPerStrip - 1) / groupsPerStrip;
+
+    std::vector<Rect> regions(numGroups);
+    int capacityBefore = 0;
+    for (int strip = 0; strip < strips; ++strip)
+    {
+        int first = strip * groupsPerStrip;
+        int last = (std::min)(numGroups, first + groupsPerStrip);
+        int stripCapacity = 0;
+        for (int group = first; group < last; ++group)
+        {
+            stripCapacity += capacities[group];
+        }
+
+        // Edges come from running totals so the strips tile the area exactly
+        int top = static_cast<int>(area.top) + static_cast<int>(static_cast<long long>(areaHeight) * capacityBefore / totalCapacity);
+        int bottom = static_cast<int>(area.top) + static_cast<int>(static_cast<long long>(areaHeight) * (capacityBefore + stripCapacity) / totalCapacity);
+        int capacityLeft = 0;
+        for (int group = first; group < last; ++group)
+        {
+            int left = static_cast<int>(area.left) + static_cast<int>(static_cast<long long>(areaWidth) * capacityLeft / stripCapacity);
+            capacityLeft += capacities[group];
+            int right = static_cast<int>(area.left) + static_cast<int>(static_cast<long long>(areaWidth) * capacityLeft / stripCapacity);
+            regions[group] = MakeLayoutRect<Rect>(left, top, right, bottom);
+        }
+        capacityBefore += stripCapacity;
+    }
+
+    // Re-solve only the groups whose region, size or spacing changed
+    std::vector<LayoutGroupRegion<Rect>> solved(numGroups);
+    for (int group = 0; group < numGroups; ++group)
+    {
+        LayoutGroupRegion<Rect>& current = solved[group];
+        auto it = cached.find(keys[group]);
+        if (it != cached.end())
+        {
+            LayoutGroupRegion<Rect>& previous = groups[it->second];
+            if (previous.solved && previous.count == counts[group] && previous.spacing == params.minSpacingY &&
+                LayoutRectsEqual(previous.region, regions[group]))
+            {
+                current = std::move(previous);
+                current.capacity = capacities[group];
+                continue;
+            }
+        }
+
+        current.key = keys[group];
+        current.count = counts[group];
+        current.capacity = capacities[group];
+        current.region = regions[group];
+        current.spacing = params.minSpacingY;
+
+        LayoutInputs<Rect> groupParams = params;
+        groupParams.workArea = regions[group];
+        groupParams.pixelFixX = 0;
+        groupParams.pixelFixY = 0;
+        groupParams.layoutMode = LAYOUT_GRID;
+        groupParams.allMonitors = false;
+        if (!ComputeGridLayout(groupParams, current.count, current.cells))
+        {
+            // A short region cannot take the spacing; tile it without
+            groupParams.minSpacingY = 0;
+            if (!ComputeGridLayout(groupParams, current.count, current.cells))
+                return false;
+        }
+        current.solved = true;
+        if (regionsSolved)
+            ++*regionsSolved;
+    }
+    groups.swap(solved);
+
+    cells.resize(numWindows);
+    for (int i = 0; i < numWindows; ++i)
+    {
+        cells[i] = groups[windowGroup[i]].cells[windowSlot[i]];
+    }
+    return true;
+}
+
+// Function to split the window count over the monitors. Each monitor's
+// share is proportional to its work area in logical pixels (physical area
+// scaled down by its DPI), so a high-DPI panel is not handed more windows
+// than it can show legibly. Remainders go to the largest fractions
+// (largest remainder method), ties to the lower index.
+template <typename Rect>
+void SplitWindowsAcrossMonitors(const std::vector<LayoutMonitor<Rect>>& monitors, int numWindows, std::vector<int>& counts)
+{
+    counts.assign(monitors.size(), 0);
+    if (monitors.empty() || numWindows <= 0)
+        return;
+
+    std::vector<double> weights;
+    double totalWeight = 0.0;
+    for (const LayoutMonitor<Rect>& monitor : monitors)
+    {
+        const Rect& work = monitor.workArea;
+        double scale = (monitor.dpi > 0) ? 96.0 / monitor.dpi : 1.0;
+        double weight = (std::max)(0.0, static_cast<double>(work.right - work.left)) * scale *
+            (std::max)(0.0, static_cast<double>(work.bottom - work.top)) * scale;
+        weights.push_back(weight);
+        totalWeight += weight;
+    }
+    if (totalWeight <= 0.0)
+    {
+        counts[0] = numWindows;
+        return;
+    }
+
+    std::vector<double> remainders(weights.size());
+    int assigned = 0;
+    for (size_t i = 0; i < weights.size(); ++i)
+    {
+        double share = numWindows * weights[i] / totalWeight;
+        counts[i] = static_cast<int>(share);
+        remainders[i] = share - counts[i];
+        assigned += counts[i];
+    }
+    while (assigned < numWindows)
+    {
+        size_t best = 0;
+        for (size_t i = 1; i < remainders.size(); ++i)
+        {
+            if (remainders[i] > remainders[best])
+                best = i;
+        }
+        counts[best]++;
+        remainders[best] = -1.0;
+        assigned++;
+    }
+}
+
+// Function to lay out the windows over all monitors. The list is cut into
+// consecutive slices in monitor order, so list order is kept, and each
+// monitor's grid is solved in turn; a solve takes microseconds, far less
+// than starting a thread would. Grouped and custom layouts span one
+// monitor, so every monitor is tiled as a grid here.
+template <typename Rect>
+bool ComputeMultiMonitorLayout(const LayoutInputs<Rect>& params, const std::vector<LayoutMonitor<Rect>>& monitors, int numWindows, std::vector<Rect>& cells)
+{
+    cells.clear();
+    std::vector<int> counts;
+    SplitWindowsAcrossMonitors(monitors, numWindows, counts);
+
+    cells.reserve(numWindows);
+    std::vector<Rect> monitorCells;
+    for (size_t i = 0; i < monitors.size(); ++i)
+    {
+        LayoutInputs<Rect> monitor = params;
+        monitor.workArea = monitors[i].workArea;
+        monitor.allMonitors = false;
+        if (monitor.layoutMode == LAYOUT_GROUPED || monitor.layoutMode == LAYOUT_CUSTOM)
+            monitor.layoutMode = LAYOUT_GRID;
+        if (!ComputeGridLayout(monitor, counts[i], monitorCells))
+            return false;
+        cells.insert(cells.end(), monitorCells.begin(), monitorCells.end());
+    }
+    return true;
+}
+
+// Function to get the cell of a grid position
+template <typename Rect>
+Rect GetGridCell(const GridGeometry& grid, int row, int column)
+{
+    return MakeLayoutRect<Rect>(grid.columnX[column], grid.rowY[row],
+        grid.columnX[column] + grid.columnWidths[column], grid.rowY[row] + grid.rowHeights[row]);
+}
+
+// Function to shift the boundary between two adjacent columns or rows,
+// keeping both at least MIN_LINKED_CELL_SIZE pixels
+inline void MoveGridBoundary(std::vector<int>& positions, std::vector<int>& sizes, int before, int delta)
+{
+    int after = before + 1;
+    if (delta > sizes[after] - MIN_LINKED_CELL_SIZE)
+        delta = sizes[after] - MIN_LINKED_CELL_SIZE;
+    if (delta < MIN_LINKED_CELL_SIZE - sizes[before])
+        delta = MIN_LINKED_CELL_SIZE - sizes[before];
+    sizes[before] += delta;
+    sizes[after] -= delta;
+    positions[after] += delta;
+}
+
+// Function to list the grid positions whose cells can change while the
+// cell at row, column is resized: only the columns and rows next to its
+// edges. The list depends on the dragged cell alone, so a drag lists it once.
+inline void GetLinkedReflowPositions(const GridGeometry& grid, int row, int column, std::vector<int>& positions)
+{
+    positions.clear();
+    for (int c = (std::max)(0, column - 1); c <= (std::min)(grid.columns - 1, column + 1); ++c)
+    {
+        for (int r = 0; r < grid.rows; ++r)
+            positions.push_back(r * grid.columns + c);
+    }
+    for (int r = (std::max)(0, row - 1); r <= (std::min)(grid.rows - 1, row + 1); ++r)
+    {
+        for (int c = 0; c < grid.columns; ++c)
+        {
+            if (c < column - 1 || c > column + 1)
+                positions.push_back(r * grid.columns + c);
+        }
+    }
+}
+
+// Function to reflow a grid in place for the dragged cell's rectangle.
+// Only the boundaries next to the dragged cell move, so only the entries
+// of the boundary arrays around it are reset from the grid at drag start,
+// which keeps rounding from accumulating, and moved again: the work is
+// the same for any grid size. grid must have the shape of start. A cell
+// dragged back to where it started gets the grid at drag start back.
+// Returns false for a plain move, which leaves the grid as it is.
+template <typename Rect>
+bool ReflowLinkedGrid(const GridGeometry& start, GridGeometry& grid, int row, int column, const Rect& startRect, const Rect& rect)
+{
+    int deltaLeft = rect.left - startRect.left;
+    int deltaRight = rect.right - startRect.right;
+    int deltaTop = rect.top - startRect.top;
+    int deltaBottom = rect.bottom - startRect.bottom;
+    if (deltaLeft == deltaRight && deltaTop == deltaBottom && (deltaLeft != 0 || deltaTop != 0))
+        return false;
+
+    for (int c = (std::max)(0, column - 1); c <= (std::min)(grid.columns - 1, column + 1); ++c)
+    {
+        grid.columnX[c] = start.columnX[c];
+        grid.columnWidths[c] = start.columnWidths[c];
+    }
+    for (int r = (std::max)(0, row - 1); r <= (std::min)(grid.rows - 1, row + 1); ++r)
+    {
+        grid.rowY[r] = start.rowY[r];
+        grid.rowHeights[r] = start.rowHeights[r];
+    }
+
+    if (deltaLeft != 0 && column > 0)
+        MoveGridBoundary(grid.columnX, grid.columnWidths, column - 1, deltaLeft);
+    if (deltaRight != 0 && column < grid.columns - 1)
+        MoveGridBoundary(grid.columnX, grid.columnWidths, column, deltaRight);
+    if (deltaTop != 0 && row > 0)
+        MoveGridBoundary(grid.rowY, grid.rowHeights, row - 1, deltaTop);
+    if (deltaBottom != 0 && row < grid.rows - 1)
+        MoveGridBoundary(grid.rowY, grid.rowHeights, row, deltaBottom);
+    return true;
+}
+
+// Function to count the display frames a committed reflow missed. Frames
+// are counted from a common start; the first change a reflow shows is
+// due by the end of the frame after the one it happened in, and every
+// frame the reflow lands later is shown with the old layout.
+inline int CountMissedFrames(double changeMs, double commitMs, double framePeriodMs)
+{
+    if (framePeriodMs <= 0.0)
+        return 0;
+    long long late = static_cast<long long>(commitMs / framePeriodMs) - static_cast<long long>(changeMs / framePeriodMs) - 1;
+    return late > 0 ? static_cast<int>(late) : 0;
+}
+
+// Helpers for the layout parser, which reads from pos
+inline void SkipLayoutSpace(const wchar_t*& pos)
+{
+    while (*pos && iswspace(*pos))
+        ++pos;
+}
+
+inline bool ParseLayoutChar(const wchar_t*& pos, wchar_t ch)
+{
+    SkipLayoutSpace(pos);
+    if (*pos != ch)
+        return false;
+    ++pos;
+    return true;
+}
+
+inline bool ParseLayoutNumber(const wchar_t*& pos, int minimum, int maximum, int& number)
+{
+    SkipLayoutSpace(pos);
+    if (!iswdigit(*pos))
+        return false;
+    number = 0;
+    while (iswdigit(*pos) && number <= maximum)
+    {
+        number = number * 10 + (*pos - L'0');
+        ++pos;
+    }
+    return number >= minimum && number <= maximum && !iswdigit(*pos);
+}
+
+inline std::wstring ParseLayoutWord(const wchar_t*& pos)
+{
+    SkipLayoutSpace(pos);
+    std::wstring word;
+    while (iswalpha(*pos))
+    {
+        word += static_cast<wchar_t>(towlower(*pos));
+        ++pos;
+    }
+    return word;
+}
+
+// Function to compile the binding of a region, after "for":
+//   process=NAME  windows of the executable NAME
+//   class=NAME    windows of the window class NAME
+//   rule=N        windows taken by the Nth capture rule
+inline bool ParseLayoutBinding(const wchar_t*& pos, LayoutBinding& binding)
+{
+    std::wstring kind = ParseLayoutWord(pos);
+    if (!ParseLayoutChar(pos, L'='))
+        return false;
+
+    if (kind == L"rule")
+    {
+        int rule;
+        if (!ParseLayoutNumber(pos, 1, MAX_LAYOUT_RULES, rule))
+            return false;
+        binding.kind = LAYOUT_BIND_RULE;
+        binding.rule = rule - 1;
+        return true;
+    }
+    if (kind != L"process" && kind != L"class")
+        return false;
+
+    SkipLayoutSpace(pos);
+    std::wstring value;
+    while (*pos && !iswspace(*pos) && *pos != L',' && *pos != L')')
+    {
+        value += static_cast<wchar_t>(towlower(*pos));
+        ++pos;
+    }
+    if (value.empty())
+        return false;
+    binding.kind = (kind == L"process") ? LAYOUT_BIND_PROCESS : LAYOUT_BIND_CLASS;
+    binding.value = value;
+    return true;
+}
+
+// Function to compile one layout node and its children, in preorder:
+//   slot                 one window
+//   grid(rows, columns)  up to rows * columns windows, filled row by row
+//   auto                 the windows left over, in a best-fitting grid
+//   columns([w:w:...,] node, node, ...)  side by side, sized by the weights
+//   rows([w:w:...,] node, node, ...)     top to bottom, sized by the weights
+// A slot or grid may be followed by "for" and a binding, e.g.
+// "slot for process=devenv.exe", to hold only the windows it matches.
+inline bool ParseLayoutNode(const wchar_t*& pos, LayoutProgram& program, int weight)
+{
+    if (program.codeLength >= MAX_LAYOUT_INSTRUCTIONS)
+        return false;
+
+    int index = program.codeLength++;
+    LayoutInstruction& instruction = program.code[index];
+    instruction = LayoutInstruction();
+    instruction.weight = static_cast<unsigned short>(weight);
+    instruction.firstRegion = static_cast<unsigned short>(program.regionCount);
+
+    std::wstring word = ParseLayoutWord(pos);
+    if (word == L"slot" || word == L"auto" || word == L"grid")
+    {
+        if (program.regionCount >= MAX_LAYOUT_REGIONS)
+            return false;
+
+        int capacity = 1;
+        if (word == L"grid")
+        {
+            int rows, columns;
+            if (!ParseLayoutChar(pos, L'(') || !ParseLayoutNumber(pos, 1, MAX_LAYOUT_GRID, rows) ||
+                !ParseLayoutChar(pos, L',') || !ParseLayoutNumber(pos, 1, MAX_LAYOUT_GRID, columns) ||
+                !ParseLayoutChar(pos, L')'))
+                return false;
+            instruction.rows = static_cast<unsigned short>(rows);
+            instruction.columns = static_cast<unsigned short>(columns);
+            capacity = rows * columns;
+        }
+        else if (word == L"auto")
+        {
+            // Only one region can take the windows left over
+            if (program.overflowRegion >= 0)
+                return false;
+            program.overflowRegion = program.regionCount;
+            capacity = 0;
+        }
+
+        LayoutBinding& binding = program.binding[program.regionCount];
+        binding = LayoutBinding();
+        const wchar_t* mark = pos;
+        if (ParseLayoutWord(pos) == L"for")
+        {
+            // The windows left over cannot be bound
+            if (word == L"auto" || !ParseLayoutBinding(pos, binding))
+                return false;
+            program.boundRegions++;
+        }
+        else
+        {
+            pos = mark;
+        }
+
+        instruction.op = LAYOUT_OP_REGION;
+        program.regionCapacity[program.regionCount++] = capacity;
+    }
+    else if (word == L"columns" || word == L"rows")
+    {
+        instruction.op = (word == L"columns") ? LAYOUT_OP_COLUMNS : LAYOUT_OP_ROWS;
+        if (!ParseLayoutChar(pos, L'('))
+            return false;
+
+        // Optional weights, one per child
+        int weights[MAX_LAYOUT_SPLIT_CHILDREN];
+        int weightCount = 0;
+        SkipLayoutSpace(pos);
+        if (iswdigit(*pos))
+        {
+            do
+            {
+                if (weightCount >= MAX_LAYOUT_SPLIT_CHILDREN ||
+                    !ParseLayoutNumber(pos, 1, MAX_LAYOUT_WEIGHT, weights[weightCount]))
+                    return false;
+                weightCount++;
+            } while (ParseLayoutChar(pos, L':'));
+            if (!ParseLayoutChar(pos, L','))
+                return false;
+        }
+
+        int childCount = 0;
+        do
+        {
+            if (childCount >= MAX_LAYOUT_SPLIT_CHILDREN)
+                return false;
+            int childWeight = (weightCount > 0 && childCount < weightCount) ? weights[childCount] : 1;
+            if (!ParseLayoutNode(pos, program, childWeight))
+                return false;
+            childCount++;
+        } while (ParseLayoutChar(pos, L','));
+
+        if (!ParseLayoutChar(pos, L')') || (weightCount > 0 && weightCount != childCount))
+            return false;
+        instruction.childCount = static_cast<unsigned char>(childCount);
+    }
+    else
+    {
+        return false;
+    }
+
+    instruction.next = static_cast<unsigned short>(program.codeLength);
+    instruction.endRegion = static_cast<unsigned short>(program.regionCount);
+    return true;
+}
+
+// Function to compile a line of the layouts file: "name = layout [gap=N]"
+inline bool ParseLayoutLine(const std::wstring& line, LayoutProgram& program)
+{
+    program = LayoutProgram();
+    program.source = line;
+    size_t equals = line.find(L'=');
+    if (equals == std::wstring::npos)
+        return false;
+
+    // The name is what precedes the '=', without surrounding whitespace
+    size_t first = line.find_first_not_of(L" \t\r\n");
+    if (first >= equals)
+        return false;
+    size_t last = line.find_last_not_of(L" \t\r\n", equals - 1);
+    program.name = line.substr(first, last - first + 1);
+
+    const wchar_t* pos = line.c_str() + equals + 1;
+    if (!ParseLayoutNode(pos, program, 1))
+        return false;
+
+    // Options after the layout
+    SkipLayoutSpace(pos);
+    while (*pos)
+    {
+        if (ParseLayoutWord(pos) != L"gap" || !ParseLayoutChar(pos, L'=') ||
+            !ParseLayoutNumber(pos, 0, MAX_LAYOUT_GAP, program.gap))
+            return false;
+        SkipLayoutSpace(pos);
+    }
+
+    // Without an "auto" region the rest go to the last unbound one
+    for (int region = program.regionCount - 1; region >= 0 && program.overflowRegion < 0; --region)
+    {
+        if (program.binding[region].kind == LAYOUT_BIND_NONE)
+            program.overflowRegion = region;
+    }
+    return program.overflowRegion >= 0;
+}
+
+// Function to tile count windows into a region of a layout: a fixed grid
+// fills row by row while the windows fit, otherwise the best-fitting grid
+template <typename Rect>
+bool TileLayoutRegion(const Rect& region, int count, const LayoutInstruction& instruction, int gap, Rect* cells)
+{
+    int width = static_cast<int>(region.right - region.left);
+    int height = static_cast<int>(region.bottom - region.top);
+    if (width <= 0 || height <= 0)
+        return false;
+
+    int rows, columns;
+    if (instruction.columns > 0 && count <= instruction.rows * instruction.columns)
+    {
+        columns = instruction.columns;
+        rows = (count + columns - 1) / columns;
+    }
+    else
+    {
+        rows = FindBestRowCount(count, static_cast<double>(width) / height);
+        columns = (count + rows - 1) / rows;
+    }
+
+    // Edges are computed from the start, so rounding never adds up to a gap
+    int cellsWidth = width - gap * (columns - 1);
+    int cellsHeight = height - gap * (rows - 1);
+    if (cellsWidth < columns || cellsHeight < rows)
+        return false;
+
+    int regionLeft = static_cast<int>(region.left);
+    int regionTop = static_cast<int>(region.top);
+    int i = 0;
+    for (int row = 0; row < rows; ++row)
+    {
+        int top = regionTop + cellsHeight * row / rows + gap * row;
+        int bottom = regionTop + cellsHeight * (row + 1) / rows + gap * row;
+        int left = regionLeft;
+        for (int column = 0; column < columns && i < count; ++column, ++i)
+        {
+            int right = regionLeft + cellsWidth * (column + 1) / columns + gap * column;
+            cells[i] = MakeLayoutRect<Rect>(left, top, right, bottom);
+            left = right + gap;
+        }
+    }
+    return true;
+}
+
+// Function to compute the cells of a compiled layout for a work area and the
+// window count of each region. The cells come out region after region.
+// Runs on fixed-size stack arrays only; cells must hold as many entries as
+// there are windows. Returns false if a region has no room left.
+template <typename Rect>
+bool EvaluateLayoutRegions(const LayoutProgram& program, const Rect& area, const int* counts, Rect* cells)
+{
+    // The index of each region's first cell
+    int firstCell[MAX_LAYOUT_REGIONS + 1];
+    firstCell[0] = 0;
+    for (int region = 0; region < program.regionCount; ++region)
+    {
+        firstCell[region + 1] = firstCell[region] + counts[region];
+    }
+
+    // Each instruction is visited at most once, so the stack cannot overflow
+    struct PendingNode
+    {
+        int instruction;
+        Rect rect;
+    };
+    PendingNode pending[MAX_LAYOUT_INSTRUCTIONS];
+    int top = 0;
+    pending[top].instruction = 0;
+    pending[top++].rect = area;
+
+    while (top > 0)
+    {
+        PendingNode node = pending[--top];
+        const LayoutInstruction& instruction = program.code[node.instruction];
+        int first = firstCell[instruction.firstRegion];
+        int count = firstCell[instruction.endRegion] - first;
+        if (count == 0)
+            continue;
+
+        if (instruction.op == LAYOUT_OP_REGION)
+        {
+            if (!TileLayoutRegion(node.rect, count, instruction, program.gap, cells + first))
+                return false;
+            continue;
+        }
+
+        // Only children with windows share the space
+        int children[MAX_LAYOUT_SPLIT_CHILDREN];
+        int used = 0;
+        int totalWeight = 0;
+        for (int k = 0, child = node.instruction + 1; k < instruction.childCount; ++k, child = program.code[child].next)
+        {
+            const LayoutInstruction& childInstruction = program.code[child];
+            if (firstCell[childInstruction.endRegion] > firstCell[childInstruction.firstRegion])
+            {
+                children[used++] = child;
+                totalWeight += childInstruction.weight;
+            }
+        }
+
+        bool sideBySide = (instruction.op == LAYOUT_OP_COLUMNS);
+        int start = static_cast<int>(sideBySide ? node.rect.left : node.rect.top);
+        int length = static_cast<int>(sideBySide ? node.rect.right - node.rect.left : node.rect.bottom - node.rect.top) - program.gap * (used - 1);
+        if (length < used)
+            return false;
+
+        int weightBefore = 0;
+        for (int k = 0; k < used; ++k)
+        {
+            int weight = program.code[children[k]].weight;
+            Rect rect = node.rect;
+            int from = start + static_cast<int>(static_cast<long long>(length) * weightBefore / totalWeight) + program.gap * k;
+            weightBefore += weight;
+            int to = start + static_cast<int>(static_cast<long long>(length) * weightBefore / totalWeight) + program.gap * k;
+            if (sideBySide)
+            {
+                rect.left = from;
+                rect.right = to;
+            }
+            else
+            {
+                rect.top = from;
+                rect.bottom = to;
+            }
+            pending[top].instruction = children[k];
+            pending[top++].rect = rect;
+        }
+    }
+    return true;
+}
+
+// Function to compute the cells of a compiled layout for a work area and a
+// window count, with the windows filling the regions in order. Bindings
+// are not looked at. Cells must hold numWindows entries.
+template <typename Rect>
+bool EvaluateLayoutProgram(const LayoutProgram& program, const Rect& area, int numWindows, Rect* cells)
+{
+    if (numWindows <= 0 || program.codeLength == 0)
+        return numWindows <= 0;
+
+    int counts[MAX_LAYOUT_REGIONS];
+    int remaining = numWindows;
+    for (int region = 0; region < program.regionCount; ++region)
+    {
+        counts[region] = (std::min)(program.regionCapacity[region], remaining);
+        remaining -= counts[region];
+    }
+    counts[program.overflowRegion] += remaining;
+    return EvaluateLayoutRegions(program, area, counts, cells);
+}
+
+// Function to check a window's names against the binding of a region
+inline bool MatchLayoutBinding(const LayoutBinding& binding, const LayoutWindowNames& names)
+{
+    switch (binding.kind)
+    {
+    case LAYOUT_BIND_PROCESS:
+        return names.process == binding.value;
+    case LAYOUT_BIND_CLASS:
+        return names.className == binding.value;
+    case LAYOUT_BIND_RULE:
+        return names.rule == binding.rule;
+    default:
+        return false;
+    }
+}
+
+// Function to pick the region of every window of a layout with bindings:
+// bound windows first, to the first matching region with room, then the
+// others to the unbound regions in order, the rest to the overflow region.
+// getNames(window, bindsKind, names) fills in the names of window number
+// window that some binding kind tests (bindsKind[LAYOUT_BIND_*]); it is
+// called once per window, not once per bound region. windowRegion gets one
+// region per window and counts the windows per region.
+template <typename GetNames>
+void AssignLayoutRegions(const LayoutProgram& program, int numWindows, GetNames getNames, std::vector<int>& windowRegion, int* counts)
+{
+    windowRegion.assign(numWindows, -1);
+    bool bindsKind[LAYOUT_BIND_RULE + 1] = {};
+    for (int region = 0; region < program.regionCount; ++region)
+    {
+        counts[region] = 0;
+        bindsKind[program.binding[region].kind] = true;
+    }
+
+    LayoutWindowNames names;
+    for (int i = 0; i < numWindows; ++i)
+    {
+        getNames(i, bindsKind, names);
+        for (int region = 0; region < program.regionCount; ++region)
+        {
+            const LayoutBinding& binding = program.binding[region];
+            if (binding.kind == LAYOUT_BIND_NONE || counts[region] >= program.regionCapacity[region])
+                continue;
+            if (MatchLayoutBinding(binding, names))
+            {
+                windowRegion[i] = region;
+                counts[region]++;
+                break;
+            }
+        }
+    }
+
+    int region = 0;
+    for (int i = 0; i < numWindows; ++i)
+    {
+        if (windowRegion[i] >= 0)
+            continue;
+        while (region < program.regionCount &&
+            (program.binding[region].kind != LAYOUT_BIND_NONE || counts[region] >= program.regionCapacity[region]))
+            region++;
+        int target = (region < program.regionCount) ? region : program.overflowRegion;
+        windowRegion[i] = target;
+        counts[target]++;
+    }
+}
+
+// Function to compute the cells of a compiled layout for numWindows
+// windows, in list order, with the pixel fixes of the built-in layouts.
+// Bound regions take the windows their bindings match, as named by
+// getNames (see AssignLayoutRegions).
+template <typename Rect, typename GetNames>
+bool ComputeProgramLayout(const LayoutInputs<Rect>& params, const LayoutProgram& program, int numWindows, GetNames getNames, std::vector<Rect>& cells)
+{
+    Rect area = GetFixedWorkArea(params);
+    cells.resize(numWindows);
+
+    // Without bindings the windows fill the regions in order
+    if (program.boundRegions == 0)
+    {
+        if (!EvaluateLayoutProgram(program, area, numWindows, cells.data()))
+        {
+            cells.clear();
+            return false;
+        }
+        return true;
+    }
+
+    std::vector<int> windowRegion;
+    int counts[MAX_LAYOUT_REGIONS];
+    AssignLayoutRegions(program, numWindows, getNames, windowRegion, counts);
+    std::vector<Rect> regionCells(numWindows);
+    if (!EvaluateLayoutRegions(program, area, counts, regionCells.data()))
+    {
+        cells.clear();
+        return false;
+    }
+
+    // Back from region order to list order
+    int next[MAX_LAYOUT_REGIONS];
+    next[0] = 0;
+    for (int region = 1; region < program.regionCount; ++region)
+    {
+        next[region] = next[region - 1] + counts[region - 1];
+    }
+    for (int i = 0; i < numWindows; ++i)
+    {
+        cells[i] = regionCells[next[windowRegion[i]]++];
+    }
+    return true;
+}
@@ -0,0 +1,97 @@
+// Layout state published in shared memory for status bars and overlays, and
+// the sequence lock that guards it. Kept free of Windows headers so readers
+// on other platforms (and the tests) use the same layout and protocol.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#define LAYOUT_STATE_MAGIC 0x4C544D57   // "WMTL"
+#define LAYOUT_STATE_VERSION 1
+#define MAX_PUBLISHED_WINDOWS 1024
+#define PUBLISHED_TITLE_CHARS 128
+#define PUBLISHED_WINDOW_HAS_CELL 1     // The window has a cell in the applied layout
+
+// Titles are UTF-16 everywhere; wchar_t is only 16 bits wide on Windows
+#ifdef _WIN32
+typedef wchar_t PublishedChar;
+#else
+typedef char16_t PublishedChar;
+#endif
+
+// One captured window in the published layout state. Fixed-width fields
+// only, so readers in any language and bitness see the same layout.
+struct PublishedWindow
+{
+    uint64_t hWnd;
+    uint32_t flags;                     // PUBLISHED_WINDOW_*
+    int32_t cellLeft;                   // Cell in screen coordinates
+    int32_t cellTop;
+    int32_t cellRight;
+    int32_t cellBottom;
+    PublishedChar title[PUBLISHED_TITLE_CHARS]; // Truncated, always terminated
+};
+
+// Captured windows and their cells, in list order, in a named shared-memory
+// block that local readers map with FILE_MAP_READ. The writer is the only
+// one allowed to write and guards each update with a sequence lock:
+// sequence is odd while an update is in progress. A reader copies what it
+// needs between two loads of sequence and keeps the copy only if both loads
+// are equal and even, so it never blocks the writer and needs no call into
+// the writing process.
+struct PublishedLayoutState
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                      // sizeof(PublishedLayoutState)
+    uint32_t maxWindows;
+    std::atomic<uint64_t> sequence;
+    uint64_t registryVersion;           // Version of the window registry shown
+    int32_t layoutMode;                 // LAYOUT_*
+    int32_t customLayout;               // Index in the layouts file, with LAYOUT_CUSTOM
+    int32_t isCapturing;
+    uint32_t windowCount;               // May be below the captured count if over the limit
+    PublishedWindow windows[MAX_PUBLISHED_WINDOWS];
+};
+
+// Readers built by other compilers rely on these offsets
+static_assert(sizeof(std::atomic<uint64_t>) == 8, "sequence must be a plain 64-bit word");
+static_assert(sizeof(PublishedWindow) == 288, "PublishedWindow layout changed");
+static_assert(offsetof(PublishedLayoutState, windows) == 48, "PublishedLayoutState layout changed");
+
+// Function to start an update: readers that load sequence from here on
+// retry until EndLayoutStateUpdate. Returns the value to end with.
+inline uint64_t BeginLayoutStateUpdate(PublishedLayoutState& state)
+{
+    uint64_t sequence = state.sequence.load(std::memory_order_relaxed);
+    state.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return sequence;
+}
+
+// Function to finish an update, publishing everything written since the begin
+inline void EndLayoutStateUpdate(PublishedLayoutState& state, uint64_t sequence)
+{
+    state.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+// Function to take a consistent copy of the state: copy(state) is run
+// between two loads of sequence and its result kept only if no update
+// overlapped it. Gives up after maxAttempts tries while the writer is busy.
+// Returns false if no consistent copy was taken.
+template <typename Copy>
+bool ReadLayoutState(const PublishedLayoutState& state, Copy copy, int maxAttempts)
+{
+    for (int attempt = 0; attempt < maxAttempts; ++attempt)
+    {
+        uint64_t before = state.sequence.load(std::memory_order_acquire);
+        if (before & 1)
+            continue;
+        copy(state);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (state.sequence.load(std::memory_order_relaxed) == before)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,242 @@
+// Grid index of window rectangles for hit-testing and lasso queries. Kept
+// free of Windows headers so the tests can run the same code on other
+// platforms: the window handle and rectangle types are template
+// parameters, and a rectangle only needs left, top, right and bottom.
+//
+// The bounds (the virtual screen) are split into square buckets of
+// SPATIAL_INDEX_CELL_SIZE pixels, each listing the entries that overlap it.
+// A query visits only the buckets its rectangle overlaps, so its cost
+// follows the windows near the rectangle, not the windows on the desktop.
+#pragma once
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#define SPATIAL_INDEX_CELL_SIZE 256
+
+template <typename Handle, typename Rect>
+struct SpatialGrid
+{
+    struct Entry
+    {
+        Handle hWnd;
+        Rect rect;
+        unsigned int zOrder;     // Higher is closer to the top
+        unsigned int queryStamp; // Deduplicates windows spanning several buckets
+        bool live;
+    };
+    Rect bounds;                            // Virtual screen
+    int columns = 0;
+    int rows = 0;
+    std::vector<std::vector<int>> buckets;  // Entry ids per bucket, row-major
+    std::vector<Entry> entries;
+    std::vector<int> freeEntries;
+    std::unordered_map<Handle, int> entryOf;
+    unsigned int topZOrder = 0;
+    unsigned int queryStamp = 0;
+};
+
+// Function to check whether two rectangles share at least one pixel
+template <typename Rect>
+inline bool SpatialRectsOverlap(const Rect& a, const Rect& b)
+{
+    return a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom;
+}
+
+// Function to get the bucket range a rectangle overlaps; false if it is off-screen
+template <typename Handle, typename Rect>
+bool GetSpatialBucketRange(const SpatialGrid<Handle, Rect>& index, const Rect& rect, int& firstColumn, int& lastColumn, int& firstRow, int& lastRow)
+{
+    if (rect.right <= index.bounds.left || rect.left >= index.bounds.right ||
+        rect.bottom <= index.bounds.top || rect.top >= index.bounds.bottom)
+        return false;
+
+    firstColumn = (std::max)(0, static_cast<int>(rect.left - index.bounds.left) / SPATIAL_INDEX_CELL_SIZE);
+    lastColumn = (std::min)(index.columns - 1, static_cast<int>(rect.right - 1 - index.bounds.left) / SPATIAL_INDEX_CELL_SIZE);
+    firstRow = (std::max)(0, static_cast<int>(rect.top - index.bounds.top) / SPATIAL_INDEX_CELL_SIZE);
+    lastRow = (std::min)(index.rows - 1, static_cast<int>(rect.bottom - 1 - index.bounds.top) / SPATIAL_INDEX_CELL_SIZE);
+    return true;
+}
+
+// Functions to add an entry to or remove it from the buckets it overlaps
+template <typename Handle, typename Rect>
+void LinkSpatialEntry(SpatialGrid<Handle, Rect>& index, int id)
+{
+    int firstColumn, lastColumn, firstRow, lastRow;
+    if (!GetSpatialBucketRange(index, index.entries[id].rect, firstColumn, lastColumn, firstRow, lastRow))
+        return;
+    for (int row = firstRow; row <= lastRow; ++row)
+    {
+        for (int column = firstColumn; column <= lastColumn; ++column)
+        {
+            index.buckets[row * index.columns + column].push_back(id);
+        }
+    }
+}
+
+template <typename Handle, typename Rect>
+void UnlinkSpatialEntry(SpatialGrid<Handle, Rect>& index, int id)
+{
+    int firstColumn, lastColumn, firstRow, lastRow;
+    if (!GetSpatialBucketRange(index, index.entries[id].rect, firstColumn, lastColumn, firstRow, lastRow))
+        return;
+    for (int row = firstRow; row <= lastRow; ++row)
+    {
+        for (int column = firstColumn; column <= lastColumn; ++column)
+        {
+            std::vector<int>& bucket = index.buckets[row * index.columns + column];
+            bucket.erase(std::remove(bucket.begin(), bucket.end(), id), bucket.end());
+        }
+    }
+}
+
+// Function to empty the index and size its buckets to cover bounds
+template <typename Handle, typename Rect>
+void ResetSpatialIndex(SpatialGrid<Handle, Rect>& index, const Rect& bounds)
+{
+    index.bounds = bounds;
+    index.columns = (std::max)(1, static_cast<int>((index.bounds.right - index.bounds.left + SPATIAL_INDEX_CELL_SIZE - 1) / SPATIAL_INDEX_CELL_SIZE));
+    index.rows = (std::max)(1, static_cast<int>((index.bounds.bottom - index.bounds.top + SPATIAL_INDEX_CELL_SIZE - 1) / SPATIAL_INDEX_CELL_SIZE));
+    index.buckets.assign(index.columns * index.rows, std::vector<int>());
+    index.entries.clear();
+    index.freeEntries.clear();
+    index.entryOf.clear();
+}
+
+// Function to add a window below every indexed one, for building the index
+// from a z-order listing that starts at the top
+template <typename Handle, typename Rect>
+void AppendSpatialEntry(SpatialGrid<Handle, Rect>& index, Handle hWnd, const Rect& rect, unsigned int zOrder)
+{
+    typename SpatialGrid<Handle, Rect>::Entry entry;
+    entry.hWnd = hWnd;
+    entry.rect = rect;
+    entry.zOrder = zOrder;
+    entry.queryStamp = 0;
+    entry.live = true;
+
+    int id = static_cast<int>(index.entries.size());
+    index.entries.push_back(entry);
+    index.entryOf[hWnd] = id;
+    LinkSpatialEntry(index, id);
+}
+
+// Function to insert a window at the top of the z-order, or move it
+template <typename Handle, typename Rect>
+void PlaceSpatialEntry(SpatialGrid<Handle, Rect>& index, Handle hWnd, const Rect& rect)
+{
+    auto it = index.entryOf.find(hWnd);
+    if (it != index.entryOf.end())
+    {
+        typename SpatialGrid<Handle, Rect>::Entry& entry = index.entries[it->second];
+        if (entry.rect.left == rect.left && entry.rect.top == rect.top &&
+            entry.rect.right == rect.right && entry.rect.bottom == rect.bottom)
+            return;
+        UnlinkSpatialEntry(index, it->second);
+        entry.rect = rect;
+        LinkSpatialEntry(index, it->second);
+        return;
+    }
+
+    // New windows appear on top
+    int id;
+    if (!index.freeEntries.empty())
+    {
+        id = index.freeEntries.back();
+        index.freeEntries.pop_back();
+    }
+    else
+    {
+        id = static_cast<int>(index.entries.size());
+        index.entries.push_back(typename SpatialGrid<Handle, Rect>::Entry());
+    }
+    typename SpatialGrid<Handle, Rect>::Entry& entry = index.entries[id];
+    entry.hWnd = hWnd;
+    entry.rect = rect;
+    entry.zOrder = ++index.topZOrder;
+    entry.queryStamp = 0;
+    entry.live = true;
+    index.entryOf[hWnd] = id;
+    LinkSpatialEntry(index, id);
+}
+
+// Function to move an indexed window to the top of the z-order
+template <typename Handle, typename Rect>
+void RaiseSpatialEntry(SpatialGrid<Handle, Rect>& index, Handle hWnd)
+{
+    auto it = index.entryOf.find(hWnd);
+    if (it != index.entryOf.end())
+        index.entries[it->second].zOrder = ++index.topZOrder;
+}
+
+// Function to drop a window; its entry is reused by the next new one
+template <typename Handle, typename Rect>
+void RemoveSpatialEntry(SpatialGrid<Handle, Rect>& index, Handle hWnd)
+{
+    auto it = index.entryOf.find(hWnd);
+    if (it == index.entryOf.end())
+        return;
+
+    int id = it->second;
+    UnlinkSpatialEntry(index, id);
+    index.entries[id].live = false;
+    index.entryOf.erase(it);
+    index.freeEntries.push_back(id);
+}
+
+// Function to find the topmost indexed window containing a point.
+// Returns a value-initialized handle if there is none.
+template <typename Handle, typename Rect>
+Handle HitTestSpatialIndex(const SpatialGrid<Handle, Rect>& index, int x, int y)
+{
+    Rect probe = Rect();
+    probe.left = x;
+    probe.top = y;
+    probe.right = x + 1;
+    probe.bottom = y + 1;
+    int firstColumn, lastColumn, firstRow, lastRow;
+    if (index.buckets.empty() || !GetSpatialBucketRange(index, probe, firstColumn, lastColumn, firstRow, lastRow))
+        return Handle();
+
+    Handle hTop = Handle();
+    unsigned int topZOrder = 0;
+    for (int id : index.buckets[firstRow * index.columns + firstColumn])
+    {
+        const typename SpatialGrid<Handle, Rect>::Entry& entry = index.entries[id];
+        if (entry.zOrder >= topZOrder && SpatialRectsOverlap(entry.rect, probe))
+        {
+            hTop = entry.hWnd;
+            topZOrder = entry.zOrder;
+        }
+    }
+    return hTop;
+}
+
+// Function to list every indexed window intersecting a rectangle
+template <typename Handle, typename Rect>
+void QuerySpatialIndex(SpatialGrid<Handle, Rect>& index, const Rect& rect, std::vector<Handle>& windows)
+{
+    windows.clear();
+    int firstColumn, lastColumn, firstRow, lastRow;
+    if (index.buckets.empty() || !GetSpatialBucketRange(index, rect, firstColumn, lastColumn, firstRow, lastRow))
+        return;
+
+    unsigned int stamp = ++index.queryStamp;
+    for (int row = firstRow; row <= lastRow; ++row)
+    {
+        for (int column = firstColumn; column <= lastColumn; ++column)
+        {
+            for (int id : index.buckets[row * index.columns + column])
+            {
+                typename SpatialGrid<Handle, Rect>::Entry& entry = index.entries[id];
+                if (entry.queryStamp == stamp)
+                    continue;
+                entry.queryStamp = stamp;
+
+                if (SpatialRectsOverlap(entry.rect, rect))
+                    windows.push_back(entry.hWnd);
+            }
+        }
+    }
+}
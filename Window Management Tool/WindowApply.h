@@ -0,0 +1,114 @@
+// Apply pipelines: how planned window moves reach the screen. Every place
+// and activate call goes through a backend, so the tool runs them on the
+// Win32 calls while the tests run them headless, counting the calls. Kept
+// free of Windows headers: a backend provides
+//   Window, Batch             handle types; a default-constructed Batch means none
+//   BeginBatch(count)         a batch for count windows, or none if refused
+//   Defer(batch, window, stack, insertAfter, target)
+//                             adds a move to the batch; returns false if the
+//                             window refused it, which discards the batch
+//   EndBatch(batch)           moves every window in the batch at once
+//   Place(window, stack, insertAfter, target)
+//                             moves one window
+//   IsWindow(window)          the window still exists
+//   Activate(window)          brings the window to the foreground
+//   StepAside()               gets the tool's own window out of the way
+// A move with stack set also shows the window and puts it directly below
+// insertAfter, or on top for a default-constructed insertAfter; without it
+// the z-order is kept. No move activates a window. A move only needs
+// hWnd, before and after, whose rectangle type the backend takes.
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Function to move windows to their "after" (forward) or "before" rectangles in
+// one batch. A batch lets the system reposition every window in a single
+// pass instead of repainting the desktop once per window.
+template <typename Backend, typename Move>
+void ApplyWindowMoves(Backend& backend, const std::vector<Move>& moves, bool forward)
+{
+    typedef typename Backend::Window Window;
+    typedef typename Backend::Batch Batch;
+    if (moves.empty())
+        return;
+
+    Batch batch = backend.BeginBatch(static_cast<int>(moves.size()));
+    bool batched = batch != Batch();
+    for (size_t i = 0; i < moves.size() && batched; ++i)
+    {
+        if (!backend.IsWindow(moves[i].hWnd))
+            continue;
+
+        batched = backend.Defer(batch, moves[i].hWnd, false, Window(), forward ? moves[i].after : moves[i].before);
+    }
+
+    if (batched)
+    {
+        backend.EndBatch(batch);
+        return;
+    }
+
+    // A batch fails as a whole if any window rejects it (e.g. an elevated
+    // or hung process), so fall back to moving the windows one by one
+    for (const auto& move : moves)
+    {
+        if (!backend.IsWindow(move.hWnd))
+            continue;
+
+        backend.Place(move.hWnd, false, Window(), forward ? move.after : move.before);
+    }
+}
+
+// Function to move windows and stack them in one ordered batch: the last
+// window ends up on top and each earlier one directly below the next, the
+// same order the windows were raised in one by one before. No window is
+// activated here.
+template <typename Backend, typename Move>
+void ApplyWindowStack(Backend& backend, const std::vector<Move>& moves)
+{
+    typedef typename Backend::Window Window;
+    typedef typename Backend::Batch Batch;
+    if (moves.empty())
+        return;
+
+    Batch batch = backend.BeginBatch(static_cast<int>(moves.size()));
+    bool batched = batch != Batch();
+    Window insertAfter = Window();
+    for (size_t i = moves.size(); i-- > 0 && batched; )
+    {
+        batched = backend.Defer(batch, moves[i].hWnd, true, insertAfter, moves[i].after);
+        insertAfter = moves[i].hWnd;
+    }
+
+    if (batched)
+    {
+        backend.EndBatch(batch);
+        return;
+    }
+
+    // Same order one window at a time if a window refused the batch
+    insertAfter = Window();
+    for (size_t i = moves.size(); i-- > 0; )
+    {
+        if (!backend.IsWindow(moves[i].hWnd))
+            continue;
+
+        backend.Place(moves[i].hWnd, true, insertAfter, moves[i].after);
+        insertAfter = moves[i].hWnd;
+    }
+}
+
+// Function to finish an arrange: the moves go out as one ordered batch,
+// then the tool steps aside and the last window is activated, once.
+// Returns true if a window was activated.
+template <typename Backend, typename Move>
+bool ApplyArrangeMoves(Backend& backend, const std::vector<Move>& moves)
+{
+    ApplyWindowStack(backend, moves);
+    backend.StepAside();
+    if (moves.empty())
+        return false;
+    backend.Activate(moves.back().hWnd);
+    return true;
+}
@@ -2,15 +2,41 @@
 #include <windows.h>
 #include <windowsx.h>
 #include <commctrl.h>
+#include <dwmapi.h>
+#include <ShellScalingApi.h>
+#include <shellapi.h>
+#include <psapi.h>
 #include <vector>
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <memory>
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <cwctype>
 #include <float.h>
+#include <atomic>
+#include <climits>
+#include <random>
+#include <sddl.h>
+#include "LayoutState.h"
+#include "EpochReclamation.h"
+#include "SpatialIndex.h"
+#include "LayoutSolver.h"
+#include "AutoTileDebounce.h"
+#include "WindowApply.h"
+#include "ArrangeScheduler.h"
 
 // Link necessary libraries
 #pragma comment(lib, "user32.lib")
 #pragma comment(lib, "Comctl32.lib")
+#pragma comment(lib, "dwmapi.lib")
+#pragma comment(lib, "Shcore.lib")
+#pragma comment(lib, "psapi.lib")
+#pragma comment(lib, "advapi32.lib")
 
 // Constants for control positioning
 #define MARGIN 10
@@ -48,28 +74,397 @@
 #define ID_WINDOWTITLE_LABEL 18          // Label for Window Title
 #define ID_WINDOWTITLE_EDIT 16           // Edit box for Window Title input
 #define ID_CAPTURE_BY_TITLE_BUTTON 17    // Button to capture windows by title
+#define ID_AUTO_TILE_CHECKBOX 19         // Checkbox to toggle the auto-tiling daemon
+#define ID_CAPTURE_BY_RULES_BUTTON 20    // Button to capture windows matching the capture rules
+#define ID_UNDO_BUTTON 21                // Button to undo the last layout change
+#define ID_REDO_BUTTON 22                // Button to redo the last undone layout change
+#define ID_LINKED_RESIZE_CHECKBOX 23     // Checkbox to reflow neighbors when a tiled window is resized
+#define ID_TRAY_SHOW_PANEL 24            // Tray menu: open the control panel
+#define ID_TRAY_ARRANGE 25               // Tray menu: arrange the captured windows
+#define ID_TRAY_EXIT 26                  // Tray menu: quit
+#define ID_TRAY_ICON 1                   // The only notification icon
+#define ID_SWAP_BUTTON 27                // Button to swap the two selected windows
+#define ID_CAPTURE_APPEND_CHECKBOX 28    // Checkbox to add captured windows to the current list
+
+// File holding the user-defined layouts, next to the executable; the
+// limits of one compiled layout are in LayoutSolver.h
+#define LAYOUTS_FILE L"Layouts.txt"
+#define MAX_CUSTOM_LAYOUTS 32
+
+// File holding the capture rules, next to the executable
+#define CAPTURE_RULES_FILE L"CaptureRules.txt"
+#define MAX_CAPTURE_RULES 4096
+#define CAPTURE_RULE_MASK_WORDS (MAX_CAPTURE_RULES / 64)
+static_assert(MAX_CAPTURE_RULES == MAX_LAYOUT_RULES, "layout bindings must be able to name every capture rule");
+
+// Settings file next to the executable; hotkeys live in its [Hotkeys] section
+#define SETTINGS_FILE L"WindowManagementTool.ini"
+
+// Number of workspaces reachable through hotkeys
+#define MAX_WORKSPACES 9
+
+// Hotkey actions
+#define HOTKEY_NONE 0
+#define HOTKEY_ARRANGE 1
+#define HOTKEY_RESTORE 2
+#define HOTKEY_SWITCH_WORKSPACE 3  // Argument: workspace number
+#define HOTKEY_CYCLE_LAYOUT 4
+#define HOTKEY_FOCUS_NEXT 5
+#define HOTKEY_UNDO 6
+#define HOTKEY_REDO 7
+
+// Layout history: a ring of LAYOUT_HISTORY_ENTRIES entries whose window moves
+// share one circular pool of LAYOUT_HISTORY_MOVES records, so the memory used
+// is fixed no matter how many layouts are applied
+#define LAYOUT_HISTORY_ENTRIES 4096
+#define LAYOUT_HISTORY_MOVES 16384
+
+// Timer IDs
+#define ID_AUTO_TILE_TIMER 1
+#define ID_LINKED_RESIZE_TIMER 2
+#define ID_SETTINGS_RELOAD_TIMER 3
+#define ID_METRICS_EXPORT_TIMER 4
+#define ID_CAPTURE_TIMEOUT_TIMER 5
+
+// How often the settings file is checked for outside edits
+#define SETTINGS_RELOAD_INTERVAL_MS 1000
+
+// Event trace (/record and /replay)
+#define TRACE_MAGIC 0x54544D57          // "WMTT"
+#define TRACE_VERSION 2
+#define TRACE_FLUSH_RECORDS 4096        // Records buffered before a write
+#define TRACE_MOUSE_DOWN 1              // a, b: cursor position, c: 1 if the click went to the tool
+#define TRACE_MOUSE_UP 2
+#define TRACE_HOTKEY 3                  // a: modifiers, b: virtual key (Esc and Enter of a capture too)
+#define TRACE_WINDOW_SHOW 4             // window, a-d: window rectangle
+#define TRACE_WINDOW_DESTROY 5          // window
+#define TRACE_LIST 6                    // window: number of TRACE_LIST_ENTRY records that follow
+#define TRACE_LIST_ENTRY 7              // window, a-d: rectangle to restore to
+#define TRACE_WORK_AREA 8               // a-d: work area of the next arrange
+#define TRACE_ARRANGE 9                 // window: TRACE_ARRANGE_*, a: pixel fix X, b: pixel fix Y, c: spacing, d: layout mode
+#define TRACE_RESTORE 10
+#define TRACE_WINDOW_MOVE 11            // window, a-d: window rectangle
+#define TRACE_WINDOW_HIDE 12            // window: hidden or minimized, no longer hit
+#define TRACE_WINDOW_RAISE 13           // window: activated, now on top
+#define TRACE_SCREEN 14                 // a-d: virtual screen
+#define TRACE_MONITOR 15                // window: DPI, a-d: work area; one per monitor before an all-monitors arrange
+#define TRACE_CAPTURE_START 16          // a: windows to capture, b: 1 if appending
+#define TRACE_CAPTURE_END 17            // a: CAPTURE_END_* reason
+#define TRACE_NAME 18                   // window, a: TRACE_NAME_*, b: length; the TRACE_TEXT records follow
+#define TRACE_TEXT 19                   // a-d: four UTF-16 units of a name
+#define TRACE_ARRANGE_ALL_MONITORS 1    // The arrange spread the windows over every monitor
+#define TRACE_NAME_GROUP 0              // Group key of a captured window
+#define TRACE_NAME_PROCESS 1            // Lower-case executable name of a captured window
+#define TRACE_NAME_CLASS 2              // Lower-case class name of a captured window
+#define TRACE_NAME_LAYOUT 3             // Line of the custom layout the next arrange uses
+
+// Self-check of the Windows side (/selfcheck [cases] [/seed n]): the apply
+// pipelines on real windows, then the benchmarks and simulations below. The
+// layout solvers are checked on their own by tests/LayoutSelfCheck.cpp,
+// linked-resize drags by tests/LinkedResizeBenchmark.cpp, the auto-tile
+// debounce by tests/AutoTileBurstTest.cpp and a held arrange chord by
+// tests/ArrangeStormTest.cpp.
+#define SELFCHECK_DEFAULT_CASES 1000    // Arranges of real windows
+#define SELFCHECK_APPLY_MAX_WINDOWS 32
+#define SELFCHECK_MAX_REPORTED_FAILURES 20
+#define SELFCHECK_REPORT_FILE L"SelfCheck.report.txt"
+#define SELFCHECK_SPATIAL_WINDOWS 5000  // Synthetic desktop of the spatial index benchmark
+#define SELFCHECK_SPATIAL_QUERIES 10000
+#define SELFCHECK_RECORD_WINDOWS 10000 // Window records walked by the record benchmarks
+#define SELFCHECK_RECORD_PASSES 200
+#define SELFCHECK_RULE_COUNT 500        // Capture rules of the classification benchmark
+#define SELFCHECK_RULE_WINDOWS 100000   // Window descriptors classified against them
+#define SELFCHECK_RULE_BATCH 1000       // Descriptors timed per sample
+#define SELFCHECK_HISTORY_CHANGES 20000 // Layout changes recorded by the history benchmarks
+#define SELFCHECK_HISTORY_MAX_MOVES 4   // Windows moved per change, few enough to fill the ring
+
+// Runtime metrics, exported as Prometheus text and kept in shared memory
+#define METRICS_FILE L"WindowManagementTool.prom"
+#define METRICS_SHARED_MEMORY_NAME L"Local\\WindowManagementToolMetrics"
+#define METRICS_MAGIC 0x53544D57        // "WMTS"
+#define METRICS_VERSION 5
+#define METRICS_EXPORT_INTERVAL_MS 15000
+#define METRICS_SUB_BUCKETS 4           // Linear steps within each power of two
+#define METRICS_HISTOGRAM_BUCKETS 128   // Covers 1 us up to about 2^33 us
+
+// Counters
+#define METRIC_CAPTURES 0               // Windows added to the capture list
+#define METRIC_ARRANGES 1
+#define METRIC_WINDOWS_ARRANGED 2
+#define METRIC_WINDOWS_SKIPPED_CLOSED 3
+#define METRIC_WINDOWS_HUNG 4           // Arranged windows whose application was not responding
+#define METRIC_RESTORES 5
+#define METRIC_REGISTRY_PUBLISHES 6     // Window registry snapshots published
+#define METRIC_REGISTRY_PUBLISHES_BATCHED 7 // Publish requests folded into one already pending
+#define METRIC_AUTO_TILE_EVENTS 8       // Window events seen by the auto-tiling daemon
+#define METRIC_AUTO_TILE_RELAYOUTS 9    // Relayouts the daemon ran for those events
+#define METRIC_LINKED_RESIZE_FRAMES 10  // Frames that committed a linked reflow
+#define METRIC_LINKED_RESIZE_FRAMES_DROPPED 11 // Display frames missed during linked drags
+#define METRIC_ARRANGE_ACTIVATIONS 12   // Windows brought to the foreground by arranges
+#define METRIC_ARRANGE_REQUESTS 13      // Arrange requests received by the scheduler
+#define METRIC_ARRANGE_REQUESTS_DROPPED 14 // Requests folded into one already pending
+#define METRIC_ARRANGES_CANCELLED 15    // Arranges abandoned for a newer request
+#define METRIC_SETTINGS_RELOADS 16      // Settings file reloads after outside edits
+#define METRIC_WINDOWS_REORDERED 17     // Windows moved by list reorders
+#define METRIC_LAYOUT_RELOADS 18        // Layouts file reloads
+#define METRIC_COUNTER_COUNT 19
+
+// Gauges
+#define METRIC_STARTUP_MICROSECONDS 0   // Process start to the first message loop
+#define METRIC_PRIVATE_BYTES 1          // Committed private memory of the process
+#define METRIC_WINDOW_RECORD_BYTES 2    // Storage of the captured window list
+#define METRIC_TITLE_POOL_BYTES 3       // Storage of the interned window titles
+#define METRIC_WORKING_SET_BYTES 4      // Physical memory in use by the process
+#define METRIC_GAUGE_COUNT 5
+
+// Latency histograms
+#define METRIC_CAPTURE_LATENCY 0
+#define METRIC_ARRANGE_LATENCY 1
+#define METRIC_RESTORE_LATENCY 2
+#define METRIC_LIST_REFRESH_LATENCY 3
+#define METRIC_HOOK_CALLBACK_LATENCY 4
+#define METRIC_PANEL_CREATE_LATENCY 5
+#define METRIC_HISTOGRAM_COUNT 6
+
+// Layout state published for status bars and overlays; see PublishedLayoutState
+// in LayoutState.h. Readers get SECTION_QUERY and SECTION_MAP_READ only,
+// the owner too; the writer keeps the full-access handle it created.
+#define LAYOUT_SHARED_MEMORY_NAME L"Local\\WindowManagementToolLayout"
+#define LAYOUT_SHARED_MEMORY_SDDL L"D:P(A;;0x5;;;OW)(A;;0x5;;;IU)"
+
+// Largest invisible border accepted as a frame inset, in pixels
+#define MAX_FRAME_INSET 64
 
 // Custom message for unhooking
 #define WM_UNHOOK_HOOKS (WM_USER + 1)
 
-// Structure to store window information
-struct WindowInfo
+// Capture session states. The hooks are only installed outside CAPTURE_IDLE;
+// once a session is ending they pass all input through until they are removed.
+#define CAPTURE_IDLE 0
+#define CAPTURE_ACTIVE 1
+#define CAPTURE_ENDING 2
+
+// Reasons a capture session ends
+#define CAPTURE_END_COMPLETED 0   // The requested number of windows was captured
+#define CAPTURE_END_FINISHED 1    // Enter or the capture button ended an open-ended session
+#define CAPTURE_END_CANCELLED 2   // Esc
+#define CAPTURE_END_TIMEOUT 3     // [Capture] TimeoutSeconds elapsed
+#define WM_ARRANGE_REQUEST (WM_USER + 2)   // Runs the pending arrange request
+#define WM_TRAY_ICON (WM_USER + 3)         // Notifications from the tray icon
+#define WM_PUBLISH_REGISTRY (WM_USER + 4)  // Publishes the requested registry snapshot
+
+// Captured windows, stored as parallel arrays so the arrange and restore
+// loops walk only contiguous handles and rectangles. Position i is window
+// number i + 1 in the list.
+struct WindowRecords
 {
-    HWND hWnd;
-    RECT rect;
-    std::wstring windowTitle;
-    int index; // Index number in the order of registration
+    std::vector<HWND> handles;
+    std::vector<RECT> rects;            // Position at capture, used by restore
+    std::vector<const wchar_t*> titles; // Interned in titlePool
+};
+
+// Chars in each title pool block
+#define TITLE_POOL_BLOCK_CHARS 16384
+
+// A new title pool generation is started once the pool holds more than
+// this many chars and under a quarter of them are still referenced
+#define TITLE_POOL_COMPACT_CHARS (4 * TITLE_POOL_BLOCK_CHARS)
+
+// Hash and equality on the text of interned titles
+struct TitleHash
+{
+    size_t operator()(const wchar_t* title) const
+    {
+        size_t hash = 14695981039346656037ULL;
+        for (; *title; ++title)
+            hash = (hash ^ static_cast<size_t>(*title)) * 1099511628211ULL;
+        return hash;
+    }
+};
+
+struct TitleEqual
+{
+    bool operator()(const wchar_t* first, const wchar_t* second) const
+    {
+        return wcscmp(first, second) == 0;
+    }
+};
+
+// Interned window titles. Each distinct title is stored once in arena
+// blocks that are never moved. When most of the pool is garbage, the live
+// titles move to a new generation and the old blocks are freed once no
+// published snapshot can point into them. Only the UI thread interns.
+struct TitlePool
+{
+    std::vector<std::unique_ptr<wchar_t[]>> blocks;
+    size_t blockUsed = TITLE_POOL_BLOCK_CHARS;
+    size_t charsAllocated = 0;
+    bool compactDue = false;   // A block was added since the last compaction check
+    std::unordered_set<const wchar_t*, TitleHash, TitleEqual> titles;
+};
+
+// Layout inputs, validated when edited and stored in the [Settings] section
+struct LayoutSettings
+{
+    int pixelFixX = 0;
+    int pixelFixY = 0;
+    int minSpacingY = 20;
+    int monitorSelection = 0;  // Monitor combo box entry, including "All Monitors"
+};
+
+// Immutable copy of the capture state and the layout inputs, published by
+// the UI thread after each batch of changes. Readers on any thread see one
+// consistent version.
+struct WindowRegistrySnapshot
+{
+    WindowRecords windows;
+    bool isCapturing;
+    int windowsCaptured;
+    LayoutSettings settings;
+    std::vector<LayoutMonitor<RECT>> monitors; // Work area and DPI of each monitor, by index
+    int allMonitorsSelection;                  // Monitor selection that spreads over all of them, -1 = none
+    int layoutMode;
+    unsigned long long version;
 };
 
 // Global variables
-std::vector<WindowInfo> windowList;
-bool isCapturing = false;
-bool captureCompleted = false;
-int windowsToCapture = 0;
-int windowsCaptured = 0;
+WindowRecords windowList;
+TitlePool titlePool;
+
+// One interactive capture session: clicks toggle windows in and out of the
+// list and a drag captures every window it touches
+struct CaptureSession
+{
+    int state = CAPTURE_IDLE;
+    int target = 0;             // Windows to capture, 0 for open-ended
+    size_t baseCount = 0;       // Windows already in the list when the session started
+    int endReason = CAPTURE_END_CANCELLED;
+    bool buttonDown = false;    // A suppressed button-down is waiting for its button-up
+    POINT buttonDownPoint = { 0, 0 };
+};
+CaptureSession captureSession;
+bool captureAppend = false;     // Keep the current list when a capture starts
+
+// Log-linear latency histogram in microseconds: each power of two is split
+// into METRICS_SUB_BUCKETS equal steps, so the relative error stays under
+// 25% over the whole range at a fixed size
+struct LatencyHistogram
+{
+    std::atomic<unsigned long long> buckets[METRICS_HISTOGRAM_BUCKETS];
+    std::atomic<unsigned long long> count;
+    std::atomic<unsigned long long> sumMicroseconds;
+};
+
+// All metrics in one block, placed in shared memory so a local agent can
+// map it and read the live values directly. Every field is updated with
+// relaxed atomic adds; nothing on the hot path takes a lock.
+struct MetricsBlock
+{
+    DWORD magic;
+    DWORD version;
+    std::atomic<unsigned long long> counters[METRIC_COUNTER_COUNT];
+    std::atomic<unsigned long long> gauges[METRIC_GAUGE_COUNT];
+    LatencyHistogram histograms[METRIC_HISTOGRAM_COUNT];
+};
+
+MetricsBlock localMetrics;            // Used if the shared memory cannot be created
+MetricsBlock* metrics = &localMetrics;
+HANDLE hMetricsMapping = NULL;
+
+PublishedLayoutState* publishedLayout = NULL; // NULL if the shared memory could not be created
+HANDLE hLayoutMapping = NULL;
+
+// Function to count an event
+inline void CountMetric(int counter, unsigned long long amount = 1)
+{
+    metrics->counters[counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+// Function to set a gauge to its current value
+inline void SetMetricGauge(int gauge, unsigned long long value)
+{
+    metrics->gauges[gauge].store(value, std::memory_order_relaxed);
+}
+
+// Function to get the histogram bucket of a latency
+inline int GetLatencyBucket(unsigned long long microseconds)
+{
+    if (microseconds < METRICS_SUB_BUCKETS)
+        return static_cast<int>(microseconds);
+
+    int exponent = 0;
+    while ((microseconds >> exponent) >= 2 * METRICS_SUB_BUCKETS)
+        ++exponent;
+    int bucket = (exponent + 1) * METRICS_SUB_BUCKETS + static_cast<int>((microseconds >> exponent) - METRICS_SUB_BUCKETS);
+    return (bucket < METRICS_HISTOGRAM_BUCKETS) ? bucket : METRICS_HISTOGRAM_BUCKETS - 1;
+}
+
+// Function to get the largest latency a bucket holds, in microseconds
+inline unsigned long long GetLatencyBucketLimit(int bucket)
+{
+    if (bucket < METRICS_SUB_BUCKETS)
+        return bucket;
+    int exponent = bucket / METRICS_SUB_BUCKETS - 1;
+    unsigned long long mantissa = METRICS_SUB_BUCKETS + bucket % METRICS_SUB_BUCKETS;
+    return ((mantissa + 1) << exponent) - 1;
+}
+
+// Function to add a latency sample
+inline void RecordLatency(int histogram, unsigned long long microseconds)
+{
+    LatencyHistogram& target = metrics->histograms[histogram];
+    target.buckets[GetLatencyBucket(microseconds)].fetch_add(1, std::memory_order_relaxed);
+    target.count.fetch_add(1, std::memory_order_relaxed);
+    target.sumMicroseconds.fetch_add(microseconds, std::memory_order_relaxed);
+}
+
+// Times the enclosing scope into a latency histogram
+struct ScopedLatency
+{
+    int histogram;
+    LARGE_INTEGER start;
+    bool stopped = false;
+
+    explicit ScopedLatency(int histogramIndex) : histogram(histogramIndex)
+    {
+        QueryPerformanceCounter(&start);
+    }
+
+    ~ScopedLatency()
+    {
+        Stop();
+    }
+
+    // Records the sample now; called before a message box, whose time on
+    // screen is the user's and not part of the measured work
+    void Stop()
+    {
+        if (stopped)
+            return;
+        stopped = true;
+        LARGE_INTEGER end, frequency;
+        QueryPerformanceCounter(&end);
+        QueryPerformanceFrequency(&frequency);
+        RecordLatency(histogram, static_cast<unsigned long long>((end.QuadPart - start.QuadPart) * 1000000 / frequency.QuadPart));
+    }
+};
+
+// Window registry: the published snapshot, plus epoch-based reclamation
+// (EpochReclamation.h). A replaced snapshot is freed once no reader can
+// hold it any more.
+std::atomic<const WindowRegistrySnapshot*> windowRegistry(nullptr);
+EpochReaders registryReaders;
+std::vector<std::pair<const WindowRegistrySnapshot*, uint64_t>> retiredRegistrySnapshots;
+std::vector<std::pair<std::vector<std::unique_ptr<wchar_t[]>>, uint64_t>> retiredTitleBlocks;
+unsigned long long windowRegistryVersion = 0;
+bool windowRegistryPublishPending = false; // WM_PUBLISH_REGISTRY is posted
+
+// Current layout settings (UI thread); other code reads them from the registry
+LayoutSettings layoutSettings;
+FILETIME settingsFileTime = { 0 };   // Last write time of the settings file we have seen
 HHOOK hMouseHook = NULL;
 HHOOK hKeyboardHook = NULL;
-HHOOK hGlobalKeyboardHook = NULL; // For global shortcuts
+HHOOK hGlobalKeyboardHook = NULL; // Fallback for shortcuts that RegisterHotKey rejected
 HINSTANCE hInstance;
 HWND hListView;
 HWND hMonitorComboBox;
@@ -85,6 +480,8 @@ HWND hNumWindowsLabel;
 HWND hMonitorLabel;
 HWND hMoveUpButton;
 HWND hMoveDownButton;
+HWND hSwapButton;
+HFONT hPanelFont = NULL;         // Message font at the panel's DPI
 HWND hPixelFixXLabel;   // Handle for Horizontal Pixel Fix Label
 HWND hPixelFixXEdit;    // Handle for Horizontal Pixel Fix Edit Box
 HWND hPixelFixYLabel;   // Handle for Vertical Pixel Fix Label
@@ -96,9 +493,72 @@ HWND hMinSpacingYEdit;  // Handle for Min Vertical Spacing Edit Box
 HWND hWindowTitleLabel;          // Label for Window Title
 HWND hWindowTitleEdit;           // Edit box for Window Title input
 HWND hCaptureByTitleButton;      // Button to capture windows by title
+HWND hAutoTileCheckBox;          // Checkbox to toggle the auto-tiling daemon
+HWND hLinkedResizeCheckBox;      // Checkbox to reflow neighbors when a tiled window is resized
+HWND hCaptureAppendCheckBox;     // Checkbox to add captured windows to the current list
+HWND hCaptureByRulesButton;      // Button to capture windows matching the capture rules
+HWND hUndoButton;                // Button to undo the last layout change
+HWND hRedoButton;                // Button to redo the last undone layout change
+
+// Auto-tiling daemon state
+HWINEVENTHOOK hWinEventHook = NULL; // Window lifecycle hook, installed only while auto-tiling
+bool autoTileEnabled = false;
+std::wstring autoTileTitle;         // Title a new window must carry to be captured automatically
+AutoTileBurst autoTileBurst;        // Relayout pending for the current burst of list changes
+
+// One fixed-size trace record; rectangles and points are stored as shorts
+struct TraceRecord
+{
+    DWORD time;                // Milliseconds since recording started
+    unsigned char type;        // TRACE_*
+    unsigned char reserved[3];
+    DWORD window;              // Window handle, which fits in 32 bits
+    short a, b, c, d;
+};
+
+// File header of a trace
+struct TraceHeader
+{
+    DWORD magic;
+    DWORD version;
+};
+
+// Event recorder state
+bool traceRecording = false;
+HANDLE hTraceFile = INVALID_HANDLE_VALUE;
+DWORD traceStartTime = 0;
+std::vector<TraceRecord> traceBuffer;
+HWINEVENTHOOK hTraceWinEventHooks[3] = {};
+std::unordered_set<HWND> traceWindows;                       // Windows the trace has shown or listed
+std::unordered_map<HWND, std::wstring> traceGroupKeys;       // Group key last recorded per window
+
+// Names of the simulated windows of a replayed trace, which layout
+// bindings look at instead of asking the system
+struct TraceWindowNames
+{
+    std::wstring process;
+    std::wstring className;
+};
+std::unordered_map<HWND, TraceWindowNames> replayWindowNames;
+
+// Control panel inputs, kept while the panel is destroyed so hotkeys
+// arrange the same way when only the tray icon is resident
+struct ControlPanelState
+{
+    std::wstring numWindows = L"1";
+    std::wstring windowTitle;
+};
+
+// Tray-resident mode (/tray): the control panel is only built while shown
+bool trayMode = false;
+ControlPanelState panelState;
+UINT WM_TASKBAR_CREATED = 0;   // Broadcast when Explorer restarts and the tray icon must be re-added
+LARGE_INTEGER processStartCounter;
+bool footprintPanelBuilt = false; // The panel existed when the footprint gauges were last read
 
 // Original window procedure for ListView
 WNDPROC OldListViewProc = NULL;
+bool listDragActive = false; // Selected rows are being dragged to a new position
 
 // Global variables for message box timeout
 UINT_PTR g_msgboxTimerId = 0;
@@ -107,6 +567,263 @@ HWND g_hMsgBoxWnd = NULL;   // Handle to the message box window
 
 // Map to store monitor information
 std::map<int, MONITORINFO> monitorMap;
+std::map<int, UINT> monitorDpiMap;      // Effective DPI of each monitor in monitorMap
+int allMonitorsComboIndex = -1;         // Combo box entry that spreads windows over all monitors
+
+// Inputs of a layout, read once per arrange
+typedef LayoutInputs<RECT> GridLayoutParams;
+
+// One region of the grouped layout, with its cached cells
+typedef LayoutGroupRegion<RECT> LayoutGroup;
+
+// One monitor of the all-monitors layout
+typedef LayoutMonitor<RECT> MonitorArea;
+
+// Geometry of the last applied grid, kept so a manual resize of one window
+// can reflow only the rows and columns next to it
+struct TiledLayout : GridGeometry
+{
+    std::vector<HWND> windows;     // Row-major, windows[row * columns + column]
+    std::vector<RECT> cells;       // Cell of each list position, in any layout mode
+};
+
+// State of a drag on a tiled window
+struct LinkedResizeState
+{
+    HWND hDragged = NULL;
+    int row = 0;
+    int column = 0;
+    RECT startRect;                // Window rectangle when the drag started
+    GridGeometry startGrid;        // Grid when the drag started
+    std::vector<RECT> startRects;  // Rectangle of every grid window when the drag started
+    std::vector<int> positions;    // Grid positions the drag can reflow
+    std::vector<RECT> cells;       // Their cells before the frame being committed
+    bool dirty = false;            // The window moved since the last commit
+    HWINEVENTHOOK hLocationHook = NULL;
+    LARGE_INTEGER dragStart;
+    double changeMs = 0.0;         // First location change since the last commit, from drag start
+    double framePeriodMs = 0.0;
+    long long lastFrame = -1;      // Display frame of the last commit, from drag start
+    int frames = 0;                // Frames that committed a reflow
+    int droppedFrames = 0;         // Display frames committed reflows landed late by
+};
+
+// One window moved by a layout change; only windows that actually moved are
+// stored, which makes every history entry a delta against the previous state
+struct WindowMove
+{
+    HWND hWnd;
+    RECT before;
+    RECT after;
+};
+
+// Undo/redo history of applied layouts
+struct LayoutHistory
+{
+    struct Entry
+    {
+        size_t firstMove; // Position of the first move in the pool (monotonic, not wrapped)
+        size_t moveCount;
+    };
+    std::vector<WindowMove> moves; // Circular pool, LAYOUT_HISTORY_MOVES records
+    std::vector<Entry> entries;    // Ring, LAYOUT_HISTORY_ENTRIES entries
+    size_t oldest = 0;             // Ring index of the oldest entry
+    size_t count = 0;              // Entries in the ring
+    size_t cursor = 0;             // Entries before the cursor can be undone, the rest redone
+    size_t moveEnd = 0;            // Pool position after the last recorded move
+    size_t pendingFirst = 0;       // Start of the entry being recorded
+    bool recording = false;
+};
+
+// Grid index of the visible top-level windows, used for hit-testing and
+// lasso capture without asking the system for every query
+typedef SpatialGrid<HWND, RECT> SpatialIndex;
+
+// One configurable shortcut
+struct HotkeyBinding
+{
+    UINT modifiers;  // MOD_ALT | MOD_CONTROL | MOD_SHIFT | MOD_WIN
+    UINT vk;         // Virtual key code
+    int action;      // HOTKEY_* action
+    int argument;
+    bool registered; // false = handled by the low-level hook fallback
+};
+
+// Entry of the chord lookup table; zero means "not bound"
+struct HotkeyTableEntry
+{
+    unsigned char action;
+    unsigned char argument;
+    bool viaHook;
+};
+
+// Declarative capture rule. Every predicate that is set must match; the first
+// matching rule in file order decides whether the window is captured.
+struct CaptureRule
+{
+    bool include;              // true = capture matching windows, false = never capture them
+    std::wstring titlePattern; // Case-insensitive, '*' wildcards, empty = any title
+    std::wstring className;    // Case-insensitive exact class name, empty = any
+    std::wstring processName;  // Case-insensitive executable name (e.g. devenv.exe), empty = any
+    int minWidth, maxWidth;    // Window size range in pixels, 0 = unbounded
+    int minHeight, maxHeight;
+    int monitor;               // Index into monitorMap, -1 = any monitor
+};
+
+// The properties of a window the capture rules are evaluated against
+struct WindowDescriptor
+{
+    std::wstring title;
+    std::wstring className;   // Only filled in if a rule tests the class
+    std::wstring processName; // Only filled in if a rule tests the process
+    int width;
+    int height;
+    int monitor;
+};
+
+// Bit set with one bit per capture rule
+typedef std::vector<unsigned long long> RuleMask;
+
+// Capture rules compiled into a decision table. Each predicate kind maps a
+// window property to the mask of rules it satisfies (rules that do not test
+// that property are always set), so classifying a window is one lookup per
+// property, one automaton pass over the title and an AND of the masks.
+struct CaptureRuleTable
+{
+    std::vector<CaptureRule> rules;
+    size_t maskWords = 0;
+
+    // Exact-match predicates: value -> mask, plus the mask for unknown values
+    std::unordered_map<std::wstring, RuleMask> classMasks;
+    RuleMask anyClassMask;
+    std::unordered_map<std::wstring, RuleMask> processMasks;
+    RuleMask anyProcessMask;
+    std::map<int, RuleMask> monitorMasks;
+    RuleMask anyMonitorMask;
+
+    // Title patterns: literal fragments matched by an Aho-Corasick automaton.
+    // A fragment match sets the rules that use it as exact, prefix, suffix or
+    // substring pattern depending on where in the title it was found.
+    struct TitleNode
+    {
+        std::map<wchar_t, int> next;
+        int fail = 0;
+        int output = -1;     // Fragment ending at this node, -1 = none
+        int outputLink = -1; // Nearest node on the fail chain with an output
+    };
+    struct TitleFragment
+    {
+        size_t length;
+        RuleMask exactMask, prefixMask, suffixMask, containsMask;
+    };
+    std::vector<TitleNode> titleNodes;
+    std::vector<TitleFragment> titleFragments;
+    RuleMask anyTitleMask;
+    std::vector<int> wildcardTitleRules; // Patterns with inner '*', matched directly
+
+    bool usesClass = false;
+    bool usesProcess = false;
+    bool usesMonitor = false;
+};
+
+// Compiled capture rules, empty until a rules file has been loaded
+CaptureRuleTable captureRuleTable;
+
+// Hotkeys: the bindings in registration order, and a flat table indexed by
+// modifier mask and virtual key so a chord resolves with a single load
+std::vector<HotkeyBinding> hotkeyBindings;
+HotkeyTableEntry hotkeyTable[16][256] = {};
+bool hotkeyHookKeys[256] = {}; // Keys with at least one chord handled by the hook
+HotkeyKeyState hotkeyKeyState;  // Hooked keys that are held, to tell auto-repeat from a new press
+
+// Workspaces: the window list of every workspace that is not active
+WindowRecords workspaceLists[MAX_WORKSPACES];
+int currentWorkspace = 0;
+int currentLayoutMode = LAYOUT_GRID;
+
+// History of applied layouts for undo/redo
+LayoutHistory layoutHistory;
+
+// Index of the top-level windows, kept up to date while capturing
+SpatialIndex spatialIndex;
+HWINEVENTHOOK hSpatialIndexHooks[3] = {};
+
+// Grouped layout: cached regions, and the group key of every window seen.
+// Keys are interned, so the solve groups windows by id instead of hashing
+// a string per window; ids stay valid for the life of the process.
+std::vector<LayoutGroup> layoutGroups;
+std::deque<std::wstring> groupKeyNames; // Key of each id; a deque so references stay valid
+std::vector<int> groupKeyRules;         // Capture rule of each id, -1 for process keys
+std::unordered_map<std::wstring, int> groupKeyIds;
+std::unordered_map<HWND, int> windowGroupKeys;
+
+// User-defined layouts from the layouts file
+std::vector<LayoutProgram> customLayouts;
+int currentCustomLayout = 0;          // Layout used by LAYOUT_CUSTOM
+bool gridFallbackReported = false;    // All-monitors grid fallback was shown for this mode
+FILETIME customLayoutsFileTime = { 0 };
+
+// Invisible frame insets per window class, styles and DPI, as "class/style/exstyle@dpi"
+std::unordered_map<std::wstring, RECT> frameInsetCache;
+
+// Arrange scheduler: one pending slot served by WM_ARRANGE_REQUEST
+ArrangeScheduler arrangeScheduler;
+
+// Backend of the apply pipelines in WindowApply.h: the Win32 calls that
+// place and activate windows. The self-check's backend moves and stacks
+// real windows but leaves the focus and the tool's own window alone.
+struct Win32ApplyBackend
+{
+    typedef HWND Window;
+    typedef HDWP Batch;
+    bool interactive;           // Activate windows and minimize the tool
+
+    Batch BeginBatch(int count)
+    {
+        return BeginDeferWindowPos(count);
+    }
+
+    bool Defer(Batch& batch, Window hWnd, bool stack, Window hInsertAfter, const RECT& target)
+    {
+        batch = DeferWindowPos(batch, hWnd, stack ? hInsertAfter : NULL, target.left, target.top,
+            target.right - target.left, target.bottom - target.top, stack ? SWP_NOACTIVATE | SWP_SHOWWINDOW : SWP_NOZORDER | SWP_NOACTIVATE);
+        return batch != NULL;
+    }
+
+    void EndBatch(Batch batch)
+    {
+        EndDeferWindowPos(batch);
+    }
+
+    void Place(Window hWnd, bool stack, Window hInsertAfter, const RECT& target)
+    {
+        SetWindowPos(hWnd, stack ? hInsertAfter : NULL, target.left, target.top, target.right - target.left, target.bottom - target.top,
+            stack ? SWP_NOACTIVATE | SWP_SHOWWINDOW : SWP_NOZORDER | SWP_NOACTIVATE);
+    }
+
+    bool IsWindow(Window hWnd)
+    {
+        return ::IsWindow(hWnd) != FALSE;
+    }
+
+    void Activate(Window hWnd)
+    {
+        if (interactive)
+            SetForegroundWindow(hWnd);
+    }
+
+    void StepAside()
+    {
+        if (interactive && IsWindowVisible(hMainWindow))
+            ShowWindow(hMainWindow, SW_MINIMIZE);
+    }
+};
+Win32ApplyBackend liveApplyBackend = { true };
+
+// Live linked resizing of the tiled grid
+TiledLayout tiledLayout;
+LinkedResizeState linkedResize;
+HWINEVENTHOOK hMoveSizeHook = NULL;
 
 // Function prototypes
 LRESULT CALLBACK LowLevelMouseProc(int nCode, WPARAM wParam, LPARAM lParam);
@@ -115,27 +832,154 @@ BOOL CALLBACK MonitorEnumProc(HMONITOR hMonitor, HDC hdcMonitor, LPRECT lprcMoni
 BOOL CALLBACK EnumWindowsProc(HWND hwnd, LPARAM lParam); // New: Callback for EnumWindows
 void UpdateMonitorComboBox();
 void RefreshWindowList();
+void PublishWindowRegistry();
+void RequestWindowRegistryPublish();
+void FlushWindowRegistryPublish();
+const WindowRegistrySnapshot* BeginWindowRegistryRead();
+void EndWindowRegistryRead();
 void MoveSelectedItem(int direction);
+void ReorderWindowRange(int first, const std::vector<int>& order);
+void MoveWindowBlock(const std::vector<int>& positions, int target);
+void SwapWindowPositions(int first, int second);
+void UpdateWindowListRow(int position);
+std::vector<int> GetSelectedPositions();
+void SelectPositions(int first, int count);
 LRESULT CALLBACK ListViewProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp);
 void AdjustControls();
+int PanelPixels(int value);
+void UpdatePanelFont();
+std::wstring GetPanelText(HWND hControl, const std::wstring& saved);
+void CreateControlPanel(HWND hWnd);
+void DestroyControlPanel();
+void ShowControlPanel();
+void HideControlPanel();
+void AddTrayIcon(HWND hWnd);
+void RemoveTrayIcon(HWND hWnd);
+void ShowTrayMenu(HWND hWnd);
+void UpdateFootprintMetrics();
+const wchar_t* InternWindowTitle(const wchar_t* title);
+int FindWindowRecord(const WindowRecords& list, HWND hWnd);
+void AddWindowRecord(WindowRecords& list, HWND hWnd, const wchar_t* title);
+void EraseWindowRecord(WindowRecords& list, size_t position);
+void ClearWindowRecords(WindowRecords& list);
+size_t RemoveClosedWindowRecords(WindowRecords& list, bool notify);
+void ValidateLayoutSettings(LayoutSettings& settings);
+void LoadLayoutSettings(LayoutSettings& settings);
+void SaveLayoutSettings(const LayoutSettings& settings);
+void SetLayoutSettings(const LayoutSettings& settings);
+void CommitPanelSettings(bool showErrors);
+void ReloadSettingsIfChanged();
+void RecordTraceEvent(unsigned char type, DWORD window, int a = 0, int b = 0, int c = 0, int d = 0);
+void RecordTraceRect(unsigned char type, HWND hWnd, const RECT& rect);
+void RecordTraceText(int kind, HWND hWnd, const std::wstring& text);
+void RecordTraceWindowList();
+void RecordTraceArrange(const GridLayoutParams& params);
+bool StartTraceRecording(const std::wstring& path);
+void StopTraceRecording();
+void CALLBACK TraceWinEventProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD idEventThread, DWORD dwmsEventTime);
+bool ReplayTrace(const std::wstring& path, std::wstring& report);
+bool RunLayoutSelfCheck(int cases, unsigned int seed, std::wstring& report);
+void OpenMetricsSharedMemory();
+void CloseMetricsSharedMemory();
+std::string FormatPrometheusMetrics();
+void OpenLayoutSharedMemory();
+void CloseLayoutSharedMemory();
+void PublishLayoutState();
+void ExportMetrics();
 void ArrangeWindows();
+void RequestArrange();
+void RunPendingArrange();
 VOID CALLBACK MsgBoxTimerProc(HWND hwnd, UINT uMsg, UINT_PTR idEvent, DWORD dwTime);
 LRESULT CALLBACK CBTProc(int nCode, WPARAM wParam, LPARAM lParam);
 int TimedMessageBox(HWND hWnd, LPCTSTR lpText, LPCTSTR lpCaption, UINT uType);
 void StartCapturingWindows(HWND hWnd);
+void EndCaptureSession(int reason);
+void FinishCaptureSession();
+int GetSessionCaptureCount();
+void UpdateCaptureStatus();
 void RestoreWindows();
 void ClearCapturedWindows();
 HWND GetWindowUnderCursor();
 void CaptureWindowUnderCursor();
 void CheckAndRemoveClosedWindows();
 void CaptureWindowsByTitle(const std::wstring& title); // New: Function to capture windows by title
-
-// Function to get the window under the cursor
+bool GetGridLayoutParams(GridLayoutParams& params, bool showErrors);
+void GetLayoutMonitors(std::vector<MonitorArea>& monitors);
+bool ComputeMultiMonitorLayout(const GridLayoutParams& params, int numWindows, std::vector<RECT>& cells);
+bool IsGridFallbackLayout(const GridLayoutParams& params);
+bool ComputeLayout(const GridLayoutParams& params, const std::vector<HWND>& windows, std::vector<RECT>& cells, TiledLayout* grid);
+int InternGroupKey(const std::wstring& key);
+int GetWindowGroupId(HWND hWnd);
+const std::wstring& GetWindowGroupKey(HWND hWnd);
+void GetWindowGroupIds(const std::vector<HWND>& windows, std::vector<int>& keys);
+bool ComputeGroupedLayout(const GridLayoutParams& params, const std::vector<HWND>& windows, std::vector<RECT>& cells);
+bool LoadCustomLayouts(const std::wstring& path, std::vector<LayoutProgram>& layouts, int& errorLine);
+void ReloadCustomLayoutsIfChanged();
+bool ComputeCustomLayout(const GridLayoutParams& params, const std::vector<HWND>& windows, std::vector<RECT>& cells);
+void ApplyWindowLayoutBatch(const std::vector<RECT>& cells);
+void RelayoutWindows();
+void EnableAutoTiling(bool enable);
+bool MatchesAutoTileRule(HWND hwnd);
+void CALLBACK AutoTileWinEventProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD idEventThread, DWORD dwmsEventTime);
+void ScheduleAutoTileRelayout();
+std::wstring GetAppFilePath(const wchar_t* fileName);
+bool LoadCaptureRules(const std::wstring& path, std::vector<CaptureRule>& rules, int& errorLine);
+void CompileCaptureRules(const std::vector<CaptureRule>& rules, CaptureRuleTable& table);
+bool ClassifyWindow(const CaptureRuleTable& table, const WindowDescriptor& window, int* matchedRule = NULL);
+bool GetWindowDescriptor(HWND hwnd, const CaptureRuleTable& table, WindowDescriptor& window);
+void CaptureWindowsByRules();
+bool ParseHotkeyChord(const std::wstring& chord, UINT& modifiers, UINT& vk);
+void LoadHotkeyBindings();
+void RegisterHotkeys(HWND hWnd);
+void UnregisterHotkeys(HWND hWnd);
+void DispatchHotkey(UINT modifiers, UINT vk);
+void SwitchWorkspace(int workspace);
+void CycleLayoutMode();
+void FocusNextCapturedWindow();
+void BeginLayoutHistoryEntry();
+void RecordWindowMove(const WindowMove& move);
+void CommitLayoutHistoryEntry();
+void ApplyWindowMoves(const std::vector<WindowMove>& moves, bool forward);
+void ApplyArrangeMoves(const std::vector<WindowMove>& moves);
+void UndoLayout();
+void RedoLayout();
+void BuildSpatialIndex();
+void StartSpatialIndexTracking();
+void StopSpatialIndexTracking();
+void SpatialIndexUpdate(HWND hwnd);
+void SpatialIndexRemove(HWND hwnd);
+HWND SpatialIndexHitTest(POINT pt);
+void SpatialIndexQuery(const RECT& rect, std::vector<HWND>& windows);
+void BenchmarkSpatialIndexQuery(std::mt19937& random, std::vector<double>& samples);
+void BenchmarkWindowRecordPass(std::mt19937& random, std::vector<double>& samples);
+void BenchmarkReferenceRecordPass(std::mt19937& random, std::vector<double>& samples);
+void BenchmarkCaptureRules(std::mt19937& random, std::vector<double>& samples);
+void BenchmarkLayoutHistoryPush(std::mt19937& random, std::vector<double>& samples);
+void BenchmarkLayoutHistoryStep(std::mt19937& random, std::vector<double>& samples);
+bool IsCapturableWindow(HWND hwnd);
+void CALLBACK SpatialIndexWinEventProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD idEventThread, DWORD dwmsEventTime);
+bool AddCapturedWindow(HWND hWnd);
+void CaptureWindowsInRect(const RECT& rect);
+void SetTiledLayout(const TiledLayout& grid, const std::vector<RECT>& cells);
+void EnableLinkedResize(bool enable);
+void CALLBACK LinkedResizeWinEventProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD idEventThread, DWORD dwmsEventTime);
+void BeginLinkedResize(HWND hwnd);
+void ReflowLinkedResize(bool final);
+void EndLinkedResize();
+void OnLinkedResizeFrame();
+BOOL CALLBACK EnumWindowsByRulesProc(HWND hwnd, LPARAM lParam);
+
+// Function to get the window under the cursor. The spatial index answers
+// without system calls; WindowFromPoint is the fallback when it has no window.
 HWND GetWindowUnderCursor()
 {
     POINT pt;
     GetCursorPos(&pt);
-    HWND hWnd = WindowFromPoint(pt);
+    HWND hWnd = SpatialIndexHitTest(pt);
+    if (hWnd)
+        return hWnd;
+
+    hWnd = WindowFromPoint(pt);
 
     // If it's a child window, get the parent window
     while (hWnd && (GetWindowLong(hWnd, GWL_STYLE) & WS_CHILD))
@@ -145,182 +989,832 @@ HWND GetWindowUnderCursor()
     return hWnd;
 }
 
-// Function to capture the window under the cursor
-void CaptureWindowUnderCursor()
+// Function to intern a window title; equal titles share one copy
+const wchar_t* InternWindowTitle(const wchar_t* title)
 {
-    HWND hWnd = GetWindowUnderCursor();
-    if (hWnd && IsWindow(hWnd))
+    auto it = titlePool.titles.find(title);
+    if (it != titlePool.titles.end())
+        return *it;
+
+    size_t length = wcslen(title) + 1;
+    if (titlePool.blockUsed + length > TITLE_POOL_BLOCK_CHARS)
     {
-        // Check if the window is already captured
-        for (const auto& info : windowList)
-        {
-            if (info.hWnd == hWnd)
-            {
-                // Window already captured, no action needed
-                return;
-            }
-        }
+        // Longer titles than a block get a block of their own
+        size_t blockChars = (std::max)(length, static_cast<size_t>(TITLE_POOL_BLOCK_CHARS));
+        titlePool.blocks.emplace_back(new wchar_t[blockChars]);
+        titlePool.blockUsed = 0;
+        titlePool.charsAllocated += blockChars;
+        titlePool.compactDue = true;
+    }
 
-        WindowInfo info;
-        info.hWnd = hWnd;
-        GetWindowRect(hWnd, &info.rect);
+    wchar_t* copy = titlePool.blocks.back().get() + titlePool.blockUsed;
+    wmemcpy(copy, title, length);
+    titlePool.blockUsed += length;
+    titlePool.titles.insert(copy);
+    return copy;
+}
 
-        // Get window title
-        wchar_t title[256];
-        GetWindowText(hWnd, title, sizeof(title) / sizeof(wchar_t));
-        info.windowTitle = title;
+// Function to find the position of a window in a window list, or -1
+int FindWindowRecord(const WindowRecords& list, HWND hWnd)
+{
+    auto it = std::find(list.handles.begin(), list.handles.end(), hWnd);
+    return (it == list.handles.end()) ? -1 : static_cast<int>(it - list.handles.begin());
+}
 
-        // Set index number
-        info.index = static_cast<int>(windowList.size()) + 1;
+// Function to add a window at the end of a window list, with its current position
+void AddWindowRecord(WindowRecords& list, HWND hWnd, const wchar_t* title)
+{
+    RECT rect;
+    GetWindowRect(hWnd, &rect);
+    list.handles.push_back(hWnd);
+    list.rects.push_back(rect);
+    list.titles.push_back(InternWindowTitle(title));
+}
 
-        windowList.push_back(info);
-        windowsCaptured++;
+// Function to remove the window at a position from a window list
+void EraseWindowRecord(WindowRecords& list, size_t position)
+{
+    list.handles.erase(list.handles.begin() + position);
+    list.rects.erase(list.rects.begin() + position);
+    list.titles.erase(list.titles.begin() + position);
+}
 
-        // Refresh the ListView
-        RefreshWindowList();
+// Function to empty a window list
+void ClearWindowRecords(WindowRecords& list)
+{
+    list.handles.clear();
+    list.rects.clear();
+    list.titles.clear();
+}
 
-        if (windowsCaptured >= windowsToCapture)
+// Function to drop the closed windows from a window list in one pass,
+// optionally telling the user about each; returns how many were dropped
+size_t RemoveClosedWindowRecords(WindowRecords& list, bool notify)
+{
+    size_t sessionBase = captureSession.baseCount;
+    size_t kept = 0;
+    for (size_t i = 0; i < list.handles.size(); ++i)
+    {
+        if (!IsWindow(list.handles[i]))
         {
-            // Capturing complete
-            captureCompleted = true;
+            if (notify)
+            {
+                std::wstring message = std::wstring(L"Window has been closed: ") + list.titles[i];
+                TimedMessageBox(NULL, message.c_str(), L"Info", MB_OK);
+            }
+            CountMetric(METRIC_WINDOWS_SKIPPED_CLOSED);
 
-            // Post a message to unhook the hooks after the hook procedure returns
-            PostMessage(hMainWindow, WM_UNHOOK_HOOKS, 0, 0);
+            // A capture session counts its own windows past the base
+            if (&list == &windowList && i < sessionBase)
+                captureSession.baseCount--;
+            continue;
         }
+
+        if (kept != i)
+        {
+            list.handles[kept] = list.handles[i];
+            list.rects[kept] = list.rects[i];
+            list.titles[kept] = list.titles[i];
+        }
+        ++kept;
     }
-    else
-    {
-        // Invalid window, no action needed
-    }
+
+    size_t removed = list.handles.size() - kept;
+    list.handles.resize(kept);
+    list.rects.resize(kept);
+    list.titles.resize(kept);
+    return removed;
 }
 
-// Mouse hook callback
-LRESULT CALLBACK LowLevelMouseProc(int nCode, WPARAM wParam, LPARAM lParam)
+// The window record as it was before the parallel arrays, with a heap
+// string per window; kept only as the reference for the record benchmarks
+struct ReferenceWindowInfo
 {
-    if (nCode == HC_ACTION)
+    HWND hWnd;
+    RECT rect;
+    std::wstring windowTitle;
+    int index;
+};
+
+// Function to make SELFCHECK_RECORD_WINDOWS synthetic windows for the
+// record benchmarks: titles from a few hundred applications, and a target
+// rectangle that differs from the current one for about half of them
+static void MakeBenchmarkWindows(std::mt19937& random, std::vector<RECT>& rects, std::vector<RECT>& targets, std::vector<std::wstring>& titles)
+{
+    std::uniform_int_distribution<int> positionDistribution(0, 3000);
+    std::uniform_int_distribution<int> appDistribution(0, 199);
+    std::uniform_int_distribution<int> moveDistribution(0, 1);
+    for (int i = 0; i < SELFCHECK_RECORD_WINDOWS; ++i)
     {
-        if (wParam == WM_LBUTTONDOWN)
+        RECT rect;
+        rect.left = positionDistribution(random);
+        rect.top = positionDistribution(random);
+        rect.right = rect.left + 800;
+        rect.bottom = rect.top + 600;
+        rects.push_back(rect);
+        if (moveDistribution(random))
         {
-            if (isCapturing)
-            {
-                // Capture window under the cursor
-                CaptureWindowUnderCursor();
-
-                // Suppress the click event
-                return 1; // Stop processing this click
-            }
-            else if (captureCompleted)
-            {
-                // Suppress the click event
-                return 1; // Stop processing this click
-            }
+            rect.left++;
+            rect.right++;
         }
+        targets.push_back(rect);
+
+        wchar_t title[64];
+        swprintf_s(title, 64, L"Document %d - Application %d", i % 7, appDistribution(random));
+        titles.push_back(title);
     }
-    return CallNextHookEx(hMouseHook, nCode, wParam, lParam);
 }
 
-// Keyboard hook callback
-LRESULT CALLBACK LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam)
+// Function to time the restore diff over SELFCHECK_RECORD_WINDOWS window
+// records, for the self-check: each record's rectangle is compared with
+// its target and the changed windows are listed. With the parallel arrays
+// the pass streams through handles and rectangles only.
+void BenchmarkWindowRecordPass(std::mt19937& random, std::vector<double>& samples)
 {
-    if (nCode == HC_ACTION && isCapturing)
+    std::vector<RECT> rects, targets;
+    std::vector<std::wstring> titles;
+    MakeBenchmarkWindows(random, rects, targets, titles);
+    WindowRecords list;
+    for (int i = 0; i < SELFCHECK_RECORD_WINDOWS; ++i)
     {
-        KBDLLHOOKSTRUCT* pkbhs = (KBDLLHOOKSTRUCT*)lParam;
-        if (wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN)
+        list.handles.push_back(reinterpret_cast<HWND>(static_cast<INT_PTR>(i + 1)));
+        list.rects.push_back(rects[i]);
+        list.titles.push_back(InternWindowTitle(titles[i].c_str()));
+    }
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    std::vector<WindowMove> moves;
+    moves.reserve(SELFCHECK_RECORD_WINDOWS);
+    for (int pass = 0; pass < SELFCHECK_RECORD_PASSES; ++pass)
+    {
+        LARGE_INTEGER start, end;
+        QueryPerformanceCounter(&start);
+        moves.clear();
+        for (size_t i = 0; i < list.handles.size(); ++i)
         {
-            if (pkbhs->vkCode == VK_ESCAPE)
+            if (!EqualRect(&list.rects[i], &targets[i]))
             {
-                captureCompleted = true;
-
-                // Post a message to unhook the hooks after the hook procedure returns
-                PostMessage(hMainWindow, WM_UNHOOK_HOOKS, 0, 0);
-
-                // Do not call MessageBox here
-
-                return 1; // Prevent further processing
+                WindowMove move = { list.handles[i], list.rects[i], targets[i] };
+                moves.push_back(move);
             }
         }
+        QueryPerformanceCounter(&end);
+        samples.push_back((end.QuadPart - start.QuadPart) * 1e6 / frequency.QuadPart);
     }
-    return CallNextHookEx(hKeyboardHook, nCode, wParam, lParam);
 }
-LRESULT CALLBACK GlobalKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam)
+
+// Function to time the same pass over the reference record layout, where
+// every record drags its title string through the cache
+void BenchmarkReferenceRecordPass(std::mt19937& random, std::vector<double>& samples)
 {
-    if (nCode == HC_ACTION)
+    std::vector<RECT> rects, targets;
+    std::vector<std::wstring> titles;
+    MakeBenchmarkWindows(random, rects, targets, titles);
+    std::vector<ReferenceWindowInfo> list;
+    for (int i = 0; i < SELFCHECK_RECORD_WINDOWS; ++i)
     {
-        KBDLLHOOKSTRUCT* pkbhs = (KBDLLHOOKSTRUCT*)lParam;
-        if (wParam == WM_KEYDOWN && pkbhs->vkCode == 'J' && GetAsyncKeyState(VK_CONTROL) & 0x8000)
+        ReferenceWindowInfo info = { reinterpret_cast<HWND>(static_cast<INT_PTR>(i + 1)), rects[i], titles[i], i };
+        list.push_back(info);
+    }
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    std::vector<WindowMove> moves;
+    moves.reserve(SELFCHECK_RECORD_WINDOWS);
+    for (int pass = 0; pass < SELFCHECK_RECORD_PASSES; ++pass)
+    {
+        LARGE_INTEGER start, end;
+        QueryPerformanceCounter(&start);
+        moves.clear();
+        for (size_t i = 0; i < list.size(); ++i)
         {
-            //OutputDebugString(L"Ctrl + J detected\n");
-            ArrangeWindows();
-            return 1; // Prevent further processing
+            if (!EqualRect(&list[i].rect, &targets[i]))
+            {
+                WindowMove move = { list[i].hWnd, list[i].rect, targets[i] };
+                moves.push_back(move);
+            }
         }
+        QueryPerformanceCounter(&end);
+        samples.push_back((end.QuadPart - start.QuadPart) * 1e6 / frequency.QuadPart);
     }
-    return CallNextHookEx(hGlobalKeyboardHook, nCode, wParam, lParam);
 }
 
-// Function to start capturing windows
-void StartCapturingWindows(HWND hWnd)
+// Function to add a window to the captured list; returns false if it is
+// invalid or already captured
+bool AddCapturedWindow(HWND hWnd)
 {
-    if (isCapturing)
-    {
-        TimedMessageBox(NULL, L"Window capturing is already in progress.", L"Info", MB_OK);
-        return;
-    }
+    if (!hWnd || !IsWindow(hWnd))
+        return false;
 
-    // Get the number of windows to capture
-    wchar_t buffer[10];
-    GetWindowText(hNumWindowsEdit, buffer, 10);
-    windowsToCapture = _wtoi(buffer);
-    if (windowsToCapture <= 0)
-    {
-        TimedMessageBox(NULL, L"Please enter a valid number of windows to capture.", L"Error", MB_OK);
-        return;
-    }
+    // Check if the window is already captured
+    if (FindWindowRecord(windowList, hWnd) >= 0)
+        return false;
 
-    // Initialize variables
-    isCapturing = true;
-    captureCompleted = false;
-    windowsCaptured = 0;
+    // Get window title
+    wchar_t title[256];
+    GetWindowText(hWnd, title, sizeof(title) / sizeof(wchar_t));
 
-    // Clear previous window list
-    windowList.clear();
-    ListView_DeleteAllItems(hListView);
+    AddWindowRecord(windowList, hWnd, title);
+    CountMetric(METRIC_CAPTURES);
+    return true;
+}
 
-    // Set mouse hook
-    hMouseHook = SetWindowsHookEx(WH_MOUSE_LL, LowLevelMouseProc, hInstance, 0);
-    // Set keyboard hook
-    hKeyboardHook = SetWindowsHookEx(WH_KEYBOARD_LL, LowLevelKeyboardProc, hInstance, 0);
+// Function to get the number of windows the current session has added
+int GetSessionCaptureCount()
+{
+    return windowList.handles.size() > captureSession.baseCount ?
+        static_cast<int>(windowList.handles.size() - captureSession.baseCount) : 0;
+}
 
-    if (hMouseHook == NULL || hKeyboardHook == NULL)
+// Function to end the capture once enough windows have been captured
+static void CheckCaptureCompleted()
+{
+    UpdateCaptureStatus();
+    if (captureSession.target > 0 && GetSessionCaptureCount() >= captureSession.target)
+        EndCaptureSession(CAPTURE_END_COMPLETED);
+}
+
+// Function to tell a click from a lasso drag between button-down and button-up
+static bool IsCaptureClick(POINT start, POINT end)
+{
+    return abs(end.x - start.x) <= GetSystemMetrics(SM_CXDRAG) && abs(end.y - start.y) <= GetSystemMetrics(SM_CYDRAG);
+}
+
+// Function to get the rectangle a lasso drag covers, both corners included
+static RECT GetLassoRect(POINT start, POINT end)
+{
+    RECT lasso = { (std::min)(end.x, start.x), (std::min)(end.y, start.y),
+        (std::max)(end.x, start.x) + 1, (std::max)(end.y, start.y) + 1 };
+    return lasso;
+}
+
+// Function to list the indexed windows a lasso touches in capture order,
+// from top to bottom and left to right
+static void GetLassoWindows(const RECT& rect, std::vector<HWND>& windows)
+{
+    SpatialIndexQuery(rect, windows);
+
+    std::vector<std::pair<RECT, HWND>> ordered;
+    for (HWND hWnd : windows)
     {
-        TimedMessageBox(NULL, L"Cannot set hooks.", L"Error", MB_OK);
-        isCapturing = false;
+        ordered.push_back(std::make_pair(spatialIndex.entries[spatialIndex.entryOf[hWnd]].rect, hWnd));
     }
-    else
+    std::sort(ordered.begin(), ordered.end(), [](const std::pair<RECT, HWND>& a, const std::pair<RECT, HWND>& b)
+    {
+        return (a.first.top != b.first.top) ? a.first.top < b.first.top : a.first.left < b.first.left;
+    });
+
+    for (size_t i = 0; i < ordered.size(); ++i)
     {
-        TimedMessageBox(NULL, L"Click on the windows you wish to capture. Press ESC to cancel.", L"Info", MB_OK);
+        windows[i] = ordered[i].second;
     }
 }
 
-// *** New Function: Capture Windows by Title ***
-void CaptureWindowsByTitle(const std::wstring& title)
+// Function to capture the window under the cursor, or take it out of the
+// list if it is already captured
+void CaptureWindowUnderCursor()
 {
-    if (title.empty())
-    {
-        TimedMessageBox(NULL, L"Please enter a window title to capture.", L"Error", MB_OK);
+    ScopedLatency latency(METRIC_CAPTURE_LATENCY);
+    HWND hWnd = GetWindowUnderCursor();
+    if (!hWnd || hWnd == hMainWindow)
         return;
-    }
-
-    // Clear previous window list
-    windowList.clear();
-    ListView_DeleteAllItems(hListView);
+
+    int position = FindWindowRecord(windowList, hWnd);
+    if (position >= 0)
+    {
+        // Taking out a window captured before this session shrinks the
+        // appended base, not the session's own count
+        if (static_cast<size_t>(position) < captureSession.baseCount)
+            captureSession.baseCount--;
+        EraseWindowRecord(windowList, position);
+        tiledLayout = TiledLayout();
+        RefreshWindowList();
+        UpdateCaptureStatus();
+    }
+    else if (IsCapturableWindow(hWnd) && AddCapturedWindow(hWnd))
+    {
+        // Refresh the ListView
+        RefreshWindowList();
+        CheckCaptureCompleted();
+    }
+}
+
+// Function to capture every window touched by a lasso rectangle, numbered
+// from top to bottom and left to right, until the session's target is met
+void CaptureWindowsInRect(const RECT& rect)
+{
+    ScopedLatency latency(METRIC_CAPTURE_LATENCY);
+    std::vector<HWND> windows;
+    GetLassoWindows(rect, windows);
+
+    bool listChanged = false;
+    for (HWND hWnd : windows)
+    {
+        if (captureSession.target > 0 && GetSessionCaptureCount() >= captureSession.target)
+            break;
+        if (hWnd != hMainWindow && IsCapturableWindow(hWnd) && AddCapturedWindow(hWnd))
+            listChanged = true;
+    }
+
+    if (listChanged)
+    {
+        RefreshWindowList();
+        CheckCaptureCompleted();
+    }
+}
+
+// Function to check whether a window can be captured: a top-level window
+// Alt+Tab would list (visible, not a tool window, not owned unless it asks
+// for a taskbar button) that is not part of the shell, i.e. the desktop,
+// its wallpaper workers or a taskbar
+bool IsCapturableWindow(HWND hwnd)
+{
+    if (!IsWindowVisible(hwnd) || hwnd == GetShellWindow())
+        return false;
+
+    LONG exStyle = GetWindowLong(hwnd, GWL_EXSTYLE);
+    if (!(exStyle & WS_EX_APPWINDOW) && ((exStyle & WS_EX_TOOLWINDOW) || GetWindow(hwnd, GW_OWNER) != NULL))
+        return false;
+
+    wchar_t className[32];
+    if (GetClassName(hwnd, className, sizeof(className) / sizeof(wchar_t)) == 0)
+        return false;
+    return wcscmp(className, L"WorkerW") != 0 && wcscmp(className, L"Progman") != 0 &&
+        wcscmp(className, L"Shell_TrayWnd") != 0 && wcscmp(className, L"Shell_SecondaryTrayWnd") != 0;
+}
+
+// Function to check whether a window belongs in the spatial index. Only
+// windows that can be captured are indexed, so a lasso over the desktop
+// or the taskbar picks up nothing.
+static bool IsSpatialIndexCandidate(HWND hwnd, RECT& rect)
+{
+    // Child windows report location changes too; reject them first
+    if (GetAncestor(hwnd, GA_ROOT) != hwnd || IsIconic(hwnd) || !IsCapturableWindow(hwnd))
+        return false;
+
+    // Click-through and cloaked windows (e.g. on another virtual desktop) are never hit
+    if (GetWindowLong(hwnd, GWL_EXSTYLE) & WS_EX_TRANSPARENT)
+        return false;
+    DWORD cloaked = 0;
+    if (SUCCEEDED(DwmGetWindowAttribute(hwnd, DWMWA_CLOAKED, &cloaked, sizeof(cloaked))) && cloaked)
+        return false;
+
+    return GetWindowRect(hwnd, &rect) && rect.right > rect.left && rect.bottom > rect.top;
+}
+
+// Callback for EnumWindows that collects the windows in z-order, topmost first
+static BOOL CALLBACK SpatialIndexEnumProc(HWND hwnd, LPARAM lParam)
+{
+    reinterpret_cast<std::vector<HWND>*>(lParam)->push_back(hwnd);
+    return TRUE;
+}
+
+// Function to rebuild the spatial index from scratch
+void BuildSpatialIndex()
+{
+    SpatialIndex& index = spatialIndex;
+    RECT bounds;
+    bounds.left = GetSystemMetrics(SM_XVIRTUALSCREEN);
+    bounds.top = GetSystemMetrics(SM_YVIRTUALSCREEN);
+    bounds.right = bounds.left + GetSystemMetrics(SM_CXVIRTUALSCREEN);
+    bounds.bottom = bounds.top + GetSystemMetrics(SM_CYVIRTUALSCREEN);
+    ResetSpatialIndex(index, bounds);
+
+    std::vector<HWND> windows;
+    EnumWindows(SpatialIndexEnumProc, reinterpret_cast<LPARAM>(&windows));
+
+    // EnumWindows lists windows from the top of the z-order down
+    index.topZOrder = static_cast<unsigned int>(windows.size());
+    for (size_t i = 0; i < windows.size(); ++i)
+    {
+        RECT rect;
+        if (IsSpatialIndexCandidate(windows[i], rect))
+            AppendSpatialEntry(index, windows[i], rect, index.topZOrder - static_cast<unsigned int>(i));
+    }
+}
+
+// Function to insert or move a window after it was shown, moved or resized
+void SpatialIndexUpdate(HWND hwnd)
+{
+    RECT rect;
+    if (!IsSpatialIndexCandidate(hwnd, rect))
+    {
+        SpatialIndexRemove(hwnd);
+        return;
+    }
+    PlaceSpatialEntry(spatialIndex, hwnd, rect);
+}
+
+// Function to drop a hidden, minimized or destroyed window
+void SpatialIndexRemove(HWND hwnd)
+{
+    RemoveSpatialEntry(spatialIndex, hwnd);
+}
+
+// Function to find the topmost indexed window containing a point
+HWND SpatialIndexHitTest(POINT pt)
+{
+    return HitTestSpatialIndex(spatialIndex, pt.x, pt.y);
+}
+
+// Function to list every indexed window intersecting a rectangle
+void SpatialIndexQuery(const RECT& rect, std::vector<HWND>& windows)
+{
+    QuerySpatialIndex(spatialIndex, rect, windows);
+}
+
+// Function to time lasso queries against a synthetic desktop of
+// SELFCHECK_SPATIAL_WINDOWS windows on an 8K virtual screen, for the
+// self-check. The live index is set aside while it runs.
+void BenchmarkSpatialIndexQuery(std::mt19937& random, std::vector<double>& samples)
+{
+    SpatialIndex saved;
+    std::swap(saved, spatialIndex);
+
+    RECT bounds = { 0, 0, 7680, 4320 };
+    ResetSpatialIndex(spatialIndex, bounds);
+    std::uniform_int_distribution<int> xDistribution(0, 7679);
+    std::uniform_int_distribution<int> yDistribution(0, 4319);
+    std::uniform_int_distribution<int> widthDistribution(200, 1920);
+    std::uniform_int_distribution<int> heightDistribution(150, 1080);
+    for (int i = 0; i < SELFCHECK_SPATIAL_WINDOWS; ++i)
+    {
+        RECT rect;
+        rect.left = xDistribution(random);
+        rect.top = yDistribution(random);
+        rect.right = rect.left + widthDistribution(random);
+        rect.bottom = rect.top + heightDistribution(random);
+        PlaceSpatialEntry(spatialIndex, reinterpret_cast<HWND>(static_cast<INT_PTR>(i + 1)), rect);
+    }
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    std::vector<HWND> windows;
+    for (int i = 0; i < SELFCHECK_SPATIAL_QUERIES; ++i)
+    {
+        RECT lasso;
+        lasso.left = xDistribution(random);
+        lasso.top = yDistribution(random);
+        lasso.right = lasso.left + widthDistribution(random);
+        lasso.bottom = lasso.top + heightDistribution(random);
+
+        LARGE_INTEGER start, end;
+        QueryPerformanceCounter(&start);
+        SpatialIndexQuery(lasso, windows);
+        QueryPerformanceCounter(&end);
+        samples.push_back((end.QuadPart - start.QuadPart) * 1e6 / frequency.QuadPart);
+    }
+
+    std::swap(saved, spatialIndex);
+}
+
+// WinEvent callback that keeps the spatial index in sync with the desktop
+void CALLBACK SpatialIndexWinEventProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD idEventThread, DWORD dwmsEventTime)
+{
+    ScopedLatency latency(METRIC_HOOK_CALLBACK_LATENCY);
+    if (hwnd == NULL || idObject != OBJID_WINDOW || idChild != CHILDID_SELF)
+        return;
+
+    switch (event)
+    {
+    case EVENT_OBJECT_SHOW:
+    case EVENT_OBJECT_LOCATIONCHANGE:
+        SpatialIndexUpdate(hwnd);
+        break;
+    case EVENT_OBJECT_HIDE:
+    case EVENT_OBJECT_DESTROY:
+        SpatialIndexRemove(hwnd);
+        break;
+    case EVENT_SYSTEM_FOREGROUND:
+    {
+        // The activated window moves to the top of the z-order
+        SpatialIndexUpdate(hwnd);
+        RaiseSpatialEntry(spatialIndex, hwnd);
+    }
+    break;
+    default:
+        break;
+    }
+}
+
+// Function to build the index and follow window changes incrementally
+void StartSpatialIndexTracking()
+{
+    BuildSpatialIndex();
+    hSpatialIndexHooks[0] = SetWinEventHook(EVENT_OBJECT_DESTROY, EVENT_OBJECT_HIDE, NULL,
+        SpatialIndexWinEventProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+    hSpatialIndexHooks[1] = SetWinEventHook(EVENT_OBJECT_LOCATIONCHANGE, EVENT_OBJECT_LOCATIONCHANGE, NULL,
+        SpatialIndexWinEventProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+    hSpatialIndexHooks[2] = SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, NULL,
+        SpatialIndexWinEventProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+}
+
+// Function to stop tracking and release the index
+void StopSpatialIndexTracking()
+{
+    for (auto& hHook : hSpatialIndexHooks)
+    {
+        if (hHook)
+        {
+            UnhookWinEvent(hHook);
+            hHook = NULL;
+        }
+    }
+    spatialIndex.buckets.clear();
+    spatialIndex.entries.clear();
+    spatialIndex.freeEntries.clear();
+    spatialIndex.entryOf.clear();
+}
+
+// Mouse hook callback
+LRESULT CALLBACK LowLevelMouseProc(int nCode, WPARAM wParam, LPARAM lParam)
+{
+    ScopedLatency latency(METRIC_HOOK_CALLBACK_LATENCY);
+    if (nCode == HC_ACTION)
+    {
+        MSLLHOOKSTRUCT* pmhs = (MSLLHOOKSTRUCT*)lParam;
+        if (wParam == WM_LBUTTONUP)
+            RecordTraceEvent(TRACE_MOUSE_UP, 0, pmhs->pt.x, pmhs->pt.y);
+
+        if (wParam == WM_LBUTTONDOWN && captureSession.state == CAPTURE_ACTIVE)
+        {
+            // Clicks on the tool itself go through, so the capture button
+            // can end the session
+            HWND hTarget = WindowFromPoint(pmhs->pt);
+            bool onTool = hTarget && GetAncestor(hTarget, GA_ROOT) == hMainWindow;
+            RecordTraceEvent(TRACE_MOUSE_DOWN, 0, pmhs->pt.x, pmhs->pt.y, onTool ? 1 : 0);
+            if (onTool)
+                return CallNextHookEx(hMouseHook, nCode, wParam, lParam);
+
+            // Start a click or a lasso; the window is captured on release
+            captureSession.buttonDown = true;
+            captureSession.buttonDownPoint = pmhs->pt;
+
+            // Suppress the click event
+            return 1; // Stop processing this click
+        }
+        else if (wParam == WM_LBUTTONUP && captureSession.buttonDown)
+        {
+            captureSession.buttonDown = false;
+            if (captureSession.state == CAPTURE_ACTIVE)
+            {
+                if (IsCaptureClick(captureSession.buttonDownPoint, pmhs->pt))
+                {
+                    // Capture or release the window under the cursor
+                    CaptureWindowUnderCursor();
+                }
+                else
+                {
+                    // Capture every window the dragged rectangle touches
+                    CaptureWindowsInRect(GetLassoRect(captureSession.buttonDownPoint, pmhs->pt));
+                }
+            }
+
+            // The matching button-down was suppressed, so suppress this too
+            return 1;
+        }
+    }
+    return CallNextHookEx(hMouseHook, nCode, wParam, lParam);
+}
+
+// Keyboard hook callback
+LRESULT CALLBACK LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam)
+{
+    if (nCode == HC_ACTION && captureSession.state == CAPTURE_ACTIVE)
+    {
+        // Only keys seen during a session are timed; the pass-through is not our work
+        ScopedLatency latency(METRIC_HOOK_CALLBACK_LATENCY);
+        KBDLLHOOKSTRUCT* pkbhs = (KBDLLHOOKSTRUCT*)lParam;
+        if (wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN)
+        {
+            if (pkbhs->vkCode == VK_ESCAPE || pkbhs->vkCode == VK_RETURN)
+            {
+                RecordTraceEvent(TRACE_HOTKEY, 0, 0, pkbhs->vkCode);
+
+                // Do not call MessageBox here
+                EndCaptureSession(pkbhs->vkCode == VK_ESCAPE ? CAPTURE_END_CANCELLED : CAPTURE_END_FINISHED);
+                return 1; // Prevent further processing
+            }
+        }
+    }
+    return CallNextHookEx(hKeyboardHook, nCode, wParam, lParam);
+}
+
+// Global keyboard hook, only installed for chords RegisterHotKey rejected.
+// Unbound keys are rejected by one table load before any modifier query,
+// and before the latency timer, so typing does not pay for the histogram.
+LRESULT CALLBACK GlobalKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam)
+{
+    if (nCode == HC_ACTION)
+    {
+        KBDLLHOOKSTRUCT* pkbhs = (KBDLLHOOKSTRUCT*)lParam;
+        UINT vk = pkbhs->vkCode & 0xFF;
+        if (hotkeyHookKeys[vk])
+        {
+            ScopedLatency latency(METRIC_HOOK_CALLBACK_LATENCY);
+            bool down = (wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN);
+            UINT modifiers = 0;
+            if (down)
+            {
+                if (GetAsyncKeyState(VK_MENU) & 0x8000)
+                    modifiers |= MOD_ALT;
+                if (GetAsyncKeyState(VK_CONTROL) & 0x8000)
+                    modifiers |= MOD_CONTROL;
+                if (GetAsyncKeyState(VK_SHIFT) & 0x8000)
+                    modifiers |= MOD_SHIFT;
+                if ((GetAsyncKeyState(VK_LWIN) | GetAsyncKeyState(VK_RWIN)) & 0x8000)
+                    modifiers |= MOD_WIN;
+            }
+
+            switch (FilterHotkeyEvent(hotkeyKeyState, vk, down, hotkeyTable[modifiers & 0xF][vk].viaHook))
+            {
+            case HOTKEY_EVENT_DISPATCH:
+                // Run the action after the hook returns, the same way a registered hotkey arrives
+                PostMessage(hMainWindow, WM_HOTKEY, 0, MAKELPARAM(modifiers, vk));
+                return 1; // Prevent further processing
+            case HOTKEY_EVENT_SWALLOW:
+                return 1;
+            default:
+                break;
+            }
+        }
+    }
+    return CallNextHookEx(hGlobalKeyboardHook, nCode, wParam, lParam);
+}
+
+// Function to remove the capture hooks
+static void RemoveCaptureHooks()
+{
+    if (hMouseHook)
+    {
+        UnhookWindowsHookEx(hMouseHook);
+        hMouseHook = NULL;
+    }
+    if (hKeyboardHook)
+    {
+        UnhookWindowsHookEx(hKeyboardHook);
+        hKeyboardHook = NULL;
+    }
+}
+
+// Function to show the session progress on the capture button
+void UpdateCaptureStatus()
+{
+    if (!hCaptureButton)
+        return;
+
+    if (captureSession.state != CAPTURE_ACTIVE)
+    {
+        SetWindowText(hCaptureButton, L"Capture Windows");
+        return;
+    }
+
+    wchar_t text[64];
+    if (captureSession.target > 0)
+        swprintf_s(text, 64, L"Finish (%d/%d)", GetSessionCaptureCount(), captureSession.target);
+    else
+        swprintf_s(text, 64, L"Finish (%d)", GetSessionCaptureCount());
+    SetWindowText(hCaptureButton, text);
+}
+
+// Function to start capturing windows. The session runs alongside the rest
+// of the tool: clicks capture or release windows until the count is reached,
+// Enter or the capture button finishes, Esc cancels or the timeout elapses.
+void StartCapturingWindows(HWND hWnd)
+{
+    if (captureSession.state == CAPTURE_ACTIVE)
+    {
+        EndCaptureSession(CAPTURE_END_FINISHED);
+        FinishCaptureSession();
+        return;
+    }
+    if (captureSession.state != CAPTURE_IDLE)
+        return;
+
+    // Get the number of windows to capture; empty or 0 captures until Enter
+    int target = _wtoi(GetPanelText(hNumWindowsEdit, panelState.numWindows).c_str());
+    if (target < 0)
+    {
+        TimedMessageBox(NULL, L"Please enter a valid number of windows to capture.", L"Error", MB_OK);
+        return;
+    }
+
+    // Initialize the session
+    captureSession = CaptureSession();
+    captureSession.target = target;
+    captureSession.state = CAPTURE_ACTIVE;
+
+    // Clear previous window list unless appending to it
+    if (!captureAppend)
+    {
+        ClearWindowRecords(windowList);
+        tiledLayout = TiledLayout();
+        ListView_DeleteAllItems(hListView);
+    }
+    captureSession.baseCount = windowList.handles.size();
+
+    // Index the desktop for hit-testing and lasso capture
+    StartSpatialIndexTracking();
+
+    // Set mouse hook
+    hMouseHook = SetWindowsHookEx(WH_MOUSE_LL, LowLevelMouseProc, hInstance, 0);
+    // Set keyboard hook
+    hKeyboardHook = SetWindowsHookEx(WH_KEYBOARD_LL, LowLevelKeyboardProc, hInstance, 0);
+
+    if (hMouseHook == NULL || hKeyboardHook == NULL)
+    {
+        RemoveCaptureHooks();
+        StopSpatialIndexTracking();
+        captureSession.state = CAPTURE_IDLE;
+        RequestWindowRegistryPublish();
+        TimedMessageBox(NULL, L"Cannot set hooks.", L"Error", MB_OK);
+        return;
+    }
+    RecordTraceEvent(TRACE_CAPTURE_START, 0, target, captureAppend ? 1 : 0);
+    RequestWindowRegistryPublish();
+    UpdateCaptureStatus();
+
+    // End the session on its own if a timeout is configured
+    UINT timeoutSeconds = GetPrivateProfileInt(L"Capture", L"TimeoutSeconds", 0, GetAppFilePath(SETTINGS_FILE).c_str());
+    if (timeoutSeconds > 0)
+        SetTimer(hMainWindow, ID_CAPTURE_TIMEOUT_TIMER, timeoutSeconds * 1000, NULL);
+}
+
+// Function to end the capture session. Hook callbacks cannot remove their
+// own hooks, so the session stops reacting to input right away and the hooks
+// are removed once the hook procedure has returned.
+void EndCaptureSession(int reason)
+{
+    if (captureSession.state != CAPTURE_ACTIVE)
+        return;
+
+    captureSession.state = CAPTURE_ENDING;
+    captureSession.endReason = reason;
+    RecordTraceEvent(TRACE_CAPTURE_END, 0, reason);
+    KillTimer(hMainWindow, ID_CAPTURE_TIMEOUT_TIMER);
+
+    // Post a message to unhook the hooks after the hook procedure returns
+    PostMessage(hMainWindow, WM_UNHOOK_HOOKS, 0, 0);
+}
+
+// Function to remove the hooks of an ended session and report the result
+void FinishCaptureSession()
+{
+    if (captureSession.state != CAPTURE_ENDING)
+        return;
+
+    RemoveCaptureHooks();
+    StopSpatialIndexTracking();
+    captureSession.state = CAPTURE_IDLE;
+    captureSession.buttonDown = false;
+    RequestWindowRegistryPublish();
+    UpdateCaptureStatus();
+
+    // Display the appropriate MessageBox
+    wchar_t message[128];
+    switch (captureSession.endReason)
+    {
+    case CAPTURE_END_COMPLETED:
+        TimedMessageBox(NULL, L"All windows have been captured.", L"Info", MB_OK);
+        break;
+    case CAPTURE_END_FINISHED:
+        swprintf_s(message, 128, L"%d windows have been captured.", GetSessionCaptureCount());
+        TimedMessageBox(NULL, message, L"Info", MB_OK);
+        break;
+    case CAPTURE_END_TIMEOUT:
+        swprintf_s(message, 128, L"Window capturing timed out after %d windows.", GetSessionCaptureCount());
+        TimedMessageBox(NULL, message, L"Info", MB_OK);
+        break;
+    default:
+        TimedMessageBox(NULL, L"Window capturing has been canceled.", L"Info", MB_OK);
+        break;
+    }
+}
+
+// *** New Function: Capture Windows by Title ***
+void CaptureWindowsByTitle(const std::wstring& title)
+{
+    if (title.empty())
+    {
+        TimedMessageBox(NULL, L"Please enter a window title to capture.", L"Error", MB_OK);
+        return;
+    }
+    ScopedLatency latency(METRIC_CAPTURE_LATENCY);
+
+    // Clear previous window list
+    ClearWindowRecords(windowList);
+    tiledLayout = TiledLayout();
+    ListView_DeleteAllItems(hListView);
 
     // Enumerate all top-level windows and capture those with matching title
     EnumWindows(EnumWindowsProc, reinterpret_cast<LPARAM>(&title));
 
     // Refresh the ListView to display the updated windowList
     RefreshWindowList();
+    latency.Stop();
 
-    if (windowList.empty())
+    if (windowList.handles.empty())
     {
         TimedMessageBox(NULL, L"No windows found with the specified title.", L"Info", MB_OK);
     }
@@ -333,589 +1827,4586 @@ void CaptureWindowsByTitle(const std::wstring& title)
 // *** New Callback Function: EnumWindowsProc ***
 BOOL CALLBACK EnumWindowsProc(HWND hwnd, LPARAM lParam)
 {
-    std::wstring targetTitle = *(std::wstring*)lParam;
+    const std::wstring& targetTitle = *(const std::wstring*)lParam;
 
     // Get window title
     wchar_t windowTitle[256];
     GetWindowText(hwnd, windowTitle, sizeof(windowTitle) / sizeof(wchar_t));
-    std::wstring currentTitle = windowTitle;
 
-    // Check if the window title matches (case-insensitive)
-    if (_wcsicmp(currentTitle.c_str(), targetTitle.c_str()) == 0)
+    // Check if the window title matches (case-insensitive)
+    if (_wcsicmp(windowTitle, targetTitle.c_str()) == 0)
+    {
+        // Check if the window is already captured
+        if (FindWindowRecord(windowList, hwnd) >= 0)
+            return TRUE;
+
+        // Add to windowList
+        AddWindowRecord(windowList, hwnd, windowTitle);
+    }
+
+    return TRUE; // Continue enumeration
+}
+
+// Function to build the path of a file that lives next to the executable
+std::wstring GetAppFilePath(const wchar_t* fileName)
+{
+    wchar_t modulePath[MAX_PATH];
+    DWORD length = GetModuleFileName(NULL, modulePath, MAX_PATH);
+    std::wstring path(modulePath, length);
+    size_t slash = path.find_last_of(L"\\/");
+    path = (slash == std::wstring::npos) ? std::wstring() : path.substr(0, slash + 1);
+    return path + fileName;
+}
+
+// Function to lower-case a string for case-insensitive matching
+static std::wstring ToLower(const std::wstring& text)
+{
+    std::wstring result(text);
+    for (auto& ch : result)
+    {
+        ch = static_cast<wchar_t>(towlower(ch));
+    }
+    return result;
+}
+
+// Function to match a lower-case text against a lower-case '*' wildcard pattern
+static bool WildcardMatch(const wchar_t* pattern, const wchar_t* text)
+{
+    const wchar_t* starPattern = NULL;
+    const wchar_t* starText = NULL;
+    while (*text)
+    {
+        if (*pattern == L'*')
+        {
+            starPattern = ++pattern;
+            starText = text;
+        }
+        else if (*pattern == *text)
+        {
+            ++pattern;
+            ++text;
+        }
+        else if (starPattern)
+        {
+            // Let the last '*' swallow one more character and retry
+            pattern = starPattern;
+            text = ++starText;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (*pattern == L'*')
+    {
+        ++pattern;
+    }
+    return *pattern == 0;
+}
+
+// Function to get the lower-case executable name of the process owning a window
+static std::wstring GetProcessNameForWindow(HWND hwnd)
+{
+    DWORD processId = 0;
+    GetWindowThreadProcessId(hwnd, &processId);
+    HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+    if (hProcess == NULL)
+        return std::wstring();
+
+    wchar_t imagePath[MAX_PATH];
+    DWORD size = MAX_PATH;
+    std::wstring name;
+    if (QueryFullProcessImageName(hProcess, 0, imagePath, &size))
+    {
+        std::wstring path(imagePath, size);
+        size_t slash = path.find_last_of(L"\\/");
+        name = ToLower((slash == std::wstring::npos) ? path : path.substr(slash + 1));
+    }
+    CloseHandle(hProcess);
+    return name;
+}
+
+// Function to strip surrounding whitespace
+static std::wstring TrimString(const std::wstring& text)
+{
+    size_t first = text.find_first_not_of(L" \t\r\n");
+    if (first == std::wstring::npos)
+        return std::wstring();
+    size_t last = text.find_last_not_of(L" \t\r\n");
+    return text.substr(first, last - first + 1);
+}
+
+// Function to parse one rule line: include|exclude followed by key=value pairs,
+// values containing spaces may be quoted, e.g.
+//     include title="*Visual Studio*" process=devenv.exe minwidth=800 monitor=2
+static bool ParseCaptureRule(const std::wstring& line, CaptureRule& rule)
+{
+    rule = CaptureRule();
+    rule.include = true;
+    rule.minWidth = rule.maxWidth = rule.minHeight = rule.maxHeight = 0;
+    rule.monitor = -1;
+
+    size_t pos = 0;
+    bool first = true;
+    while (pos < line.size())
+    {
+        while (pos < line.size() && iswspace(line[pos]))
+            ++pos;
+        if (pos >= line.size())
+            break;
+
+        // Read one token, keeping quoted sections together
+        std::wstring token;
+        bool quoted = false;
+        while (pos < line.size() && (quoted || !iswspace(line[pos])))
+        {
+            if (line[pos] == L'"')
+                quoted = !quoted;
+            else
+                token += line[pos];
+            ++pos;
+        }
+        if (quoted)
+            return false;
+
+        if (first)
+        {
+            first = false;
+            std::wstring keyword = ToLower(token);
+            if (keyword == L"include")
+                rule.include = true;
+            else if (keyword == L"exclude")
+                rule.include = false;
+            else
+                return false;
+            continue;
+        }
+
+        size_t equals = token.find(L'=');
+        if (equals == std::wstring::npos)
+            return false;
+        std::wstring key = ToLower(token.substr(0, equals));
+        std::wstring value = token.substr(equals + 1);
+        int number = _wtoi(value.c_str());
+
+        if (key == L"title")
+            rule.titlePattern = value;
+        else if (key == L"class")
+            rule.className = value;
+        else if (key == L"process")
+            rule.processName = value;
+        else if (key == L"minwidth")
+            rule.minWidth = number;
+        else if (key == L"maxwidth")
+            rule.maxWidth = number;
+        else if (key == L"minheight")
+            rule.minHeight = number;
+        else if (key == L"maxheight")
+            rule.maxHeight = number;
+        else if (key == L"monitor")
+            rule.monitor = number - 1; // Monitors are numbered from 1 in the UI
+        else
+            return false;
+    }
+    return !first;
+}
+
+// Function to read a UTF-8 text file, with or without a byte order mark
+static bool ReadUtf8File(const std::wstring& path, std::wstring& text)
+{
+    text.clear();
+    HANDLE hFile = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    std::string bytes;
+    char buffer[4096];
+    DWORD bytesRead = 0;
+    while (ReadFile(hFile, buffer, sizeof(buffer), &bytesRead, NULL) && bytesRead > 0)
+    {
+        bytes.append(buffer, bytesRead);
+    }
+    CloseHandle(hFile);
+
+    if (bytes.size() >= 3 && bytes.compare(0, 3, "\xEF\xBB\xBF") == 0)
+        bytes.erase(0, 3);
+    if (!bytes.empty())
+    {
+        int length = MultiByteToWideChar(CP_UTF8, 0, bytes.data(), static_cast<int>(bytes.size()), NULL, 0);
+        text.resize(length);
+        MultiByteToWideChar(CP_UTF8, 0, bytes.data(), static_cast<int>(bytes.size()), &text[0], length);
+    }
+    return true;
+}
+
+// Function to load the capture rules file. On failure errorLine holds the
+// offending line, or 0 if the file could not be read.
+bool LoadCaptureRules(const std::wstring& path, std::vector<CaptureRule>& rules, int& errorLine)
+{
+    rules.clear();
+    errorLine = 0;
+
+    std::wstring text;
+    if (!ReadUtf8File(path, text))
+        return false;
+
+    int lineNumber = 0;
+    size_t start = 0;
+    while (start <= text.size())
+    {
+        size_t end = text.find(L'\n', start);
+        if (end == std::wstring::npos)
+            end = text.size();
+        std::wstring line = TrimString(text.substr(start, end - start));
+        start = end + 1;
+        lineNumber++;
+
+        if (line.empty() || line[0] == L'#')
+            continue;
+
+        CaptureRule rule;
+        if (!ParseCaptureRule(line, rule) || rules.size() >= MAX_CAPTURE_RULES)
+        {
+            errorLine = lineNumber;
+            return false;
+        }
+        rules.push_back(rule);
+    }
+    return true;
+}
+
+// Helpers for the rule bit sets
+static void SetRuleBit(RuleMask& mask, size_t rule)
+{
+    mask[rule / 64] |= 1ULL << (rule % 64);
+}
+
+static void OrRuleMask(unsigned long long* target, const RuleMask& mask)
+{
+    for (size_t i = 0; i < mask.size(); ++i)
+    {
+        target[i] |= mask[i];
+    }
+}
+
+static void AndRuleMask(unsigned long long* target, const RuleMask& mask)
+{
+    for (size_t i = 0; i < mask.size(); ++i)
+    {
+        target[i] &= mask[i];
+    }
+}
+
+static int LowestSetBit(unsigned long long word)
+{
+    // De Bruijn multiplication; works on 32-bit targets without 64-bit bit-scan intrinsics
+    static const int table[64] = {
+        0, 1, 2, 53, 3, 7, 54, 27, 4, 38, 41, 8, 34, 55, 48, 28,
+        62, 5, 39, 46, 44, 42, 22, 9, 24, 35, 59, 56, 49, 18, 29, 11,
+        63, 52, 6, 26, 37, 40, 33, 47, 61, 45, 43, 21, 23, 58, 17, 10,
+        51, 25, 36, 32, 60, 20, 57, 16, 50, 31, 19, 15, 30, 14, 13, 12 };
+    return table[((word & (0 - word)) * 0x022FDD63CC95386DULL) >> 58];
+}
+
+// Function to add a title fragment to the automaton, returning its fragment id
+static int AddTitleFragment(CaptureRuleTable& table, const std::wstring& fragment)
+{
+    int node = 0;
+    for (wchar_t ch : fragment)
+    {
+        auto it = table.titleNodes[node].next.find(ch);
+        if (it == table.titleNodes[node].next.end())
+        {
+            table.titleNodes.push_back(CaptureRuleTable::TitleNode());
+            int child = static_cast<int>(table.titleNodes.size()) - 1;
+            table.titleNodes[node].next[ch] = child;
+            node = child;
+        }
+        else
+        {
+            node = it->second;
+        }
+    }
+
+    if (table.titleNodes[node].output == -1)
+    {
+        RuleMask empty(table.maskWords, 0);
+        CaptureRuleTable::TitleFragment entry = { fragment.size(), empty, empty, empty, empty };
+        table.titleFragments.push_back(entry);
+        table.titleNodes[node].output = static_cast<int>(table.titleFragments.size()) - 1;
+    }
+    return table.titleNodes[node].output;
+}
+
+// Function to compile the capture rules into the decision table
+void CompileCaptureRules(const std::vector<CaptureRule>& rules, CaptureRuleTable& table)
+{
+    table = CaptureRuleTable();
+    table.maskWords = (rules.size() + 63) / 64;
+    RuleMask empty(table.maskWords, 0);
+    table.anyClassMask = table.anyProcessMask = table.anyMonitorMask = table.anyTitleMask = empty;
+    table.titleNodes.push_back(CaptureRuleTable::TitleNode()); // Root of the automaton
+
+    // Normalize the rules and collect the distinct predicate values first,
+    // so rules without a predicate can be added to every value's mask
+    for (const auto& source : rules)
+    {
+        CaptureRule rule = source;
+        rule.titlePattern = ToLower(rule.titlePattern);
+        rule.className = ToLower(rule.className);
+        rule.processName = ToLower(rule.processName);
+        table.rules.push_back(rule);
+
+        if (!rule.className.empty())
+            table.classMasks.emplace(rule.className, empty);
+        if (!rule.processName.empty())
+            table.processMasks.emplace(rule.processName, empty);
+        if (rule.monitor >= 0)
+            table.monitorMasks.emplace(rule.monitor, empty);
+    }
+    table.usesClass = !table.classMasks.empty();
+    table.usesProcess = !table.processMasks.empty();
+    table.usesMonitor = !table.monitorMasks.empty();
+
+    for (size_t i = 0; i < table.rules.size(); ++i)
+    {
+        const CaptureRule& rule = table.rules[i];
+
+        if (rule.className.empty())
+        {
+            SetRuleBit(table.anyClassMask, i);
+            for (auto& entry : table.classMasks)
+                SetRuleBit(entry.second, i);
+        }
+        else
+        {
+            SetRuleBit(table.classMasks[rule.className], i);
+        }
+
+        if (rule.processName.empty())
+        {
+            SetRuleBit(table.anyProcessMask, i);
+            for (auto& entry : table.processMasks)
+                SetRuleBit(entry.second, i);
+        }
+        else
+        {
+            SetRuleBit(table.processMasks[rule.processName], i);
+        }
+
+        if (rule.monitor < 0)
+        {
+            SetRuleBit(table.anyMonitorMask, i);
+            for (auto& entry : table.monitorMasks)
+                SetRuleBit(entry.second, i);
+        }
+        else
+        {
+            SetRuleBit(table.monitorMasks[rule.monitor], i);
+        }
+
+        // Classify the title pattern by where its wildcards are
+        const std::wstring& pattern = rule.titlePattern;
+        size_t first = pattern.find_first_not_of(L'*');
+        if (first == std::wstring::npos)
+        {
+            SetRuleBit(table.anyTitleMask, i); // Empty or all-wildcard pattern
+            continue;
+        }
+        size_t last = pattern.find_last_not_of(L'*');
+        std::wstring core = pattern.substr(first, last - first + 1);
+        if (core.find(L'*') != std::wstring::npos)
+        {
+            table.wildcardTitleRules.push_back(static_cast<int>(i));
+            continue;
+        }
+
+        bool leadingStar = first > 0;
+        bool trailingStar = last + 1 < pattern.size();
+        int fragment = AddTitleFragment(table, core);
+        CaptureRuleTable::TitleFragment& entry = table.titleFragments[fragment];
+        if (leadingStar && trailingStar)
+            SetRuleBit(entry.containsMask, i);
+        else if (trailingStar)
+            SetRuleBit(entry.prefixMask, i);
+        else if (leadingStar)
+            SetRuleBit(entry.suffixMask, i);
+        else
+            SetRuleBit(entry.exactMask, i);
+    }
+
+    // Breadth-first pass to set the failure and output links of the automaton
+    std::vector<int> queue;
+    for (const auto& edge : table.titleNodes[0].next)
+    {
+        queue.push_back(edge.second);
+    }
+    for (size_t head = 0; head < queue.size(); ++head)
+    {
+        int node = queue[head];
+        for (const auto& edge : table.titleNodes[node].next)
+        {
+            int child = edge.second;
+            int fail = table.titleNodes[node].fail;
+            while (fail != 0 && table.titleNodes[fail].next.find(edge.first) == table.titleNodes[fail].next.end())
+            {
+                fail = table.titleNodes[fail].fail;
+            }
+            auto it = table.titleNodes[fail].next.find(edge.first);
+            table.titleNodes[child].fail = (it != table.titleNodes[fail].next.end() && it->second != child) ? it->second : 0;
+
+            int failNode = table.titleNodes[child].fail;
+            table.titleNodes[child].outputLink = (table.titleNodes[failNode].output != -1) ? failNode : table.titleNodes[failNode].outputLink;
+            queue.push_back(child);
+        }
+    }
+}
+
+// Function to decide whether a window is captured by the compiled rules.
+// The index of the deciding rule is stored in matchedRule if given.
+bool ClassifyWindow(const CaptureRuleTable& table, const WindowDescriptor& window, int* matchedRule)
+{
+    if (table.rules.empty())
+        return false;
+
+    // Title: one automaton pass, lower-casing on the fly
+    unsigned long long candidates[CAPTURE_RULE_MASK_WORDS] = { 0 };
+    OrRuleMask(candidates, table.anyTitleMask);
+
+    size_t titleLength = window.title.size();
+    int state = 0;
+    for (size_t i = 0; i < titleLength; ++i)
+    {
+        wchar_t ch = static_cast<wchar_t>(towlower(window.title[i]));
+        for (;;)
+        {
+            auto it = table.titleNodes[state].next.find(ch);
+            if (it != table.titleNodes[state].next.end())
+            {
+                state = it->second;
+                break;
+            }
+            if (state == 0)
+                break;
+            state = table.titleNodes[state].fail;
+        }
+
+        int node = (table.titleNodes[state].output != -1) ? state : table.titleNodes[state].outputLink;
+        while (node != -1)
+        {
+            const CaptureRuleTable::TitleFragment& fragment = table.titleFragments[table.titleNodes[node].output];
+            bool atStart = (i + 1 == fragment.length);
+            bool atEnd = (i + 1 == titleLength);
+            OrRuleMask(candidates, fragment.containsMask);
+            if (atStart)
+                OrRuleMask(candidates, fragment.prefixMask);
+            if (atEnd)
+                OrRuleMask(candidates, fragment.suffixMask);
+            if (atStart && atEnd)
+                OrRuleMask(candidates, fragment.exactMask);
+            node = table.titleNodes[node].outputLink;
+        }
+    }
+
+    if (!table.wildcardTitleRules.empty())
+    {
+        std::wstring lowerTitle = ToLower(window.title);
+        for (int rule : table.wildcardTitleRules)
+        {
+            if (WildcardMatch(table.rules[rule].titlePattern.c_str(), lowerTitle.c_str()))
+                candidates[rule / 64] |= 1ULL << (rule % 64);
+        }
+    }
+
+    // Exact-match predicates: one lookup each
+    if (table.usesClass)
+    {
+        auto it = table.classMasks.find(window.className);
+        AndRuleMask(candidates, it != table.classMasks.end() ? it->second : table.anyClassMask);
+    }
+    if (table.usesProcess)
+    {
+        auto it = table.processMasks.find(window.processName);
+        AndRuleMask(candidates, it != table.processMasks.end() ? it->second : table.anyProcessMask);
+    }
+    if (table.usesMonitor)
+    {
+        auto it = table.monitorMasks.find(window.monitor);
+        AndRuleMask(candidates, it != table.monitorMasks.end() ? it->second : table.anyMonitorMask);
+    }
+
+    // The first remaining rule in file order decides; size ranges are only
+    // checked for the rules that are still candidates
+    for (size_t word = 0; word < table.maskWords; ++word)
+    {
+        unsigned long long bits = candidates[word];
+        while (bits)
+        {
+            int index = static_cast<int>(word * 64) + LowestSetBit(bits);
+            bits &= bits - 1;
+
+            const CaptureRule& rule = table.rules[index];
+            if ((rule.minWidth > 0 && window.width < rule.minWidth) ||
+                (rule.maxWidth > 0 && window.width > rule.maxWidth) ||
+                (rule.minHeight > 0 && window.height < rule.minHeight) ||
+                (rule.maxHeight > 0 && window.height > rule.maxHeight))
+            {
+                continue;
+            }
+            if (matchedRule)
+                *matchedRule = index;
+            return rule.include;
+        }
+    }
+    return false;
+}
+
+// Function to time the compiled capture rules, for the self-check:
+// SELFCHECK_RULE_WINDOWS synthetic descriptors are classified against
+// SELFCHECK_RULE_COUNT random rules, one sample per SELFCHECK_RULE_BATCH
+// descriptors. The rules mix every title pattern kind with class, process,
+// size and monitor predicates, about a fifth of them excluding.
+void BenchmarkCaptureRules(std::mt19937& random, std::vector<double>& samples)
+{
+    std::uniform_int_distribution<int> wordDistribution(0, 299);
+    std::uniform_int_distribution<int> classDistribution(0, 79);
+    std::uniform_int_distribution<int> processDistribution(0, 149);
+    std::uniform_int_distribution<int> monitorDistribution(0, 3);
+    std::uniform_int_distribution<int> sizeDistribution(200, 2000);
+    std::uniform_int_distribution<int> percentDistribution(0, 99);
+    std::uniform_int_distribution<int> shapeDistribution(0, 4);
+    wchar_t text[128];
+
+    std::vector<CaptureRule> rules;
+    for (int i = 0; i < SELFCHECK_RULE_COUNT; ++i)
+    {
+        CaptureRule rule;
+        rule.include = percentDistribution(random) >= 20;
+        if (percentDistribution(random) < 70)
+        {
+            int word = wordDistribution(random);
+            switch (shapeDistribution(random))
+            {
+            case 0: swprintf_s(text, 128, L"Word%d", word); break;
+            case 1: swprintf_s(text, 128, L"Word%d*", word); break;
+            case 2: swprintf_s(text, 128, L"*Word%d", word); break;
+            case 3: swprintf_s(text, 128, L"*Word%d*", word); break;
+            default: swprintf_s(text, 128, L"Word%d*Word%d", word, wordDistribution(random)); break;
+            }
+            rule.titlePattern = text;
+        }
+        if (percentDistribution(random) < 30)
+        {
+            swprintf_s(text, 128, L"Class%d", classDistribution(random) / 2);
+            rule.className = text;
+        }
+        if (percentDistribution(random) < 30)
+        {
+            swprintf_s(text, 128, L"process%d.exe", processDistribution(random) / 2);
+            rule.processName = text;
+        }
+        rule.minWidth = (percentDistribution(random) < 10) ? sizeDistribution(random) : 0;
+        rule.maxWidth = 0;
+        rule.minHeight = 0;
+        rule.maxHeight = (percentDistribution(random) < 10) ? sizeDistribution(random) : 0;
+        rule.monitor = (percentDistribution(random) < 10) ? monitorDistribution(random) : -1;
+        rules.push_back(rule);
+    }
+    CaptureRuleTable table;
+    CompileCaptureRules(rules, table);
+
+    // Half of the classes and processes are named by no rule
+    std::vector<WindowDescriptor> windows(SELFCHECK_RULE_WINDOWS);
+    for (auto& window : windows)
+    {
+        swprintf_s(text, 128, L"Word%d Word%d - Word%d", wordDistribution(random), wordDistribution(random), wordDistribution(random));
+        window.title = text;
+        swprintf_s(text, 128, L"class%d", classDistribution(random));
+        window.className = text;
+        swprintf_s(text, 128, L"process%d.exe", processDistribution(random));
+        window.processName = text;
+        window.width = sizeDistribution(random);
+        window.height = sizeDistribution(random);
+        window.monitor = monitorDistribution(random);
+    }
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    int captured = 0;
+    for (size_t first = 0; first < windows.size(); first += SELFCHECK_RULE_BATCH)
+    {
+        size_t last = (std::min)(first + SELFCHECK_RULE_BATCH, windows.size());
+        LARGE_INTEGER start, end;
+        QueryPerformanceCounter(&start);
+        for (size_t i = first; i < last; ++i)
+        {
+            if (ClassifyWindow(table, windows[i]))
+                ++captured;
+        }
+        QueryPerformanceCounter(&end);
+        samples.push_back((end.QuadPart - start.QuadPart) * 1e6 / frequency.QuadPart);
+    }
+    static volatile int capturedSink;
+    capturedSink = captured; // Keeps the classification from being optimized away
+}
+
+// Function to collect the properties of a window that the compiled rules test.
+// Properties no rule looks at are skipped to avoid needless system calls.
+bool GetWindowDescriptor(HWND hwnd, const CaptureRuleTable& table, WindowDescriptor& window)
+{
+    wchar_t windowTitle[256];
+    GetWindowText(hwnd, windowTitle, sizeof(windowTitle) / sizeof(wchar_t));
+    window.title = windowTitle;
+
+    window.className.clear();
+    if (table.usesClass)
+    {
+        wchar_t className[256];
+        GetClassName(hwnd, className, sizeof(className) / sizeof(wchar_t));
+        window.className = ToLower(className);
+    }
+
+    window.processName.clear();
+    if (table.usesProcess)
+    {
+        window.processName = GetProcessNameForWindow(hwnd);
+    }
+
+    RECT rect;
+    if (!GetWindowRect(hwnd, &rect))
+        return false;
+    window.width = rect.right - rect.left;
+    window.height = rect.bottom - rect.top;
+
+    window.monitor = -1;
+    if (table.usesMonitor)
+    {
+        MONITORINFO mi = { 0 };
+        mi.cbSize = sizeof(mi);
+        if (GetMonitorInfo(MonitorFromWindow(hwnd, MONITOR_DEFAULTTONEAREST), &mi))
+        {
+            for (const auto& entry : monitorMap)
+            {
+                if (EqualRect(&entry.second.rcMonitor, &mi.rcMonitor))
+                {
+                    window.monitor = entry.first;
+                    break;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Callback for EnumWindows that captures windows accepted by the capture rules
+BOOL CALLBACK EnumWindowsByRulesProc(HWND hwnd, LPARAM lParam)
+{
+    if (hwnd == hMainWindow || !IsCapturableWindow(hwnd))
+        return TRUE;
+
+    // Check if the window is already captured
+    if (FindWindowRecord(windowList, hwnd) >= 0)
+        return TRUE;
+
+    WindowDescriptor window;
+    if (!GetWindowDescriptor(hwnd, captureRuleTable, window) || !ClassifyWindow(captureRuleTable, window))
+        return TRUE;
+
+    AddWindowRecord(windowList, hwnd, window.title.c_str());
+    return TRUE; // Continue enumeration
+}
+
+// Function to capture all windows accepted by the rules in CaptureRules.txt
+void CaptureWindowsByRules()
+{
+    ScopedLatency latency(METRIC_CAPTURE_LATENCY);
+    std::vector<CaptureRule> rules;
+    int errorLine = 0;
+    if (!LoadCaptureRules(GetAppFilePath(CAPTURE_RULES_FILE), rules, errorLine))
+    {
+        wchar_t message[256];
+        if (errorLine > 0)
+            swprintf_s(message, 256, L"Invalid capture rule on line %d of %s.", errorLine, CAPTURE_RULES_FILE);
+        else
+            swprintf_s(message, 256, L"Cannot read %s next to the executable.", CAPTURE_RULES_FILE);
+        latency.Stop();
+        TimedMessageBox(NULL, message, L"Error", MB_OK);
+        return;
+    }
+    CompileCaptureRules(rules, captureRuleTable);
+    windowGroupKeys.clear();
+
+    // Clear previous window list
+    ClearWindowRecords(windowList);
+    tiledLayout = TiledLayout();
+    ListView_DeleteAllItems(hListView);
+
+    EnumWindows(EnumWindowsByRulesProc, 0);
+    RefreshWindowList();
+    latency.Stop();
+
+    if (windowList.handles.empty())
+    {
+        TimedMessageBox(NULL, L"No windows matched the capture rules.", L"Info", MB_OK);
+    }
+    else
+    {
+        TimedMessageBox(NULL, L"All matching windows have been captured.", L"Info", MB_OK);
+    }
+}
+
+// Function to parse a chord such as "Ctrl+Alt+J", "Win+Shift+F5" or "Ctrl+Left"
+bool ParseHotkeyChord(const std::wstring& chord, UINT& modifiers, UINT& vk)
+{
+    modifiers = 0;
+    vk = 0;
+
+    size_t start = 0;
+    while (start < chord.size())
+    {
+        size_t plus = chord.find(L'+', start);
+        if (plus == std::wstring::npos)
+            plus = chord.size();
+        std::wstring part = ToLower(TrimString(chord.substr(start, plus - start)));
+        start = plus + 1;
+
+        if (vk != 0)
+            return false; // The key must be the last part
+        if (part == L"ctrl" || part == L"control")
+            modifiers |= MOD_CONTROL;
+        else if (part == L"alt")
+            modifiers |= MOD_ALT;
+        else if (part == L"shift")
+            modifiers |= MOD_SHIFT;
+        else if (part == L"win")
+            modifiers |= MOD_WIN;
+        else if (part.size() == 1 && iswalnum(part[0]))
+            vk = towupper(part[0]); // Letters and digits are their own virtual keys
+        else if (part.size() >= 2 && part[0] == L'f' && iswdigit(part[1]))
+        {
+            // The whole rest must be the number, so "F1x" is not read as F1
+            wchar_t* end = NULL;
+            long number = wcstol(part.c_str() + 1, &end, 10);
+            if (*end != 0 || number < 1 || number > 24)
+                return false;
+            vk = VK_F1 + static_cast<UINT>(number) - 1;
+        }
+        else if (part == L"left")
+            vk = VK_LEFT;
+        else if (part == L"right")
+            vk = VK_RIGHT;
+        else if (part == L"up")
+            vk = VK_UP;
+        else if (part == L"down")
+            vk = VK_DOWN;
+        else if (part == L"tab")
+            vk = VK_TAB;
+        else if (part == L"space")
+            vk = VK_SPACE;
+        else if (part == L"enter")
+            vk = VK_RETURN;
+        else
+            return false;
+    }
+    return vk != 0;
+}
+
+// Function to read the hotkey bindings from the [Hotkeys] section of the
+// settings file; missing entries get the defaults, empty entries are unbound,
+// and a chord already bound to an earlier entry is not bound again
+void LoadHotkeyBindings()
+{
+    struct DefaultBinding
+    {
+        const wchar_t* name;
+        const wchar_t* chord;
+        int action;
+    };
+    static const DefaultBinding defaults[] = {
+        { L"Arrange", L"Ctrl+J", HOTKEY_ARRANGE },
+        { L"Restore", L"Ctrl+Shift+J", HOTKEY_RESTORE },
+        // Shifted like the workspace chords: Ctrl+Alt+letter is AltGr+letter on many layouts
+        { L"CycleLayout", L"Ctrl+Alt+Shift+L", HOTKEY_CYCLE_LAYOUT },
+        { L"FocusNext", L"Ctrl+Alt+Shift+N", HOTKEY_FOCUS_NEXT },
+        { L"Undo", L"Ctrl+Alt+Shift+Z", HOTKEY_UNDO },
+        { L"Redo", L"Ctrl+Alt+Shift+Y", HOTKEY_REDO },
+    };
+
+    std::wstring settingsPath = GetAppFilePath(SETTINGS_FILE);
+    hotkeyBindings.clear();
+
+    auto addBinding = [&](const wchar_t* name, const wchar_t* defaultChord, int action, int argument)
+    {
+        wchar_t chord[64];
+        GetPrivateProfileString(L"Hotkeys", name, defaultChord, chord, 64, settingsPath.c_str());
+
+        HotkeyBinding binding;
+        if (chord[0] == 0 || !ParseHotkeyChord(chord, binding.modifiers, binding.vk))
+            return;
+        for (const auto& bound : hotkeyBindings)
+        {
+            if (bound.modifiers == binding.modifiers && bound.vk == binding.vk)
+                return;
+        }
+        binding.action = action;
+        binding.argument = argument;
+        binding.registered = false;
+        hotkeyBindings.push_back(binding);
+    };
+
+    for (const auto& entry : defaults)
+    {
+        addBinding(entry.name, entry.chord, entry.action, 0);
+    }
+    for (int workspace = 1; workspace <= MAX_WORKSPACES; ++workspace)
+    {
+        wchar_t name[32];
+        wchar_t chord[32];
+        swprintf_s(name, 32, L"Workspace%d", workspace);
+        // Not Ctrl+Alt+digit: that is AltGr+digit, which types characters on many layouts
+        swprintf_s(chord, 32, L"Ctrl+Alt+Shift+%d", workspace);
+        addBinding(name, chord, HOTKEY_SWITCH_WORKSPACE, workspace);
+    }
+}
+
+// Function to register all bindings with the system and fill the lookup table.
+// The low-level hook is only installed if some chord could not be registered.
+void RegisterHotkeys(HWND hWnd)
+{
+    memset(hotkeyTable, 0, sizeof(hotkeyTable));
+    memset(hotkeyHookKeys, 0, sizeof(hotkeyHookKeys));
+
+    bool needHook = false;
+    for (size_t i = 0; i < hotkeyBindings.size(); ++i)
+    {
+        HotkeyBinding& binding = hotkeyBindings[i];
+        // Holding a chord sends one WM_HOTKEY, not one per auto-repeat
+        binding.registered = RegisterHotKey(hWnd, static_cast<int>(i) + 1, binding.modifiers | MOD_NOREPEAT, binding.vk) != FALSE;
+
+        HotkeyTableEntry& entry = hotkeyTable[binding.modifiers & 0xF][binding.vk & 0xFF];
+        entry.action = static_cast<unsigned char>(binding.action);
+        entry.argument = static_cast<unsigned char>(binding.argument);
+        entry.viaHook = !binding.registered;
+        if (!binding.registered)
+        {
+            hotkeyHookKeys[binding.vk & 0xFF] = true;
+            needHook = true;
+        }
+    }
+
+    if (needHook && !hGlobalKeyboardHook)
+    {
+        hGlobalKeyboardHook = SetWindowsHookEx(WH_KEYBOARD_LL, GlobalKeyboardProc, hInstance, 0);
+        if (!hGlobalKeyboardHook)
+        {
+            MessageBox(hWnd, L"Failed to set global keyboard hook.", L"Error", MB_OK | MB_ICONERROR);
+        }
+    }
+}
+
+// Function to release all hotkeys and the hook fallback
+void UnregisterHotkeys(HWND hWnd)
+{
+    for (size_t i = 0; i < hotkeyBindings.size(); ++i)
+    {
+        if (hotkeyBindings[i].registered)
+        {
+            UnregisterHotKey(hWnd, static_cast<int>(i) + 1);
+            hotkeyBindings[i].registered = false;
+        }
+    }
+    if (hGlobalKeyboardHook)
+    {
+        UnhookWindowsHookEx(hGlobalKeyboardHook);
+        hGlobalKeyboardHook = NULL;
+    }
+    memset(hotkeyTable, 0, sizeof(hotkeyTable));
+    memset(hotkeyHookKeys, 0, sizeof(hotkeyHookKeys));
+}
+
+// Function to run the action bound to a chord
+void DispatchHotkey(UINT modifiers, UINT vk)
+{
+    RecordTraceEvent(TRACE_HOTKEY, 0, modifiers, vk);
+    const HotkeyTableEntry& entry = hotkeyTable[modifiers & 0xF][vk & 0xFF];
+    switch (entry.action)
+    {
+    case HOTKEY_ARRANGE:
+        RequestArrange();
+        break;
+    case HOTKEY_RESTORE:
+        RestoreWindows();
+        break;
+    case HOTKEY_SWITCH_WORKSPACE:
+        SwitchWorkspace(entry.argument - 1);
+        break;
+    case HOTKEY_CYCLE_LAYOUT:
+        CycleLayoutMode();
+        break;
+    case HOTKEY_FOCUS_NEXT:
+        FocusNextCapturedWindow();
+        break;
+    case HOTKEY_UNDO:
+        UndoLayout();
+        break;
+    case HOTKEY_REDO:
+        RedoLayout();
+        break;
+    default:
+        break;
+    }
+}
+
+// Function to switch to another workspace: the windows of the current one are
+// minimized, the windows of the target one are restored and tiled. Refused
+// during a capture session, whose baseCount indexes the current list.
+void SwitchWorkspace(int workspace)
+{
+    if (workspace < 0 || workspace >= MAX_WORKSPACES || workspace == currentWorkspace)
+        return;
+    if (captureSession.state == CAPTURE_ACTIVE)
+        return;
+
+    for (HWND hWnd : windowList.handles)
+    {
+        if (IsWindow(hWnd))
+            ShowWindow(hWnd, SW_SHOWMINNOACTIVE);
+    }
+    std::swap(workspaceLists[currentWorkspace], windowList);
+    std::swap(windowList, workspaceLists[workspace]);
+    currentWorkspace = workspace;
+
+    for (HWND hWnd : windowList.handles)
+    {
+        if (IsWindow(hWnd) && IsIconic(hWnd))
+            ShowWindow(hWnd, SW_SHOWNOACTIVATE);
+    }
+    RefreshWindowList();
+    RelayoutWindows();
+}
+
+// Function to switch to the next layout mode and re-tile
+void CycleLayoutMode()
+{
+    // Each custom layout is a step of its own; without any, skip the mode
+    if (currentLayoutMode == LAYOUT_CUSTOM && currentCustomLayout + 1 < static_cast<int>(customLayouts.size()))
+    {
+        currentCustomLayout++;
+    }
+    else
+    {
+        currentLayoutMode = (currentLayoutMode + 1) % LAYOUT_COUNT;
+        currentCustomLayout = 0;
+        if (currentLayoutMode == LAYOUT_CUSTOM && customLayouts.empty())
+            currentLayoutMode = (currentLayoutMode + 1) % LAYOUT_COUNT;
+    }
+    gridFallbackReported = false;
+    RequestWindowRegistryPublish();
+
+    RelayoutWindows();
+}
+
+// Function to move the focus to the captured window after the foreground one
+void FocusNextCapturedWindow()
+{
+    if (windowList.handles.empty())
+        return;
+
+    HWND hForeground = GetForegroundWindow();
+    size_t count = windowList.handles.size();
+    int foreground = FindWindowRecord(windowList, hForeground);
+    size_t start = (foreground >= 0) ? static_cast<size_t>(foreground) : count - 1;
+
+    for (size_t step = 1; step <= count; ++step)
+    {
+        HWND hWnd = windowList.handles[(start + step) % count];
+        if (IsWindow(hWnd))
+        {
+            SetForegroundWindow(hWnd);
+            return;
+        }
+    }
+}
+
+// Function to restore window positions
+void RestoreWindows()
+{
+    ScopedLatency latency(METRIC_RESTORE_LATENCY);
+    CountMetric(METRIC_RESTORES);
+    RecordTraceEvent(TRACE_RESTORE, 0);
+    std::vector<size_t> closed;
+    BeginLayoutHistoryEntry();
+    for (size_t i = 0; i < windowList.handles.size(); ++i)
+    {
+        HWND hWnd = windowList.handles[i];
+        const RECT& rect = windowList.rects[i];
+        if (IsWindow(hWnd))
+        {
+            // Remember where the window was for undo
+            WindowMove move;
+            move.hWnd = hWnd;
+            GetWindowRect(hWnd, &move.before);
+            move.after = rect;
+            if (!EqualRect(&move.before, &move.after))
+                RecordWindowMove(move);
+
+            SetWindowPos(hWnd, NULL, rect.left, rect.top,
+                rect.right - rect.left,
+                rect.bottom - rect.top,
+                SWP_NOZORDER | SWP_NOACTIVATE);
+        }
+        else
+        {
+            closed.push_back(i);
+        }
+    }
+    CommitLayoutHistoryEntry();
+    latency.Stop();
+
+    // Closed windows are reported once every other window is back
+    for (size_t position : closed)
+    {
+        std::wstring message = std::wstring(L"Window no longer available: ") + windowList.titles[position];
+        TimedMessageBox(NULL, message.c_str(), L"Warning", MB_OK);
+    }
+}
+
+// Function to start recording a layout change. Anything that could still be
+// redone is discarded, since the new change branches off the current state.
+void BeginLayoutHistoryEntry()
+{
+    LayoutHistory& history = layoutHistory;
+    if (history.moves.empty())
+    {
+        // Allocated once; the history never grows beyond this
+        history.moves.resize(LAYOUT_HISTORY_MOVES);
+        history.entries.resize(LAYOUT_HISTORY_ENTRIES);
+    }
+
+    history.count = history.cursor;
+    if (history.count > 0)
+    {
+        const LayoutHistory::Entry& last = history.entries[(history.oldest + history.count - 1) % LAYOUT_HISTORY_ENTRIES];
+        history.moveEnd = last.firstMove + last.moveCount;
+    }
+    history.pendingFirst = history.moveEnd;
+    history.recording = true;
+}
+
+// Function to add one moved window to the entry being recorded
+void RecordWindowMove(const WindowMove& move)
+{
+    LayoutHistory& history = layoutHistory;
+    if (!history.recording)
+        return;
+
+    // A change bigger than the whole pool cannot be undone; drop it
+    if (history.moveEnd - history.pendingFirst >= LAYOUT_HISTORY_MOVES)
+    {
+        history.recording = false;
+        history.moveEnd = history.pendingFirst;
+        return;
+    }
+
+    // Evict the oldest entries whose moves are about to be overwritten
+    while (history.count > 0)
+    {
+        const LayoutHistory::Entry& oldestEntry = history.entries[history.oldest];
+        if (oldestEntry.firstMove + LAYOUT_HISTORY_MOVES > history.moveEnd)
+            break;
+        history.oldest = (history.oldest + 1) % LAYOUT_HISTORY_ENTRIES;
+        history.count--;
+        history.cursor--;
+    }
+
+    history.moves[history.moveEnd % LAYOUT_HISTORY_MOVES] = move;
+    history.moveEnd++;
+}
+
+// Function to finish the entry being recorded; changes that moved nothing are not kept
+void CommitLayoutHistoryEntry()
+{
+    LayoutHistory& history = layoutHistory;
+    if (!history.recording)
+        return;
+    history.recording = false;
+
+    size_t moveCount = history.moveEnd - history.pendingFirst;
+    if (moveCount == 0)
+        return;
+
+    // A full ring drops its oldest entry
+    if (history.count == LAYOUT_HISTORY_ENTRIES)
+    {
+        history.oldest = (history.oldest + 1) % LAYOUT_HISTORY_ENTRIES;
+        history.count--;
+        history.cursor--;
+    }
+
+    LayoutHistory::Entry& entry = history.entries[(history.oldest + history.count) % LAYOUT_HISTORY_ENTRIES];
+    entry.firstMove = history.pendingFirst;
+    entry.moveCount = moveCount;
+    history.count++;
+    history.cursor = history.count;
+}
+
+// Function to copy the moves of a history entry out of the circular pool
+static std::vector<WindowMove> GetLayoutHistoryMoves(const LayoutHistory::Entry& entry)
+{
+    std::vector<WindowMove> moves;
+    moves.reserve(entry.moveCount);
+    for (size_t i = 0; i < entry.moveCount; ++i)
+    {
+        moves.push_back(layoutHistory.moves[(entry.firstMove + i) % LAYOUT_HISTORY_MOVES]);
+    }
+    return moves;
+}
+
+// Function to move the history cursor back over one entry (undo) or forward
+// over one (redo). Returns the entry stepped over, or NULL at either end.
+static const LayoutHistory::Entry* StepLayoutHistory(bool forward)
+{
+    LayoutHistory& history = layoutHistory;
+    if (forward ? history.cursor == history.count : history.cursor == 0)
+        return NULL;
+
+    if (!forward)
+        history.cursor--;
+    const LayoutHistory::Entry& entry = history.entries[(history.oldest + history.cursor) % LAYOUT_HISTORY_ENTRIES];
+    if (forward)
+        history.cursor++;
+    return &entry;
+}
+
+// Function to undo the last layout change as a single batch
+void UndoLayout()
+{
+    const LayoutHistory::Entry* entry = StepLayoutHistory(false);
+    if (entry)
+        ApplyWindowMoves(GetLayoutHistoryMoves(*entry), false);
+}
+
+// Function to redo the last undone layout change as a single batch
+void RedoLayout()
+{
+    const LayoutHistory::Entry* entry = StepLayoutHistory(true);
+    if (entry)
+        ApplyWindowMoves(GetLayoutHistoryMoves(*entry), true);
+}
+
+// Function to make SELFCHECK_HISTORY_CHANGES synthetic layout changes of 1
+// to SELFCHECK_HISTORY_MAX_MOVES moved windows each, for the self-check.
+// The moves of all changes are laid end to end; counts holds each change's size.
+static void MakeHistoryChanges(std::mt19937& random, std::vector<WindowMove>& moves, std::vector<size_t>& counts)
+{
+    std::uniform_int_distribution<int> countDistribution(1, SELFCHECK_HISTORY_MAX_MOVES);
+    std::uniform_int_distribution<int> positionDistribution(0, 3000);
+    for (int change = 0; change < SELFCHECK_HISTORY_CHANGES; ++change)
+    {
+        size_t count = countDistribution(random);
+        for (size_t i = 0; i < count; ++i)
+        {
+            WindowMove move;
+            move.hWnd = reinterpret_cast<HWND>(static_cast<INT_PTR>(i + 1));
+            SetRect(&move.before, positionDistribution(random), positionDistribution(random), 0, 0);
+            move.before.right = move.before.left + 800;
+            move.before.bottom = move.before.top + 600;
+            move.after = move.before;
+            OffsetRect(&move.after, 1 + static_cast<int>(i), 0);
+            moves.push_back(move);
+        }
+        counts.push_back(count);
+    }
+}
+
+// Function to record one change the way an arrange does
+static void RecordHistoryChange(const WindowMove* moves, size_t count)
+{
+    BeginLayoutHistoryEntry();
+    for (size_t i = 0; i < count; ++i)
+    {
+        RecordWindowMove(moves[i]);
+    }
+    CommitLayoutHistoryEntry();
+}
+
+// Function to get the memory held by the layout history
+static size_t GetLayoutHistoryBytes()
+{
+    return sizeof(LayoutHistory) + layoutHistory.moves.capacity() * sizeof(WindowMove) +
+        layoutHistory.entries.capacity() * sizeof(LayoutHistory::Entry);
+}
+
+// Function to time recording SELFCHECK_HISTORY_CHANGES changes into an
+// empty history, one sample per change. Past the first few thousand every
+// change evicts the oldest entries, which is the steady state of a long session.
+void BenchmarkLayoutHistoryPush(std::mt19937& random, std::vector<double>& samples)
+{
+    std::vector<WindowMove> moves;
+    std::vector<size_t> counts;
+    MakeHistoryChanges(random, moves, counts);
+    LayoutHistory saved;
+    std::swap(saved, layoutHistory);
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    size_t first = 0;
+    for (size_t count : counts)
+    {
+        LARGE_INTEGER start, end;
+        QueryPerformanceCounter(&start);
+        RecordHistoryChange(&moves[first], count);
+        QueryPerformanceCounter(&end);
+        samples.push_back((end.QuadPart - start.QuadPart) * 1e6 / frequency.QuadPart);
+        first += count;
+    }
+    std::swap(saved, layoutHistory);
+}
+
+// Function to time undo and redo steps through a full history, one sample
+// per step: the cursor walks back to the oldest entry and forward again,
+// copying each entry's moves out of the pool as UndoLayout and RedoLayout do
+void BenchmarkLayoutHistoryStep(std::mt19937& random, std::vector<double>& samples)
+{
+    std::vector<WindowMove> moves;
+    std::vector<size_t> counts;
+    MakeHistoryChanges(random, moves, counts);
+    LayoutHistory saved;
+    std::swap(saved, layoutHistory);
+    size_t first = 0;
+    for (size_t count : counts)
+    {
+        RecordHistoryChange(&moves[first], count);
+        first += count;
+    }
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    size_t copied = 0;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (;;)
+        {
+            LARGE_INTEGER start, end;
+            QueryPerformanceCounter(&start);
+            const LayoutHistory::Entry* entry = StepLayoutHistory(pass == 1);
+            if (entry)
+                copied += GetLayoutHistoryMoves(*entry).size();
+            QueryPerformanceCounter(&end);
+            if (!entry)
+                break;
+            samples.push_back((end.QuadPart - start.QuadPart) * 1e6 / frequency.QuadPart);
+        }
+    }
+    static volatile size_t copiedSink;
+    copiedSink = copied; // Keeps the copies from being optimized away
+    std::swap(saved, layoutHistory);
+}
+
+// Function to clear captured windows
+void ClearCapturedWindows()
+{
+    ClearWindowRecords(windowList);
+    tiledLayout = TiledLayout();
+    ListView_DeleteAllItems(hListView);
+    RequestWindowRegistryPublish();
+    TimedMessageBox(NULL, L"All captured windows have been cleared.", L"Info", MB_OK);
+}
+
+// Function to check and remove closed windows
+void CheckAndRemoveClosedWindows()
+{
+    if (RemoveClosedWindowRecords(windowList, true) > 0)
+    {
+        // Refresh the ListView
+        RefreshWindowList();
+    }
+}
+
+// Function to get the grid layout inputs from the published snapshot only:
+// settings, monitors and layout mode all come from one version, so this
+// reads neither the controls nor the UI thread's state. Callers on the UI
+// thread flush a pending publish first if they just changed an input.
+bool GetGridLayoutParams(GridLayoutParams& params, bool showErrors)
+{
+    bool found = false;
+    const WindowRegistrySnapshot* snapshot = BeginWindowRegistryRead();
+    if (snapshot)
+    {
+        // Get selected monitor
+        int monitorIndex = snapshot->settings.monitorSelection;
+        int monitorCount = static_cast<int>(snapshot->monitors.size());
+        params.allMonitors = (monitorIndex == snapshot->allMonitorsSelection && monitorCount > 0);
+        if (params.allMonitors)
+            monitorIndex = 0;
+        found = monitorIndex >= 0 && monitorIndex < monitorCount;
+        if (found)
+        {
+            params.workArea = snapshot->monitors[monitorIndex].workArea;
+            params.pixelFixX = snapshot->settings.pixelFixX;
+            params.pixelFixY = snapshot->settings.pixelFixY;
+            params.minSpacingY = snapshot->settings.minSpacingY;
+            params.layoutMode = snapshot->layoutMode;
+        }
+    }
+    EndWindowRegistryRead();
+
+    if (!found && showErrors)
+    {
+        TimedMessageBox(NULL, L"Selected monitor not found.", L"Error", MB_OK);
+    }
+    return found;
+}
+
+// Function to bring settings into range, whatever their source
+void ValidateLayoutSettings(LayoutSettings& settings)
+{
+    if (settings.minSpacingY < 0)
+        settings.minSpacingY = 0;
+
+    // The last entry may be "All Monitors", one past the last monitor
+    int entries = static_cast<int>(monitorMap.size()) + (allMonitorsComboIndex >= 0 ? 1 : 0);
+    if (settings.monitorSelection < 0 || settings.monitorSelection >= entries)
+        settings.monitorSelection = 0;
+}
+
+// Function to get the last write time of a file next to the executable
+static bool GetAppFileTime(const wchar_t* fileName, FILETIME& time)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesEx(GetAppFilePath(fileName).c_str(), GetFileExInfoStandard, &data))
+        return false;
+    time = data.ftLastWriteTime;
+    return true;
+}
+
+// Function to read the layout settings from the [Settings] section
+void LoadLayoutSettings(LayoutSettings& settings)
+{
+    std::wstring settingsPath = GetAppFilePath(SETTINGS_FILE);
+    LayoutSettings defaults;
+    settings.pixelFixX = static_cast<int>(GetPrivateProfileInt(L"Settings", L"PixelFixX", defaults.pixelFixX, settingsPath.c_str()));
+    settings.pixelFixY = static_cast<int>(GetPrivateProfileInt(L"Settings", L"PixelFixY", defaults.pixelFixY, settingsPath.c_str()));
+    settings.minSpacingY = static_cast<int>(GetPrivateProfileInt(L"Settings", L"MinSpacingY", defaults.minSpacingY, settingsPath.c_str()));
+    settings.monitorSelection = static_cast<int>(GetPrivateProfileInt(L"Settings", L"Monitor", defaults.monitorSelection, settingsPath.c_str()));
+    ValidateLayoutSettings(settings);
+    GetAppFileTime(SETTINGS_FILE, settingsFileTime);
+}
+
+// Function to write the layout settings to the [Settings] section
+void SaveLayoutSettings(const LayoutSettings& settings)
+{
+    std::wstring settingsPath = GetAppFilePath(SETTINGS_FILE);
+    WritePrivateProfileString(L"Settings", L"PixelFixX", std::to_wstring(settings.pixelFixX).c_str(), settingsPath.c_str());
+    WritePrivateProfileString(L"Settings", L"PixelFixY", std::to_wstring(settings.pixelFixY).c_str(), settingsPath.c_str());
+    WritePrivateProfileString(L"Settings", L"MinSpacingY", std::to_wstring(settings.minSpacingY).c_str(), settingsPath.c_str());
+    WritePrivateProfileString(L"Settings", L"Monitor", std::to_wstring(settings.monitorSelection).c_str(), settingsPath.c_str());
+
+    // Our own write is not an outside edit
+    GetAppFileTime(SETTINGS_FILE, settingsFileTime);
+}
+
+// Function to make new settings current and publish them
+void SetLayoutSettings(const LayoutSettings& settings)
+{
+    layoutSettings = settings;
+    RequestWindowRegistryPublish();
+}
+
+// Function to show a setting in its edit box unless it already says so
+static void ShowSettingInPanel(HWND hEdit, int value)
+{
+    if (hEdit && _wtoi(GetPanelText(hEdit, std::wstring()).c_str()) != value)
+        SetWindowText(hEdit, std::to_wstring(value).c_str());
+}
+
+// Function to validate the panel's layout inputs once, when an edit box loses
+// focus, the monitor changes or an arrange is requested, and to store and
+// publish them if they changed
+void CommitPanelSettings(bool showErrors)
+{
+    if (!hListView)
+        return;
+
+    LayoutSettings settings;
+    settings.pixelFixX = _wtoi(GetPanelText(hPixelFixXEdit, std::wstring()).c_str()); // Converts to integer, handles negative values
+    settings.pixelFixY = _wtoi(GetPanelText(hPixelFixYEdit, std::wstring()).c_str()); // Converts to integer, handles negative values
+    settings.minSpacingY = _wtoi(GetPanelText(hMinSpacingYEdit, std::wstring()).c_str());
+    settings.monitorSelection = ComboBox_GetCurSel(hMonitorComboBox);
+
+    // Validate minimum spacing
+    if (settings.minSpacingY < 0 && showErrors)
+    {
+        TimedMessageBox(NULL, L"Minimum vertical spacing cannot be negative. Resetting to 0.", L"Invalid Input", MB_OK | MB_ICONWARNING);
+    }
+    ValidateLayoutSettings(settings);
+    ShowSettingInPanel(hMinSpacingYEdit, settings.minSpacingY);
+
+    if (settings.pixelFixX == layoutSettings.pixelFixX && settings.pixelFixY == layoutSettings.pixelFixY &&
+        settings.minSpacingY == layoutSettings.minSpacingY && settings.monitorSelection == layoutSettings.monitorSelection)
+    {
+        return;
+    }
+    SetLayoutSettings(settings);
+    SaveLayoutSettings(settings);
+}
+
+// Function to pick up edits made to the settings file while running
+void ReloadSettingsIfChanged()
+{
+    FILETIME time;
+    if (!GetAppFileTime(SETTINGS_FILE, time) || CompareFileTime(&time, &settingsFileTime) == 0)
+        return;
+
+    LayoutSettings settings;
+    LoadLayoutSettings(settings);
+    SetLayoutSettings(settings);
+
+    // Keep an open panel in step with the file
+    ShowSettingInPanel(hPixelFixXEdit, settings.pixelFixX);
+    ShowSettingInPanel(hPixelFixYEdit, settings.pixelFixY);
+    ShowSettingInPanel(hMinSpacingYEdit, settings.minSpacingY);
+    if (hMonitorComboBox)
+        ComboBox_SetCurSel(hMonitorComboBox, settings.monitorSelection);
+    CountMetric(METRIC_SETTINGS_RELOADS);
+}
+
+// Function to load the layouts file. On failure errorLine holds the
+// offending line, or 0 if the file could not be read.
+bool LoadCustomLayouts(const std::wstring& path, std::vector<LayoutProgram>& layouts, int& errorLine)
+{
+    layouts.clear();
+    errorLine = 0;
+
+    std::wstring text;
+    if (!ReadUtf8File(path, text))
+        return false;
+
+    int lineNumber = 0;
+    size_t start = 0;
+    while (start <= text.size())
+    {
+        size_t end = text.find(L'\n', start);
+        if (end == std::wstring::npos)
+            end = text.size();
+        std::wstring line = TrimString(text.substr(start, end - start));
+        start = end + 1;
+        lineNumber++;
+
+        if (line.empty() || line[0] == L'#')
+            continue;
+
+        LayoutProgram program;
+        if (!ParseLayoutLine(line, program) || layouts.size() >= MAX_CUSTOM_LAYOUTS)
+        {
+            errorLine = lineNumber;
+            return false;
+        }
+        layouts.push_back(program);
+    }
+    return true;
+}
+
+// Function to pick up the layouts file when it appears or is edited. A
+// file with errors is reported and the layouts loaded before are kept.
+void ReloadCustomLayoutsIfChanged()
+{
+    FILETIME time;
+    if (!GetAppFileTime(LAYOUTS_FILE, time) || CompareFileTime(&time, &customLayoutsFileTime) == 0)
+        return;
+    customLayoutsFileTime = time;
+
+    std::vector<LayoutProgram> layouts;
+    int errorLine = 0;
+    if (!LoadCustomLayouts(GetAppFilePath(LAYOUTS_FILE), layouts, errorLine))
+    {
+        wchar_t message[256];
+        if (errorLine > 0)
+            swprintf_s(message, 256, L"Invalid layout on line %d of %s.", errorLine, LAYOUTS_FILE);
+        else
+            swprintf_s(message, 256, L"Cannot read %s next to the executable.", LAYOUTS_FILE);
+        TimedMessageBox(NULL, message, L"Error", MB_OK);
+        return;
+    }
+
+    customLayouts.swap(layouts);
+    if (currentCustomLayout >= static_cast<int>(customLayouts.size()))
+        currentCustomLayout = 0;
+    if (currentLayoutMode == LAYOUT_CUSTOM && customLayouts.empty())
+    {
+        currentLayoutMode = LAYOUT_GRID;
+        RequestWindowRegistryPublish();
+    }
+    CountMetric(METRIC_LAYOUT_RELOADS);
+}
+
+// Function to look up the names of a window that some binding kind of a
+// layout tests; names no binding tests are left empty
+static void GetLayoutWindowNames(HWND hWnd, const bool* bindsKind, LayoutWindowNames& names)
+{
+    // A replayed trace names its simulated windows itself
+    auto replayed = replayWindowNames.find(hWnd);
+    bool isReplayed = replayed != replayWindowNames.end();
+    if (bindsKind[LAYOUT_BIND_PROCESS])
+        names.process = isReplayed ? replayed->second.process : GetProcessNameForWindow(hWnd);
+    if (bindsKind[LAYOUT_BIND_CLASS])
+    {
+        if (isReplayed)
+        {
+            names.className = replayed->second.className;
+        }
+        else
+        {
+            wchar_t className[256];
+            GetClassName(hWnd, className, sizeof(className) / sizeof(wchar_t));
+            names.className = ToLower(className);
+        }
+    }
+    if (bindsKind[LAYOUT_BIND_RULE])
+    {
+        // The group key is cached, and names the rule that took the window
+        names.rule = groupKeyRules[GetWindowGroupId(hWnd)];
+    }
+}
+
+// Function to compute the cells of the current custom layout for windows,
+// in their order; bound regions take the windows their bindings match
+bool ComputeCustomLayout(const GridLayoutParams& params, const std::vector<HWND>& windows, std::vector<RECT>& cells)
+{
+    int numWindows = static_cast<int>(windows.size());
+
+    // The layouts file may have gone away since the mode was chosen
+    if (customLayouts.empty())
+    {
+        GridLayoutParams gridParams = params;
+        gridParams.layoutMode = LAYOUT_GRID;
+        return ComputeGridLayout(gridParams, numWindows, cells);
+    }
+
+    auto getNames = [&windows](int window, const bool* bindsKind, LayoutWindowNames& names)
+    {
+        GetLayoutWindowNames(windows[window], bindsKind, names);
+    };
+    return ComputeProgramLayout(params, customLayouts[currentCustomLayout], numWindows, getNames, cells);
+}
+
+// Function to get the group a window is tiled with in the grouped layout:
+// the capture rule that took it when rules are loaded, else its process.
+// Keys are cached per window since looking up a process is a system call.
+const std::wstring& GetWindowGroupKey(HWND hWnd)
+{
+    return groupKeyNames[GetWindowGroupId(hWnd)];
+}
+
+// Function to get the id of a group key, giving a new key the next id
+int InternGroupKey(const std::wstring& key)
+{
+    auto it = groupKeyIds.find(key);
+    if (it != groupKeyIds.end())
+        return it->second;
+    int id = static_cast<int>(groupKeyNames.size());
+    groupKeyNames.push_back(key);
+    groupKeyRules.push_back(key.compare(0, 5, L"rule:") == 0 ? _wtoi(key.c_str() + 5) : -1);
+    groupKeyIds.emplace(key, id);
+    return id;
+}
+
+// Function to get the interned group key of a window, looking it up the
+// first time the window is seen
+int GetWindowGroupId(HWND hWnd)
+{
+    auto it = windowGroupKeys.find(hWnd);
+    if (it != windowGroupKeys.end())
+        return it->second;
+
+    std::wstring key;
+    WindowDescriptor window;
+    int rule = -1;
+    if (!captureRuleTable.rules.empty() && GetWindowDescriptor(hWnd, captureRuleTable, window) &&
+        ClassifyWindow(captureRuleTable, window, &rule) && rule >= 0)
+    {
+        key = L"rule:" + std::to_wstring(rule);
+    }
+    else
+    {
+        key = L"process:" + GetProcessNameForWindow(hWnd);
+    }
+    return windowGroupKeys.emplace(hWnd, InternGroupKey(key)).first->second;
+}
+
+// Function to get the interned group key of every window, in list order
+void GetWindowGroupIds(const std::vector<HWND>& windows, std::vector<int>& keys)
+{
+    keys.resize(windows.size());
+    for (size_t i = 0; i < windows.size(); ++i)
+    {
+        keys[i] = GetWindowGroupId(windows[i]);
+    }
+
+    // Forget windows that are no longer captured
+    if (windowGroupKeys.size() > windows.size() * 2)
+    {
+        std::unordered_map<HWND, int> live;
+        for (size_t i = 0; i < windows.size(); ++i)
+        {
+            live.emplace(windows[i], keys[i]);
+        }
+        windowGroupKeys.swap(live);
+    }
+}
+
+// Function to lay out the windows grouped by process or capture rule (see
+// ComputeGroupedLayout in LayoutSolver.h), reusing the cached regions
+bool ComputeGroupedLayout(const GridLayoutParams& params, const std::vector<HWND>& windows, std::vector<RECT>& cells)
+{
+    std::vector<int> keys;
+    GetWindowGroupIds(windows, keys);
+    return ComputeGroupedLayout(params, keys, layoutGroups, cells);
+}
+
+// Function to get the work area and effective DPI of every monitor in
+// monitorMap, in its order. This relies on the process being per-monitor
+// aware: rcWork is then in physical pixels and GetDpiForMonitor reports
+// each monitor's real scale instead of 96.
+void GetLayoutMonitors(std::vector<MonitorArea>& monitors)
+{
+    monitors.clear();
+    for (const auto& entry : monitorMap)
+    {
+        MonitorArea monitor;
+        monitor.workArea = entry.second.rcWork;
+        auto dpi = monitorDpiMap.find(entry.first);
+        monitor.dpi = (dpi != monitorDpiMap.end()) ? dpi->second : 0;
+        monitors.push_back(monitor);
+    }
+}
+
+// Function to lay out the windows over all monitors in monitorMap. The
+// caller applies all cells as one batch. Grouped and custom layouts span
+// one monitor, so every monitor is tiled as a grid here; ArrangeWindows
+// tells the user (IsGridFallbackLayout).
+bool ComputeMultiMonitorLayout(const GridLayoutParams& params, int numWindows, std::vector<RECT>& cells)
+{
+    std::vector<MonitorArea> monitors;
+    GetLayoutMonitors(monitors);
+    return ComputeMultiMonitorLayout(params, monitors, numWindows, cells);
+}
+
+// Function to tell whether a layout is replaced by the grid: grouped and
+// custom layouts are not spread over all monitors
+bool IsGridFallbackLayout(const GridLayoutParams& params)
+{
+    return params.allMonitors && (params.layoutMode == LAYOUT_GROUPED || params.layoutMode == LAYOUT_CUSTOM);
+}
+
+// Function to compute the cells of windows, in list order, for the selected
+// monitor or for all of them
+bool ComputeLayout(const GridLayoutParams& params, const std::vector<HWND>& windows, std::vector<RECT>& cells, TiledLayout* grid)
+{
+    int numWindows = static_cast<int>(windows.size());
+    if (!params.allMonitors && params.layoutMode != LAYOUT_GROUPED && params.layoutMode != LAYOUT_CUSTOM)
+        return ComputeGridLayout(params, numWindows, cells, grid);
+
+    // Linked resizing follows a single grid, so it is off for these layouts
+    if (grid)
+        grid->valid = false;
+    if (params.allMonitors)
+        return ComputeMultiMonitorLayout(params, numWindows, cells);
+    if (params.layoutMode == LAYOUT_CUSTOM)
+        return ComputeCustomLayout(params, windows, cells);
+    return ComputeGroupedLayout(params, windows, cells);
+}
+
+// Function to compute the outer window size whose client area fills a cell
+static SIZE GetAdjustedWindowSize(HWND hWnd, const RECT& cell)
+{
+    int cellWidth = cell.right - cell.left;
+    int cellHeight = cell.bottom - cell.top;
+
+    // Desired client area size
+    RECT desiredClientRect = { 0, 0, cellWidth, cellHeight };
+
+    // Get current window style
+    LONG style = GetWindowLong(hWnd, GWL_STYLE);
+    LONG exStyle = GetWindowLong(hWnd, GWL_EXSTYLE);
+
+    // Adjust window size to fit desired client area
+    RECT adjustedWindowRect = desiredClientRect;
+    if (!AdjustWindowRectEx(&adjustedWindowRect, style, FALSE, exStyle))
+    {
+        // Fallback if AdjustWindowRectEx fails
+        adjustedWindowRect.right = cellWidth;
+        adjustedWindowRect.bottom = cellHeight;
+    }
+
+    SIZE size = { adjustedWindowRect.right - adjustedWindowRect.left, adjustedWindowRect.bottom - adjustedWindowRect.top };
+    return size;
+}
+
+// Function to measure how far a window's rectangle reaches past the frame
+// DWM actually draws (the invisible resize borders and shadow). Windows
+// with the same class, styles and DPI share their frame, so the insets are
+// measured once per combination and cached. The process is per-monitor
+// DPI aware, so both rectangles are in physical pixels.
+static bool GetFrameInsets(HWND hWnd, RECT& insets)
+{
+    wchar_t className[256];
+    if (!GetClassName(hWnd, className, sizeof(className) / sizeof(wchar_t)))
+        return false;
+    wchar_t styles[32];
+    swprintf_s(styles, 32, L"/%08X/%08X@", static_cast<unsigned int>(GetWindowLong(hWnd, GWL_STYLE)),
+        static_cast<unsigned int>(GetWindowLong(hWnd, GWL_EXSTYLE)));
+    std::wstring key = std::wstring(className) + styles + std::to_wstring(GetDpiForWindow(hWnd));
+
+    auto it = frameInsetCache.find(key);
+    if (it != frameInsetCache.end())
+    {
+        insets = it->second;
+        return true;
+    }
+
+    // Minimized and maximized windows do not show their normal frame
+    if (IsIconic(hWnd) || IsZoomed(hWnd))
+        return false;
+
+    RECT windowRect, frameRect;
+    if (!GetWindowRect(hWnd, &windowRect) ||
+        FAILED(DwmGetWindowAttribute(hWnd, DWMWA_EXTENDED_FRAME_BOUNDS, &frameRect, sizeof(frameRect))))
+    {
+        return false;
+    }
+
+    insets.left = frameRect.left - windowRect.left;
+    insets.top = frameRect.top - windowRect.top;
+    insets.right = windowRect.right - frameRect.right;
+    insets.bottom = windowRect.bottom - frameRect.bottom;
+
+    // Anything else is a window mid-animation or with custom bounds; do not trust it
+    if (insets.left < 0 || insets.top < 0 || insets.right < 0 || insets.bottom < 0 ||
+        insets.left > MAX_FRAME_INSET || insets.top > MAX_FRAME_INSET ||
+        insets.right > MAX_FRAME_INSET || insets.bottom > MAX_FRAME_INSET)
+    {
+        return false;
+    }
+
+    frameInsetCache[key] = insets;
+    return true;
+}
+
+// Function to get the window rectangle whose visible frame exactly fills a
+// cell. Without frame insets, the client area is fitted to the cell instead.
+static RECT GetWindowRectForCell(HWND hWnd, const RECT& cell)
+{
+    RECT rect;
+    RECT insets;
+    if (GetFrameInsets(hWnd, insets))
+    {
+        rect.left = cell.left - insets.left;
+        rect.top = cell.top - insets.top;
+        rect.right = cell.right + insets.right;
+        rect.bottom = cell.bottom + insets.bottom;
+        return rect;
+    }
+
+    SIZE size = GetAdjustedWindowSize(hWnd, cell);
+    rect.left = cell.left;
+    rect.top = cell.top;
+    rect.right = cell.left + size.cx;
+    rect.bottom = cell.top + size.cy;
+    return rect;
+}
+
+// Function to move windows to their "after" (forward) or "before" rectangles in
+// one batch, through the live backend
+void ApplyWindowMoves(const std::vector<WindowMove>& moves, bool forward)
+{
+    ApplyWindowMoves(liveApplyBackend, moves, forward);
+}
+
+// Function to move all captured windows into their cells in one batch.
+// Windows already in place are left alone, and the change is recorded in
+// the layout history.
+void ApplyWindowLayoutBatch(const std::vector<RECT>& cells)
+{
+    size_t count = (std::min)(cells.size(), windowList.handles.size());
+
+    std::vector<WindowMove> moves;
+    moves.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        WindowMove move;
+        move.hWnd = windowList.handles[i];
+        if (!GetWindowRect(move.hWnd, &move.before))
+            continue;
+
+        move.after = GetWindowRectForCell(move.hWnd, cells[i]);
+        if (!EqualRect(&move.before, &move.after))
+            moves.push_back(move);
+    }
+
+    BeginLayoutHistoryEntry();
+    for (const auto& move : moves)
+    {
+        RecordWindowMove(move);
+    }
+    CommitLayoutHistoryEntry();
+
+    ApplyWindowMoves(moves, true);
+}
+
+// Function to finish an arrange through the live backend: one ordered
+// batch, then the tool steps aside and one window is activated
+void ApplyArrangeMoves(const std::vector<WindowMove>& moves)
+{
+    if (ApplyArrangeMoves(liveApplyBackend, moves))
+        CountMetric(METRIC_ARRANGE_ACTIVATIONS);
+}
+
+// Function to ask for an arrange. Requests are not run on the spot: they
+// fill a single pending slot that is served by WM_ARRANGE_REQUEST, so a
+// burst of key repeats queued behind a slow arrange collapses into one.
+// Panel edits still being typed are committed first, so a hotkey pressed
+// before the edit box loses focus arranges with what the panel shows.
+void RequestArrange()
+{
+    CountMetric(METRIC_ARRANGE_REQUESTS);
+    CommitPanelSettings(false);
+    switch (AddArrangeRequest(arrangeScheduler))
+    {
+    case ARRANGE_REQUEST_DROPPED:
+        CountMetric(METRIC_ARRANGE_REQUESTS_DROPPED);
+        break;
+    case ARRANGE_REQUEST_POST:
+        PostMessage(hMainWindow, WM_ARRANGE_REQUEST, 0, 0);
+        break;
+    default:
+        break;
+    }
+}
+
+// Function to serve the pending arrange request
+void RunPendingArrange()
+{
+    if (!BeginPendingArrange(arrangeScheduler))
+        return;
+
+    ArrangeWindows();
+    if (EndArrange(arrangeScheduler))
+        PostMessage(hMainWindow, WM_ARRANGE_REQUEST, 0, 0);
+}
+
+// Function to check whether a newer arrange request is waiting, in which
+// case the running arrange is abandoned before its next commit
+static bool IsArrangeSuperseded()
+{
+    if (IsArrangeSuperseded(arrangeScheduler))
+        return true;
+
+    MSG msg;
+    if (PeekMessage(&msg, hMainWindow, WM_ARRANGE_REQUEST, WM_ARRANGE_REQUEST, PM_NOREMOVE))
+        return true;
+    if (PeekMessage(&msg, hMainWindow, WM_HOTKEY, WM_HOTKEY, PM_NOREMOVE))
+    {
+        UINT modifiers = LOWORD(msg.lParam);
+        UINT vk = HIWORD(msg.lParam);
+        return hotkeyTable[modifiers & 0xF][vk & 0xFF].action == HOTKEY_ARRANGE;
+    }
+    return false;
+}
+
+// Function to plan the move of every captured window into its cell, in
+// list order; windows closed since the layout was computed are skipped
+static void BuildWindowMoves(const std::vector<RECT>& cells, std::vector<WindowMove>& moves)
+{
+    size_t count = (std::min)(cells.size(), windowList.handles.size());
+    moves.clear();
+    moves.reserve(count);
+    for (size_t windowIndex = 0; windowIndex < count; ++windowIndex)
+    {
+        HWND hWnd = windowList.handles[windowIndex];
+        const RECT& cell = cells[windowIndex];
+
+        if (!IsWindow(hWnd))
+        {
+            // Window is no longer valid; skip
+            CountMetric(METRIC_WINDOWS_SKIPPED_CLOSED);
+            continue;
+        }
+        if (IsHungAppWindow(hWnd))
+            CountMetric(METRIC_WINDOWS_HUNG);
+
+        WindowMove move;
+        move.hWnd = hWnd;
+        GetWindowRect(hWnd, &move.before);
+        move.after = GetWindowRectForCell(hWnd, cell);
+        moves.push_back(move);
+    }
+}
+
+// Function to arrange windows considering multiple monitors and ensuring equal sizes
+void ArrangeWindows()
+{
+    if (windowList.handles.empty())
+    {
+        TimedMessageBox(NULL, L"No windows to arrange. Please capture windows first.", L"Info", MB_OK);
+        return;
+    }
+
+    // Check and remove any closed windows before arranging
+    CheckAndRemoveClosedWindows();
+
+    if (windowList.handles.empty())
+    {
+        TimedMessageBox(NULL, L"No valid windows to arrange.", L"Info", MB_OK);
+        return;
+    }
+
+    // The layout inputs are read from the snapshot; publish any change first
+    FlushWindowRegistryPublish();
+    GridLayoutParams params;
+    if (!GetGridLayoutParams(params, true))
+        return;
+
+    // Only the solve and the apply are timed, not the checks above and their messages
+    ScopedLatency latency(METRIC_ARRANGE_LATENCY);
+    std::vector<RECT> cells;
+    TiledLayout grid;
+    if (!ComputeLayout(params, windowList.handles, cells, &grid))
+    {
+        latency.Stop();
+        TimedMessageBox(NULL, L"Not enough vertical space for the specified spacing and Pixel Fix Y. Please reduce the spacing or Pixel Fix Y.", L"Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+
+    if (IsArrangeSuperseded())
+    {
+        CountMetric(METRIC_ARRANGES_CANCELLED);
+        return;
+    }
+
+    SetTiledLayout(grid, cells);
+
+    // Bring minimized windows back first, once each, so they are placed
+    // as normal windows rather than having their restore position changed
+    for (HWND hWnd : windowList.handles)
+    {
+        if (IsWindow(hWnd) && IsIconic(hWnd))
+            ShowWindow(hWnd, SW_RESTORE);
+    }
+
+    // Now, arrange the windows
+    std::vector<WindowMove> moves;
+    BuildWindowMoves(cells, moves);
+
+    // Restoring windows takes a while; a newer request may have come in
+    if (IsArrangeSuperseded())
+    {
+        CountMetric(METRIC_ARRANGES_CANCELLED);
+        return;
+    }
+
+    // Remember where the windows were for undo
+    BeginLayoutHistoryEntry();
+    for (const auto& move : moves)
+    {
+        if (!EqualRect(&move.before, &move.after))
+            RecordWindowMove(move);
+    }
+    CommitLayoutHistoryEntry();
+
+    RecordTraceArrange(params);
+    ApplyArrangeMoves(moves);
+    CountMetric(METRIC_ARRANGES);
+    CountMetric(METRIC_WINDOWS_ARRANGED, moves.size());
+
+    // Once per layout and monitor choice, say why the layout looks like the grid
+    if (IsGridFallbackLayout(params) && !gridFallbackReported)
+    {
+        gridFallbackReported = true;
+        latency.Stop();
+        TimedMessageBox(NULL, (params.layoutMode == LAYOUT_CUSTOM) ?
+            L"Custom layouts apply to one monitor. With all monitors selected, each monitor is tiled as a grid." :
+            L"The grouped layout applies to one monitor. With all monitors selected, each monitor is tiled as a grid.",
+            L"Info", MB_OK);
+    }
+}
+
+// Function to remember the grid and cells the captured windows were just tiled into
+void SetTiledLayout(const TiledLayout& grid, const std::vector<RECT>& cells)
+{
+    tiledLayout = grid;
+    tiledLayout.cells = cells;
+    tiledLayout.windows.clear();
+    if (!tiledLayout.valid)
+    {
+        PublishLayoutState();
+        return;
+    }
+
+    tiledLayout.windows = windowList.handles;
+    tiledLayout.windows.resize(tiledLayout.rows * tiledLayout.columns, NULL);
+    PublishLayoutState();
+}
+
+// Function to get the cell a list position is tiled into. The grid is
+// preferred because linked resizing keeps it current.
+static bool GetPositionCell(int position, RECT& cell)
+{
+    if (tiledLayout.valid && position < tiledLayout.rows * tiledLayout.columns)
+    {
+        cell = GetGridCell<RECT>(tiledLayout, position / tiledLayout.columns, position % tiledLayout.columns);
+        return true;
+    }
+    if (position < static_cast<int>(tiledLayout.cells.size()))
+    {
+        cell = tiledLayout.cells[position];
+        return true;
+    }
+    return false;
+}
+
+// Function to get the time since the drag started, in milliseconds
+static double GetLinkedResizeMs()
+{
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (now.QuadPart - linkedResize.dragStart.QuadPart) * 1000.0 / frequency.QuadPart;
+}
+
+// Function to turn linked resizing on or off. Only the rare move/size
+// start and end events are hooked; location changes are only followed
+// for the process owning the window being dragged.
+void EnableLinkedResize(bool enable)
+{
+    if (enable && !hMoveSizeHook)
+    {
+        hMoveSizeHook = SetWinEventHook(EVENT_SYSTEM_MOVESIZESTART, EVENT_SYSTEM_MOVESIZEEND, NULL,
+            LinkedResizeWinEventProc, 0, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+    }
+    else if (!enable && hMoveSizeHook)
+    {
+        if (linkedResize.hDragged)
+            EndLinkedResize();
+        UnhookWinEvent(hMoveSizeHook);
+        hMoveSizeHook = NULL;
+    }
+}
+
+// WinEvent callback for drags of tiled windows
+void CALLBACK LinkedResizeWinEventProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD idEventThread, DWORD dwmsEventTime)
+{
+    ScopedLatency latency(METRIC_HOOK_CALLBACK_LATENCY);
+    if (idObject != OBJID_WINDOW || idChild != CHILDID_SELF)
+        return;
+
+    switch (event)
+    {
+    case EVENT_SYSTEM_MOVESIZESTART:
+        BeginLinkedResize(hwnd);
+        break;
+    case EVENT_OBJECT_LOCATIONCHANGE:
+        // Commit right away if this display frame has no commit yet; else
+        // the frame timer commits the change in the next one
+        if (hwnd == linkedResize.hDragged)
+        {
+            if (!linkedResize.dirty)
+            {
+                linkedResize.dirty = true;
+                linkedResize.changeMs = GetLinkedResizeMs();
+            }
+            OnLinkedResizeFrame();
+        }
+        break;
+    case EVENT_SYSTEM_MOVESIZEEND:
+        if (hwnd == linkedResize.hDragged)
+            EndLinkedResize();
+        break;
+    default:
+        break;
+    }
+}
+
+// Function to start following a drag if the window is part of the tiled grid
+void BeginLinkedResize(HWND hwnd)
+{
+    if (linkedResize.hDragged || !tiledLayout.valid)
+        return;
+
+    int position = -1;
+    for (size_t i = 0; i < tiledLayout.windows.size(); ++i)
+    {
+        if (tiledLayout.windows[i] == hwnd)
+        {
+            position = static_cast<int>(i);
+            break;
+        }
+    }
+    if (position < 0 || !GetWindowRect(hwnd, &linkedResize.startRect))
+        return;
+
+    linkedResize.hDragged = hwnd;
+    linkedResize.row = position / tiledLayout.columns;
+    linkedResize.column = position % tiledLayout.columns;
+    linkedResize.startGrid = tiledLayout;
+    GetLinkedReflowPositions(tiledLayout, linkedResize.row, linkedResize.column, linkedResize.positions);
+    linkedResize.startRects.assign(tiledLayout.windows.size(), RECT());
+    for (size_t i = 0; i < tiledLayout.windows.size(); ++i)
+    {
+        if (tiledLayout.windows[i])
+            GetWindowRect(tiledLayout.windows[i], &linkedResize.startRects[i]);
+    }
+    linkedResize.dirty = false;
+    linkedResize.lastFrame = -1;
+    linkedResize.frames = 0;
+    linkedResize.droppedFrames = 0;
+
+    // Commit once per display refresh. Location changes commit as they
+    // come; the timer only picks up a change that had to wait for the next
+    // frame. Timers are rounded to their resolution, so it ticks as often
+    // as it can and OnLinkedResizeFrame keeps commits to one per frame.
+    HDC hdc = GetDC(NULL);
+    int refreshRate = GetDeviceCaps(hdc, VREFRESH);
+    ReleaseDC(NULL, hdc);
+    if (refreshRate <= 1)
+        refreshRate = 60;
+    linkedResize.framePeriodMs = 1000.0 / refreshRate;
+    QueryPerformanceCounter(&linkedResize.dragStart);
+    SetTimer(hMainWindow, ID_LINKED_RESIZE_TIMER, USER_TIMER_MINIMUM, NULL);
+
+    DWORD processId = 0;
+    GetWindowThreadProcessId(hwnd, &processId);
+    linkedResize.hLocationHook = SetWinEventHook(EVENT_OBJECT_LOCATIONCHANGE, EVENT_OBJECT_LOCATIONCHANGE, NULL,
+        LinkedResizeWinEventProc, processId, 0, WINEVENT_OUTOFCONTEXT);
+}
+
+// Function to reflow the neighbors of the dragged window. The grid is
+// reflowed in place and only the positions next to the dragged cell are
+// looked at, so a frame's work follows the dragged row and column, not
+// the number of windows. When the drag ends the dragged window snaps
+// into its new cell and the whole drag, from the rectangles at drag
+// start, becomes one layout history entry. A plain move instead takes
+// the window out of the grid where it was dropped.
+void ReflowLinkedResize(bool final)
+{
+    RECT rect;
+    if (!GetWindowRect(linkedResize.hDragged, &rect))
+        return;
+
+    // An arrange during the drag replaced the grid the drag started in
+    int row = linkedResize.row;
+    int column = linkedResize.column;
+    if (!tiledLayout.valid || tiledLayout.rows != linkedResize.startGrid.rows || tiledLayout.columns != linkedResize.startGrid.columns ||
+        tiledLayout.windows[row * tiledLayout.columns + column] != linkedResize.hDragged)
+        return;
+
+    std::vector<RECT>& oldCells = linkedResize.cells;
+    oldCells.clear();
+    for (int position : linkedResize.positions)
+    {
+        oldCells.push_back(GetGridCell<RECT>(tiledLayout, position / tiledLayout.columns, position % tiledLayout.columns));
+    }
+    if (!ReflowLinkedGrid(linkedResize.startGrid, tiledLayout, row, column, linkedResize.startRect, rect))
+    {
+        if (final && !EqualRect(&rect, &linkedResize.startRect))
+            tiledLayout.windows[row * tiledLayout.columns + column] = NULL;
+        return;
+    }
+
+    if (final)
+        BeginLayoutHistoryEntry();
+    std::vector<WindowMove> moves;
+    for (size_t i = 0; i < linkedResize.positions.size(); ++i)
+    {
+        int position = linkedResize.positions[i];
+        HWND hWnd = tiledLayout.windows[position];
+        if (!hWnd || !IsWindow(hWnd))
+            continue;
+
+        // The dragged window belongs to the user until the drag ends
+        if (hWnd == linkedResize.hDragged && !final)
+            continue;
+
+        RECT newCell = GetGridCell<RECT>(tiledLayout, position / tiledLayout.columns, position % tiledLayout.columns);
+        if (!final && EqualRect(&oldCells[i], &newCell))
+            continue;
+
+        WindowMove move;
+        move.hWnd = hWnd;
+        GetWindowRect(hWnd, &move.before);
+        move.after = GetWindowRectForCell(hWnd, newCell);
+        if (!EqualRect(&move.before, &move.after))
+            moves.push_back(move);
+
+        // History undoes the whole drag, not just its last frame
+        if (final && !EqualRect(&linkedResize.startRects[position], &move.after))
+        {
+            WindowMove change = { hWnd, linkedResize.startRects[position], move.after };
+            RecordWindowMove(change);
+        }
+    }
+
+    ApplyWindowMoves(moves, true);
+    if (final)
+        CommitLayoutHistoryEntry();
+}
+
+// Function called on location changes and by the frame timer during a
+// drag: commits the latest position once per display frame. Calls without
+// a change cost nothing and are not frames; a commit that lands after the
+// frame following the change it shows counts the frames it missed.
+void OnLinkedResizeFrame()
+{
+    if (!linkedResize.dirty)
+        return;
+    long long frame = static_cast<long long>(GetLinkedResizeMs() / linkedResize.framePeriodMs);
+    if (frame == linkedResize.lastFrame)
+        return;
+
+    linkedResize.dirty = false;
+    linkedResize.lastFrame = frame;
+    linkedResize.frames++;
+    ReflowLinkedResize(false);
+    linkedResize.droppedFrames += CountMissedFrames(linkedResize.changeMs, GetLinkedResizeMs(), linkedResize.framePeriodMs);
+}
+
+// Function to finish a drag: snap the dragged window into its new cell
+void EndLinkedResize()
+{
+    KillTimer(hMainWindow, ID_LINKED_RESIZE_TIMER);
+    if (linkedResize.hLocationHook)
+    {
+        UnhookWinEvent(linkedResize.hLocationHook);
+        linkedResize.hLocationHook = NULL;
+    }
+
+    ReflowLinkedResize(true);
+    CountMetric(METRIC_LINKED_RESIZE_FRAMES, linkedResize.frames);
+    CountMetric(METRIC_LINKED_RESIZE_FRAMES_DROPPED, linkedResize.droppedFrames);
+
+    linkedResize.hDragged = NULL;
+    linkedResize.startGrid = GridGeometry();
+    linkedResize.startRects.clear();
+    linkedResize.positions.clear();
+    PublishLayoutState();
+}
+
+// Function to re-solve the layout silently and apply it as a single batch.
+// Used by the auto-tiling daemon, which must never pop up message boxes.
+void RelayoutWindows()
+{
+    ScopedLatency latency(METRIC_ARRANGE_LATENCY);
+    // Drop closed windows without notifying the user
+    if (RemoveClosedWindowRecords(windowList, false) > 0)
+        RefreshWindowList();
+
+    if (windowList.handles.empty())
+        return;
+
+    // The layout inputs are read from the snapshot; publish any change first
+    FlushWindowRegistryPublish();
+    GridLayoutParams params;
+    if (!GetGridLayoutParams(params, false))
+        return;
+
+    std::vector<RECT> cells;
+    TiledLayout grid;
+    if (!ComputeLayout(params, windowList.handles, cells, &grid))
+        return;
+
+    SetTiledLayout(grid, cells);
+    RecordTraceArrange(params);
+    ApplyWindowLayoutBatch(cells);
+    CountMetric(METRIC_ARRANGES);
+    CountMetric(METRIC_WINDOWS_ARRANGED, windowList.handles.size());
+}
+
+// Function to check whether a window should be captured by the auto-tiling daemon.
+// The capture rules decide if a rules file is loaded, otherwise the title box.
+bool MatchesAutoTileRule(HWND hwnd)
+{
+    if (hwnd == hMainWindow)
+        return false;
+
+    // Only visible top-level windows are tiled
+    if (GetAncestor(hwnd, GA_ROOT) != hwnd || !IsWindowVisible(hwnd))
+        return false;
+
+    if (!captureRuleTable.rules.empty())
+    {
+        WindowDescriptor window;
+        return GetWindowDescriptor(hwnd, captureRuleTable, window) && ClassifyWindow(captureRuleTable, window);
+    }
+
+    if (autoTileTitle.empty())
+        return false;
+
+    wchar_t windowTitle[256];
+    GetWindowText(hwnd, windowTitle, sizeof(windowTitle) / sizeof(wchar_t));
+    return _wcsicmp(windowTitle, autoTileTitle.c_str()) == 0;
+}
+
+// Function to (re)start the debounce timer for the next relayout
+void ScheduleAutoTileRelayout()
+{
+    CountMetric(METRIC_AUTO_TILE_EVENTS);
+    if (AddAutoTileBurstEvent(autoTileBurst, GetTickCount()))
+        SetTimer(hMainWindow, ID_AUTO_TILE_TIMER, AUTO_TILE_DEBOUNCE_MS, NULL);
+}
+
+// Function to update the captured list for a window event while
+// auto-tiling. Returns true if the list changed and needs a relayout.
+static bool UpdateAutoTileList(DWORD event, HWND hwnd)
+{
+    int kind = (event == EVENT_OBJECT_SHOW) ? AUTO_TILE_EVENT_SHOW :
+        (event == EVENT_OBJECT_DESTROY) ? AUTO_TILE_EVENT_DESTROY : AUTO_TILE_EVENT_OTHER;
+    int position = FindWindowRecord(windowList, hwnd);
+    switch (GetAutoTileListChange(kind, position >= 0, [hwnd]() { return MatchesAutoTileRule(hwnd); }))
+    {
+    case AUTO_TILE_LIST_ADD:
+    {
+        wchar_t windowTitle[256];
+        GetWindowText(hwnd, windowTitle, sizeof(windowTitle) / sizeof(wchar_t));
+        AddWindowRecord(windowList, hwnd, windowTitle);
+        return true;
+    }
+    case AUTO_TILE_LIST_REMOVE:
+        EraseWindowRecord(windowList, position);
+        return true;
+    default:
+        return false;
+    }
+}
+
+// WinEvent callback for window creation and destruction while auto-tiling.
+// The hook is out-of-context, so this runs on the UI thread's message loop.
+void CALLBACK AutoTileWinEventProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD idEventThread, DWORD dwmsEventTime)
+{
+    ScopedLatency latency(METRIC_HOOK_CALLBACK_LATENCY);
+    if (!autoTileEnabled || hwnd == NULL || idObject != OBJID_WINDOW || idChild != CHILDID_SELF)
+        return;
+
+    if (UpdateAutoTileList(event, hwnd))
+        ScheduleAutoTileRelayout();
+}
+
+// Function to turn the auto-tiling daemon on or off
+void EnableAutoTiling(bool enable)
+{
+    if (enable == autoTileEnabled)
+        return;
+
+    if (enable)
+    {
+        autoTileTitle = GetPanelText(hWindowTitleEdit, panelState.windowTitle);
+
+        // Use the capture rules if there is a valid rules file
+        std::vector<CaptureRule> rules;
+        int errorLine = 0;
+        if (!LoadCaptureRules(GetAppFilePath(CAPTURE_RULES_FILE), rules, errorLine))
+            rules.clear();
+        CompileCaptureRules(rules, captureRuleTable);
+        windowGroupKeys.clear();
+
+        // Destroy and show cover both ends of a window's life; creation itself
+        // is ignored because most windows get their title before being shown
+        hWinEventHook = SetWinEventHook(EVENT_OBJECT_DESTROY, EVENT_OBJECT_SHOW, NULL,
+            AutoTileWinEventProc, 0, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+        if (hWinEventHook == NULL)
+        {
+            TimedMessageBox(NULL, L"Cannot set window event hook.", L"Error", MB_OK);
+            Button_SetCheck(hAutoTileCheckBox, BST_UNCHECKED);
+            return;
+        }
+
+        autoTileEnabled = true;
+
+        // Pick up matching windows that already exist, then tile once
+        if (!captureRuleTable.rules.empty())
+        {
+            EnumWindows(EnumWindowsByRulesProc, 0);
+        }
+        else if (!autoTileTitle.empty())
+        {
+            EnumWindows(EnumWindowsProc, reinterpret_cast<LPARAM>(&autoTileTitle));
+        }
+        RefreshWindowList();
+        RelayoutWindows();
+    }
+    else
+    {
+        autoTileEnabled = false;
+        if (hWinEventHook)
+        {
+            UnhookWinEvent(hWinEventHook);
+            hWinEventHook = NULL;
+        }
+        KillTimer(hMainWindow, ID_AUTO_TILE_TIMER);
+        autoTileBurst.relayoutPending = false;
+    }
+}
+
+// Callback for enumerating monitors
+BOOL CALLBACK MonitorEnumProc(HMONITOR hMonitor, HDC hdcMonitor, LPRECT lprcMonitor, LPARAM dwData)
+{
+    MONITORINFO mi = { 0 };
+    mi.cbSize = sizeof(mi);
+    if (GetMonitorInfo(hMonitor, &mi))
+    {
+        int index = static_cast<int>(monitorMap.size());
+        monitorMap[index] = mi;
+
+        UINT dpiX = 96, dpiY = 96;
+        if (FAILED(GetDpiForMonitor(hMonitor, MDT_EFFECTIVE_DPI, &dpiX, &dpiY)))
+            dpiX = 96;
+        monitorDpiMap[index] = dpiX;
+
+        wchar_t monitorName[256];
+        wsprintf(monitorName, L"Monitor %d (%dx%d)", index + 1,
+            mi.rcMonitor.right - mi.rcMonitor.left,
+            mi.rcMonitor.bottom - mi.rcMonitor.top);
+
+        ComboBox_AddString((HWND)dwData, monitorName);
+    }
+    return TRUE;
+}
+
+// Function to update monitor combo box
+void UpdateMonitorComboBox()
+{
+    ComboBox_ResetContent(hMonitorComboBox);
+    monitorMap.clear();
+    monitorDpiMap.clear();
+    EnumDisplayMonitors(NULL, NULL, MonitorEnumProc, (LPARAM)hMonitorComboBox);
+
+    // Spreading only makes sense with more than one display
+    // The entry goes last, so its index is known even without the combo box
+    allMonitorsComboIndex = -1;
+    if (monitorMap.size() > 1)
+    {
+        allMonitorsComboIndex = static_cast<int>(monitorMap.size());
+        ComboBox_AddString(hMonitorComboBox, L"All Monitors (weighted)");
+    }
+    ComboBox_SetCurSel(hMonitorComboBox, 0);
+    RequestWindowRegistryPublish();
+}
+
+// Function to start a new title pool generation if most of the pool is no
+// longer referenced: the titles of the captured list and the workspaces
+// are interned again into a fresh pool. Returns the old blocks, which the
+// caller retires with the snapshot it replaces, or nothing.
+static std::vector<std::unique_ptr<wchar_t[]>> CompactTitlePool()
+{
+    std::vector<std::unique_ptr<wchar_t[]>> oldBlocks;
+    if (!titlePool.compactDue || titlePool.charsAllocated <= TITLE_POOL_COMPACT_CHARS)
+        return oldBlocks;
+    titlePool.compactDue = false;
+
+    std::unordered_set<const wchar_t*> live;
+    size_t liveChars = 0;
+    auto countLive = [&live, &liveChars](const WindowRecords& list)
+    {
+        for (const wchar_t* title : list.titles)
+        {
+            if (live.insert(title).second)
+                liveChars += wcslen(title) + 1;
+        }
+    };
+    countLive(windowList);
+    for (const auto& list : workspaceLists)
+        countLive(list);
+    if (liveChars * 4 > titlePool.charsAllocated)
+        return oldBlocks;
+
+    TitlePool oldPool;
+    std::swap(oldPool, titlePool);
+    auto internAgain = [](WindowRecords& list)
+    {
+        for (const wchar_t*& title : list.titles)
+            title = InternWindowTitle(title);
+    };
+    internAgain(windowList);
+    for (auto& list : workspaceLists)
+        internAgain(list);
+    oldBlocks = std::move(oldPool.blocks);
+    return oldBlocks;
+}
+
+// Function to ask for the capture state to be published. Every change made
+// in one turn of the message loop (a click seen by the mouse hook, a list
+// refresh, a settings commit) shares one snapshot, published by
+// WM_PUBLISH_REGISTRY once the turn is over, so hook callbacks never copy
+// the list themselves.
+void RequestWindowRegistryPublish()
+{
+    if (windowRegistryPublishPending)
+    {
+        CountMetric(METRIC_REGISTRY_PUBLISHES_BATCHED);
+        return;
+    }
+
+    windowRegistryPublishPending = true;
+    if (!hMainWindow || !PostMessage(hMainWindow, WM_PUBLISH_REGISTRY, 0, 0))
+        PublishWindowRegistry();
+}
+
+// Function to publish a requested snapshot now, for code on the UI thread
+// that reads the registry right after changing what it holds
+void FlushWindowRegistryPublish()
+{
+    if (windowRegistryPublishPending)
+        PublishWindowRegistry();
+}
+
+// Function to publish the current capture state as a new snapshot. Only the
+// UI thread changes the capture state, so only it calls this; changes go
+// through RequestWindowRegistryPublish so a batch of them is copied once.
+void PublishWindowRegistry()
+{
+    windowRegistryPublishPending = false;
+    CountMetric(METRIC_REGISTRY_PUBLISHES);
+    std::vector<std::unique_ptr<wchar_t[]>> oldTitleBlocks = CompactTitlePool();
+    WindowRegistrySnapshot* snapshot = new WindowRegistrySnapshot();
+    snapshot->windows = windowList;
+    snapshot->isCapturing = captureSession.state != CAPTURE_IDLE;
+    snapshot->windowsCaptured = GetSessionCaptureCount();
+    snapshot->settings = layoutSettings;
+    GetLayoutMonitors(snapshot->monitors);
+    snapshot->allMonitorsSelection = allMonitorsComboIndex;
+    snapshot->layoutMode = currentLayoutMode;
+    snapshot->version = ++windowRegistryVersion;
+    RecordTraceWindowList();
+    PublishLayoutState();
+
+    // Old title blocks live as long as the snapshot replaced here, the newest one pointing into them
+    const WindowRegistrySnapshot* old = windowRegistry.exchange(snapshot);
+    if (old || !oldTitleBlocks.empty())
+    {
+        uint64_t retiredEpoch = AdvanceEpoch(registryReaders);
+        if (old)
+            retiredRegistrySnapshots.emplace_back(old, retiredEpoch);
+        if (!oldTitleBlocks.empty())
+            retiredTitleBlocks.emplace_back(std::move(oldTitleBlocks), retiredEpoch);
+    }
+
+    // Readers that began before the swap may still hold an old snapshot
+    uint64_t oldestReader = GetOldestReaderEpoch(registryReaders);
+    ReclaimRetired(retiredRegistrySnapshots, oldestReader, [](const WindowRegistrySnapshot* retired) { delete retired; });
+    ReclaimRetired(retiredTitleBlocks, oldestReader, [](std::vector<std::unique_ptr<wchar_t[]>>&) {});
+}
+
+// Function to start reading the registry from any thread. The snapshot
+// stays valid until the matching EndWindowRegistryRead; no lock is taken.
+const WindowRegistrySnapshot* BeginWindowRegistryRead()
+{
+    EnterEpochRead(registryReaders);
+    return windowRegistry.load();
+}
+
+// Function to let go of the snapshot returned by BeginWindowRegistryRead
+void EndWindowRegistryRead()
+{
+    LeaveEpochRead(registryReaders);
+}
+
+// Function to refresh the window list
+void RefreshWindowList()
+{
+    ScopedLatency latency(METRIC_LIST_REFRESH_LATENCY);
+    // Without the control panel there is nothing to show
+    if (!hListView)
+    {
+        RequestWindowRegistryPublish();
+        return;
+    }
+
+    ListView_DeleteAllItems(hListView);
+
+    for (size_t i = 0; i < windowList.handles.size(); ++i)
+    {
+        HWND hWnd = windowList.handles[i];
+
+        // Format the index number
+        wchar_t indexStr[16];
+        swprintf_s(indexStr, 16, L"%d", static_cast<int>(i) + 1);
+
+        // Format the window handle
+        wchar_t handleStr[32];
+        swprintf_s(handleStr, 32, L"0x%016IX", (UINT_PTR)hWnd);
+
+        // Insert index column
+        LVITEM lvItem = { 0 };
+        lvItem.mask = LVIF_TEXT | LVIF_PARAM;
+        lvItem.pszText = indexStr;
+        lvItem.lParam = (LPARAM)hWnd;
+        lvItem.iItem = ListView_GetItemCount(hListView);
+        ListView_InsertItem(hListView, &lvItem);
+
+        // Set window title in the second column
+        ListView_SetItemText(hListView, lvItem.iItem, 1, const_cast<LPWSTR>(windowList.titles[i]));
+
+        // Set window handle in the third column
+        ListView_SetItemText(hListView, lvItem.iItem, 2, handleStr);
+    }
+
+    // Optionally, you can auto-size columns after refreshing
+    ListView_SetColumnWidth(hListView, 0, LVSCW_AUTOSIZE);
+    ListView_SetColumnWidth(hListView, 1, LVSCW_AUTOSIZE_USEHEADER);
+    ListView_SetColumnWidth(hListView, 2, LVSCW_AUTOSIZE_USEHEADER);
+
+    RequestWindowRegistryPublish();
+}
+
+// Function to rewrite one ListView row from the window list. The number
+// column follows the position, so it never changes.
+void UpdateWindowListRow(int position)
+{
+    if (!hListView)
+        return;
+
+    HWND hWnd = windowList.handles[position];
+    wchar_t handleStr[32];
+    swprintf_s(handleStr, 32, L"0x%016IX", (UINT_PTR)hWnd);
+
+    LVITEM lvItem = { 0 };
+    lvItem.mask = LVIF_PARAM;
+    lvItem.iItem = position;
+    lvItem.lParam = (LPARAM)hWnd;
+    ListView_SetItem(hListView, &lvItem);
+    ListView_SetItemText(hListView, position, 1, const_cast<LPWSTR>(windowList.titles[position]));
+    ListView_SetItemText(hListView, position, 2, handleStr);
+}
+
+// Function to get the selected list positions in ascending order
+std::vector<int> GetSelectedPositions()
+{
+    std::vector<int> positions;
+    if (!hListView)
+        return positions;
+
+    for (int item = ListView_GetNextItem(hListView, -1, LVNI_SELECTED); item != -1;
+        item = ListView_GetNextItem(hListView, item, LVNI_SELECTED))
+    {
+        positions.push_back(item);
+    }
+    return positions;
+}
+
+// Function to select a run of list positions and nothing else
+void SelectPositions(int first, int count)
+{
+    if (!hListView)
+        return;
+
+    ListView_SetItemState(hListView, -1, 0, LVIS_SELECTED);
+    for (int i = 0; i < count; ++i)
+    {
+        ListView_SetItemState(hListView, first + i, LVIS_SELECTED, LVIS_SELECTED);
+    }
+    ListView_EnsureVisible(hListView, first, FALSE);
+}
+
+// Function to reorder a range of the window list. order[i] is the old
+// position of the window that moves to position first + i. Only windows
+// whose position changes are touched: their rows are rewritten and, if
+// the list was tiled, they move straight into the cells of their new
+// positions in one batch, so no separate arrange is needed. The moves are
+// one layout history entry, so undo puts the windows back.
+void ReorderWindowRange(int first, const std::vector<int>& order)
+{
+    size_t count = order.size();
+    std::vector<HWND> handles(count);
+    std::vector<RECT> rects(count);
+    std::vector<const wchar_t*> titles(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        handles[i] = windowList.handles[order[i]];
+        rects[i] = windowList.rects[order[i]];
+        titles[i] = windowList.titles[order[i]];
+    }
+
+    std::vector<WindowMove> moves;
+    for (size_t i = 0; i < count; ++i)
+    {
+        int position = first + static_cast<int>(i);
+        if (order[i] == position)
+            continue;
+
+        windowList.handles[position] = handles[i];
+        windowList.rects[position] = rects[i];
+        windowList.titles[position] = titles[i];
+        if (position < static_cast<int>(tiledLayout.windows.size()))
+            tiledLayout.windows[position] = handles[i];
+        UpdateWindowListRow(position);
+
+        RECT cell;
+        if (!IsWindow(handles[i]) || IsIconic(handles[i]) || !GetPositionCell(position, cell))
+            continue;
+
+        WindowMove move;
+        move.hWnd = handles[i];
+        GetWindowRect(move.hWnd, &move.before);
+        move.after = GetWindowRectForCell(move.hWnd, cell);
+        if (!EqualRect(&move.before, &move.after))
+            moves.push_back(move);
+    }
+
+    BeginLayoutHistoryEntry();
+    for (const auto& move : moves)
+    {
+        RecordWindowMove(move);
+    }
+    CommitLayoutHistoryEntry();
+
+    ApplyWindowMoves(moves, true);
+    RequestWindowRegistryPublish();
+    CountMetric(METRIC_WINDOWS_REORDERED, moves.size());
+}
+
+// Function to move windows as one block so that it is inserted before the
+// window at target (or at the end if target is the list size). The block
+// keeps the order of positions, which must be ascending.
+void MoveWindowBlock(const std::vector<int>& positions, int target)
+{
+    if (positions.empty())
+        return;
+
+    // Only the span between the block and the target changes
+    int first = (std::min)(positions.front(), target);
+    int last = (std::max)(positions.back() + 1, target);
+
+    std::vector<int> rest;
+    int insertAt = 0;
+    size_t next = 0;
+    for (int position = first; position < last; ++position)
+    {
+        if (next < positions.size() && positions[next] == position)
+        {
+            ++next;
+            continue;
+        }
+        if (position < target)
+            ++insertAt;
+        rest.push_back(position);
+    }
+
+    std::vector<int> order(rest.begin(), rest.begin() + insertAt);
+    order.insert(order.end(), positions.begin(), positions.end());
+    order.insert(order.end(), rest.begin() + insertAt, rest.end());
+
+    ReorderWindowRange(first, order);
+    SelectPositions(first + insertAt, static_cast<int>(positions.size()));
+}
+
+// Function to swap two windows, in the list and on screen
+void SwapWindowPositions(int first, int second)
+{
+    if (first == second)
+        return;
+    if (first > second)
+        std::swap(first, second);
+
+    std::vector<int> order(second - first + 1);
+    for (int i = 0; i < static_cast<int>(order.size()); ++i)
+    {
+        order[i] = first + i;
+    }
+    std::swap(order.front(), order.back());
+    ReorderWindowRange(first, order);
+}
+
+// Function to move the selected items up or down one step as a block
+void MoveSelectedItem(int direction)
+{
+    std::vector<int> selected = GetSelectedPositions();
+    if (selected.empty())
+        return;
+
+    int target = (direction < 0) ? selected.front() - 1 : selected.back() + 2;
+    if (target < 0 || target > (int)windowList.handles.size())
+        return;
+
+    MoveWindowBlock(selected, target);
+}
+
+// Function to get where rows dropped at a point of the ListView go: before
+// the row under the point, or after it when the point is in its lower half
+static int GetListDropPosition(POINT pt)
+{
+    int count = ListView_GetItemCount(hListView);
+    LVHITTESTINFO hit = { 0 };
+    hit.pt = pt;
+    int item = ListView_HitTest(hListView, &hit);
+    if (item < 0)
+    {
+        RECT first;
+        if (count > 0 && ListView_GetItemRect(hListView, 0, &first, LVIR_BOUNDS) && pt.y < first.top)
+            return 0;
+        return count;
+    }
+
+    RECT rect;
+    ListView_GetItemRect(hListView, item, &rect, LVIR_BOUNDS);
+    return (pt.y >= (rect.top + rect.bottom) / 2) ? item + 1 : item;
+}
+
+// Function to show where dragged rows would be dropped
+static void ShowListDropMark(int target)
+{
+    int count = ListView_GetItemCount(hListView);
+    LVINSERTMARK mark = { 0 };
+    mark.cbSize = sizeof(mark);
+    mark.iItem = (target < count) ? target : count - 1;
+    mark.dwFlags = (target < count) ? 0 : LVIM_AFTER;
+    ListView_SetInsertMark(hListView, &mark);
+}
+
+// ListView window procedure
+LRESULT CALLBACK ListViewProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp)
+{
+    // Dragging selected rows, started by LVN_BEGINDRAG
+    if (listDragActive)
+    {
+        POINT pt = { GET_X_LPARAM(lp), GET_Y_LPARAM(lp) };
+        if (msg == WM_MOUSEMOVE)
+        {
+            ShowListDropMark(GetListDropPosition(pt));
+            return 0;
+        }
+        if (msg == WM_LBUTTONUP || msg == WM_CAPTURECHANGED)
+        {
+            listDragActive = false;
+            LVINSERTMARK mark = { 0 };
+            mark.cbSize = sizeof(mark);
+            mark.iItem = -1;
+            ListView_SetInsertMark(hwnd, &mark);
+            if (msg == WM_LBUTTONUP)
+            {
+                ReleaseCapture();
+                MoveWindowBlock(GetSelectedPositions(), GetListDropPosition(pt));
+                return 0;
+            }
+        }
+    }
+
+    if (msg == WM_LBUTTONDBLCLK)
+    {
+        int selected = ListView_GetNextItem(hwnd, -1, LVNI_SELECTED);
+        if (selected != -1)
+        {
+            LVITEM lvItem = { 0 };
+            lvItem.mask = LVIF_PARAM;
+            lvItem.iItem = selected;
+            ListView_GetItem(hwnd, &lvItem);
+            HWND hWnd = (HWND)lvItem.lParam;
+            if (IsWindow(hWnd))
+            {
+                // Bring the window to the foreground and give it focus
+                SetForegroundWindow(hWnd);
+            }
+        }
+    }
+    return CallWindowProc(OldListViewProc, hwnd, msg, wp, lp);
+}
+
+// Function to adjust control positions and sizes
+// Function to scale a size given at 96 DPI to the DPI of the panel's monitor
+int PanelPixels(int value)
+{
+    return MulDiv(value, GetDpiForWindow(hMainWindow), USER_DEFAULT_SCREEN_DPI);
+}
+
+// Callback to set the panel font on one control
+static BOOL CALLBACK SetPanelFontProc(HWND hChild, LPARAM lParam)
+{
+    SendMessage(hChild, WM_SETFONT, (WPARAM)lParam, TRUE);
+    return TRUE;
+}
+
+// Function to give the panel's controls the message font at the panel's DPI
+void UpdatePanelFont()
+{
+    NONCLIENTMETRICS metrics = { 0 };
+    metrics.cbSize = sizeof(metrics);
+    if (!SystemParametersInfoForDpi(SPI_GETNONCLIENTMETRICS, sizeof(metrics), &metrics, 0, GetDpiForWindow(hMainWindow)))
+        return;
+    HFONT hFont = CreateFontIndirect(&metrics.lfMessageFont);
+    if (!hFont)
+        return;
+
+    EnumChildWindows(hMainWindow, SetPanelFontProc, (LPARAM)hFont);
+    if (hPanelFont)
+        DeleteObject(hPanelFont);
+    hPanelFont = hFont;
+}
+
+void AdjustControls()
+{
+    if (!hListView)
+        return;
+
+    RECT rcClient;
+    GetClientRect(hMainWindow, &rcClient);
+    int clientWidth = rcClient.right - rcClient.left;
+    int clientHeight = rcClient.bottom - rcClient.top;
+
+    // Minimum window size; all sizes are given at 96 DPI and scaled to the panel's monitor
+    if (clientWidth < PanelPixels(MIN_WINDOW_WIDTH))
+        clientWidth = PanelPixels(MIN_WINDOW_WIDTH);
+    if (clientHeight < PanelPixels(MIN_WINDOW_HEIGHT))
+        clientHeight = PanelPixels(MIN_WINDOW_HEIGHT);
+
+    int x = PanelPixels(MARGIN);
+    int y = PanelPixels(MARGIN);
+
+    // Arrange buttons on the top
+    SetWindowPos(hCaptureButton, NULL, x, y, PanelPixels(BUTTON_WIDTH), PanelPixels(BUTTON_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(BUTTON_WIDTH) + PanelPixels(MARGIN);
+
+    SetWindowPos(hRestoreButton, NULL, x, y, PanelPixels(SMALL_BUTTON_WIDTH), PanelPixels(BUTTON_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(SMALL_BUTTON_WIDTH) + PanelPixels(MARGIN);
+
+    SetWindowPos(hClearButton, NULL, x, y, PanelPixels(SMALL_BUTTON_WIDTH), PanelPixels(BUTTON_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(SMALL_BUTTON_WIDTH) + PanelPixels(MARGIN);
+
+    SetWindowPos(hArrangeButton, NULL, x, y, PanelPixels(BUTTON_WIDTH), PanelPixels(BUTTON_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(BUTTON_WIDTH) + PanelPixels(MARGIN);
+
+    SetWindowPos(hUndoButton, NULL, x, y, PanelPixels(SMALL_BUTTON_WIDTH), PanelPixels(BUTTON_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(SMALL_BUTTON_WIDTH) + PanelPixels(MARGIN);
+
+    SetWindowPos(hRedoButton, NULL, x, y, PanelPixels(SMALL_BUTTON_WIDTH), PanelPixels(BUTTON_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(SMALL_BUTTON_WIDTH) + PanelPixels(MARGIN);
+
+    // *** Position the new "Capture by Title" button ***
+    SetWindowPos(hCaptureByTitleButton, NULL, x, y, PanelPixels(BUTTON_WIDTH), PanelPixels(BUTTON_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(BUTTON_WIDTH) + PanelPixels(MARGIN);
+
+    // Reset x and move y down for next row
+    x = PanelPixels(MARGIN);
+    y += PanelPixels(BUTTON_HEIGHT) + PanelPixels(MARGIN);
+
+    // Number of windows label and edit
+    SetWindowPos(hNumWindowsLabel, NULL, x, y + PanelPixels(3), PanelPixels(LABEL_WIDTH), PanelPixels(LABEL_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(LABEL_WIDTH) + PanelPixels(MARGIN);
+
+    SetWindowPos(hNumWindowsEdit, NULL, x, y, PanelPixels(EDIT_WIDTH), PanelPixels(LABEL_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(EDIT_WIDTH) + PanelPixels(MARGIN);
+
+    // Monitor selection label and combo box
+    SetWindowPos(hMonitorLabel, NULL, x, y + PanelPixels(3), PanelPixels(LABEL_WIDTH), PanelPixels(LABEL_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(LABEL_WIDTH) + PanelPixels(MARGIN);
+
+    SetWindowPos(hMonitorComboBox, NULL, x, y, PanelPixels(COMBOBOX_WIDTH), PanelPixels(COMBOBOX_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(COMBOBOX_WIDTH) + PanelPixels(MARGIN);
+
+    // Pixel Fix X label and edit box
+    SetWindowPos(hPixelFixXLabel, NULL, x, y + PanelPixels(3), PanelPixels(150), PanelPixels(LABEL_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(150) + PanelPixels(MARGIN);
+
+    SetWindowPos(hPixelFixXEdit, NULL, x, y, PanelPixels(100), PanelPixels(LABEL_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(100) + PanelPixels(MARGIN);
+
+    // Pixel Fix Y label and edit box
+    SetWindowPos(hPixelFixYLabel, NULL, x, y + PanelPixels(3), PanelPixels(150), PanelPixels(LABEL_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(150) + PanelPixels(MARGIN);
+
+    SetWindowPos(hPixelFixYEdit, NULL, x, y, PanelPixels(100), PanelPixels(LABEL_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(100) + PanelPixels(MARGIN);
+
+    // Min Vertical Spacing Y label and edit box
+    SetWindowPos(hMinSpacingYLabel, NULL, x, y + PanelPixels(3), PanelPixels(200), PanelPixels(LABEL_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(200) + PanelPixels(MARGIN);
+
+    SetWindowPos(hMinSpacingYEdit, NULL, x, y, PanelPixels(100), PanelPixels(LABEL_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(100) + PanelPixels(MARGIN);
+
+    // *** Position the new Window Title label and edit box ***
+    // Reset x and move y down for next row
+    x = PanelPixels(MARGIN);
+    y += PanelPixels(LABEL_HEIGHT) + PanelPixels(MARGIN);
+
+    // Window Title label
+    SetWindowPos(hWindowTitleLabel, NULL, x, y + PanelPixels(3), PanelPixels(LABEL_WIDTH), PanelPixels(LABEL_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(LABEL_WIDTH) + PanelPixels(MARGIN);
+
+    // Window Title edit box
+    SetWindowPos(hWindowTitleEdit, NULL, x, y, PanelPixels(200), PanelPixels(LABEL_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(200) + PanelPixels(MARGIN);
+
+    // *** Position the "Capture by Title" button ***
+    SetWindowPos(hCaptureByTitleButton, NULL, x, y, PanelPixels(BUTTON_WIDTH), PanelPixels(BUTTON_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(BUTTON_WIDTH) + PanelPixels(MARGIN);
+
+    // "Capture by Rules" button
+    SetWindowPos(hCaptureByRulesButton, NULL, x, y, PanelPixels(BUTTON_WIDTH), PanelPixels(BUTTON_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(BUTTON_WIDTH) + PanelPixels(MARGIN);
+
+    // Auto-tile checkbox
+    SetWindowPos(hAutoTileCheckBox, NULL, x, y, PanelPixels(BUTTON_WIDTH), PanelPixels(LABEL_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(BUTTON_WIDTH) + PanelPixels(MARGIN);
+
+    // Linked resize checkbox
+    SetWindowPos(hLinkedResizeCheckBox, NULL, x, y, PanelPixels(BUTTON_WIDTH), PanelPixels(LABEL_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(BUTTON_WIDTH) + PanelPixels(MARGIN);
+
+    // Append capture checkbox
+    SetWindowPos(hCaptureAppendCheckBox, NULL, x, y, PanelPixels(BUTTON_WIDTH), PanelPixels(LABEL_HEIGHT), SWP_NOZORDER);
+    x += PanelPixels(BUTTON_WIDTH) + PanelPixels(MARGIN);
+
+    // Adjust y for the next row
+    y += PanelPixels(LABEL_HEIGHT) + PanelPixels(MARGIN);
+
+    // Adjust ListView size
+    int listViewWidth = clientWidth - 3 * PanelPixels(MARGIN) - PanelPixels(MOVE_BUTTON_WIDTH);
+    int listViewHeight = clientHeight - y - PanelPixels(MARGIN);
+    SetWindowPos(hListView, NULL, PanelPixels(MARGIN), y, listViewWidth, listViewHeight, SWP_NOZORDER);
+
+    // Move Up and Move Down buttons
+    int moveButtonX = PanelPixels(MARGIN) + listViewWidth + PanelPixels(MARGIN);
+    int moveButtonY = y;
+    SetWindowPos(hMoveUpButton, NULL, moveButtonX, moveButtonY, PanelPixels(MOVE_BUTTON_WIDTH), PanelPixels(MOVE_BUTTON_HEIGHT), SWP_NOZORDER);
+    moveButtonY += PanelPixels(MOVE_BUTTON_HEIGHT) + PanelPixels(MARGIN);
+    SetWindowPos(hMoveDownButton, NULL, moveButtonX, moveButtonY, PanelPixels(MOVE_BUTTON_WIDTH), PanelPixels(MOVE_BUTTON_HEIGHT), SWP_NOZORDER);
+    moveButtonY += PanelPixels(MOVE_BUTTON_HEIGHT) + PanelPixels(MARGIN);
+    SetWindowPos(hSwapButton, NULL, moveButtonX, moveButtonY, PanelPixels(MOVE_BUTTON_WIDTH), PanelPixels(MOVE_BUTTON_HEIGHT), SWP_NOZORDER);
+
+    // Adjust ListView column widths
+    int totalColumnWidth = listViewWidth - GetSystemMetricsForDpi(SM_CXVSCROLL, GetDpiForWindow(hMainWindow));
+    int indexColWidth = PanelPixels(50);
+    int handleColWidth = PanelPixels(120);
+    int titleColWidth = totalColumnWidth - indexColWidth - handleColWidth;
+
+    ListView_SetColumnWidth(hListView, 0, indexColWidth);
+    ListView_SetColumnWidth(hListView, 1, titleColWidth);
+    ListView_SetColumnWidth(hListView, 2, handleColWidth);
+}
+
+// Message box timer callback
+VOID CALLBACK MsgBoxTimerProc(HWND hwnd, UINT uMsg, UINT_PTR idEvent, DWORD dwTime)
+{
+    if (g_hMsgBoxWnd)
+    {
+        PostMessage(g_hMsgBoxWnd, WM_CLOSE, 0, 0);
+    }
+    if (g_msgboxTimerId)
+    {
+        KillTimer(NULL, g_msgboxTimerId);
+        g_msgboxTimerId = 0;
+    }
+}
+
+// CBT hook procedure for message box timeout
+LRESULT CALLBACK CBTProc(int nCode, WPARAM wParam, LPARAM lParam)
+{
+    if (nCode == HCBT_ACTIVATE)
+    {
+        // Get the handle of the message box window
+        g_hMsgBoxWnd = (HWND)wParam;
+
+        // Set the timer when the message box is activated
+        if (g_msgboxTimerId)
+        {
+            KillTimer(NULL, g_msgboxTimerId);
+        }
+        g_msgboxTimerId = SetTimer(NULL, 0, 2000, MsgBoxTimerProc); // 2000 ms timeout
+
+        // Unhook the CBT hook
+        if (g_hMsgBoxHook)
+        {
+            UnhookWindowsHookEx(g_hMsgBoxHook);
+            g_hMsgBoxHook = NULL;
+        }
+    }
+    return CallNextHookEx(NULL, nCode, wParam, lParam);
+}
+
+// Function to display a timed message box
+int TimedMessageBox(HWND hWnd, LPCTSTR lpText, LPCTSTR lpCaption, UINT uType)
+{
+    // Reset the message box window handle
+    g_hMsgBoxWnd = NULL;
+
+    // Set the CBT hook
+    g_hMsgBoxHook = SetWindowsHookEx(WH_CBT, CBTProc, NULL, GetCurrentThreadId());
+
+    int ret = MessageBox(hWnd, lpText, lpCaption, uType);
+
+    // Unhook the CBT hook in case it wasn't unhooked
+    if (g_hMsgBoxHook)
+    {
+        UnhookWindowsHookEx(g_hMsgBoxHook);
+        g_hMsgBoxHook = NULL;
+    }
+    // Kill the timer if it's still running
+    if (g_msgboxTimerId)
+    {
+        KillTimer(NULL, g_msgboxTimerId);
+        g_msgboxTimerId = 0;
+    }
+
+    return ret;
+}
+
+// Function to append one event to the trace; free when not recording
+void RecordTraceEvent(unsigned char type, DWORD window, int a, int b, int c, int d)
+{
+    if (!traceRecording)
+        return;
+
+    TraceRecord record = { 0 };
+    record.time = GetTickCount() - traceStartTime;
+    record.type = type;
+    record.window = window;
+    record.a = static_cast<short>(a);
+    record.b = static_cast<short>(b);
+    record.c = static_cast<short>(c);
+    record.d = static_cast<short>(d);
+    traceBuffer.push_back(record);
+
+    if (traceBuffer.size() >= TRACE_FLUSH_RECORDS)
+    {
+        DWORD written = 0;
+        WriteFile(hTraceFile, traceBuffer.data(), static_cast<DWORD>(traceBuffer.size() * sizeof(TraceRecord)), &written, NULL);
+        traceBuffer.clear();
+    }
+}
+
+// Function to append an event carrying a window and a rectangle
+void RecordTraceRect(unsigned char type, HWND hWnd, const RECT& rect)
+{
+    RecordTraceEvent(type, static_cast<DWORD>(reinterpret_cast<UINT_PTR>(hWnd)), rect.left, rect.top, rect.right, rect.bottom);
+}
+
+// Function to append a name: a TRACE_NAME record and the TRACE_TEXT records holding it
+void RecordTraceText(int kind, HWND hWnd, const std::wstring& text)
+{
+    int length = (std::min)(static_cast<int>(text.size()), SHRT_MAX);
+    RecordTraceEvent(TRACE_NAME, static_cast<DWORD>(reinterpret_cast<UINT_PTR>(hWnd)), kind, length);
+    for (int i = 0; i < length; i += 4)
+    {
+        int units[4] = { 0, 0, 0, 0 };
+        for (int unit = 0; unit < 4 && i + unit < length; ++unit)
+        {
+            units[unit] = static_cast<unsigned short>(text[i + unit]);
+        }
+        RecordTraceEvent(TRACE_TEXT, 0, units[0], units[1], units[2], units[3]);
+    }
+}
+
+// Function to record the captured windows as they are now. The names the
+// grouped and custom layouts look at are recorded once per window, and the
+// group key again whenever it changes.
+void RecordTraceWindowList()
+{
+    if (!traceRecording)
+        return;
+
+    for (HWND hWnd : windowList.handles)
+    {
+        traceWindows.insert(hWnd);
+        const std::wstring& key = GetWindowGroupKey(hWnd);
+        auto recorded = traceGroupKeys.find(hWnd);
+        if (recorded != traceGroupKeys.end() && recorded->second == key)
+            continue;
+
+        if (recorded == traceGroupKeys.end())
+        {
+            wchar_t className[256];
+            if (GetClassName(hWnd, className, sizeof(className) / sizeof(wchar_t)) == 0)
+                className[0] = 0;
+            RecordTraceText(TRACE_NAME_PROCESS, hWnd, GetProcessNameForWindow(hWnd));
+            RecordTraceText(TRACE_NAME_CLASS, hWnd, ToLower(className));
+        }
+        RecordTraceText(TRACE_NAME_GROUP, hWnd, key);
+        traceGroupKeys[hWnd] = key;
+    }
+
+    RecordTraceEvent(TRACE_LIST, static_cast<DWORD>(windowList.handles.size()));
+    for (size_t i = 0; i < windowList.handles.size(); ++i)
+    {
+        RecordTraceRect(TRACE_LIST_ENTRY, windowList.handles[i], windowList.rects[i]);
+    }
+}
+
+// Function to record an arrange with what the replay needs to solve it
+// again: the monitors when it spans all of them and the custom layout
+void RecordTraceArrange(const GridLayoutParams& params)
+{
+    if (!traceRecording)
+        return;
+
+    if (params.allMonitors)
     {
-        // Check if the window is already captured
-        for (const auto& info : windowList)
+        for (const auto& entry : monitorMap)
         {
-            if (info.hWnd == hwnd)
-            {
-                // Already captured, skip
-                return TRUE;
-            }
+            auto dpi = monitorDpiMap.find(entry.first);
+            const RECT& work = entry.second.rcWork;
+            RecordTraceEvent(TRACE_MONITOR, dpi != monitorDpiMap.end() ? dpi->second : USER_DEFAULT_SCREEN_DPI,
+                work.left, work.top, work.right, work.bottom);
         }
-
-        // Add to windowList
-        WindowInfo info;
-        info.hWnd = hwnd;
-        GetWindowRect(hwnd, &info.rect); // *** Corrected handle reference ***
-        info.windowTitle = currentTitle;
-        info.index = static_cast<int>(windowList.size()) + 1;
-        windowList.push_back(info);
     }
+    if (params.layoutMode == LAYOUT_CUSTOM && !customLayouts.empty())
+        RecordTraceText(TRACE_NAME_LAYOUT, NULL, customLayouts[currentCustomLayout].source);
 
-    return TRUE; // Continue enumeration
+    RecordTraceRect(TRACE_WORK_AREA, NULL, params.workArea);
+    RecordTraceEvent(TRACE_ARRANGE, params.allMonitors ? TRACE_ARRANGE_ALL_MONITORS : 0,
+        params.pixelFixX, params.pixelFixY, params.minSpacingY, params.layoutMode);
 }
 
-// Function to restore window positions
-void RestoreWindows()
+// WinEvent callback recording the windows the spatial index would hold:
+// top-level windows appearing, moving, going away and being activated.
+// Destroy, hide and activation events come for every window of every
+// process, so only windows the trace already knows are recorded.
+void CALLBACK TraceWinEventProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD idEventThread, DWORD dwmsEventTime)
 {
-    for (const auto& info : windowList)
+    if (idObject != OBJID_WINDOW || idChild != CHILDID_SELF || !hwnd)
+        return;
+
+    DWORD window = static_cast<DWORD>(reinterpret_cast<UINT_PTR>(hwnd));
+    RECT rect;
+    switch (event)
     {
-        if (IsWindow(info.hWnd))
+    case EVENT_OBJECT_SHOW:
+    case EVENT_OBJECT_LOCATIONCHANGE:
+        if (IsSpatialIndexCandidate(hwnd, rect))
         {
-            SetWindowPos(info.hWnd, NULL, info.rect.left, info.rect.top,
-                info.rect.right - info.rect.left,
-                info.rect.bottom - info.rect.top,
-                SWP_NOZORDER | SWP_NOACTIVATE);
+            bool known = !traceWindows.insert(hwnd).second;
+            RecordTraceRect(known ? TRACE_WINDOW_MOVE : TRACE_WINDOW_SHOW, hwnd, rect);
         }
-        else
+        else if (traceWindows.count(hwnd))
+        {
+            RecordTraceEvent(TRACE_WINDOW_HIDE, window);
+        }
+        break;
+    case EVENT_OBJECT_HIDE:
+        if (traceWindows.count(hwnd))
+            RecordTraceEvent(TRACE_WINDOW_HIDE, window);
+        break;
+    case EVENT_OBJECT_DESTROY:
+        if (traceWindows.erase(hwnd))
         {
-            std::wstring message = L"Window no longer available: " + info.windowTitle;
-            TimedMessageBox(NULL, message.c_str(), L"Warning", MB_OK);
+            traceGroupKeys.erase(hwnd);
+            RecordTraceEvent(TRACE_WINDOW_DESTROY, window);
         }
+        break;
+    case EVENT_SYSTEM_FOREGROUND:
+        if (traceWindows.count(hwnd))
+            RecordTraceEvent(TRACE_WINDOW_RAISE, window);
+        break;
+    default:
+        break;
     }
 }
 
-// Function to clear captured windows
-void ClearCapturedWindows()
+// Function to start recording hook traffic, window lifecycle and commands.
+// The trace starts with the screen and the windows already on it, bottom
+// of the z-order first, so the replay can hit-test them.
+bool StartTraceRecording(const std::wstring& path)
 {
-    windowList.clear();
-    ListView_DeleteAllItems(hListView);
-    TimedMessageBox(NULL, L"All captured windows have been cleared.", L"Info", MB_OK);
+    hTraceFile = CreateFile(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hTraceFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    TraceHeader header = { TRACE_MAGIC, TRACE_VERSION };
+    DWORD written = 0;
+    WriteFile(hTraceFile, &header, sizeof(header), &written, NULL);
+
+    traceStartTime = GetTickCount();
+    traceBuffer.reserve(TRACE_FLUSH_RECORDS);
+    traceRecording = true;
+
+    int screenLeft = GetSystemMetrics(SM_XVIRTUALSCREEN);
+    int screenTop = GetSystemMetrics(SM_YVIRTUALSCREEN);
+    RecordTraceEvent(TRACE_SCREEN, 0, screenLeft, screenTop,
+        screenLeft + GetSystemMetrics(SM_CXVIRTUALSCREEN), screenTop + GetSystemMetrics(SM_CYVIRTUALSCREEN));
+    std::vector<HWND> windows;
+    EnumWindows(SpatialIndexEnumProc, reinterpret_cast<LPARAM>(&windows));
+    for (auto it = windows.rbegin(); it != windows.rend(); ++it)
+    {
+        RECT rect;
+        if (*it != hMainWindow && IsSpatialIndexCandidate(*it, rect))
+        {
+            traceWindows.insert(*it);
+            RecordTraceRect(TRACE_WINDOW_SHOW, *it, rect);
+        }
+    }
+
+    hTraceWinEventHooks[0] = SetWinEventHook(EVENT_OBJECT_DESTROY, EVENT_OBJECT_HIDE, NULL,
+        TraceWinEventProc, 0, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+    hTraceWinEventHooks[1] = SetWinEventHook(EVENT_OBJECT_LOCATIONCHANGE, EVENT_OBJECT_LOCATIONCHANGE, NULL,
+        TraceWinEventProc, 0, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+    hTraceWinEventHooks[2] = SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, NULL,
+        TraceWinEventProc, 0, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+    return true;
 }
 
-// Function to check and remove closed windows
-void CheckAndRemoveClosedWindows()
+// Function to write out what is buffered and close the trace
+void StopTraceRecording()
 {
-    bool listChanged = false;
-    for (auto it = windowList.begin(); it != windowList.end(); )
-    {
-        if (!IsWindow(it->hWnd))
-        {
-            std::wstring message = L"Window has been closed: " + it->windowTitle;
-            TimedMessageBox(NULL, message.c_str(), L"Info", MB_OK);
+    if (!traceRecording)
+        return;
 
-            it = windowList.erase(it);
-            listChanged = true;
-        }
-        else
+    for (auto& hHook : hTraceWinEventHooks)
+    {
+        if (hHook)
         {
-            ++it;
+            UnhookWinEvent(hHook);
+            hHook = NULL;
         }
     }
-    if (listChanged)
+    traceWindows.clear();
+    traceGroupKeys.clear();
+
+    DWORD written = 0;
+    if (!traceBuffer.empty())
+        WriteFile(hTraceFile, traceBuffer.data(), static_cast<DWORD>(traceBuffer.size() * sizeof(TraceRecord)), &written, NULL);
+    traceBuffer.clear();
+    CloseHandle(hTraceFile);
+    hTraceFile = INVALID_HANDLE_VALUE;
+    traceRecording = false;
+}
+
+// Function to get a latency percentile in microseconds from sorted samples
+static double GetPercentile(const std::vector<double>& sorted, double fraction)
+{
+    if (sorted.empty())
+        return 0.0;
+    size_t index = static_cast<size_t>(ceil(fraction * sorted.size()));
+    return sorted[(index > 0 ? index : 1) - 1];
+}
+
+// Function to add one command's latency line to a replay report
+static void AppendLatencyReport(std::wstring& report, const wchar_t* name, std::vector<double>& samples)
+{
+    std::sort(samples.begin(), samples.end());
+    wchar_t line[256];
+    swprintf_s(line, 256, L"%-8s count %6d  p50 %9.1f us  p90 %9.1f us  p99 %9.1f us  max %9.1f us\r\n", name,
+        static_cast<int>(samples.size()), GetPercentile(samples, 0.50), GetPercentile(samples, 0.90),
+        GetPercentile(samples, 0.99), samples.empty() ? 0.0 : samples.back());
+    report += line;
+}
+
+// Function to read the name whose TRACE_NAME record is at records[i];
+// i is left on the last TRACE_TEXT record of the name
+static std::wstring ReadTraceText(const std::vector<TraceRecord>& records, size_t& i)
+{
+    size_t length = static_cast<size_t>((std::max)(0, static_cast<int>(records[i].b)));
+    std::wstring text;
+    while (text.size() < length && i + 1 < records.size() && records[i + 1].type == TRACE_TEXT)
     {
-        // Update indices
-        for (size_t i = 0; i < windowList.size(); ++i)
+        const TraceRecord& record = records[++i];
+        const short units[4] = { record.a, record.b, record.c, record.d };
+        for (int unit = 0; unit < 4 && text.size() < length; ++unit)
         {
-            windowList[i].index = static_cast<int>(i) + 1;
+            text += static_cast<wchar_t>(static_cast<unsigned short>(units[unit]));
         }
-        // Refresh the ListView
-        RefreshWindowList();
     }
+    return text;
 }
 
-// Function to arrange windows considering multiple monitors and ensuring equal sizes
-void ArrangeWindows()
+// Function to replay a trace against a simulated window server as fast as
+// possible. Simulated windows are rectangles keyed by their recorded
+// handle, held in the spatial index as the live desktop is. Clicks, drags
+// and the capture keys go through the capture session the way the hooks
+// do, hit-testing the index; arranges and restores run the same layouts
+// as the live tool, with the recorded group keys, window names, custom
+// layout and monitors, and move the simulated rectangles instead of
+// windows. Each recorded capture list is checked against the replayed one
+// and then taken over, so the replay follows the recording.
+bool ReplayTrace(const std::wstring& path, std::wstring& report)
 {
-    if (windowList.empty())
+    HANDLE hFile = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
     {
-        TimedMessageBox(NULL, L"No windows to arrange. Please capture windows first.", L"Info", MB_OK);
-        return;
+        report = L"Cannot open trace file.";
+        return false;
     }
 
-    // Check and remove any closed windows before arranging
-    CheckAndRemoveClosedWindows();
-
-    if (windowList.empty())
+    std::string bytes;
+    char buffer[65536];
+    DWORD bytesRead = 0;
+    while (ReadFile(hFile, buffer, sizeof(buffer), &bytesRead, NULL) && bytesRead > 0)
     {
-        TimedMessageBox(NULL, L"No valid windows to arrange.", L"Info", MB_OK);
-        return;
+        bytes.append(buffer, bytesRead);
     }
+    CloseHandle(hFile);
 
-    // Get selected monitor
-    int monitorIndex = ComboBox_GetCurSel(hMonitorComboBox);
-    if (monitorMap.find(monitorIndex) == monitorMap.end())
+    TraceHeader header = { 0 };
+    if (bytes.size() >= sizeof(header))
+        memcpy(&header, bytes.data(), sizeof(header));
+    if (header.magic != TRACE_MAGIC || header.version != TRACE_VERSION)
     {
-        TimedMessageBox(NULL, L"Selected monitor not found.", L"Error", MB_OK);
-        return;
+        report = L"Not a trace file, or written by another version.";
+        return false;
     }
-    MONITORINFO mi = monitorMap[monitorIndex];
-    RECT workArea = mi.rcWork;
-    int workWidth = workArea.right - workArea.left;
-    int workHeight = workArea.bottom - workArea.top;
+    size_t count = (bytes.size() - sizeof(header)) / sizeof(TraceRecord);
+    std::vector<TraceRecord> records(count);
+    if (count > 0)
+        memcpy(records.data(), bytes.data() + sizeof(header), count * sizeof(TraceRecord));
+
+    // The live index, list and layout inputs hold the simulated ones meanwhile
+    SpatialIndex savedIndex;
+    std::swap(savedIndex, spatialIndex);
+    WindowRecords savedList;
+    std::swap(savedList, windowList);
+    std::unordered_map<HWND, int> savedGroupKeys;
+    savedGroupKeys.swap(windowGroupKeys);
+    std::vector<LayoutGroup> savedGroups;
+    savedGroups.swap(layoutGroups);
+    std::map<int, MONITORINFO> savedMonitors;
+    savedMonitors.swap(monitorMap);
+    std::map<int, UINT> savedDpis;
+    savedDpis.swap(monitorDpiMap);
+    std::vector<LayoutProgram> savedLayouts;
+    savedLayouts.swap(customLayouts);
+    int savedCustomLayout = currentCustomLayout;
+    currentCustomLayout = 0;
+
+    // The simulated window server and capture session
+    RECT screen = { 0, 0, 1920, 1080 };
+    ResetSpatialIndex(spatialIndex, screen);
+    std::unordered_map<HWND, RECT> serverWindows;
+    std::vector<std::pair<HWND, RECT>> captured;   // Window and the rectangle to restore to
+    std::unordered_map<HWND, std::wstring> groupKeys;
+    std::vector<std::pair<RECT, UINT>> monitors;  // Work area and DPI, for the next arrange
+    bool layoutRecorded = false;                  // A custom layout was recorded for the next arrange
+    CaptureSession session;
+    RECT workArea = { 0, 0, 1920, 1080 };
+    std::vector<double> arrangeLatency, restoreLatency, listLatency, lifecycleLatency, captureLatency;
+    long long windowsMoved = 0;
+    int inputEvents = 0;
+    int clicks = 0, lassos = 0;
+    int differences = 0;
+
+    // Moves a simulated window; hidden windows stay out of the index
+    auto moveWindow = [&serverWindows](HWND hWnd, const RECT& rect) {
+        RECT& current = serverWindows[hWnd];
+        if (EqualRect(&current, &rect))
+            return false;
+        current = rect;
+        if (spatialIndex.entryOf.count(hWnd))
+            PlaceSpatialEntry(spatialIndex, hWnd, rect);
+        return true;
+    };
+    auto findCaptured = [&captured](HWND hWnd) {
+        return std::find_if(captured.begin(), captured.end(), [hWnd](const std::pair<HWND, RECT>& window) { return window.first == hWnd; });
+    };
+    auto sessionFull = [&captured, &session]() {
+        return session.target > 0 && captured.size() >= session.baseCount + session.target;
+    };
+
+    LARGE_INTEGER frequency, replayStart, replayEnd;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&replayStart);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const TraceRecord& record = records[i];
+        HWND hWnd = reinterpret_cast<HWND>(static_cast<UINT_PTR>(record.window));
+        RECT rect = { record.a, record.b, record.c, record.d };
+        POINT pt = { record.a, record.b };
+        LARGE_INTEGER start, end;
+        QueryPerformanceCounter(&start);
+
+        switch (record.type)
+        {
+        case TRACE_MOUSE_DOWN:
+            // Clicks on the tool go through to it, as in LowLevelMouseProc
+            inputEvents++;
+            if (session.state == CAPTURE_ACTIVE && record.c == 0)
+            {
+                session.buttonDown = true;
+                session.buttonDownPoint = pt;
+            }
+            continue;
+        case TRACE_MOUSE_UP:
+        {
+            inputEvents++;
+            if (!session.buttonDown)
+                continue;
+            session.buttonDown = false;
+            if (session.state != CAPTURE_ACTIVE)
+                continue;
+
+            if (IsCaptureClick(session.buttonDownPoint, pt))
+            {
+                // Capture or release the window under the cursor
+                clicks++;
+                HWND hTarget = SpatialIndexHitTest(pt);
+                auto it = findCaptured(hTarget);
+                if (hTarget && it != captured.end())
+                {
+                    if (static_cast<size_t>(it - captured.begin()) < session.baseCount)
+                        session.baseCount--;
+                    captured.erase(it);
+                }
+                else if (hTarget)
+                {
+                    captured.emplace_back(hTarget, serverWindows[hTarget]);
+                }
+            }
+            else
+            {
+                // Capture the windows the lasso touches until the target is met
+                lassos++;
+                std::vector<HWND> windows;
+                GetLassoWindows(GetLassoRect(session.buttonDownPoint, pt), windows);
+                for (HWND hTarget : windows)
+                {
+                    if (sessionFull())
+                        break;
+                    if (findCaptured(hTarget) == captured.end())
+                        captured.emplace_back(hTarget, serverWindows[hTarget]);
+                }
+            }
+            if (sessionFull())
+            {
+                session.state = CAPTURE_ENDING;
+                session.endReason = CAPTURE_END_COMPLETED;
+            }
+            QueryPerformanceCounter(&end);
+            captureLatency.push_back((end.QuadPart - start.QuadPart) * 1e6 / frequency.QuadPart);
+            continue;
+        }
+        case TRACE_HOTKEY:
+            // Esc and Enter end a capture; the commands of other chords are traced on their own
+            inputEvents++;
+            if (session.state == CAPTURE_ACTIVE && record.a == 0 && (record.b == VK_ESCAPE || record.b == VK_RETURN))
+            {
+                session.state = CAPTURE_ENDING;
+                session.endReason = (record.b == VK_ESCAPE) ? CAPTURE_END_CANCELLED : CAPTURE_END_FINISHED;
+            }
+            continue;
+        case TRACE_CAPTURE_START:
+            session = CaptureSession();
+            session.target = record.a;
+            session.state = CAPTURE_ACTIVE;
+            if (record.b == 0)
+                captured.clear();
+            session.baseCount = captured.size();
+            continue;
+        case TRACE_CAPTURE_END:
+            // The capture button and the timeout end a session from outside
+            if (session.state == CAPTURE_ACTIVE)
+                session.endReason = record.a;
+            else if (session.state != CAPTURE_ENDING || session.endReason != record.a)
+                differences++;
+            session.state = CAPTURE_IDLE;
+            session.buttonDown = false;
+            continue;
+        case TRACE_SCREEN:
+            ResetSpatialIndex(spatialIndex, rect);
+            continue;
+        case TRACE_WINDOW_SHOW:
+        case TRACE_WINDOW_MOVE:
+            serverWindows[hWnd] = rect;
+            PlaceSpatialEntry(spatialIndex, hWnd, rect);
+            break;
+        case TRACE_WINDOW_HIDE:
+            SpatialIndexRemove(hWnd);
+            break;
+        case TRACE_WINDOW_RAISE:
+            RaiseSpatialEntry(spatialIndex, hWnd);
+            break;
+        case TRACE_WINDOW_DESTROY:
+            serverWindows.erase(hWnd);
+            SpatialIndexRemove(hWnd);
+            groupKeys.erase(hWnd);
+            replayWindowNames.erase(hWnd);
+            break;
+        case TRACE_NAME:
+        {
+            int kind = record.a;
+            std::wstring text = ReadTraceText(records, i);
+            if (kind == TRACE_NAME_GROUP)
+            {
+                groupKeys[hWnd] = text;
+            }
+            else if (kind == TRACE_NAME_PROCESS)
+            {
+                replayWindowNames[hWnd].process = text;
+            }
+            else if (kind == TRACE_NAME_CLASS)
+            {
+                replayWindowNames[hWnd].className = text;
+            }
+            else if (kind == TRACE_NAME_LAYOUT)
+            {
+                // Compiled once, then only when another layout is recorded
+                layoutRecorded = true;
+                if (customLayouts.empty() || customLayouts[0].source != text)
+                {
+                    customLayouts.assign(1, LayoutProgram());
+                    if (!ParseLayoutLine(text, customLayouts[0]))
+                        customLayouts.clear();
+                }
+            }
+            continue;
+        }
+        case TRACE_LIST:
+        {
+            std::vector<std::pair<HWND, RECT>> recorded;
+            size_t entries = (std::min)(static_cast<size_t>(record.window), count - i - 1);
+            for (size_t entry = 0; entry < entries && records[i + 1].type == TRACE_LIST_ENTRY; ++entry)
+            {
+                const TraceRecord& item = records[++i];
+                HWND hItem = reinterpret_cast<HWND>(static_cast<UINT_PTR>(item.window));
+                RECT itemRect = { item.a, item.b, item.c, item.d };
+                recorded.emplace_back(hItem, itemRect);
+                serverWindows.emplace(hItem, itemRect);
+            }
 
-    // Retrieve pixelFix values
-    wchar_t pixelFixXBuffer[16];
-    GetWindowText(hPixelFixXEdit, pixelFixXBuffer, 16);
-    int pixelFixX = _wtoi(pixelFixXBuffer); // Converts to integer, handles negative values
+            // Windows captured by title or rules, reorders and workspace
+            // switches only show up here; clicks and drags must agree
+            bool same = recorded.size() == captured.size();
+            for (size_t entry = 0; same && entry < recorded.size(); ++entry)
+            {
+                same = recorded[entry].first == captured[entry].first;
+            }
+            if (!same)
+                differences++;
+            if (session.baseCount > recorded.size())
+                session.baseCount = recorded.size();
+            captured.swap(recorded);
+            QueryPerformanceCounter(&end);
+            listLatency.push_back((end.QuadPart - start.QuadPart) * 1e6 / frequency.QuadPart);
+            continue;
+        }
+        case TRACE_MONITOR:
+            monitors.emplace_back(rect, static_cast<UINT>(record.window));
+            continue;
+        case TRACE_WORK_AREA:
+            workArea = rect;
+            continue;
+        case TRACE_ARRANGE:
+        {
+            // Closed windows are dropped first, as in the live arrange
+            captured.erase(std::remove_if(captured.begin(), captured.end(), [&serverWindows](const std::pair<HWND, RECT>& window) {
+                return serverWindows.find(window.first) == serverWindows.end();
+            }), captured.end());
+
+            // The layouts read the captured list and group keys
+            int numWindows = static_cast<int>(captured.size());
+            windowList.handles.resize(numWindows);
+            windowList.rects.resize(numWindows);
+            windowList.titles.assign(numWindows, L"");
+            for (int window = 0; window < numWindows; ++window)
+            {
+                HWND hCaptured = captured[window].first;
+                windowList.handles[window] = hCaptured;
+                windowList.rects[window] = captured[window].second;
+                auto key = groupKeys.find(hCaptured);
+                windowGroupKeys[hCaptured] = InternGroupKey((key != groupKeys.end()) ? key->second : L"process:");
+            }
 
-    wchar_t pixelFixYBuffer[16];
-    GetWindowText(hPixelFixYEdit, pixelFixYBuffer, 16);
-    int pixelFixY = _wtoi(pixelFixYBuffer); // Converts to integer, handles negative values
+            GridLayoutParams params;
+            params.workArea = workArea;
+            params.pixelFixX = record.a;
+            params.pixelFixY = record.b;
+            params.minSpacingY = record.c;
+            params.layoutMode = record.d;
+            params.allMonitors = (record.window & TRACE_ARRANGE_ALL_MONITORS) && !monitors.empty();
+            if (params.allMonitors)
+            {
+                monitorMap.clear();
+                monitorDpiMap.clear();
+                for (size_t monitor = 0; monitor < monitors.size(); ++monitor)
+                {
+                    MONITORINFO info = { sizeof(MONITORINFO) };
+                    info.rcMonitor = monitors[monitor].first;
+                    info.rcWork = monitors[monitor].first;
+                    monitorMap[static_cast<int>(monitor)] = info;
+                    monitorDpiMap[static_cast<int>(monitor)] = monitors[monitor].second;
+                }
+            }
+            monitors.clear();
 
-    // Retrieve minimum vertical spacing
-    wchar_t minSpacingYBuffer[16];
-    GetWindowText(hMinSpacingYEdit, minSpacingYBuffer, 16);
-    int minSpacingY = _wtoi(minSpacingYBuffer);
+            // Without a recorded layout the live tool had none loaded
+            if (params.layoutMode == LAYOUT_CUSTOM && !layoutRecorded)
+                customLayouts.clear();
+            layoutRecorded = false;
 
-    // Validate minimum spacing
-    if (minSpacingY < 0)
-    {
-        TimedMessageBox(NULL, L"Minimum vertical spacing cannot be negative. Resetting to 0.", L"Invalid Input", MB_OK | MB_ICONWARNING);
-        minSpacingY = 0;
+            std::vector<RECT> cells;
+            if (ComputeLayout(params, windowList.handles, cells, NULL))
+            {
+                for (size_t window = 0; window < cells.size() && window < captured.size(); ++window)
+                {
+                    if (moveWindow(captured[window].first, cells[window]))
+                        windowsMoved++;
+                }
+            }
+            QueryPerformanceCounter(&end);
+            arrangeLatency.push_back((end.QuadPart - start.QuadPart) * 1e6 / frequency.QuadPart);
+            continue;
+        }
+        case TRACE_RESTORE:
+            for (const auto& window : captured)
+            {
+                if (serverWindows.count(window.first) && moveWindow(window.first, window.second))
+                    windowsMoved++;
+            }
+            QueryPerformanceCounter(&end);
+            restoreLatency.push_back((end.QuadPart - start.QuadPart) * 1e6 / frequency.QuadPart);
+            continue;
+        default:
+            continue;
+        }
+
+        QueryPerformanceCounter(&end);
+        lifecycleLatency.push_back((end.QuadPart - start.QuadPart) * 1e6 / frequency.QuadPart);
     }
 
-    // Apply pixelFixX to starting X position
-    int startXPos = workArea.left + pixelFixX;
+    QueryPerformanceCounter(&replayEnd);
+    double seconds = (replayEnd.QuadPart - replayStart.QuadPart) / static_cast<double>(frequency.QuadPart);
+    double recordedSeconds = count ? records[count - 1].time / 1000.0 : 0.0;
+
+    // Put the live state back
+    std::swap(savedIndex, spatialIndex);
+    std::swap(savedList, windowList);
+    savedGroupKeys.swap(windowGroupKeys);
+    savedGroups.swap(layoutGroups);
+    savedMonitors.swap(monitorMap);
+    savedDpis.swap(monitorDpiMap);
+    savedLayouts.swap(customLayouts);
+    currentCustomLayout = savedCustomLayout;
+    replayWindowNames.clear();
+
+    wchar_t summary[256];
+    swprintf_s(summary, 256, L"%d records (%d input events) replayed in %.3f s, %.0f records/s, %.0fx real time, %lld window moves\r\n",
+        static_cast<int>(count), inputEvents, seconds, seconds > 0 ? count / seconds : 0.0,
+        seconds > 0 ? recordedSeconds / seconds : 0.0, windowsMoved);
+    report = summary;
+    AppendLatencyReport(report, L"arrange", arrangeLatency);
+    AppendLatencyReport(report, L"restore", restoreLatency);
+    AppendLatencyReport(report, L"capture", captureLatency);
+    AppendLatencyReport(report, L"list", listLatency);
+    AppendLatencyReport(report, L"window", lifecycleLatency);
+    swprintf_s(summary, 256, L"%d clicks and %d lassos replayed; %d capture lists or session ends differ from the recording\r\n",
+        clicks, lassos, differences);
+    report += summary;
+    return true;
+}
 
-    // Apply pixelFixY to available height by reserving space at the bottom
-    int totalSpacingY = (windowList.size() > 1) ? (windowList.size() - 1) * minSpacingY : 0;
-    int availableHeight = workHeight - pixelFixY - totalSpacingY;
+// Function to run the apply pipelines on real windows while some of them
+// close: windows closed before the arrange must be dropped in order, and
+// windows closed between the layout and the move must not shift the others
+// out of their cells, through both the batch used by reflows and the
+// ordered batch of ArrangeWindows. The arrange runs through a backend that
+// leaves the focus and the tool's window alone; how many batches and
+// activations an arrange makes is checked headless by
+// tests/WindowApplyTest.cpp. Returns the first problem, or NULL.
+static const wchar_t* CheckApplyWithClosedWindows(std::mt19937& random, const GridLayoutParams& params)
+{
+    std::uniform_int_distribution<int> countDistribution(2, SELFCHECK_APPLY_MAX_WINDOWS);
+    std::uniform_int_distribution<int> closeDistribution(0, 3);
+    int count = countDistribution(random);
 
-    // Ensure availableHeight is positive
-    if (availableHeight <= 0)
+    ClearWindowRecords(windowList);
+    std::vector<HWND> expected;
+    for (int i = 0; i < count; ++i)
     {
-        TimedMessageBox(NULL, L"Not enough vertical space for the specified spacing and Pixel Fix Y. Please reduce the spacing or Pixel Fix Y.", L"Error", MB_OK | MB_ICONERROR);
-        return;
+        HWND hWnd = CreateWindowEx(WS_EX_TOOLWINDOW, L"STATIC", L"", WS_POPUP, 0, 0, 100, 100, NULL, NULL, hInstance, NULL);
+        if (!hWnd)
+            continue;
+        AddWindowRecord(windowList, hWnd, L"");
+        if (closeDistribution(random) == 0)
+            DestroyWindow(hWnd);
+        else
+            expected.push_back(hWnd);
     }
 
-    // Calculate the best grid layout (rows and columns) to minimize gaps
-    int numWindows = static_cast<int>(windowList.size());
-    double aspectRatio = static_cast<double>(workWidth) / (availableHeight);
-
-    int bestRows = 1;
-    int bestCols = numWindows;
-    double minDifference = DBL_MAX;
+    const wchar_t* problem = NULL;
+    RemoveClosedWindowRecords(windowList, false);
+    if (windowList.handles != expected || windowList.titles.size() != expected.size() || windowList.rects.size() != expected.size())
+        problem = L"closed windows were not dropped in order";
 
-    for (int rows = 1; rows <= numWindows; ++rows)
+    std::vector<RECT> cells;
+    if (!problem && ComputeGridLayout(params, static_cast<int>(windowList.handles.size()), cells))
     {
-        int cols = (numWindows + rows - 1) / rows; // Ceiling division
-        double gridAspectRatio = static_cast<double>(cols) / rows;
-        double difference = fabs(gridAspectRatio - aspectRatio);
+        for (HWND hWnd : windowList.handles)
+        {
+            if (closeDistribution(random) == 0)
+                DestroyWindow(hWnd);
+        }
 
-        if (difference < minDifference)
+        ApplyWindowLayoutBatch(cells);
+        for (size_t i = 0; i < windowList.handles.size() && !problem; ++i)
         {
-            minDifference = difference;
-            bestRows = rows;
-            bestCols = cols;
+            RECT rect;
+            if (IsWindow(windowList.handles[i]) && (!GetWindowRect(windowList.handles[i], &rect) || !EqualRect(&rect, &cells[i])))
+                problem = L"a window did not reach its cell after another closed";
         }
     }
 
-    // Recalculate total spacing based on bestRows
-    totalSpacingY = (bestRows - 1) * minSpacingY;
-    availableHeight = workHeight - pixelFixY - totalSpacingY;
+    // The arrange path: closed windows dropped, moves planned from the
+    // cells, more windows closed, then one ordered batch. The survivors
+    // must be in their cells and stacked in list order, the last on top.
+    RemoveClosedWindowRecords(windowList, false);
+    if (!problem && ComputeGridLayout(params, static_cast<int>(windowList.handles.size()), cells))
+    {
+        std::vector<WindowMove> moves;
+        BuildWindowMoves(cells, moves);
+        for (const auto& move : moves)
+        {
+            if (closeDistribution(random) == 0)
+                DestroyWindow(move.hWnd);
+        }
 
-    // Calculate window sizes
-    int windowHeight = availableHeight / bestRows;
-    int extraPixelsHeight = availableHeight % bestRows;
+        Win32ApplyBackend backend = { false };
+        ApplyArrangeMoves(backend, moves);
 
-    // Distribute extra pixels to the top rows to eliminate gaps
-    std::vector<int> rowHeights(bestRows, windowHeight);
-    for (int row = 0; row < extraPixelsHeight; ++row)
-    {
-        rowHeights[row]++;
+        HWND hAbove = NULL;
+        for (size_t i = moves.size(); i-- > 0 && !problem; )
+        {
+            if (!IsWindow(moves[i].hWnd))
+                continue;
+            RECT rect;
+            if (!GetWindowRect(moves[i].hWnd, &rect) || !EqualRect(&rect, &moves[i].after))
+                problem = L"an arranged window did not reach its cell after another closed";
+            else if (hAbove && GetWindow(moves[i].hWnd, GW_HWNDPREV) != hAbove)
+                problem = L"arranged windows are not stacked in list order";
+            hAbove = moves[i].hWnd;
+        }
     }
 
-    // Calculate window widths
-    int windowWidth = workWidth / bestCols;
-    int extraPixelsWidth = workWidth % bestCols;
-
-    std::vector<int> columnWidths(bestCols, windowWidth);
-    for (int col = 0; col < extraPixelsWidth; ++col)
+    for (HWND hWnd : windowList.handles)
     {
-        columnWidths[col]++;
+        if (IsWindow(hWnd))
+            DestroyWindow(hWnd);
     }
+    ClearWindowRecords(windowList);
+    return problem;
+}
 
-    // Now, arrange the windows
-    int windowIndex = 0;
-    int yPos = workArea.top; // Start at the top of the work area
-    for (int row = 0; row < bestRows; ++row)
+// Function to check that the layout history holds its memory flat: after
+// the first change, recording SELFCHECK_HISTORY_CHANGES more must not
+// allocate. bytes is set to what the history holds at the end.
+static const wchar_t* CheckLayoutHistoryMemory(std::mt19937& random, size_t& bytes)
+{
+    std::vector<WindowMove> moves;
+    std::vector<size_t> counts;
+    MakeHistoryChanges(random, moves, counts);
+    LayoutHistory saved;
+    std::swap(saved, layoutHistory);
+
+    const wchar_t* problem = NULL;
+    size_t first = 0;
+    size_t firstBytes = 0;
+    for (size_t count : counts)
     {
-        int xPos = startXPos;
-        for (int col = 0; col < bestCols; ++col)
-        {
-            if (windowIndex >= numWindows)
-                break;
+        RecordHistoryChange(&moves[first], count);
+        if (first == 0)
+            firstBytes = GetLayoutHistoryBytes();
+        else if (GetLayoutHistoryBytes() != firstBytes && !problem)
+            problem = L"layout history: memory grew with the number of entries";
+        first += count;
+    }
+    if (!problem && layoutHistory.count > LAYOUT_HISTORY_ENTRIES)
+        problem = L"layout history: more entries than the ring holds";
 
-            const auto& info = windowList[windowIndex];
+    bytes = GetLayoutHistoryBytes();
+    std::swap(saved, layoutHistory);
+    return problem;
+}
 
-            if (IsWindow(info.hWnd))
-            {
-                int cellWidth = columnWidths[col];
-                int cellHeight = rowHeights[row];
+// Benchmarks run after the layout cases; each one collects a latency
+// distribution in microseconds, held to a budget for its 99th percentile
+struct SelfCheckBenchmark
+{
+    const wchar_t* name;
+    double p99BudgetUs;  // 0 = reported only
+    void (*run)(std::mt19937& random, std::vector<double>& samples);
+};
+static const SelfCheckBenchmark selfCheckBenchmarks[] =
+{
+    { L"lasso query, 5000 windows", 100.0, BenchmarkSpatialIndexQuery },
+    { L"record pass, 10000 windows", 500.0, BenchmarkWindowRecordPass },
+    { L"record pass, 10000 windows, reference layout", 0.0, BenchmarkReferenceRecordPass },
+    { L"rule classification, 1000 of 100000 windows, 500 rules", 2000.0, BenchmarkCaptureRules },
+    { L"layout history push", 10.0, BenchmarkLayoutHistoryPush },
+    { L"layout history undo/redo step", 10.0, BenchmarkLayoutHistoryStep },
+};
 
-                // Desired client area size
-                RECT desiredClientRect = { 0, 0, cellWidth, cellHeight };
+// Function to run the self-check of the Windows side: cases arranges of
+// real windows while some of them close, moved inside the primary work
+// area so they are not clamped, then the benchmarks in selfCheckBenchmarks
+// and the layout history's memory. The layout solvers themselves are
+// checked by tests/LayoutSelfCheck.cpp, the auto-tile debounce by
+// tests/AutoTileBurstTest.cpp and the arrange scheduler by
+// tests/ArrangeStormTest.cpp, which need no windows.
+// Returns false if any case fails or any budget is exceeded.
+bool RunLayoutSelfCheck(int cases, unsigned int seed, std::wstring& report)
+{
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> spacingDistribution(0, 32);
+    std::uniform_int_distribution<int> modeDistribution(LAYOUT_GRID, LAYOUT_ROWS);
 
-                // Get current window style
-                LONG style = GetWindowLong(info.hWnd, GWL_STYLE);
-                LONG exStyle = GetWindowLong(info.hWnd, GWL_EXSTYLE);
+    GridLayoutParams params;
+    SetRect(&params.workArea, 0, 0, 1920, 1080);
+    SystemParametersInfo(SPI_GETWORKAREA, 0, &params.workArea, 0);
+    params.pixelFixX = 0;
+    params.pixelFixY = 0;
+    params.allMonitors = false;
 
-                // Adjust window size to fit desired client area
-                RECT adjustedWindowRect = desiredClientRect;
-                if (!AdjustWindowRectEx(&adjustedWindowRect, style, FALSE, exStyle))
-                {
-                    // Fallback if AdjustWindowRectEx fails
-                    adjustedWindowRect.right = cellWidth;
-                    adjustedWindowRect.bottom = cellHeight;
-                }
+    std::wstring failures;
+    int failureCount = 0;
 
-                int windowWidthAdjusted = adjustedWindowRect.right - adjustedWindowRect.left;
-                int windowHeightAdjusted = adjustedWindowRect.bottom - adjustedWindowRect.top;
-
-                // Move and resize the window
-                BOOL success = SetWindowPos(
-                    info.hWnd,
-                    HWND_TOP,
-                    xPos,
-                    yPos,
-                    windowWidthAdjusted,
-                    windowHeightAdjusted,
-                    SWP_NOACTIVATE | SWP_SHOWWINDOW
-                );
-
-                ShowWindow(info.hWnd, SW_MINIMIZE);
-                // Minimize all windows first
-                //for (const auto& info : windowList)
-                //{
-                //    if (IsWindow(info.hWnd))
-                //    {
-                //        ShowWindow(info.hWnd, SW_MINIMIZE);
-                //    }
-                //}
-                Sleep(100);
-                // Unminimize the window
-                ShowWindow(info.hWnd, SW_RESTORE);
-                ShowWindow(hMainWindow, SW_MINIMIZE);
-                if (!success)
-                {
-                    // Optional: Handle the error, e.g., log or notify the user
-                }
+    // The checks fill the captured list with their own windows
+    WindowRecords savedWindows;
+    std::swap(savedWindows, windowList);
 
-                // Bring the window to the foreground
-                SetForegroundWindow(info.hWnd);
-            }
-            else
-            {
-                // Window is no longer valid; skip
-                continue;
-            }
+    LARGE_INTEGER frequency, runStart, runEnd;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&runStart);
+
+    for (int testCase = 0; testCase < cases; ++testCase)
+    {
+        params.minSpacingY = spacingDistribution(random);
+        params.layoutMode = modeDistribution(random);
+        const wchar_t* problem = CheckApplyWithClosedWindows(random, params);
+        if (problem && ++failureCount <= SELFCHECK_MAX_REPORTED_FAILURES)
+        {
+            wchar_t line[320];
+            swprintf_s(line, 320, L"FAIL case %d: %s (mode %d, spacing %d)\r\n", testCase, problem, params.layoutMode, params.minSpacingY);
+            failures += line;
+        }
+    }
+
+    QueryPerformanceCounter(&runEnd);
+    double seconds = (runEnd.QuadPart - runStart.QuadPart) / static_cast<double>(frequency.QuadPart);
+
+    std::swap(savedWindows, windowList);
+
+    wchar_t summary[256];
+    swprintf_s(summary, 256, L"%d arranges of real windows (seed %u) checked in %.1f s: %d failed\r\n",
+        cases, seed, seconds, failureCount);
+    report = summary;
 
-            // Move to the next column position
-            xPos += columnWidths[col];
-            windowIndex++;
+    bool withinBudget = true;
+    for (const SelfCheckBenchmark& benchmark : selfCheckBenchmarks)
+    {
+        std::vector<double> samples;
+        benchmark.run(random, samples);
+        AppendLatencyReport(report, benchmark.name, samples);
+        double p99 = GetPercentile(samples, 0.99);
+        if (benchmark.p99BudgetUs > 0.0 && p99 > benchmark.p99BudgetUs)
+        {
+            wchar_t line[160];
+            swprintf_s(line, 160, L"OVER BUDGET %s: p99 %.1f us, budget %.1f us\r\n", benchmark.name, p99, benchmark.p99BudgetUs);
+            failures += line;
+            withinBudget = false;
         }
-        // After arranging a row, move Y position down by row height + spacing
-        yPos += rowHeights[row] + minSpacingY;
     }
+
+    size_t historyBytes = 0;
+    const wchar_t* historyProblem = CheckLayoutHistoryMemory(random, historyBytes);
+    wchar_t historyLine[200];
+    swprintf_s(historyLine, 200, L"layout history after %d changes: %.1f KB\r\n", SELFCHECK_HISTORY_CHANGES, historyBytes / 1024.0);
+    report += historyLine;
+    if (historyProblem)
+    {
+        swprintf_s(historyLine, 200, L"FAIL layout history: %s\r\n", historyProblem);
+        failures += historyLine;
+        failureCount++;
+    }
+
+    report += failures;
+    report += (failureCount == 0 && withinBudget) ? L"PASS\r\n" : L"FAIL\r\n";
+    return failureCount == 0 && withinBudget;
 }
 
-// Callback for enumerating monitors
-BOOL CALLBACK MonitorEnumProc(HMONITOR hMonitor, HDC hdcMonitor, LPRECT lprcMonitor, LPARAM dwData)
+// Function to write a report as UTF-8 text
+static void WriteReportFile(const std::wstring& path, const std::wstring& report)
 {
-    MONITORINFO mi = { 0 };
-    mi.cbSize = sizeof(mi);
-    if (GetMonitorInfo(hMonitor, &mi))
+    HANDLE hReport = CreateFile(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hReport == INVALID_HANDLE_VALUE)
+        return;
+
+    int length = WideCharToMultiByte(CP_UTF8, 0, report.c_str(), static_cast<int>(report.size()), NULL, 0, NULL, NULL);
+    std::string text(length, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, report.c_str(), static_cast<int>(report.size()), &text[0], length, NULL, NULL);
+    DWORD written = 0;
+    WriteFile(hReport, text.data(), static_cast<DWORD>(text.size()), &written, NULL);
+    CloseHandle(hReport);
+}
+
+// Function to split the process command line into arguments with the
+// system's quoting rules, without the program name
+static std::vector<std::wstring> GetCommandLineArguments()
+{
+    std::vector<std::wstring> arguments;
+    int count = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &count);
+    if (argv == NULL)
+        return arguments;
+    for (int i = 1; i < count; ++i)
     {
-        int index = static_cast<int>(monitorMap.size());
-        monitorMap[index] = mi;
+        arguments.push_back(argv[i]);
+    }
+    LocalFree(argv);
+    return arguments;
+}
 
-        wchar_t monitorName[256];
-        wsprintf(monitorName, L"Monitor %d (%dx%d)", index + 1,
-            mi.rcMonitor.right - mi.rcMonitor.left,
-            mi.rcMonitor.bottom - mi.rcMonitor.top);
+// Function to check for a command-line option; only a whole argument
+// matches, so "/tray" is not found in "/traylog" or inside a path
+static bool HasCommandLineOption(const std::vector<std::wstring>& arguments, const wchar_t* option)
+{
+    for (const auto& argument : arguments)
+    {
+        if (_wcsicmp(argument.c_str(), option) == 0)
+            return true;
+    }
+    return false;
+}
 
-        ComboBox_AddString((HWND)dwData, monitorName);
+// Function to get the value after a command-line option, e.g. the path in
+// /record "C:\trace.bin"; empty if the option is not given or is followed
+// by another option
+static std::wstring GetCommandLineValue(const std::vector<std::wstring>& arguments, const wchar_t* option)
+{
+    for (size_t i = 0; i + 1 < arguments.size(); ++i)
+    {
+        if (_wcsicmp(arguments[i].c_str(), option) == 0)
+            return arguments[i + 1][0] == L'/' ? std::wstring() : arguments[i + 1];
     }
-    return TRUE;
+    return std::wstring();
 }
 
-// Function to update monitor combo box
-void UpdateMonitorComboBox()
+// Function to move the metrics into a named shared-memory block. The
+// mapping starts zeroed, which is a valid all-zero MetricsBlock.
+void OpenMetricsSharedMemory()
 {
-    ComboBox_ResetContent(hMonitorComboBox);
-    monitorMap.clear();
-    EnumDisplayMonitors(NULL, NULL, MonitorEnumProc, (LPARAM)hMonitorComboBox);
-    ComboBox_SetCurSel(hMonitorComboBox, 0);
+    hMetricsMapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+        sizeof(MetricsBlock), METRICS_SHARED_MEMORY_NAME);
+    if (hMetricsMapping == NULL)
+        return;
+
+    // Another instance already publishes its metrics under this name
+    if (GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        CloseHandle(hMetricsMapping);
+        hMetricsMapping = NULL;
+        return;
+    }
+
+    void* view = MapViewOfFile(hMetricsMapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(MetricsBlock));
+    if (view == NULL)
+    {
+        CloseHandle(hMetricsMapping);
+        hMetricsMapping = NULL;
+        return;
+    }
+
+    metrics = static_cast<MetricsBlock*>(view);
+    metrics->magic = METRICS_MAGIC;
+    metrics->version = METRICS_VERSION;
 }
 
-// Function to refresh the window list
-void RefreshWindowList()
+// Function to release the shared metrics at exit
+void CloseMetricsSharedMemory()
 {
-    ListView_DeleteAllItems(hListView);
+    if (metrics != &localMetrics)
+    {
+        UnmapViewOfFile(metrics);
+        metrics = &localMetrics;
+    }
+    if (hMetricsMapping)
+    {
+        CloseHandle(hMetricsMapping);
+        hMetricsMapping = NULL;
+    }
+}
 
-    for (const auto& info : windowList)
+// Function to write all metrics in the Prometheus text exposition format
+std::string FormatPrometheusMetrics()
+{
+    struct CounterName
     {
-        // Format the index number
-        wchar_t indexStr[16];
-        swprintf_s(indexStr, 16, L"%d", info.index);
+        const char* name;
+        const char* help;
+    };
+    static const CounterName counterNames[METRIC_COUNTER_COUNT] = {
+        { "wmt_captures_total", "Windows added to the capture list." },
+        { "wmt_arranges_total", "Arranges and relayouts applied." },
+        { "wmt_windows_arranged_total", "Windows placed by arranges." },
+        { "wmt_windows_skipped_closed_total", "Captured windows dropped because they were closed." },
+        { "wmt_windows_hung_total", "Arranged windows whose application was not responding." },
+        { "wmt_restores_total", "Restores of the captured windows." },
+        { "wmt_registry_publishes_total", "Window registry snapshots published." },
+        { "wmt_registry_publishes_batched_total", "Registry publish requests folded into one already pending." },
+        { "wmt_auto_tile_events_total", "Window events seen by the auto-tiling daemon." },
+        { "wmt_auto_tile_relayouts_total", "Relayouts run by the auto-tiling daemon." },
+        { "wmt_linked_resize_frames_total", "Frames that committed a linked reflow." },
+        { "wmt_linked_resize_frames_dropped_total", "Display frames missed during linked drags." },
+        { "wmt_arrange_activations_total", "Windows brought to the foreground by arranges." },
+        { "wmt_arrange_requests_total", "Arrange requests received by the scheduler." },
+        { "wmt_arrange_requests_dropped_total", "Arrange requests folded into one already pending." },
+        { "wmt_arranges_cancelled_total", "Arranges abandoned for a newer request." },
+        { "wmt_settings_reloads_total", "Settings file reloads after outside edits." },
+        { "wmt_windows_reordered_total", "Windows moved by list reorders." },
+        { "wmt_layout_reloads_total", "Layouts file reloads." },
+    };
+    static const CounterName gaugeNames[METRIC_GAUGE_COUNT] = {
+        { "wmt_startup_seconds", "Time from process start to the message loop." },
+        { "wmt_private_bytes", "Committed private memory of the process." },
+        { "wmt_window_record_bytes", "Storage of the captured window list." },
+        { "wmt_title_pool_bytes", "Storage of the interned window titles." },
+        { "wmt_working_set_bytes", "Physical memory in use by the process." },
+    };
+    static const CounterName histogramNames[METRIC_HISTOGRAM_COUNT] = {
+        { "wmt_capture_seconds", "Time to capture windows." },
+        { "wmt_arrange_seconds", "Time to solve and apply an arrange." },
+        { "wmt_restore_seconds", "Time to restore the captured windows." },
+        { "wmt_list_refresh_seconds", "Time to refresh the window list." },
+        { "wmt_hook_callback_seconds", "Time spent in hook and WinEvent callbacks." },
+        { "wmt_panel_create_seconds", "Time to build the control panel." },
+    };
+
+    std::string text;
+    char line[256];
+    for (int counter = 0; counter < METRIC_COUNTER_COUNT; ++counter)
+    {
+        sprintf_s(line, 256, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", counterNames[counter].name,
+            counterNames[counter].help, counterNames[counter].name, counterNames[counter].name,
+            metrics->counters[counter].load(std::memory_order_relaxed));
+        text += line;
+    }
 
-        // Format the window handle
-        wchar_t handleStr[32];
-        swprintf_s(handleStr, 32, L"0x%016IX", (UINT_PTR)info.hWnd);
+    // Startup and footprint are compared between tray and panel mode, so they
+    // carry the mode they were measured in: the launch mode for the startup
+    // time, and whether the panel was built for the memory gauges
+    for (int gauge = 0; gauge < METRIC_GAUGE_COUNT; ++gauge)
+    {
+        unsigned long long value = metrics->gauges[gauge].load(std::memory_order_relaxed);
+        char labels[32] = "";
+        if (gauge == METRIC_STARTUP_MICROSECONDS)
+            sprintf_s(labels, 32, "{mode=\"%s\"}", trayMode ? "tray" : "panel");
+        else if (gauge == METRIC_PRIVATE_BYTES || gauge == METRIC_WORKING_SET_BYTES)
+            sprintf_s(labels, 32, "{mode=\"%s\"}", footprintPanelBuilt ? "panel" : "tray");
+
+        if (gauge == METRIC_STARTUP_MICROSECONDS)
+            sprintf_s(line, 256, "# HELP %s %s\n# TYPE %s gauge\n%s%s %.6f\n", gaugeNames[gauge].name,
+                gaugeNames[gauge].help, gaugeNames[gauge].name, gaugeNames[gauge].name, labels, value / 1e6);
+        else
+            sprintf_s(line, 256, "# HELP %s %s\n# TYPE %s gauge\n%s%s %llu\n", gaugeNames[gauge].name,
+                gaugeNames[gauge].help, gaugeNames[gauge].name, gaugeNames[gauge].name, labels, value);
+        text += line;
+    }
 
-        // Insert index column
-        LVITEM lvItem = { 0 };
-        lvItem.mask = LVIF_TEXT | LVIF_PARAM;
-        lvItem.pszText = indexStr;
-        lvItem.lParam = (LPARAM)info.hWnd;
-        lvItem.iItem = ListView_GetItemCount(hListView);
-        ListView_InsertItem(hListView, &lvItem);
+    for (int histogram = 0; histogram < METRIC_HISTOGRAM_COUNT; ++histogram)
+    {
+        const LatencyHistogram& source = metrics->histograms[histogram];
+        const char* name = histogramNames[histogram].name;
+        sprintf_s(line, 256, "# HELP %s %s\n# TYPE %s histogram\n", name, histogramNames[histogram].help, name);
+        text += line;
+
+        // Buckets are cumulative; stop after the last one in use
+        int lastUsed = -1;
+        for (int bucket = 0; bucket < METRICS_HISTOGRAM_BUCKETS; ++bucket)
+        {
+            if (source.buckets[bucket].load(std::memory_order_relaxed))
+                lastUsed = bucket;
+        }
+        unsigned long long cumulative = 0;
+        for (int bucket = 0; bucket <= lastUsed; ++bucket)
+        {
+            cumulative += source.buckets[bucket].load(std::memory_order_relaxed);
+            sprintf_s(line, 256, "%s_bucket{le=\"%.6f\"} %llu\n", name, (GetLatencyBucketLimit(bucket) + 1) / 1e6, cumulative);
+            text += line;
+        }
+        sprintf_s(line, 256, "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.6f\n%s_count %llu\n", name,
+            source.count.load(std::memory_order_relaxed), name,
+            source.sumMicroseconds.load(std::memory_order_relaxed) / 1e6, name,
+            source.count.load(std::memory_order_relaxed));
+        text += line;
+    }
+    return text;
+}
 
-        // Set window title in the second column
-        ListView_SetItemText(hListView, lvItem.iItem, 1, const_cast<LPWSTR>(info.windowTitle.c_str()));
+// Function to write the metrics file next to the executable. The text goes
+// to a temporary file first, so a scraper never reads a half-written file.
+void ExportMetrics()
+{
+    UpdateFootprintMetrics();
+    std::string text = FormatPrometheusMetrics();
+    std::wstring path = GetAppFilePath(METRICS_FILE);
+    std::wstring tempPath = path + L".tmp";
 
-        // Set window handle in the third column
-        ListView_SetItemText(hListView, lvItem.iItem, 2, handleStr);
-    }
+    HANDLE hFile = CreateFile(tempPath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return;
+    DWORD written = 0;
+    BOOL success = WriteFile(hFile, text.data(), static_cast<DWORD>(text.size()), &written, NULL);
+    CloseHandle(hFile);
 
-    // Optionally, you can auto-size columns after refreshing
-    ListView_SetColumnWidth(hListView, 0, LVSCW_AUTOSIZE);
-    ListView_SetColumnWidth(hListView, 1, LVSCW_AUTOSIZE_USEHEADER);
-    ListView_SetColumnWidth(hListView, 2, LVSCW_AUTOSIZE_USEHEADER);
+    if (success)
+        MoveFileEx(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+    else
+        DeleteFile(tempPath.c_str());
 }
 
-// Function to move selected item up or down
-void MoveSelectedItem(int direction)
+// Function to create the shared-memory block for the layout state. Like
+// the metrics, it is only published by the first instance.
+void OpenLayoutSharedMemory()
 {
-    int selected = ListView_GetNextItem(hListView, -1, LVNI_SELECTED);
-    if (selected == -1)
+    // Readers may map the block for reading only, so no other process can
+    // change what status bars show; without the descriptor nothing is shared
+    PSECURITY_DESCRIPTOR descriptor = NULL;
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptor(LAYOUT_SHARED_MEMORY_SDDL, SDDL_REVISION_1, &descriptor, NULL))
         return;
-
-    int newIndex = selected + direction;
-    if (newIndex < 0 || newIndex >= (int)windowList.size())
+    SECURITY_ATTRIBUTES attributes = { sizeof(attributes), descriptor, FALSE };
+    hLayoutMapping = CreateFileMapping(INVALID_HANDLE_VALUE, &attributes, PAGE_READWRITE, 0,
+        sizeof(PublishedLayoutState), LAYOUT_SHARED_MEMORY_NAME);
+    LocalFree(descriptor);
+    if (hLayoutMapping == NULL)
         return;
 
-    // Swap items in the vector
-    std::swap(windowList[selected], windowList[newIndex]);
+    if (GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        CloseHandle(hLayoutMapping);
+        hLayoutMapping = NULL;
+        return;
+    }
 
-    // Update index numbers
-    for (size_t i = 0; i < windowList.size(); ++i)
+    void* view = MapViewOfFile(hLayoutMapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(PublishedLayoutState));
+    if (view == NULL)
     {
-        windowList[i].index = static_cast<int>(i) + 1;
+        CloseHandle(hLayoutMapping);
+        hLayoutMapping = NULL;
+        return;
     }
 
-    // Refresh the list
-    RefreshWindowList();
+    // The mapping starts zeroed: sequence 0, no windows
+    publishedLayout = static_cast<PublishedLayoutState*>(view);
+    publishedLayout->size = sizeof(PublishedLayoutState);
+    publishedLayout->maxWindows = MAX_PUBLISHED_WINDOWS;
+    publishedLayout->version = LAYOUT_STATE_VERSION;
+    publishedLayout->magic = LAYOUT_STATE_MAGIC;
+    PublishLayoutState();
+}
 
-    // Reselect the moved item
-    ListView_SetItemState(hListView, newIndex, LVIS_SELECTED, LVIS_SELECTED);
-    ListView_EnsureVisible(hListView, newIndex, FALSE);
+// Function to release the layout state at exit
+void CloseLayoutSharedMemory()
+{
+    if (publishedLayout)
+    {
+        UnmapViewOfFile(publishedLayout);
+        publishedLayout = NULL;
+    }
+    if (hLayoutMapping)
+    {
+        CloseHandle(hLayoutMapping);
+        hLayoutMapping = NULL;
+    }
 }
 
-// ListView window procedure
-LRESULT CALLBACK ListViewProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp)
+// Function to write the captured windows and their cells to the shared
+// layout state under the sequence lock. Only the entries in use are written.
+void PublishLayoutState()
 {
-    if (msg == WM_LBUTTONDBLCLK)
+    if (!publishedLayout)
+        return;
+
+    PublishedLayoutState& state = *publishedLayout;
+    uint64_t sequence = BeginLayoutStateUpdate(state);
+
+    size_t count = (std::min)(windowList.handles.size(), static_cast<size_t>(MAX_PUBLISHED_WINDOWS));
+    for (size_t i = 0; i < count; ++i)
     {
-        int selected = ListView_GetNextItem(hwnd, -1, LVNI_SELECTED);
-        if (selected != -1)
-        {
-            LVITEM lvItem = { 0 };
-            lvItem.mask = LVIF_PARAM;
-            lvItem.iItem = selected;
-            ListView_GetItem(hwnd, &lvItem);
-            HWND hWnd = (HWND)lvItem.lParam;
-            if (IsWindow(hWnd))
-            {
-                // Bring the window to the foreground and give it focus
-                SetForegroundWindow(hWnd);
-            }
-        }
+        PublishedWindow& window = state.windows[i];
+        window.hWnd = reinterpret_cast<UINT_PTR>(windowList.handles[i]);
+
+        RECT cell = { 0 };
+        window.flags = GetPositionCell(static_cast<int>(i), cell) ? PUBLISHED_WINDOW_HAS_CELL : 0;
+        window.cellLeft = cell.left;
+        window.cellTop = cell.top;
+        window.cellRight = cell.right;
+        window.cellBottom = cell.bottom;
+        wcsncpy_s(window.title, PUBLISHED_TITLE_CHARS, windowList.titles[i], _TRUNCATE);
     }
-    return CallWindowProc(OldListViewProc, hwnd, msg, wp, lp);
+    state.windowCount = static_cast<unsigned int>(count);
+    state.registryVersion = windowRegistryVersion;
+    state.layoutMode = currentLayoutMode;
+    state.customLayout = currentCustomLayout;
+    state.isCapturing = captureSession.state != CAPTURE_IDLE ? 1 : 0;
+
+    EndLayoutStateUpdate(state, sequence);
 }
 
-// Function to adjust control positions and sizes
-void AdjustControls()
+// Function to get a control panel input, or its saved value while the panel is closed
+std::wstring GetPanelText(HWND hControl, const std::wstring& saved)
 {
-    RECT rcClient;
-    GetClientRect(hMainWindow, &rcClient);
-    int clientWidth = rcClient.right - rcClient.left;
-    int clientHeight = rcClient.bottom - rcClient.top;
+    if (!hControl)
+        return saved;
+
+    wchar_t buffer[256];
+    GetWindowText(hControl, buffer, 256);
+    return buffer;
+}
 
-    // Minimum window size
-    if (clientWidth < MIN_WINDOW_WIDTH)
-        clientWidth = MIN_WINDOW_WIDTH;
-    if (clientHeight < MIN_WINDOW_HEIGHT)
-        clientHeight = MIN_WINDOW_HEIGHT;
+// Function to build the control panel inside the main window
+void CreateControlPanel(HWND hWnd)
+{
+    if (hListView)
+        return;
 
-    int x = MARGIN;
-    int y = MARGIN;
+    ScopedLatency latency(METRIC_PANEL_CREATE_LATENCY);
 
-    // Arrange buttons on the top
-    SetWindowPos(hCaptureButton, NULL, x, y, BUTTON_WIDTH, BUTTON_HEIGHT, SWP_NOZORDER);
-    x += BUTTON_WIDTH + MARGIN;
+    INITCOMMONCONTROLSEX icex = { sizeof(INITCOMMONCONTROLSEX), ICC_LISTVIEW_CLASSES };
+    InitCommonControlsEx(&icex);
 
-    SetWindowPos(hRestoreButton, NULL, x, y, SMALL_BUTTON_WIDTH, BUTTON_HEIGHT, SWP_NOZORDER);
-    x += SMALL_BUTTON_WIDTH + MARGIN;
+    // Create buttons
+    hCaptureButton = CreateWindow(L"BUTTON", L"Capture Windows", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
+        0, 0, 0, 0, hWnd, (HMENU)ID_CAPTURE_BUTTON, NULL, NULL);
 
-    SetWindowPos(hClearButton, NULL, x, y, SMALL_BUTTON_WIDTH, BUTTON_HEIGHT, SWP_NOZORDER);
-    x += SMALL_BUTTON_WIDTH + MARGIN;
+    hRestoreButton = CreateWindow(L"BUTTON", L"Restore", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
+        0, 0, 0, 0, hWnd, (HMENU)ID_RESTORE_BUTTON, NULL, NULL);
 
-    SetWindowPos(hArrangeButton, NULL, x, y, BUTTON_WIDTH, BUTTON_HEIGHT, SWP_NOZORDER);
-    x += BUTTON_WIDTH + MARGIN;
+    hClearButton = CreateWindow(L"BUTTON", L"Clear", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
+        0, 0, 0, 0, hWnd, (HMENU)ID_CLEAR_BUTTON, NULL, NULL);
 
-    // *** Position the new "Capture by Title" button ***
-    SetWindowPos(hCaptureByTitleButton, NULL, x, y, BUTTON_WIDTH, BUTTON_HEIGHT, SWP_NOZORDER);
-    x += BUTTON_WIDTH + MARGIN;
+    hArrangeButton = CreateWindow(L"BUTTON", L"Arrange Windows", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
+        0, 0, 0, 0, hWnd, (HMENU)ID_ARRANGE_BUTTON, NULL, NULL);
 
-    // Reset x and move y down for next row
-    x = MARGIN;
-    y += BUTTON_HEIGHT + MARGIN;
+    hUndoButton = CreateWindow(L"BUTTON", L"Undo", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
+        0, 0, 0, 0, hWnd, (HMENU)ID_UNDO_BUTTON, NULL, NULL);
 
-    // Number of windows label and edit
-    SetWindowPos(hNumWindowsLabel, NULL, x, y + 3, LABEL_WIDTH, LABEL_HEIGHT, SWP_NOZORDER);
-    x += LABEL_WIDTH + MARGIN;
+    hRedoButton = CreateWindow(L"BUTTON", L"Redo", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
+        0, 0, 0, 0, hWnd, (HMENU)ID_REDO_BUTTON, NULL, NULL);
+
+    // *** Create the new "Capture by Title" button ***
+    hCaptureByTitleButton = CreateWindow(L"BUTTON", L"Capture by Title", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
+        0, 0, 0, 0, hWnd, (HMENU)ID_CAPTURE_BY_TITLE_BUTTON, NULL, NULL);
 
-    SetWindowPos(hNumWindowsEdit, NULL, x, y, EDIT_WIDTH, LABEL_HEIGHT, SWP_NOZORDER);
-    x += EDIT_WIDTH + MARGIN;
+    // Input field for number of windows
+    hNumWindowsEdit = CreateWindow(L"EDIT", panelState.numWindows.c_str(), WS_TABSTOP | WS_VISIBLE | WS_CHILD | ES_NUMBER | WS_BORDER,
+        0, 0, 0, 0, hWnd, (HMENU)ID_NUM_WINDOWS_EDIT, NULL, NULL);
+
+    hNumWindowsLabel = CreateWindow(L"STATIC", L"Windows to capture (0 = until Enter):", WS_VISIBLE | WS_CHILD,
+        0, 0, 0, 0, hWnd, NULL, NULL, NULL);
 
     // Monitor selection label and combo box
-    SetWindowPos(hMonitorLabel, NULL, x, y + 3, LABEL_WIDTH, LABEL_HEIGHT, SWP_NOZORDER);
-    x += LABEL_WIDTH + MARGIN;
+    hMonitorLabel = CreateWindow(L"STATIC", L"Select Monitor:", WS_VISIBLE | WS_CHILD,
+        0, 0, 0, 0, hWnd, NULL, NULL, NULL);
 
-    SetWindowPos(hMonitorComboBox, NULL, x, y, COMBOBOX_WIDTH, COMBOBOX_HEIGHT, SWP_NOZORDER);
-    x += COMBOBOX_WIDTH + MARGIN;
+    hMonitorComboBox = CreateWindow(L"COMBOBOX", NULL, CBS_DROPDOWNLIST | WS_CHILD | WS_VISIBLE | WS_VSCROLL,
+        0, 0, 0, 0, hWnd, (HMENU)ID_MONITOR_COMBOBOX, NULL, NULL);
 
-    // Pixel Fix X label and edit box
-    SetWindowPos(hPixelFixXLabel, NULL, x, y + 3, 150, LABEL_HEIGHT, SWP_NOZORDER);
-    x += 150 + MARGIN;
+    // Create Pixel Fix X Label and Edit Box
+    hPixelFixXLabel = CreateWindow(L"STATIC", L"Pixel Fix X ():", WS_VISIBLE | WS_CHILD,
+        0, 0, 150, LABEL_HEIGHT, hWnd, (HMENU)ID_PIXEL_FIX_X_LABEL, NULL, NULL);
 
-    SetWindowPos(hPixelFixXEdit, NULL, x, y, 100, LABEL_HEIGHT, SWP_NOZORDER);
-    x += 100 + MARGIN;
+    hPixelFixXEdit = CreateWindow(L"EDIT", std::to_wstring(layoutSettings.pixelFixX).c_str(), WS_TABSTOP | WS_VISIBLE | WS_CHILD | WS_BORDER,
+        0, 0, 100, LABEL_HEIGHT, hWnd, (HMENU)ID_PIXEL_FIX_X_EDIT, NULL, NULL);
 
-    // Pixel Fix Y label and edit box
-    SetWindowPos(hPixelFixYLabel, NULL, x, y + 3, 150, LABEL_HEIGHT, SWP_NOZORDER);
-    x += 150 + MARGIN;
+    // Create Pixel Fix Y Label and Edit Box
+    hPixelFixYLabel = CreateWindow(L"STATIC", L"Pixel Fix Y ():", WS_VISIBLE | WS_CHILD,
+        0, 0, 150, LABEL_HEIGHT, hWnd, (HMENU)ID_PIXEL_FIX_Y_LABEL, NULL, NULL);
 
-    SetWindowPos(hPixelFixYEdit, NULL, x, y, 100, LABEL_HEIGHT, SWP_NOZORDER);
-    x += 100 + MARGIN;
+    hPixelFixYEdit = CreateWindow(L"EDIT", std::to_wstring(layoutSettings.pixelFixY).c_str(), WS_TABSTOP | WS_VISIBLE | WS_CHILD | WS_BORDER,
+        0, 0, 100, LABEL_HEIGHT, hWnd, (HMENU)ID_PIXEL_FIX_Y_EDIT, NULL, NULL);
 
-    // Min Vertical Spacing Y label and edit box
-    SetWindowPos(hMinSpacingYLabel, NULL, x, y + 3, 200, LABEL_HEIGHT, SWP_NOZORDER);
-    x += 200 + MARGIN;
+    // Create Min Vertical Spacing Y Label and Edit Box
+    hMinSpacingYLabel = CreateWindow(L"STATIC", L"Min Vertical Spacing (pixels):", WS_VISIBLE | WS_CHILD,
+        0, 0, 200, LABEL_HEIGHT, hWnd, (HMENU)ID_MIN_SPACING_Y_LABEL, NULL, NULL);
 
-    SetWindowPos(hMinSpacingYEdit, NULL, x, y, 100, LABEL_HEIGHT, SWP_NOZORDER);
-    x += 100 + MARGIN;
+    hMinSpacingYEdit = CreateWindow(L"EDIT", std::to_wstring(layoutSettings.minSpacingY).c_str(), WS_TABSTOP | WS_VISIBLE | WS_CHILD | ES_NUMBER | WS_BORDER,
+        0, 0, 100, LABEL_HEIGHT, hWnd, (HMENU)ID_MIN_SPACING_Y_EDIT, NULL, NULL);
 
-    // *** Position the new Window Title label and edit box ***
-    // Reset x and move y down for next row
-    x = MARGIN;
-    y += LABEL_HEIGHT + MARGIN;
+    // *** Create the new Window Title label and edit box ***
+    hWindowTitleLabel = CreateWindow(L"STATIC", L"Window Title:", WS_VISIBLE | WS_CHILD,
+        0, 0, 100, LABEL_HEIGHT, hWnd, (HMENU)ID_WINDOWTITLE_LABEL, NULL, NULL);
 
-    // Window Title label
-    SetWindowPos(hWindowTitleLabel, NULL, x, y + 3, LABEL_WIDTH, LABEL_HEIGHT, SWP_NOZORDER);
-    x += LABEL_WIDTH + MARGIN;
+    hWindowTitleEdit = CreateWindow(L"EDIT", panelState.windowTitle.c_str(), WS_TABSTOP | WS_VISIBLE | WS_CHILD | WS_BORDER,
+        0, 0, 200, LABEL_HEIGHT, hWnd, (HMENU)ID_WINDOWTITLE_EDIT, NULL, NULL);
 
-    // Window Title edit box
-    SetWindowPos(hWindowTitleEdit, NULL, x, y, 200, LABEL_HEIGHT, SWP_NOZORDER);
-    x += 200 + MARGIN;
+    // Button to capture windows by the rules file
+    hCaptureByRulesButton = CreateWindow(L"BUTTON", L"Capture by Rules", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
+        0, 0, 0, 0, hWnd, (HMENU)ID_CAPTURE_BY_RULES_BUTTON, NULL, NULL);
 
-    // *** Position the "Capture by Title" button ***
-    SetWindowPos(hCaptureByTitleButton, NULL, x, y, BUTTON_WIDTH, BUTTON_HEIGHT, SWP_NOZORDER);
-    x += BUTTON_WIDTH + MARGIN;
+    // Checkbox to keep matching windows tiled automatically
+    hAutoTileCheckBox = CreateWindow(L"BUTTON", L"Auto-Tile", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_AUTOCHECKBOX,
+        0, 0, 0, 0, hWnd, (HMENU)ID_AUTO_TILE_CHECKBOX, NULL, NULL);
 
-    // Adjust y for the next row
-    y += LABEL_HEIGHT + MARGIN;
+    // Checkbox to keep the grid together when one tiled window is resized
+    hLinkedResizeCheckBox = CreateWindow(L"BUTTON", L"Linked Resize", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_AUTOCHECKBOX,
+        0, 0, 0, 0, hWnd, (HMENU)ID_LINKED_RESIZE_CHECKBOX, NULL, NULL);
 
-    // Adjust ListView size
-    int listViewWidth = clientWidth - 3 * MARGIN - MOVE_BUTTON_WIDTH;
-    int listViewHeight = clientHeight - y - MARGIN;
-    SetWindowPos(hListView, NULL, MARGIN, y, listViewWidth, listViewHeight, SWP_NOZORDER);
+    // Checkbox to add captured windows to the current list instead of replacing it
+    hCaptureAppendCheckBox = CreateWindow(L"BUTTON", L"Append Capture", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_AUTOCHECKBOX,
+        0, 0, 0, 0, hWnd, (HMENU)ID_CAPTURE_APPEND_CHECKBOX, NULL, NULL);
+
+    // Update Monitor ComboBox
+    UpdateMonitorComboBox();
+    ComboBox_SetCurSel(hMonitorComboBox, layoutSettings.monitorSelection);
+
+    // ListView to display captured windows
+    hListView = CreateWindow(WC_LISTVIEW, NULL, WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SHOWSELALWAYS | WS_BORDER,
+        0, 0, 0, 0, hWnd, (HMENU)ID_WINDOW_LISTVIEW, NULL, NULL);
+
+    // Add columns to ListView
+    LVCOLUMN lvCol = { 0 };
+    lvCol.mask = LVCF_WIDTH | LVCF_TEXT;
+
+    // Index column
+    lvCol.cx = 50;
+    lvCol.pszText = (LPWSTR)L"Index";
+    ListView_InsertColumn(hListView, 0, &lvCol);
+
+    // Window Title column
+    lvCol.cx = 300; // Will be adjusted in AdjustControls
+    lvCol.pszText = (LPWSTR)L"Window Title";
+    ListView_InsertColumn(hListView, 1, &lvCol);
+
+    // Handle column
+    lvCol.cx = 120;
+    lvCol.pszText = (LPWSTR)L"Handle";
+    ListView_InsertColumn(hListView, 2, &lvCol);
 
     // Move Up and Move Down buttons
-    int moveButtonX = MARGIN + listViewWidth + MARGIN;
-    int moveButtonY = y;
-    SetWindowPos(hMoveUpButton, NULL, moveButtonX, moveButtonY, MOVE_BUTTON_WIDTH, MOVE_BUTTON_HEIGHT, SWP_NOZORDER);
-    moveButtonY += MOVE_BUTTON_HEIGHT + MARGIN;
-    SetWindowPos(hMoveDownButton, NULL, moveButtonX, moveButtonY, MOVE_BUTTON_WIDTH, MOVE_BUTTON_HEIGHT, SWP_NOZORDER);
+    hMoveUpButton = CreateWindow(L"BUTTON", L"Move Up", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
+        0, 0, 0, 0, hWnd, (HMENU)ID_MOVE_UP_BUTTON, NULL, NULL);
 
-    // Adjust ListView column widths
-    int totalColumnWidth = listViewWidth - GetSystemMetrics(SM_CXVSCROLL);
-    int indexColWidth = 50;
-    int handleColWidth = 120;
-    int titleColWidth = totalColumnWidth - indexColWidth - handleColWidth;
+    hMoveDownButton = CreateWindow(L"BUTTON", L"Move Down", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
+        0, 0, 0, 0, hWnd, (HMENU)ID_MOVE_DOWN_BUTTON, NULL, NULL);
 
-    ListView_SetColumnWidth(hListView, 0, indexColWidth);
-    ListView_SetColumnWidth(hListView, 1, titleColWidth);
-    ListView_SetColumnWidth(hListView, 2, handleColWidth);
+    // Swap button for two selected windows
+    hSwapButton = CreateWindow(L"BUTTON", L"Swap", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+        0, 0, 0, 0, hWnd, (HMENU)ID_SWAP_BUTTON, NULL, NULL);
+
+    // Set extended ListView styles
+    ListView_SetExtendedListViewStyle(hListView, LVS_EX_FULLROWSELECT | LVS_EX_GRIDLINES);
+
+    // Subclass ListView to handle item activation
+    OldListViewProc = (WNDPROC)SetWindowLongPtr(hListView, GWLP_WNDPROC, (LONG_PTR)ListViewProc);
+
+    // Reflect state that lives on while the panel is closed
+    Button_SetCheck(hAutoTileCheckBox, autoTileEnabled ? BST_CHECKED : BST_UNCHECKED);
+    Button_SetCheck(hLinkedResizeCheckBox, hMoveSizeHook ? BST_CHECKED : BST_UNCHECKED);
+    Button_SetCheck(hCaptureAppendCheckBox, captureAppend ? BST_CHECKED : BST_UNCHECKED);
+    UpdateCaptureStatus();
+    RefreshWindowList();
+
+    // Adjust initial control positions
+    UpdatePanelFont();
+    AdjustControls();
 }
 
-// Message box timer callback
-VOID CALLBACK MsgBoxTimerProc(HWND hwnd, UINT uMsg, UINT_PTR idEvent, DWORD dwTime)
+// Function to tear the control panel down, keeping its inputs in panelState
+void DestroyControlPanel()
 {
-    if (g_hMsgBoxWnd)
+    if (!hListView)
+        return;
+
+    // An edit box that still has the focus has not been committed yet
+    CommitPanelSettings(false);
+    panelState.numWindows = GetPanelText(hNumWindowsEdit, panelState.numWindows);
+    panelState.windowTitle = GetPanelText(hWindowTitleEdit, panelState.windowTitle);
+
+    HWND* controls[] = {
+        &hCaptureButton, &hRestoreButton, &hClearButton, &hArrangeButton, &hUndoButton, &hRedoButton,
+        &hCaptureByTitleButton, &hNumWindowsEdit, &hNumWindowsLabel, &hMonitorLabel, &hMonitorComboBox,
+        &hPixelFixXLabel, &hPixelFixXEdit, &hPixelFixYLabel, &hPixelFixYEdit, &hMinSpacingYLabel,
+        &hMinSpacingYEdit, &hWindowTitleLabel, &hWindowTitleEdit, &hCaptureByRulesButton,
+        &hAutoTileCheckBox, &hLinkedResizeCheckBox, &hListView, &hMoveUpButton, &hMoveDownButton,
+        &hSwapButton, &hCaptureAppendCheckBox
+    };
+    for (HWND* control : controls)
     {
-        PostMessage(g_hMsgBoxWnd, WM_CLOSE, 0, 0);
+        if (*control)
+        {
+            DestroyWindow(*control);
+            *control = NULL;
+        }
     }
-    if (g_msgboxTimerId)
+    OldListViewProc = NULL;
+    if (hPanelFont)
     {
-        KillTimer(NULL, g_msgboxTimerId);
-        g_msgboxTimerId = 0;
+        DeleteObject(hPanelFont);
+        hPanelFont = NULL;
     }
 }
 
-// CBT hook procedure for message box timeout
-LRESULT CALLBACK CBTProc(int nCode, WPARAM wParam, LPARAM lParam)
+// Function to open the control panel from the tray
+void ShowControlPanel()
 {
-    if (nCode == HCBT_ACTIVATE)
-    {
-        // Get the handle of the message box window
-        g_hMsgBoxWnd = (HWND)wParam;
+    CreateControlPanel(hMainWindow);
+    ShowWindow(hMainWindow, SW_SHOWNORMAL);
+    SetForegroundWindow(hMainWindow);
+    UpdateFootprintMetrics();
+}
 
-        // Set the timer when the message box is activated
-        if (g_msgboxTimerId)
-        {
-            KillTimer(NULL, g_msgboxTimerId);
-        }
-        g_msgboxTimerId = SetTimer(NULL, 0, 2000, MsgBoxTimerProc); // 2000 ms timeout
+// Function to close the control panel back to the tray, giving its memory back
+void HideControlPanel()
+{
+    ShowWindow(hMainWindow, SW_HIDE);
+    DestroyControlPanel();
 
-        // Unhook the CBT hook
-        if (g_hMsgBoxHook)
-        {
-            UnhookWindowsHookEx(g_hMsgBoxHook);
-            g_hMsgBoxHook = NULL;
-        }
-    }
-    return CallNextHookEx(NULL, nCode, wParam, lParam);
+    // What the panel gave back shows in the private bytes and working set gauges
+    UpdateFootprintMetrics();
 }
 
-// Function to display a timed message box
-int TimedMessageBox(HWND hWnd, LPCTSTR lpText, LPCTSTR lpCaption, UINT uType)
+// Function to put the tool's icon in the notification area
+void AddTrayIcon(HWND hWnd)
 {
-    // Reset the message box window handle
-    g_hMsgBoxWnd = NULL;
+    NOTIFYICONDATA nid = { 0 };
+    nid.cbSize = sizeof(nid);
+    nid.hWnd = hWnd;
+    nid.uID = ID_TRAY_ICON;
+    nid.uFlags = NIF_MESSAGE | NIF_ICON | NIF_TIP;
+    nid.uCallbackMessage = WM_TRAY_ICON;
+    nid.hIcon = LoadIcon(NULL, IDI_APPLICATION);
+    wcscpy_s(nid.szTip, L"Window Management Tool");
+    Shell_NotifyIcon(NIM_ADD, &nid);
+}
 
-    // Set the CBT hook
-    g_hMsgBoxHook = SetWindowsHookEx(WH_CBT, CBTProc, NULL, GetCurrentThreadId());
+// Function to remove the tray icon
+void RemoveTrayIcon(HWND hWnd)
+{
+    NOTIFYICONDATA nid = { 0 };
+    nid.cbSize = sizeof(nid);
+    nid.hWnd = hWnd;
+    nid.uID = ID_TRAY_ICON;
+    Shell_NotifyIcon(NIM_DELETE, &nid);
+}
 
-    int ret = MessageBox(hWnd, lpText, lpCaption, uType);
+// Function to show the tray icon's menu at the cursor
+void ShowTrayMenu(HWND hWnd)
+{
+    HMENU hMenu = CreatePopupMenu();
+    AppendMenu(hMenu, MF_STRING, ID_TRAY_SHOW_PANEL, L"Show Control Panel");
+    AppendMenu(hMenu, MF_STRING, ID_TRAY_ARRANGE, L"Arrange Windows");
+    AppendMenu(hMenu, MF_SEPARATOR, 0, NULL);
+    AppendMenu(hMenu, MF_STRING, ID_TRAY_EXIT, L"Exit");
+    SetMenuDefaultItem(hMenu, ID_TRAY_SHOW_PANEL, FALSE);
+
+    // The menu only closes on an outside click if our window is in the foreground
+    POINT pt;
+    GetCursorPos(&pt);
+    SetForegroundWindow(hWnd);
+    TrackPopupMenu(hMenu, TPM_RIGHTBUTTON, pt.x, pt.y, 0, hWnd, NULL);
+    PostMessage(hWnd, WM_NULL, 0, 0);
+    DestroyMenu(hMenu);
+}
 
-    // Unhook the CBT hook in case it wasn't unhooked
-    if (g_hMsgBoxHook)
-    {
-        UnhookWindowsHookEx(g_hMsgBoxHook);
-        g_hMsgBoxHook = NULL;
-    }
-    // Kill the timer if it's still running
-    if (g_msgboxTimerId)
+// Function to refresh the memory footprint gauges
+void UpdateFootprintMetrics()
+{
+    PROCESS_MEMORY_COUNTERS_EX counters = { 0 };
+    counters.cb = sizeof(counters);
+    if (GetProcessMemoryInfo(GetCurrentProcess(), (PPROCESS_MEMORY_COUNTERS)&counters, sizeof(counters)))
     {
-        KillTimer(NULL, g_msgboxTimerId);
-        g_msgboxTimerId = 0;
+        SetMetricGauge(METRIC_PRIVATE_BYTES, counters.PrivateUsage);
+        SetMetricGauge(METRIC_WORKING_SET_BYTES, counters.WorkingSetSize);
     }
+    footprintPanelBuilt = hListView != NULL;
 
-    return ret;
+    // Storage of the captured window list and the interned titles
+    size_t recordBytes = windowList.handles.capacity() * sizeof(HWND) + windowList.rects.capacity() * sizeof(RECT)
+        + windowList.titles.capacity() * sizeof(const wchar_t*);
+    SetMetricGauge(METRIC_WINDOW_RECORD_BYTES, recordBytes);
+    SetMetricGauge(METRIC_TITLE_POOL_BYTES, titlePool.charsAllocated * sizeof(wchar_t));
 }
 
 // Callback function for the main window
@@ -927,117 +6418,32 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
     {
         hMainWindow = hWnd;
 
-        INITCOMMONCONTROLSEX icex = { sizeof(INITCOMMONCONTROLSEX), ICC_LISTVIEW_CLASSES };
-        InitCommonControlsEx(&icex);
-
-        hGlobalKeyboardHook = SetWindowsHookEx(WH_KEYBOARD_LL, GlobalKeyboardProc, hInstance, 0);
-        if (!hGlobalKeyboardHook)
-        {
-            MessageBox(hWnd, L"Failed to set global keyboard hook.", L"Error", MB_OK | MB_ICONERROR);
-        }
-        // Create buttons
-        hCaptureButton = CreateWindow(L"BUTTON", L"Capture Windows", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
-            0, 0, 0, 0, hWnd, (HMENU)ID_CAPTURE_BUTTON, NULL, NULL);
-
-        hRestoreButton = CreateWindow(L"BUTTON", L"Restore", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
-            0, 0, 0, 0, hWnd, (HMENU)ID_RESTORE_BUTTON, NULL, NULL);
-
-        hClearButton = CreateWindow(L"BUTTON", L"Clear", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
-            0, 0, 0, 0, hWnd, (HMENU)ID_CLEAR_BUTTON, NULL, NULL);
-
-        hArrangeButton = CreateWindow(L"BUTTON", L"Arrange Windows", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
-            0, 0, 0, 0, hWnd, (HMENU)ID_ARRANGE_BUTTON, NULL, NULL);
+        // Register the configured shortcuts
+        LoadHotkeyBindings();
+        RegisterHotkeys(hWnd);
 
-        // *** Create the new "Capture by Title" button ***
-        hCaptureByTitleButton = CreateWindow(L"BUTTON", L"Capture by Title", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
-            0, 0, 0, 0, hWnd, (HMENU)ID_CAPTURE_BY_TITLE_BUTTON, NULL, NULL);
-
-        // Input field for number of windows
-        hNumWindowsEdit = CreateWindow(L"EDIT", L"1", WS_TABSTOP | WS_VISIBLE | WS_CHILD | ES_NUMBER | WS_BORDER,
-            0, 0, 0, 0, hWnd, (HMENU)ID_NUM_WINDOWS_EDIT, NULL, NULL);
-
-        hNumWindowsLabel = CreateWindow(L"STATIC", L"Number of windows to capture:", WS_VISIBLE | WS_CHILD,
-            0, 0, 0, 0, hWnd, NULL, NULL, NULL);
-
-        // Monitor selection label and combo box
-        hMonitorLabel = CreateWindow(L"STATIC", L"Select Monitor:", WS_VISIBLE | WS_CHILD,
-            0, 0, 0, 0, hWnd, NULL, NULL, NULL);
-
-        hMonitorComboBox = CreateWindow(L"COMBOBOX", NULL, CBS_DROPDOWNLIST | WS_CHILD | WS_VISIBLE | WS_VSCROLL,
-            0, 0, 0, 0, hWnd, (HMENU)ID_MONITOR_COMBOBOX, NULL, NULL);
-
-        // Create Pixel Fix X Label and Edit Box
-        hPixelFixXLabel = CreateWindow(L"STATIC", L"Pixel Fix X ():", WS_VISIBLE | WS_CHILD,
-            0, 0, 150, LABEL_HEIGHT, hWnd, (HMENU)ID_PIXEL_FIX_X_LABEL, NULL, NULL);
-
-        hPixelFixXEdit = CreateWindow(L"EDIT", L"0", WS_TABSTOP | WS_VISIBLE | WS_CHILD | WS_BORDER,
-            0, 0, 100, LABEL_HEIGHT, hWnd, (HMENU)ID_PIXEL_FIX_X_EDIT, NULL, NULL);
-
-        // Create Pixel Fix Y Label and Edit Box
-        hPixelFixYLabel = CreateWindow(L"STATIC", L"Pixel Fix Y ():", WS_VISIBLE | WS_CHILD,
-            0, 0, 150, LABEL_HEIGHT, hWnd, (HMENU)ID_PIXEL_FIX_Y_LABEL, NULL, NULL);
-
-        hPixelFixYEdit = CreateWindow(L"EDIT", L"0", WS_TABSTOP | WS_VISIBLE | WS_CHILD | WS_BORDER,
-            0, 0, 100, LABEL_HEIGHT, hWnd, (HMENU)ID_PIXEL_FIX_Y_EDIT, NULL, NULL);
-
-        // Create Min Vertical Spacing Y Label and Edit Box
-        hMinSpacingYLabel = CreateWindow(L"STATIC", L"Min Vertical Spacing (pixels):", WS_VISIBLE | WS_CHILD,
-            0, 0, 200, LABEL_HEIGHT, hWnd, (HMENU)ID_MIN_SPACING_Y_LABEL, NULL, NULL);
-
-        hMinSpacingYEdit = CreateWindow(L"EDIT", L"20", WS_TABSTOP | WS_VISIBLE | WS_CHILD | ES_NUMBER | WS_BORDER,
-            0, 0, 100, LABEL_HEIGHT, hWnd, (HMENU)ID_MIN_SPACING_Y_EDIT, NULL, NULL);
-
-        // *** Create the new Window Title label and edit box ***
-        hWindowTitleLabel = CreateWindow(L"STATIC", L"Window Title:", WS_VISIBLE | WS_CHILD,
-            0, 0, 100, LABEL_HEIGHT, hWnd, (HMENU)ID_WINDOWTITLE_LABEL, NULL, NULL);
-
-        hWindowTitleEdit = CreateWindow(L"EDIT", L"", WS_TABSTOP | WS_VISIBLE | WS_CHILD | WS_BORDER,
-            0, 0, 200, LABEL_HEIGHT, hWnd, (HMENU)ID_WINDOWTITLE_EDIT, NULL, NULL);
-
-        // Update Monitor ComboBox
+        // Monitors are needed with or without the panel; linked resizing is opt-in from the panel
         UpdateMonitorComboBox();
 
-        // ListView to display captured windows
-        hListView = CreateWindow(WC_LISTVIEW, NULL, WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SINGLESEL | WS_BORDER,
-            0, 0, 0, 0, hWnd, (HMENU)ID_WINDOW_LISTVIEW, NULL, NULL);
-
-        // Add columns to ListView
-        LVCOLUMN lvCol = { 0 };
-        lvCol.mask = LVCF_WIDTH | LVCF_TEXT;
-
-        // Index column
-        lvCol.cx = 50;
-        lvCol.pszText = (LPWSTR)L"Index";
-        ListView_InsertColumn(hListView, 0, &lvCol);
-
-        // Window Title column
-        lvCol.cx = 300; // Will be adjusted in AdjustControls
-        lvCol.pszText = (LPWSTR)L"Window Title";
-        ListView_InsertColumn(hListView, 1, &lvCol);
+        // Settings come from the settings file and are watched for edits
+        LoadLayoutSettings(layoutSettings);
+        ReloadCustomLayoutsIfChanged();
+        RequestWindowRegistryPublish();
+        SetTimer(hWnd, ID_SETTINGS_RELOAD_TIMER, SETTINGS_RELOAD_INTERVAL_MS, NULL);
+        SetTimer(hWnd, ID_METRICS_EXPORT_TIMER, METRICS_EXPORT_INTERVAL_MS, NULL);
 
-        // Handle column
-        lvCol.cx = 120;
-        lvCol.pszText = (LPWSTR)L"Handle";
-        ListView_InsertColumn(hListView, 2, &lvCol);
-
-        // Move Up and Move Down buttons
-        hMoveUpButton = CreateWindow(L"BUTTON", L"Move Up", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
-            0, 0, 0, 0, hWnd, (HMENU)ID_MOVE_UP_BUTTON, NULL, NULL);
-
-        hMoveDownButton = CreateWindow(L"BUTTON", L"Move Down", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_DEFPUSHBUTTON,
-            0, 0, 0, 0, hWnd, (HMENU)ID_MOVE_DOWN_BUTTON, NULL, NULL);
-
-        // Set extended ListView styles
-        ListView_SetExtendedListViewStyle(hListView, LVS_EX_FULLROWSELECT | LVS_EX_GRIDLINES);
-
-        // Subclass ListView to handle item activation
-        OldListViewProc = (WNDPROC)SetWindowLongPtr(hListView, GWLP_WNDPROC, (LONG_PTR)ListViewProc);
+        if (trayMode)
+        {
+            // Only the icon is resident; the panel is built when opened
+            WM_TASKBAR_CREATED = RegisterWindowMessage(L"TaskbarCreated");
+            AddTrayIcon(hWnd);
+            break;
+        }
 
-        // Adjust initial control positions
-        AdjustControls();
+        CreateControlPanel(hWnd);
 
         // Set minimum window size
-        SetWindowPos(hWnd, NULL, 0, 0, MIN_WINDOW_WIDTH, MIN_WINDOW_HEIGHT, SWP_NOMOVE | SWP_NOZORDER);
+        SetWindowPos(hWnd, NULL, 0, 0, PanelPixels(MIN_WINDOW_WIDTH), PanelPixels(MIN_WINDOW_HEIGHT), SWP_NOMOVE | SWP_NOZORDER);
     }
     break;
     case WM_COMMAND:
@@ -1055,7 +6461,13 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
             ClearCapturedWindows();
             break;
         case ID_ARRANGE_BUTTON: // Arrange Windows
-            ArrangeWindows();
+            RequestArrange();
+            break;
+        case ID_UNDO_BUTTON: // Undo layout change
+            UndoLayout();
+            break;
+        case ID_REDO_BUTTON: // Redo layout change
+            RedoLayout();
             break;
         case ID_MOVE_UP_BUTTON: // Move Up
             MoveSelectedItem(-1);
@@ -1063,6 +6475,15 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
         case ID_MOVE_DOWN_BUTTON: // Move Down
             MoveSelectedItem(1);
             break;
+        case ID_SWAP_BUTTON: // Swap two windows
+        {
+            std::vector<int> selected = GetSelectedPositions();
+            if (selected.size() == 2)
+                SwapWindowPositions(selected[0], selected[1]);
+            else
+                TimedMessageBox(NULL, L"Select two windows to swap.", L"Info", MB_OK);
+        }
+        break;
         case ID_CAPTURE_BY_TITLE_BUTTON: // *** Handle "Capture by Title" Button ***
         {
             wchar_t titleBuffer[256];
@@ -1071,60 +6492,157 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
             CaptureWindowsByTitle(windowTitle);
         }
         break;
+        case ID_CAPTURE_BY_RULES_BUTTON: // Capture by rules file
+            CaptureWindowsByRules();
+            break;
+        case ID_AUTO_TILE_CHECKBOX: // Toggle auto-tiling
+            EnableAutoTiling(Button_GetCheck(hAutoTileCheckBox) == BST_CHECKED);
+            break;
+        case ID_LINKED_RESIZE_CHECKBOX: // Toggle linked resizing
+            EnableLinkedResize(Button_GetCheck(hLinkedResizeCheckBox) == BST_CHECKED);
+            break;
+        case ID_CAPTURE_APPEND_CHECKBOX: // Toggle append capture
+            captureAppend = Button_GetCheck(hCaptureAppendCheckBox) == BST_CHECKED;
+            break;
+        case ID_TRAY_SHOW_PANEL: // Tray menu
+            ShowControlPanel();
+            break;
+        case ID_TRAY_ARRANGE:
+            RequestArrange();
+            break;
+        case ID_TRAY_EXIT:
+            DestroyWindow(hWnd);
+            break;
+        case ID_PIXEL_FIX_X_EDIT: // Validate layout inputs once editing is done
+        case ID_PIXEL_FIX_Y_EDIT:
+        case ID_MIN_SPACING_Y_EDIT:
+            if (HIWORD(wParam) == EN_KILLFOCUS)
+                CommitPanelSettings(true);
+            break;
+        case ID_MONITOR_COMBOBOX:
+            if (HIWORD(wParam) == CBN_SELCHANGE)
+            {
+                CommitPanelSettings(true);
+                gridFallbackReported = false;
+            }
+            break;
+        case ID_WINDOWTITLE_EDIT: // Follow title edits while auto-tiling
+            if (HIWORD(wParam) == EN_CHANGE && autoTileEnabled)
+            {
+                wchar_t titleBuffer[256];
+                GetWindowText(hWindowTitleEdit, titleBuffer, 256);
+                autoTileTitle = titleBuffer;
+            }
+            break;
         default:
             break;
         }
     }
     break;
     case WM_UNHOOK_HOOKS:
-    {
-        // Unhook the mouse and keyboard hooks
-        if (hMouseHook)
+        FinishCaptureSession();
+        break;
+    case WM_TIMER:
+        if (wParam == ID_LINKED_RESIZE_TIMER)
         {
-            UnhookWindowsHookEx(hMouseHook);
-            hMouseHook = NULL;
+            OnLinkedResizeFrame();
         }
-        if (hKeyboardHook)
+        else if (wParam == ID_SETTINGS_RELOAD_TIMER)
         {
-            UnhookWindowsHookEx(hKeyboardHook);
-            hKeyboardHook = NULL;
+            ReloadSettingsIfChanged();
+            ReloadCustomLayoutsIfChanged();
         }
-
-        // Reset flags
-        isCapturing = false;
-        bool wasCaptureCompleted = captureCompleted;
-        captureCompleted = false;
-
-        // Display the appropriate MessageBox
-        if (windowsCaptured >= windowsToCapture && wasCaptureCompleted)
+        else if (wParam == ID_METRICS_EXPORT_TIMER)
         {
-            TimedMessageBox(NULL, L"All windows have been captured.", L"Info", MB_OK);
+            ExportMetrics();
         }
-        else
+        else if (wParam == ID_CAPTURE_TIMEOUT_TIMER)
+        {
+            EndCaptureSession(CAPTURE_END_TIMEOUT);
+            FinishCaptureSession();
+        }
+        else if (wParam == ID_AUTO_TILE_TIMER)
         {
-            TimedMessageBox(NULL, L"Window capturing has been canceled.", L"Info", MB_OK);
+            // The debounce window has passed: one relayout for the whole burst
+            KillTimer(hWnd, ID_AUTO_TILE_TIMER);
+            if (TakeAutoTileRelayout(autoTileBurst))
+            {
+                CountMetric(METRIC_AUTO_TILE_RELAYOUTS);
+                RefreshWindowList();
+                RelayoutWindows();
+            }
         }
+        break;
+    case WM_SIZE:
+        AdjustControls();
+        break;
+    case WM_DISPLAYCHANGE:
+    {
+        // Monitors or their scale changed: refresh work areas and DPIs, keeping the selection when it still exists
+        int selected = ComboBox_GetCurSel(hMonitorComboBox);
+        UpdateMonitorComboBox();
+        if (selected > 0 && selected < ComboBox_GetCount(hMonitorComboBox))
+            ComboBox_SetCurSel(hMonitorComboBox, selected);
     }
     break;
-    case WM_SIZE:
+    case WM_DPICHANGED:
+    {
+        // Moved to a monitor with another scale: take the suggested size and rescale the panel
+        const RECT* suggested = (const RECT*)lParam;
+        SetWindowPos(hWnd, NULL, suggested->left, suggested->top, suggested->right - suggested->left,
+            suggested->bottom - suggested->top, SWP_NOZORDER | SWP_NOACTIVATE);
+        if (hListView)
+            UpdatePanelFont();
         AdjustControls();
+    }
+    break;
+    case WM_ARRANGE_REQUEST:
+        RunPendingArrange();
         break;
-    case WM_DESTROY:
-        if (hGlobalKeyboardHook)
-        {
-            UnhookWindowsHookEx(hGlobalKeyboardHook);
-            hGlobalKeyboardHook = NULL;
-        }
-        if (hMouseHook)
+    case WM_PUBLISH_REGISTRY:
+        FlushWindowRegistryPublish();
+        break;
+    case WM_TRAY_ICON:
+        if (lParam == WM_LBUTTONDBLCLK)
+            ShowControlPanel();
+        else if (lParam == WM_RBUTTONUP || lParam == WM_CONTEXTMENU)
+            ShowTrayMenu(hWnd);
+        break;
+    case WM_CLOSE:
+        // In tray mode closing the panel only hides it
+        if (trayMode)
         {
-            UnhookWindowsHookEx(hMouseHook);
-            hMouseHook = NULL;
+            HideControlPanel();
+            break;
         }
-        if (hKeyboardHook)
+        return DefWindowProc(hWnd, message, wParam, lParam);
+    case WM_NOTIFY:
+    {
+        // Dragging rows in the window list reorders the windows
+        LPNMHDR header = (LPNMHDR)lParam;
+        if (header->idFrom == ID_WINDOW_LISTVIEW && header->code == LVN_BEGINDRAG)
         {
-            UnhookWindowsHookEx(hKeyboardHook);
-            hKeyboardHook = NULL;
+            listDragActive = true;
+            SetCapture(hListView);
         }
+    }
+    break;
+    case WM_HOTKEY:
+        DispatchHotkey(LOWORD(lParam), HIWORD(lParam));
+        break;
+    case WM_DESTROY:
+        KillTimer(hWnd, ID_SETTINGS_RELOAD_TIMER);
+        KillTimer(hWnd, ID_METRICS_EXPORT_TIMER);
+        ExportMetrics();
+        StopTraceRecording();
+        EnableAutoTiling(false);
+        UnregisterHotkeys(hWnd);
+        StopSpatialIndexTracking();
+        EnableLinkedResize(false);
+        if (trayMode)
+            RemoveTrayIcon(hWnd);
+        RemoveCaptureHooks();
+        captureSession.state = CAPTURE_IDLE;
         // Kill the timer if it's running
         if (g_msgboxTimerId)
         {
@@ -1134,6 +6652,12 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
         PostQuitMessage(0);
         break;
     default:
+        // Explorer restarted: the tray icon has to be added again
+        if (trayMode && message == WM_TASKBAR_CREATED && WM_TASKBAR_CREATED != 0)
+        {
+            AddTrayIcon(hWnd);
+            break;
+        }
         return DefWindowProc(hWnd, message, wParam, lParam);
     }
     return 0;
@@ -1146,10 +6670,60 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInst,
     _In_ int       nCmdShow)
 {
     UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
 
+    QueryPerformanceCounter(&processStartCounter);
     hInstance = hInst;
 
+    // Work in physical pixels on every monitor; the panel scales itself
+    SetProcessDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
+
+    // Options are matched as whole arguments; lpCmdLine is not parsed by hand
+    UNREFERENCED_PARAMETER(lpCmdLine);
+    std::vector<std::wstring> arguments = GetCommandLineArguments();
+
+    // "/replay <trace>" replays a recorded trace without any UI and reports timings
+    std::wstring replayPath = GetCommandLineValue(arguments, L"/replay");
+    if (!replayPath.empty())
+    {
+        std::wstring report;
+        bool replayed = ReplayTrace(replayPath, report);
+        OutputDebugString(report.c_str());
+
+        // Keep the report next to the trace so runs can be compared
+        WriteReportFile(replayPath + L".report.txt", report);
+        TimedMessageBox(NULL, report.c_str(), L"Replay", MB_OK);
+        return replayed ? 0 : 1;
+    }
+
+    // "/selfcheck [cases] [/seed n]" checks the apply pipelines and runs the
+    // benchmarks without any UI; the report goes to SELFCHECK_REPORT_FILE
+    if (HasCommandLineOption(arguments, L"/selfcheck"))
+    {
+        int cases = _wtoi(GetCommandLineValue(arguments, L"/selfcheck").c_str());
+        std::wstring seedText = GetCommandLineValue(arguments, L"/seed");
+        unsigned int seed = seedText.empty() ? GetTickCount() : static_cast<unsigned int>(wcstoul(seedText.c_str(), NULL, 10));
+
+        std::wstring report;
+        bool passed = RunLayoutSelfCheck(cases > 0 ? cases : SELFCHECK_DEFAULT_CASES, seed, report);
+        OutputDebugString(report.c_str());
+        WriteReportFile(GetAppFilePath(SELFCHECK_REPORT_FILE), report);
+        return passed ? 0 : 1;
+    }
+
+    // "/tray" starts with only the tray icon resident
+    trayMode = HasCommandLineOption(arguments, L"/tray");
+
+    // Live metrics are readable from shared memory while the tool runs
+    OpenMetricsSharedMemory();
+    OpenLayoutSharedMemory();
+
+    // "/record <trace>" records input, window lifecycle and commands
+    std::wstring recordPath = GetCommandLineValue(arguments, L"/record");
+    if (!recordPath.empty() && !StartTraceRecording(recordPath))
+    {
+        MessageBox(NULL, L"Cannot create the trace file.", L"Error", MB_OK);
+    }
+
     // Register window class
     WNDCLASSEX wcex = { 0 };
     wcex.cbSize = sizeof(WNDCLASSEX);
@@ -1182,8 +6756,18 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInst,
         return 1;
     }
 
-    ShowWindow(hWnd, nCmdShow);
-    UpdateWindow(hWnd);
+    if (!trayMode)
+    {
+        ShowWindow(hWnd, nCmdShow);
+        UpdateWindow(hWnd);
+    }
+
+    // Startup time and footprint of this mode
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    SetMetricGauge(METRIC_STARTUP_MICROSECONDS, (now.QuadPart - processStartCounter.QuadPart) * 1000000 / frequency.QuadPart);
+    UpdateFootprintMetrics();
 
     // Message loop
     MSG msg;
@@ -1192,5 +6776,7 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInst,
         TranslateMessage(&msg);
         DispatchMessage(&msg);
     }
+    CloseLayoutSharedMemory();
+    CloseMetricsSharedMemory();
     return (int)msg.wParam;
 }
@@ -0,0 +1,180 @@
+// Test of the arrange scheduler under key repeat, run on Linux:
+//   g++ -std=c++14 -O2 tests/ArrangeStormTest.cpp -o ArrangeStormTest && ./ArrangeStormTest
+// Key events of an arrange chord handled by the keyboard hook go through
+// FilterHotkeyEvent into the scheduler's pending slot on a simulated clock,
+// where each arrange takes TEST_ARRANGE_MS and the posted WM_ARRANGE_REQUEST
+// is served whenever no arrange is running, as the message loop does.
+// Holding the chord at TEST_REPEAT_RATE Hz auto-repeat for TEST_HOLD_MS
+// must run one or two arranges. Taps slower than an arrange must each run
+// one; taps faster than an arrange must fold into the pending slot, mark
+// the running arrange superseded, and still serve the last tap. Events of
+// a chord the hook does not handle must pass and request nothing.
+
+#include "../Window Management Tool/ArrangeScheduler.h"
+
+#include <cstdio>
+
+#define TEST_KEY 'J'
+#define TEST_REPEAT_RATE 30         // Auto-repeat rate of the held chord
+#define TEST_HOLD_MS 2000
+#define TEST_ARRANGE_MS 150         // Simulated duration of one arrange
+#define TEST_TAPS 10
+#define TEST_FAST_TAP_MS 50         // Between two taps, shorter than an arrange
+#define TEST_SLOW_TAP_MS 400        // Between two taps, longer than an arrange
+#define TEST_KEY_UP_MS 20           // Key-up after each tap
+
+// Simulated keyboard filter, scheduler and message loop
+struct StormSimulation
+{
+    HotkeyKeyState keys;
+    ArrangeScheduler scheduler;
+    bool posted = false;        // WM_ARRANGE_REQUEST in the queue
+    int runEnd = -1;            // When the running arrange returns, -1 if none runs
+    int lastRequest = -1;
+    int lastRunStart = -1;
+    int keyEvents = 0;
+    int requests = 0;
+    int dropped = 0;
+    int superseded = 0;         // Requests that came in while an arrange ran
+    int arranges = 0;
+};
+
+// Function to move the simulated clock to time: the running arrange
+// returns once its time is up, and the posted request is served when idle
+static void AdvanceStormSimulation(StormSimulation& simulation, int time)
+{
+    if (simulation.runEnd >= 0 && time >= simulation.runEnd)
+    {
+        simulation.runEnd = -1;
+        if (EndArrange(simulation.scheduler))
+            simulation.posted = true;
+    }
+    if (simulation.runEnd < 0 && simulation.posted)
+    {
+        simulation.posted = false;
+        if (BeginPendingArrange(simulation.scheduler))
+        {
+            simulation.arranges++;
+            simulation.lastRunStart = time;
+            simulation.runEnd = time + TEST_ARRANGE_MS;
+        }
+    }
+}
+
+// Function to feed a key event at time through the hook's filter into the
+// scheduler, as GlobalKeyboardProc and RequestArrange do
+static void FeedKeyEvent(StormSimulation& simulation, int time, bool down, bool hooked)
+{
+    AdvanceStormSimulation(simulation, time);
+    simulation.keyEvents++;
+    if (FilterHotkeyEvent(simulation.keys, TEST_KEY, down, hooked) != HOTKEY_EVENT_DISPATCH)
+        return;
+
+    simulation.requests++;
+    simulation.lastRequest = time;
+    switch (AddArrangeRequest(simulation.scheduler))
+    {
+    case ARRANGE_REQUEST_DROPPED:
+        simulation.dropped++;
+        break;
+    case ARRANGE_REQUEST_POST:
+        simulation.posted = true;
+        break;
+    default:
+        break;
+    }
+    if (simulation.scheduler.running && IsArrangeSuperseded(simulation.scheduler))
+        simulation.superseded++;
+    AdvanceStormSimulation(simulation, time);
+}
+
+// Function to let the simulation run until every request has been served;
+// returns the problem, or NULL
+static const char* DrainStormSimulation(StormSimulation& simulation, int time)
+{
+    for (int end = time + 4 * TEST_ARRANGE_MS; time <= end; time += TEST_ARRANGE_MS)
+        AdvanceStormSimulation(simulation, time);
+    if (simulation.posted || simulation.scheduler.pending || simulation.scheduler.running)
+        return "a request was left pending once the keys stopped";
+    if (simulation.arranges + simulation.dropped != simulation.requests)
+        return "a request was neither served nor folded into a served one";
+    if (simulation.lastRunStart < simulation.lastRequest)
+        return "the last request was not served";
+    return NULL;
+}
+
+// Function to hold the chord with auto-repeat, then release it
+static const char* CheckHeldChord(StormSimulation& simulation)
+{
+    int time = 0;
+    for (; time < TEST_HOLD_MS; time += 1000 / TEST_REPEAT_RATE)
+        FeedKeyEvent(simulation, time, true, true);
+    FeedKeyEvent(simulation, time, false, true);
+    const char* problem = DrainStormSimulation(simulation, time);
+    if (problem)
+        return problem;
+    if (simulation.arranges < 1)
+        return "holding the arrange chord ran no arrange";
+    if (simulation.arranges > 2)
+        return "holding the arrange chord ran more than two arranges";
+    return NULL;
+}
+
+// Function to tap the chord TEST_TAPS times, period ms apart
+static const char* CheckTaps(StormSimulation& simulation, int period)
+{
+    int time = 0;
+    for (int tap = 0; tap < TEST_TAPS; ++tap, time += period)
+    {
+        FeedKeyEvent(simulation, time, true, true);
+        FeedKeyEvent(simulation, time + TEST_KEY_UP_MS, false, true);
+    }
+    const char* problem = DrainStormSimulation(simulation, time);
+    if (problem)
+        return problem;
+    if (simulation.requests != TEST_TAPS)
+        return "a tap after the key was released did not request an arrange";
+    if (period > TEST_ARRANGE_MS && (simulation.arranges != TEST_TAPS || simulation.dropped != 0))
+        return "taps slower than an arrange did not run one arrange each";
+    if (period < TEST_ARRANGE_MS && simulation.arranges >= TEST_TAPS)
+        return "taps faster than an arrange did not fold into the pending slot";
+    if (period < TEST_ARRANGE_MS && simulation.superseded == 0)
+        return "a tap during an arrange did not supersede it";
+    return NULL;
+}
+
+// Function to hold a chord the hook does not handle
+static const char* CheckUnhookedChord(StormSimulation& simulation)
+{
+    int time = 0;
+    for (; time < TEST_HOLD_MS; time += 1000 / TEST_REPEAT_RATE)
+        FeedKeyEvent(simulation, time, true, false);
+    FeedKeyEvent(simulation, time, false, false);
+    if (simulation.requests != 0 || simulation.arranges != 0)
+        return "a chord the hook does not handle requested an arrange";
+    return NULL;
+}
+
+// Function to print what a check did; returns false if it found a problem
+static bool ReportStormCheck(const char* name, const StormSimulation& simulation, const char* problem)
+{
+    printf("%s, %d ms arranges: %d key events, %d requests, %d dropped, %d superseded, %d arranges\n",
+        name, TEST_ARRANGE_MS, simulation.keyEvents, simulation.requests, simulation.dropped,
+        simulation.superseded, simulation.arranges);
+    if (problem)
+        printf("FAIL %s: %s\n", name, problem);
+    return !problem;
+}
+
+int main()
+{
+    StormSimulation held, slowTaps, fastTaps, unhooked;
+    bool passed = ReportStormCheck("chord held", held, CheckHeldChord(held));
+    passed = ReportStormCheck("slow taps", slowTaps, CheckTaps(slowTaps, TEST_SLOW_TAP_MS)) && passed;
+    passed = ReportStormCheck("fast taps", fastTaps, CheckTaps(fastTaps, TEST_FAST_TAP_MS)) && passed;
+    passed = ReportStormCheck("unhooked chord held", unhooked, CheckUnhookedChord(unhooked)) && passed;
+    if (!passed)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
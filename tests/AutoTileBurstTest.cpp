@@ -0,0 +1,179 @@
+// Test of the auto-tiling debounce, run on Linux:
+//   g++ -std=c++14 -O2 tests/AutoTileBurstTest.cpp -o AutoTileBurstTest && ./AutoTileBurstTest
+// Window events are fed through GetAutoTileListChange into a simulated
+// captured list, and list changes through AddAutoTileBurstEvent, on a
+// simulated clock whose debounce timer fires TakeAutoTileRelayout as
+// WM_TIMER does. TEST_BURST_WINDOWS windows created, shown and moved a few
+// milliseconds apart must be tiled by one relayout, location changes alone
+// must run none, closing the windows must run one more, and a stream of
+// windows coming and going that never goes quiet must not keep a change
+// waiting longer than AUTO_TILE_MAX_DELAY_MS. Windows that do not match
+// the capture rules must never be listed. The whole run is repeated with
+// the tick count about to wrap around, as GetTickCount does after 49 days.
+
+#include "../Window Management Tool/AutoTileDebounce.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#define TEST_BURST_WINDOWS 20       // Windows shown, moved and closed by the bursts
+#define TEST_BURST_STEP_MS 5        // Between two window events of a burst
+#define TEST_STREAM_MS 3000         // Steady event stream that never goes quiet
+#define TEST_STREAM_STEP_MS 100
+#define TEST_UNMATCHED_WINDOW 1000  // Handles from here on do not match the capture rules
+
+// Simulated clock, debounce timer and captured list; times are relative
+// to origin, the tick count the run starts at
+struct AutoTileSimulation
+{
+    uint32_t origin = 0;
+    AutoTileBurst burst;
+    std::vector<unsigned int> windows; // Captured list
+    int deadline = -1;          // When the debounce timer fires, -1 if it is not running
+    int oldestEvent = -1;       // First list change the next relayout serves
+    int longestWait = 0;        // Longest a list change waited for its relayout
+    int events = 0;
+    int relayouts = 0;
+};
+
+// Function to move the simulated clock to time, firing the debounce timer
+// on the way as WM_TIMER does
+static void AdvanceAutoTileSimulation(AutoTileSimulation& simulation, int time)
+{
+    if (simulation.deadline < 0 || simulation.deadline > time)
+        return;
+
+    int fired = simulation.deadline;
+    simulation.deadline = -1;
+    if (TakeAutoTileRelayout(simulation.burst))
+    {
+        simulation.relayouts++;
+        simulation.longestWait = (std::max)(simulation.longestWait, fired - simulation.oldestEvent);
+        simulation.oldestEvent = -1;
+    }
+}
+
+// Function to feed a window event at time through the list update and the
+// debounce, as AutoTileWinEventProc does
+static void FeedAutoTileEvent(AutoTileSimulation& simulation, int time, int event, unsigned int hWnd)
+{
+    AdvanceAutoTileSimulation(simulation, time);
+    simulation.events++;
+    auto it = std::find(simulation.windows.begin(), simulation.windows.end(), hWnd);
+    bool listed = it != simulation.windows.end();
+    switch (GetAutoTileListChange(event, listed, [hWnd]() { return hWnd < TEST_UNMATCHED_WINDOW; }))
+    {
+    case AUTO_TILE_LIST_ADD:
+        simulation.windows.push_back(hWnd);
+        break;
+    case AUTO_TILE_LIST_REMOVE:
+        simulation.windows.erase(it);
+        break;
+    default:
+        return;
+    }
+
+    if (simulation.oldestEvent < 0)
+        simulation.oldestEvent = time;
+    if (AddAutoTileBurstEvent(simulation.burst, simulation.origin + static_cast<uint32_t>(time)))
+        simulation.deadline = time + AUTO_TILE_DEBOUNCE_MS;
+}
+
+// Function to run the bursts and the stream from a tick count; returns the problem, or NULL
+static const char* CheckAutoTileBursts(uint32_t origin, int& events, int& relayouts)
+{
+    const char* problem = NULL;
+    AutoTileSimulation simulation;
+    simulation.origin = origin;
+    int time = 0;
+
+    // Windows appear: each is created, shown and placed, and one in four
+    // is shown by another program whose windows do not match
+    for (unsigned int hWnd = 1; hWnd <= TEST_BURST_WINDOWS; ++hWnd, time += TEST_BURST_STEP_MS)
+    {
+        FeedAutoTileEvent(simulation, time, AUTO_TILE_EVENT_OTHER, hWnd);
+        FeedAutoTileEvent(simulation, time, AUTO_TILE_EVENT_SHOW, hWnd);
+        FeedAutoTileEvent(simulation, time, AUTO_TILE_EVENT_OTHER, hWnd);
+        if (hWnd % 4 == 0)
+            FeedAutoTileEvent(simulation, time, AUTO_TILE_EVENT_SHOW, TEST_UNMATCHED_WINDOW + hWnd);
+    }
+    time += AUTO_TILE_MAX_DELAY_MS;
+    AdvanceAutoTileSimulation(simulation, time);
+    if (simulation.relayouts != 1 || simulation.windows.size() != TEST_BURST_WINDOWS)
+        problem = "a burst of new windows did not run exactly one relayout";
+
+    // The relayout moves them and they are shown again; neither changes the list
+    int before = simulation.relayouts;
+    for (unsigned int hWnd = 1; hWnd <= TEST_BURST_WINDOWS; ++hWnd, time += TEST_BURST_STEP_MS)
+    {
+        FeedAutoTileEvent(simulation, time, AUTO_TILE_EVENT_OTHER, hWnd);
+        FeedAutoTileEvent(simulation, time, AUTO_TILE_EVENT_SHOW, hWnd);
+    }
+    time += AUTO_TILE_MAX_DELAY_MS;
+    AdvanceAutoTileSimulation(simulation, time);
+    if (!problem && simulation.relayouts != before)
+        problem = "location changes ran a relayout";
+
+    // The windows close, and so do the unmatched ones, which were never listed
+    before = simulation.relayouts;
+    for (unsigned int hWnd = 1; hWnd <= TEST_BURST_WINDOWS; ++hWnd, time += TEST_BURST_STEP_MS)
+    {
+        FeedAutoTileEvent(simulation, time, AUTO_TILE_EVENT_DESTROY, hWnd);
+        if (hWnd % 4 == 0)
+            FeedAutoTileEvent(simulation, time, AUTO_TILE_EVENT_DESTROY, TEST_UNMATCHED_WINDOW + hWnd);
+    }
+    time += AUTO_TILE_MAX_DELAY_MS;
+    AdvanceAutoTileSimulation(simulation, time);
+    if (!problem && (simulation.relayouts != before + 1 || !simulation.windows.empty()))
+        problem = "closing a burst of windows did not run exactly one relayout";
+
+    // A window comes and goes every TEST_STREAM_STEP_MS
+    before = simulation.relayouts;
+    unsigned int hStream = 0;
+    for (int elapsed = 0; elapsed < TEST_STREAM_MS; elapsed += TEST_STREAM_STEP_MS, time += TEST_STREAM_STEP_MS)
+    {
+        if (hStream)
+        {
+            FeedAutoTileEvent(simulation, time, AUTO_TILE_EVENT_DESTROY, hStream);
+            hStream = 0;
+        }
+        else
+        {
+            hStream = TEST_BURST_WINDOWS + 1 + elapsed / TEST_STREAM_STEP_MS;
+            FeedAutoTileEvent(simulation, time, AUTO_TILE_EVENT_SHOW, hStream);
+        }
+    }
+    time += AUTO_TILE_MAX_DELAY_MS;
+    AdvanceAutoTileSimulation(simulation, time);
+    int streamRelayouts = simulation.relayouts - before;
+    if (!problem && simulation.longestWait > AUTO_TILE_MAX_DELAY_MS)
+        problem = "a change waited longer than the maximum delay";
+    else if (!problem && streamRelayouts > TEST_STREAM_MS / (AUTO_TILE_MAX_DELAY_MS - AUTO_TILE_DEBOUNCE_MS) + 1)
+        problem = "a steady event stream ran a relayout per few events";
+    else if (!problem && (simulation.burst.relayoutPending || simulation.deadline >= 0))
+        problem = "a relayout was left pending once the events stopped";
+
+    events = simulation.events;
+    relayouts = simulation.relayouts;
+    return problem;
+}
+
+int main()
+{
+    const uint32_t origins[] = { 0, 0xFFFFFFFFu - TEST_STREAM_MS };
+    for (uint32_t origin : origins)
+    {
+        int events = 0, relayouts = 0;
+        const char* problem = CheckAutoTileBursts(origin, events, relayouts);
+        printf("auto-tile bursts of %d windows and a %d ms stream from tick count %u: %d window events, %d relayouts\n",
+            TEST_BURST_WINDOWS, TEST_STREAM_MS, origin, events, relayouts);
+        if (problem)
+        {
+            printf("FAIL: %s\n", problem);
+            return 1;
+        }
+    }
+    printf("PASS\n");
+    return 0;
+}
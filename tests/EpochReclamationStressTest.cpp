@@ -0,0 +1,156 @@
+// Stress test for the epoch-based reclamation of the window registry, run on Linux:
+//   g++ -std=c++14 -O2 -pthread tests/EpochReclamationStressTest.cpp -o EpochReclamationStressTest && ./EpochReclamationStressTest
+// One writer publishes snapshots the way PublishWindowRegistry does while
+// more reader threads than there are slots read them, some with nested
+// reads, and exit so their slots are reused. A reclaimed snapshot is
+// poisoned and kept in quarantine for a while before it is freed, so a
+// reader still holding one sees the poison. Any poisoned or inconsistent
+// read fails the test, as does a retired snapshot left after the readers
+// are gone.
+
+#include "../Window Management Tool/EpochReclamation.h"
+
+#include <chrono>
+#include <cstdio>
+#include <deque>
+
+#define TEST_READER_THREADS (MAX_EPOCH_READERS + 8)
+#define TEST_ROUNDS 3
+#define TEST_READS_PER_THREAD 5000
+#define TEST_SNAPSHOT_VALUES 64
+#define TEST_QUARANTINE 4096            // Reclaimed snapshots kept poisoned before they are freed
+#define TEST_POISON 0xDEADDEADu
+
+struct Snapshot
+{
+    uint64_t version;
+    unsigned int values[TEST_SNAPSHOT_VALUES]; // All equal to the low bits of version
+};
+
+EpochReaders readers;
+std::atomic<const Snapshot*> published(nullptr);
+std::vector<std::pair<const Snapshot*, uint64_t>> retired;
+std::deque<Snapshot*> quarantine;
+std::atomic<bool> failed(false);
+std::atomic<long long> readCount(0);
+
+// Function to publish snapshot number version, as PublishWindowRegistry does
+static void Publish(uint64_t version)
+{
+    Snapshot* snapshot = new Snapshot();
+    snapshot->version = version;
+    for (unsigned int& value : snapshot->values)
+        value = static_cast<unsigned int>(version);
+
+    const Snapshot* old = published.exchange(snapshot);
+    if (old)
+        retired.emplace_back(old, AdvanceEpoch(readers));
+
+    ReclaimRetired(retired, GetOldestReaderEpoch(readers), [](const Snapshot* snapshot) {
+        Snapshot* reclaimed = const_cast<Snapshot*>(snapshot);
+        for (unsigned int& value : reclaimed->values)
+            value = TEST_POISON;
+        quarantine.push_back(reclaimed);
+        if (quarantine.size() > TEST_QUARANTINE)
+        {
+            delete quarantine.front();
+            quarantine.pop_front();
+        }
+    });
+}
+
+// Function to check a snapshot held by a reader; returns false if it was reclaimed
+static bool CheckSnapshot(const Snapshot* snapshot, uint64_t& lastVersion)
+{
+    if (!snapshot)
+        return true;
+    if (snapshot->version < lastVersion)
+        return false;
+    lastVersion = snapshot->version;
+    for (unsigned int value : snapshot->values)
+    {
+        if (value != static_cast<unsigned int>(snapshot->version))
+            return false;
+    }
+    return true;
+}
+
+static void ReaderThread(int thread)
+{
+    uint64_t lastVersion = 0;
+    for (int read = 0; read < TEST_READS_PER_THREAD && !failed.load(std::memory_order_relaxed); ++read)
+    {
+        EnterEpochRead(readers);
+        const Snapshot* snapshot = published.load();
+        bool consistent = CheckSnapshot(snapshot, lastVersion);
+
+        // Every other thread nests a second read, which shares the outer epoch
+        if (thread % 2 == 0)
+        {
+            EnterEpochRead(readers);
+            uint64_t innerVersion = lastVersion;
+            consistent = consistent && CheckSnapshot(published.load(), innerVersion);
+            LeaveEpochRead(readers);
+        }
+
+        // Give the writer time to retire what is held here
+        std::this_thread::yield();
+        consistent = consistent && CheckSnapshot(snapshot, lastVersion);
+        LeaveEpochRead(readers);
+
+        if (!consistent)
+            failed.store(true);
+        readCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+int main()
+{
+    auto start = std::chrono::steady_clock::now();
+    uint64_t version = 0;
+    Publish(++version);
+
+    for (int round = 0; round < TEST_ROUNDS && !failed.load(); ++round)
+    {
+        std::atomic<int> running(TEST_READER_THREADS);
+        std::vector<std::thread> threads;
+        for (int thread = 0; thread < TEST_READER_THREADS; ++thread)
+        {
+            threads.emplace_back([thread, &running]() {
+                ReaderThread(thread);
+                running.fetch_sub(1);
+            });
+        }
+        while (running.load() > 0)
+        {
+            Publish(++version);
+            std::this_thread::yield();
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    // With no reader left, the next publish must free everything retired before it
+    Publish(++version);
+    size_t leftOver = retired.size();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%lld reads by %d threads in %d rounds, %llu snapshots published in %.2f s\n",
+        readCount.load(), TEST_READER_THREADS, TEST_ROUNDS, static_cast<unsigned long long>(version), seconds);
+
+    for (Snapshot* snapshot : quarantine)
+        delete snapshot;
+    delete published.load();
+
+    if (failed.load())
+    {
+        printf("FAIL: a reader saw a reclaimed or inconsistent snapshot\n");
+        return 1;
+    }
+    if (leftOver != 0)
+    {
+        printf("FAIL: %d retired snapshots were not freed once the readers were gone\n", static_cast<int>(leftOver));
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,550 @@
+// Self-check of the layout solvers, run on Linux:
+//   g++ -std=c++14 -O2 tests/LayoutSelfCheck.cpp -o LayoutSelfCheck && ./LayoutSelfCheck [cases] [seed]
+// Random work areas, window counts, spacing, pixel fixes and layout modes
+// are solved by the grid solver and the reference solver; the cells must
+// be identical and tile the work area. Every TEST_SOLVER_INTERVAL cases the
+// grouped, all-monitors and custom layouts are checked too, on synthetic
+// groups, monitors and layouts. A wrong layout fails the test, as does a
+// grid solver 99th percentile over its size class's budget, a grouped
+// layout solve over TEST_GROUPED_BUDGET_US, or a compiled custom layout
+// that evaluates slower than the size class's grid budget.
+
+#include "../Window Management Tool/LayoutSolver.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#define TEST_CASES 1000000
+#define TEST_SEED 20240607
+#define TEST_MAX_WINDOWS 256
+#define TEST_SOLVER_INTERVAL 10     // Every Nth case also checks the grouped, all-monitors and custom layouts
+#define TEST_MAX_GROUPS 8           // Groups of the grouped layout check
+#define TEST_MAX_MONITORS 4         // Synthetic monitors of the all-monitors check
+#define TEST_LAYOUT_RULES 4         // Capture rules the generated custom layouts bind to
+#define TEST_MAX_REPORTED_FAILURES 20
+#define TEST_GROUPED_WINDOWS 1200   // Synthetic windows of the grouped layout benchmark
+#define TEST_GROUPED_GROUPS 24
+#define TEST_GROUPED_SOLVES 2000
+#define TEST_GROUPED_BUDGET_US 50.0
+#define TEST_GROUPED_MAX_SOLVED 4.0 // Mean regions re-solved per moved window: the two it changes, plus rare moves
+#define TEST_EVALUATOR_SOLVES 20000 // Evaluations per window count of the evaluator benchmark
+#define TEST_EVALUATOR_LAYOUT L"main = columns(2:3, slot, rows(grid(2, 3), auto)) gap=4"
+
+struct TestRect
+{
+    int left, top, right, bottom;
+};
+
+typedef LayoutInputs<TestRect> TestParams;
+
+// Window counts are drawn per size class, and each class has a budget for
+// the 99th percentile of the grid solver's latency
+struct SizeClass
+{
+    const char* name;
+    int maxWindows;
+    double p99BudgetUs;
+};
+static const SizeClass sizeClasses[] =
+{
+    { "<=8", 8, 20.0 },
+    { "<=64", 64, 50.0 },
+    { "<=256", TEST_MAX_WINDOWS, 200.0 },
+};
+
+// Function to get a percentile of sorted samples
+static double Percentile(const std::vector<double>& sorted, double fraction)
+{
+    return sorted.empty() ? 0.0 : sorted[static_cast<size_t>(fraction * (sorted.size() - 1))];
+}
+
+// Function to compare two cell lists cell by cell
+static bool SameCells(const std::vector<TestRect>& a, const std::vector<TestRect>& b)
+{
+    return a.size() == b.size() &&
+        std::equal(a.begin(), a.end(), b.begin(), [](const TestRect& x, const TestRect& y) { return LayoutRectsEqual(x, y); });
+}
+
+// Function to grow a box to hold a rectangle; empty rectangles are ignored
+static void AddToBox(TestRect& box, const TestRect& rect)
+{
+    if (rect.right <= rect.left || rect.bottom <= rect.top)
+        return;
+    if (box.right <= box.left || box.bottom <= box.top)
+    {
+        box = rect;
+        return;
+    }
+    box.left = (std::min)(box.left, rect.left);
+    box.top = (std::min)(box.top, rect.top);
+    box.right = (std::max)(box.right, rect.right);
+    box.bottom = (std::max)(box.bottom, rect.bottom);
+}
+
+// Function to check the grouped layout: the cells lie in the area without
+// overlapping, no group's cells enter the box around another group's, and
+// a solve that reuses the cached regions after a window changes group
+// gives the same cells as tiling every region afresh. When the move only
+// changes the counts of two groups and no capacity leaves its slack, only
+// those two groups may be re-solved. Returns the problem, or NULL.
+static const wchar_t* CheckGroupedLayout(std::mt19937& random, const TestParams& params, int numWindows)
+{
+    int groups = std::uniform_int_distribution<int>(1, (std::min)(numWindows, TEST_MAX_GROUPS))(random);
+    std::uniform_int_distribution<int> groupDistribution(0, groups - 1);
+    std::vector<int> keys(numWindows);
+    for (int i = 0; i < numWindows; ++i)
+    {
+        keys[i] = groupDistribution(random);
+    }
+
+    std::vector<LayoutGroupRegion<TestRect>> cache;
+    std::vector<TestRect> cells, freshCells;
+    if (!ComputeGroupedLayout(params, keys, cache, cells))
+        return NULL;
+    if (static_cast<int>(cells.size()) != numWindows)
+        return L"grouped layout: wrong number of cells";
+    const wchar_t* problem = CheckCellsInsideArea(GetFixedWorkArea(params), cells.data(), numWindows);
+    if (problem)
+        return problem;
+
+    std::vector<TestRect> bounds(groups, TestRect());
+    for (int i = 0; i < numWindows; ++i)
+    {
+        AddToBox(bounds[keys[i]], cells[i]);
+    }
+    for (int i = 0; i < numWindows; ++i)
+    {
+        for (int group = 0; group < groups; ++group)
+        {
+            if (group != keys[i] && LayoutRectsOverlap(cells[i], bounds[group]))
+                return L"grouped layout: groups overlap";
+        }
+    }
+
+    std::vector<int> groupCounts(groups, 0);
+    for (int key : keys)
+    {
+        groupCounts[key]++;
+    }
+    int moved = std::uniform_int_distribution<int>(0, numWindows - 1)(random);
+    int target = groupDistribution(random);
+    bool countChange = target != keys[moved] && groupCounts[keys[moved]] > 1 && groupCounts[target] > 0;
+    keys[moved] = target;
+
+    std::vector<LayoutGroupRegion<TestRect>> unsolved = cache;
+    std::vector<std::pair<int, int>> capacities;
+    for (LayoutGroupRegion<TestRect>& group : unsolved)
+    {
+        group.solved = false;
+        capacities.emplace_back(group.key, group.capacity);
+    }
+    int regionsSolved = 0;
+    bool cachedSolved = ComputeGroupedLayout(params, keys, cache, cells, &regionsSolved);
+    bool freshSolved = ComputeGroupedLayout(params, keys, unsolved, freshCells);
+    if (cachedSolved != freshSolved || !SameCells(cells, freshCells))
+        return L"grouped layout: cached regions differ from a fresh solve";
+
+    bool capacitiesKept = cachedSolved && cache.size() == capacities.size();
+    for (size_t group = 0; group < cache.size() && capacitiesKept; ++group)
+    {
+        capacitiesKept = cache[group].key == capacities[group].first && cache[group].capacity == capacities[group].second;
+    }
+    if (countChange && capacitiesKept && regionsSolved > 2)
+        return L"grouped layout: moving one window re-solved groups it did not change";
+    return NULL;
+}
+
+// Function to check the all-monitors layout on synthetic monitors side by
+// side, with random work areas and DPIs: each monitor's window count is
+// within one window of its share of the logical area, the counts add up,
+// and each monitor's cells lie in its work area without overlapping.
+// Returns the problem, or NULL.
+static const wchar_t* CheckMultiMonitorLayout(std::mt19937& random, const TestParams& params, int numWindows)
+{
+    static const unsigned int dpis[] = { 96, 120, 144, 192 };
+    std::uniform_int_distribution<int> widthDistribution(640, 3840);
+    std::uniform_int_distribution<int> heightDistribution(480, 2160);
+    std::uniform_int_distribution<int> taskbarDistribution(0, 48);
+    std::uniform_int_distribution<int> dpiDistribution(0, 3);
+    int monitorCount = std::uniform_int_distribution<int>(1, TEST_MAX_MONITORS)(random);
+
+    std::vector<LayoutMonitor<TestRect>> monitors(monitorCount);
+    std::vector<double> weights;
+    double totalWeight = 0.0;
+    int x = params.workArea.left;
+    for (LayoutMonitor<TestRect>& monitor : monitors)
+    {
+        int width = widthDistribution(random);
+        int height = heightDistribution(random);
+        monitor.workArea = MakeLayoutRect<TestRect>(x, params.workArea.top, x + width, params.workArea.top + height - taskbarDistribution(random));
+        monitor.dpi = dpis[dpiDistribution(random)];
+        x += width;
+
+        double scale = 96.0 / monitor.dpi;
+        weights.push_back((monitor.workArea.right - monitor.workArea.left) * scale * (monitor.workArea.bottom - monitor.workArea.top) * scale);
+        totalWeight += weights.back();
+    }
+
+    std::vector<int> counts;
+    SplitWindowsAcrossMonitors(monitors, numWindows, counts);
+    int assigned = 0;
+    for (int i = 0; i < monitorCount; ++i)
+    {
+        if (fabs(counts[i] - numWindows * weights[i] / totalWeight) >= 1.0)
+            return L"all monitors: a monitor's window count is off its share by a window or more";
+        assigned += counts[i];
+    }
+    if (assigned != numWindows)
+        return L"all monitors: the window counts do not add up";
+
+    TestParams multiParams = params;
+    multiParams.pixelFixX = 0;
+    multiParams.pixelFixY = 0;
+    multiParams.allMonitors = true;
+    std::vector<TestRect> cells;
+    if (!ComputeMultiMonitorLayout(multiParams, monitors, numWindows, cells))
+        return NULL;
+    if (static_cast<int>(cells.size()) != numWindows)
+        return L"all monitors: wrong number of cells";
+    int first = 0;
+    for (int i = 0; i < monitorCount; ++i)
+    {
+        const wchar_t* problem = CheckCellsInsideArea(monitors[i].workArea, cells.data() + first, counts[i]);
+        if (problem)
+            return problem;
+        first += counts[i];
+    }
+    return NULL;
+}
+
+// Function to write a random layout in the layouts file syntax, at most two
+// splits deep, with random weights, fixed grids and bindings to the first
+// capture rules
+static void GenerateLayoutText(std::mt19937& random, int depth, bool& hasAuto, std::wstring& text)
+{
+    std::uniform_int_distribution<int> smallDistribution(1, 4);
+    int kind = std::uniform_int_distribution<int>(0, depth < 2 ? 4 : 2)(random);
+    if (kind == 2 && !hasAuto)
+    {
+        hasAuto = true;
+        text += L"auto";
+        return;
+    }
+    if (kind <= 2)
+    {
+        if (kind == 1)
+            text += L"grid(" + std::to_wstring(smallDistribution(random)) + L", " + std::to_wstring(smallDistribution(random)) + L")";
+        else
+            text += L"slot";
+        if (smallDistribution(random) == 1)
+            text += L" for rule=" + std::to_wstring(std::uniform_int_distribution<int>(1, TEST_LAYOUT_RULES)(random));
+        return;
+    }
+
+    text += (kind == 3) ? L"columns(" : L"rows(";
+    int children = std::uniform_int_distribution<int>(2, 4)(random);
+    if (smallDistribution(random) <= 2)
+    {
+        for (int child = 0; child < children; ++child)
+        {
+            text += std::to_wstring(std::uniform_int_distribution<int>(1, 9)(random));
+            text += (child + 1 < children) ? L":" : L", ";
+        }
+    }
+    for (int child = 0; child < children; ++child)
+    {
+        GenerateLayoutText(random, depth + 1, hasAuto, text);
+        if (child + 1 < children)
+            text += L", ";
+    }
+    text += L")";
+}
+
+// Function to check the layout language on a random layout: it compiles
+// if and only if some region is unbound, the overflow region is unbound,
+// bound regions hold only windows of their rule, no region but the
+// overflow one holds more windows than it has room for, and the cells lie
+// in the area without overlapping. Returns the problem, or NULL.
+static const wchar_t* CheckCustomLayout(std::mt19937& random, const TestParams& params, int numWindows)
+{
+    std::wstring layout;
+    bool hasAuto = false;
+    GenerateLayoutText(random, 0, hasAuto, layout);
+    std::wstring text = L"selfcheck = " + layout + L" gap=" + std::to_wstring(std::uniform_int_distribution<int>(0, 8)(random));
+
+    LayoutProgram program;
+    bool compiled = ParseLayoutLine(text, program);
+    bool hasUnbound = false;
+    for (int region = 0; region < program.regionCount; ++region)
+    {
+        if (program.binding[region].kind == LAYOUT_BIND_NONE)
+            hasUnbound = true;
+    }
+    if (compiled != hasUnbound)
+        return compiled ? L"custom layout: a layout with every region bound compiles" : L"custom layout: a generated layout does not compile";
+    if (!compiled)
+    {
+        // Give the rest somewhere to go, as the user would have to
+        text = L"selfcheck = columns(" + layout + L", auto)";
+        if (!ParseLayoutLine(text, program))
+            return L"custom layout: a generated layout does not compile";
+    }
+    if (program.binding[program.overflowRegion].kind != LAYOUT_BIND_NONE)
+        return L"custom layout: the overflow region is bound";
+
+    // -1 stands for windows no rule took
+    std::uniform_int_distribution<int> ruleDistribution(-1, TEST_LAYOUT_RULES - 1);
+    std::vector<int> rules(numWindows);
+    for (int& rule : rules)
+    {
+        rule = ruleDistribution(random);
+    }
+    auto getNames = [&rules](int window, const bool*, LayoutWindowNames& names) { names.rule = rules[window]; };
+
+    std::vector<int> windowRegion;
+    int counts[MAX_LAYOUT_REGIONS];
+    AssignLayoutRegions(program, numWindows, getNames, windowRegion, counts);
+    for (int i = 0; i < numWindows; ++i)
+    {
+        const LayoutBinding& binding = program.binding[windowRegion[i]];
+        if (binding.kind == LAYOUT_BIND_RULE && rules[i] != binding.rule)
+            return L"custom layout: a window is in a region bound to another rule";
+    }
+    for (int region = 0; region < program.regionCount; ++region)
+    {
+        if (region != program.overflowRegion && counts[region] > program.regionCapacity[region])
+            return L"custom layout: a region holds more windows than it has room for";
+    }
+
+    TestParams customParams = params;
+    customParams.layoutMode = LAYOUT_CUSTOM;
+    std::vector<TestRect> cells;
+    if (!ComputeProgramLayout(customParams, program, numWindows, getNames, cells))
+        return NULL;
+    if (static_cast<int>(cells.size()) != numWindows)
+        return L"custom layout: wrong number of cells";
+    return CheckCellsInsideArea(GetFixedWorkArea(params), cells.data(), numWindows);
+}
+
+// Function to time the grouped layout over TEST_GROUPED_WINDOWS windows in
+// TEST_GROUPED_GROUPS groups. One window changes group before every solve,
+// so each sample regroups the whole list and re-solves the regions the
+// change moved; regionsSolved gets the mean number of those per solve.
+static void BenchmarkGroupedLayout(std::mt19937& random, std::vector<double>& samples, double& regionsSolved)
+{
+    std::uniform_int_distribution<int> groupDistribution(0, TEST_GROUPED_GROUPS - 1);
+    std::uniform_int_distribution<int> windowDistribution(0, TEST_GROUPED_WINDOWS - 1);
+    std::vector<int> keys(TEST_GROUPED_WINDOWS);
+    for (int& key : keys)
+    {
+        key = groupDistribution(random);
+    }
+
+    TestParams params;
+    params.workArea = MakeLayoutRect<TestRect>(0, 0, 3840, 2160);
+    params.pixelFixX = 0;
+    params.pixelFixY = 0;
+    params.minSpacingY = 4;
+    params.layoutMode = LAYOUT_GROUPED;
+    params.allMonitors = false;
+    std::vector<LayoutGroupRegion<TestRect>> cache;
+    std::vector<TestRect> cells;
+    ComputeGroupedLayout(params, keys, cache, cells); // Fills the region cache
+
+    long long totalSolved = 0;
+    for (int solve = 0; solve < TEST_GROUPED_SOLVES; ++solve)
+    {
+        keys[windowDistribution(random)] = groupDistribution(random);
+        int solved = 0;
+        auto start = std::chrono::steady_clock::now();
+        ComputeGroupedLayout(params, keys, cache, cells, &solved);
+        auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+        totalSolved += solved;
+    }
+    regionsSolved = static_cast<double>(totalSolved) / TEST_GROUPED_SOLVES;
+}
+
+// Function to time evaluating a compiled custom layout and solving the
+// built-in grid for the same work area and window count, one sample each
+// per solve. The layout is a big left pane plus a 2x3 grid on the right,
+// with the rest below the grid. Returns false if either does not solve.
+static bool BenchmarkLayoutEvaluator(int numWindows, std::vector<double>& evaluatorSamples, std::vector<double>& gridSamples)
+{
+    LayoutProgram program;
+    if (!ParseLayoutLine(TEST_EVALUATOR_LAYOUT, program))
+        return false;
+
+    TestParams params;
+    params.workArea = MakeLayoutRect<TestRect>(0, 0, 3840, 2160);
+    params.pixelFixX = 0;
+    params.pixelFixY = 0;
+    params.minSpacingY = 0;
+    params.layoutMode = LAYOUT_GRID;
+    params.allMonitors = false;
+
+    // Both write into storage sized up front, so neither sample allocates
+    std::vector<TestRect> evaluatorCells(numWindows);
+    std::vector<TestRect> gridCells;
+    gridCells.reserve(numWindows);
+    for (int solve = 0; solve < TEST_EVALUATOR_SOLVES; ++solve)
+    {
+        auto start = std::chrono::steady_clock::now();
+        bool evaluated = EvaluateLayoutProgram(program, params.workArea, numWindows, evaluatorCells.data());
+        auto middle = std::chrono::steady_clock::now();
+        bool solved = ComputeGridLayout(params, numWindows, gridCells);
+        auto end = std::chrono::steady_clock::now();
+        if (!evaluated || !solved)
+            return false;
+        evaluatorSamples.push_back(std::chrono::duration<double, std::micro>(middle - start).count());
+        gridSamples.push_back(std::chrono::duration<double, std::micro>(end - middle).count());
+    }
+    return CheckCellsInsideArea(params.workArea, evaluatorCells.data(), numWindows) == NULL;
+}
+
+int main(int argc, char** argv)
+{
+    int cases = (argc > 1) ? atoi(argv[1]) : TEST_CASES;
+    unsigned int seed = (argc > 2) ? static_cast<unsigned int>(strtoul(argv[2], NULL, 10)) : TEST_SEED;
+    if (cases <= 0)
+        cases = TEST_CASES;
+
+    const int classCount = sizeof(sizeClasses) / sizeof(sizeClasses[0]);
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> classDistribution(0, classCount - 1);
+    std::uniform_int_distribution<int> originDistribution(-4096, 4096);
+    std::uniform_int_distribution<int> widthDistribution(TEST_MAX_WINDOWS, 7680);
+    std::uniform_int_distribution<int> heightDistribution(240, 4320);
+    std::uniform_int_distribution<int> pixelFixXDistribution(-16, 16);
+    std::uniform_int_distribution<int> pixelFixYDistribution(-16, 64);
+    std::uniform_int_distribution<int> spacingDistribution(0, 32);
+    std::uniform_int_distribution<int> modeDistribution(LAYOUT_GRID, LAYOUT_ROWS);
+
+    std::vector<std::vector<double>> latency(classCount);
+    std::vector<TestRect> cells, referenceCells;
+    GridGeometry grid;
+    int failureCount = 0;
+    int unsolvable = 0;
+
+    auto runStart = std::chrono::steady_clock::now();
+    for (int testCase = 0; testCase < cases; ++testCase)
+    {
+        int sizeClass = classDistribution(random);
+        int minWindows = sizeClass > 0 ? sizeClasses[sizeClass - 1].maxWindows + 1 : 1;
+        int numWindows = std::uniform_int_distribution<int>(minWindows, sizeClasses[sizeClass].maxWindows)(random);
+
+        TestParams params;
+        params.workArea.left = originDistribution(random);
+        params.workArea.top = originDistribution(random);
+        params.workArea.right = params.workArea.left + widthDistribution(random);
+        params.workArea.bottom = params.workArea.top + heightDistribution(random);
+        params.pixelFixX = pixelFixXDistribution(random);
+        params.pixelFixY = pixelFixYDistribution(random);
+        params.minSpacingY = spacingDistribution(random);
+        params.layoutMode = modeDistribution(random);
+        params.allMonitors = false;
+
+        auto start = std::chrono::steady_clock::now();
+        bool solved = ComputeGridLayout(params, numWindows, cells, &grid);
+        auto end = std::chrono::steady_clock::now();
+        latency[sizeClass].push_back(std::chrono::duration<double, std::micro>(end - start).count());
+
+        const wchar_t* problem = NULL;
+        bool referenceSolved = ComputeReferenceGridLayout(params, numWindows, referenceCells);
+        if (solved != referenceSolved)
+            problem = L"solver and reference disagree on whether the layout fits";
+        else if (solved && !SameCells(cells, referenceCells))
+            problem = L"cells differ from the reference solver";
+        else if (solved)
+            problem = CheckGridLayoutInvariants(params, numWindows, cells, grid);
+        else
+            unsolvable++;
+
+        if (!problem && testCase % TEST_SOLVER_INTERVAL == 0)
+        {
+            problem = CheckGroupedLayout(random, params, numWindows);
+            if (!problem)
+                problem = CheckMultiMonitorLayout(random, params, numWindows);
+            if (!problem)
+                problem = CheckCustomLayout(random, params, numWindows);
+        }
+
+        if (problem && ++failureCount <= TEST_MAX_REPORTED_FAILURES)
+        {
+            printf("FAIL case %d: %ls (%d windows, mode %d, area %d,%d %dx%d, pixel fix %d,%d, spacing %d)\n",
+                testCase, problem, numWindows, params.layoutMode, params.workArea.left, params.workArea.top,
+                params.workArea.right - params.workArea.left, params.workArea.bottom - params.workArea.top,
+                params.pixelFixX, params.pixelFixY, params.minSpacingY);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+    printf("%d cases (seed %u) checked in %.1f s: %d failed, %d did not fit the work area\n",
+        cases, seed, seconds, failureCount, unsolvable);
+
+    bool withinBudget = true;
+    for (int sizeClass = 0; sizeClass < classCount; ++sizeClass)
+    {
+        std::vector<double>& samples = latency[sizeClass];
+        std::sort(samples.begin(), samples.end());
+        double p99 = Percentile(samples, 0.99);
+        printf("grid solver, %s windows: p50 %.2f us, p99 %.2f us, max %.2f us\n",
+            sizeClasses[sizeClass].name, Percentile(samples, 0.5), p99, samples.empty() ? 0.0 : samples.back());
+        if (p99 > sizeClasses[sizeClass].p99BudgetUs)
+        {
+            printf("OVER BUDGET %s windows: p99 %.2f us, budget %.0f us\n", sizeClasses[sizeClass].name, p99, sizeClasses[sizeClass].p99BudgetUs);
+            withinBudget = false;
+        }
+    }
+
+    std::vector<double> samples;
+    double regionsSolved = 0.0;
+    BenchmarkGroupedLayout(random, samples, regionsSolved);
+    std::sort(samples.begin(), samples.end());
+    double p99 = Percentile(samples, 0.99);
+    printf("grouped layout, %d windows in %d groups: p50 %.2f us, p99 %.2f us, max %.2f us, %.2f regions re-solved per move\n",
+        TEST_GROUPED_WINDOWS, TEST_GROUPED_GROUPS, Percentile(samples, 0.5), p99, samples.back(), regionsSolved);
+    if (p99 > TEST_GROUPED_BUDGET_US)
+    {
+        printf("OVER BUDGET grouped layout: p99 %.2f us, budget %.0f us\n", p99, TEST_GROUPED_BUDGET_US);
+        withinBudget = false;
+    }
+    if (regionsSolved > TEST_GROUPED_MAX_SOLVED)
+    {
+        printf("FAIL: moving one window re-solves %.2f of %d groups on average, more than %.0f\n",
+            regionsSolved, TEST_GROUPED_GROUPS, TEST_GROUPED_MAX_SOLVED);
+        return 1;
+    }
+
+    // The evaluator at the largest window count of each size class
+    for (int sizeClass = 0; sizeClass < classCount; ++sizeClass)
+    {
+        int numWindows = sizeClasses[sizeClass].maxWindows;
+        std::vector<double> evaluatorSamples, gridSamples;
+        if (!BenchmarkLayoutEvaluator(numWindows, evaluatorSamples, gridSamples))
+        {
+            printf("FAIL: the evaluator benchmark layout does not solve for %d windows\n", numWindows);
+            return 1;
+        }
+        std::sort(evaluatorSamples.begin(), evaluatorSamples.end());
+        std::sort(gridSamples.begin(), gridSamples.end());
+        double evaluatorP99 = Percentile(evaluatorSamples, 0.99);
+        printf("custom layout evaluator, %d windows: p50 %.2f us, p99 %.2f us; grid solver p50 %.2f us, p99 %.2f us\n",
+            numWindows, Percentile(evaluatorSamples, 0.5), evaluatorP99, Percentile(gridSamples, 0.5), Percentile(gridSamples, 0.99));
+        if (evaluatorP99 > sizeClasses[sizeClass].p99BudgetUs)
+        {
+            printf("OVER BUDGET custom layout evaluator, %d windows: p99 %.2f us, budget %.0f us\n",
+                numWindows, evaluatorP99, sizeClasses[sizeClass].p99BudgetUs);
+            withinBudget = false;
+        }
+    }
+
+    if (failureCount != 0 || !withinBudget)
+    {
+        printf("FAIL: %d cases failed%s\n", failureCount, withinBudget ? "" : ", latency over budget");
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
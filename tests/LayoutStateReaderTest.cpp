@@ -0,0 +1,148 @@
+// Reader test for the published layout state, run on Linux:
+//   g++ -std=c++14 -O2 -pthread tests/LayoutStateReaderTest.cpp -o LayoutStateReaderTest && ./LayoutStateReaderTest
+// A child process rewrites the state in shared memory, far more often than
+// the tool does, while this process reads it through
+// ReadLayoutState. Every copy the reader keeps must come from a single
+// update; a torn copy or a reader that never gets through fails the test.
+
+#include "../Window Management Tool/LayoutState.h"
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#define TEST_SECONDS 3
+#define TEST_MAX_ATTEMPTS 1000
+#define TEST_WRITER_PAUSE_US 20         // Between two updates
+
+// Function to write update number n: every field is derived from n, so a
+// reader can tell whether its copy mixes two updates
+static void WriteUpdate(PublishedLayoutState& state, uint64_t n)
+{
+    uint64_t sequence = BeginLayoutStateUpdate(state);
+    unsigned int count = static_cast<unsigned int>(n % MAX_PUBLISHED_WINDOWS) + 1;
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        PublishedWindow& window = state.windows[i];
+        window.hWnd = n;
+        window.flags = PUBLISHED_WINDOW_HAS_CELL;
+        window.cellLeft = static_cast<int32_t>(n);
+        window.cellTop = static_cast<int32_t>(i);
+        window.cellRight = static_cast<int32_t>(n + 1);
+        window.cellBottom = static_cast<int32_t>(i + 1);
+        for (int c = 0; c < PUBLISHED_TITLE_CHARS - 1; ++c)
+            window.title[c] = static_cast<PublishedChar>(u'a' + (n + c) % 26);
+        window.title[PUBLISHED_TITLE_CHARS - 1] = 0;
+    }
+    state.windowCount = count;
+    state.registryVersion = n;
+    state.layoutMode = static_cast<int32_t>(n % 5);
+    EndLayoutStateUpdate(state, sequence);
+}
+
+// Function to check that a copy holds exactly one update; returns the problem, or NULL
+static const char* CheckCopy(const PublishedLayoutState& copy)
+{
+    uint64_t n = copy.registryVersion;
+    if (copy.windowCount != static_cast<unsigned int>(n % MAX_PUBLISHED_WINDOWS) + 1)
+        return "window count from another update";
+    if (copy.layoutMode != static_cast<int32_t>(n % 5))
+        return "layout mode from another update";
+    for (unsigned int i = 0; i < copy.windowCount; ++i)
+    {
+        const PublishedWindow& window = copy.windows[i];
+        if (window.hWnd != n || window.cellLeft != static_cast<int32_t>(n) || window.cellTop != static_cast<int32_t>(i) ||
+            window.cellRight != static_cast<int32_t>(n + 1) || window.cellBottom != static_cast<int32_t>(i + 1))
+            return "window from another update";
+        for (int c = 0; c < PUBLISHED_TITLE_CHARS - 1; ++c)
+        {
+            if (window.title[c] != static_cast<PublishedChar>(u'a' + (n + c) % 26))
+                return "title from another update";
+        }
+        if (window.title[PUBLISHED_TITLE_CHARS - 1] != 0)
+            return "title not terminated";
+    }
+    return NULL;
+}
+
+int main()
+{
+    void* memory = mmap(NULL, sizeof(PublishedLayoutState), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+    PublishedLayoutState* state = new (memory) PublishedLayoutState();
+    state->magic = LAYOUT_STATE_MAGIC;
+    state->version = LAYOUT_STATE_VERSION;
+    state->size = sizeof(PublishedLayoutState);
+    state->maxWindows = MAX_PUBLISHED_WINDOWS;
+    WriteUpdate(*state, 0);
+
+    pid_t writer = fork();
+    if (writer < 0)
+    {
+        perror("fork");
+        return 1;
+    }
+    if (writer == 0)
+    {
+        auto end = std::chrono::steady_clock::now() + std::chrono::seconds(TEST_SECONDS);
+        for (uint64_t n = 1; std::chrono::steady_clock::now() < end; ++n)
+        {
+            WriteUpdate(*state, n);
+            std::this_thread::sleep_for(std::chrono::microseconds(TEST_WRITER_PAUSE_US));
+        }
+        _exit(0);
+    }
+
+    // Real readers map the block with FILE_MAP_READ; this one only reads it too
+    std::unique_ptr<PublishedLayoutState> copy(new PublishedLayoutState());
+    long long kept = 0, failed = 0, distinct = 0;
+    uint64_t last = 0;
+    const char* problem = NULL;
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(TEST_SECONDS);
+    while (!problem && std::chrono::steady_clock::now() < end)
+    {
+        // Like a status bar, copy the header and only the windows in use
+        bool consistent = ReadLayoutState(*state, [&copy](const PublishedLayoutState& shared) {
+            memcpy(static_cast<void*>(copy.get()), static_cast<const void*>(&shared), offsetof(PublishedLayoutState, windows));
+            unsigned int count = copy->windowCount < MAX_PUBLISHED_WINDOWS ? copy->windowCount : MAX_PUBLISHED_WINDOWS;
+            memcpy(copy->windows, shared.windows, count * sizeof(PublishedWindow));
+        }, TEST_MAX_ATTEMPTS);
+        if (!consistent)
+        {
+            failed++;
+            continue;
+        }
+        kept++;
+        problem = CheckCopy(*copy);
+        if (copy->registryVersion < last)
+            problem = "copies went back in time";
+        if (copy->registryVersion != last)
+            distinct++;
+        last = copy->registryVersion;
+    }
+
+    int status = 0;
+    waitpid(writer, &status, 0);
+    printf("%lld consistent copies of %lld distinct updates, %lld reads gave up\n", kept, distinct, failed);
+    if (problem)
+    {
+        printf("FAIL: %s (update %llu)\n", problem, static_cast<unsigned long long>(copy->registryVersion));
+        return 1;
+    }
+    if (kept == 0 || distinct < 2)
+    {
+        printf("FAIL: the reader never got a consistent copy of a changing state\n");
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,224 @@
+// Benchmark and check of linked resizing, run on Linux:
+//   g++ -std=c++14 -O2 tests/LinkedResizeBenchmark.cpp -o LinkedResizeBenchmark && ./LinkedResizeBenchmark
+// TEST_DRAGS drags across a grid of TEST_WINDOWS windows each pull a
+// random edge of a random cell out and back, the window moving once a
+// millisecond at most. As in OnLinkedResizeFrame, a location change or a
+// tick of a frame timer with the default Windows timer resolution commits
+// the latest position, at most once per display frame, and hands the
+// moved windows to a simulated apply backend whose cost per window is
+// drawn around TEST_APPLY_WINDOW_US; the tool's thread is busy until the
+// backend is done, so changes, ticks and the next commit wait for it.
+// Time is simulated except for the reflow itself, which is measured. A
+// commit that lands later than the display frame after its first change
+// drops the frames in between (CountMissedFrames).
+// Every reflowed grid is compared with one reflowed from the grid at drag
+// start. A wrong grid fails the test, as does a reflow 99th percentile
+// over TEST_REFLOW_BUDGET_US or more than TEST_MAX_DROPPED_PERCENT of the
+// committed frames dropped.
+
+#include "../Window Management Tool/LayoutSolver.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#define TEST_WINDOWS 50
+#define TEST_DRAGS 1000
+#define TEST_DRAG_MS 2000               // Length of a drag; the edge goes out for half of it and back
+#define TEST_MAX_REACH 400              // Farthest an edge is pulled, in pixels
+#define TEST_REFRESH_RATE 60
+#define TEST_TIMER_MS 15.625            // Default resolution of Windows timers
+#define TEST_APPLY_BATCH_US 200.0       // Cost of one batched move on the simulated backend
+#define TEST_APPLY_WINDOW_US 150.0      // Mean cost of moving one window there
+#define TEST_REFLOW_BUDGET_US 20.0
+#define TEST_MAX_DROPPED_PERCENT 1.0
+
+struct TestRect
+{
+    int left, top, right, bottom;
+};
+
+// Function to get a percentile of sorted samples
+static double Percentile(const std::vector<double>& sorted, double fraction)
+{
+    return sorted.empty() ? 0.0 : sorted[static_cast<size_t>(fraction * (sorted.size() - 1))];
+}
+
+// Function to get how far the dragged edge is from its start at a time of the drag
+static int GetDragOffset(int reach, int ms)
+{
+    int half = TEST_DRAG_MS / 2;
+    return reach * (ms <= half ? ms : TEST_DRAG_MS - ms) / half;
+}
+
+// Function to get the first millisecond after a time at which the dragged
+// window moves, or past the end of the drag if it no longer does
+static int GetNextDragChange(int reach, int afterMs)
+{
+    int ms = afterMs + 1;
+    while (ms <= TEST_DRAG_MS && GetDragOffset(reach, ms) == GetDragOffset(reach, ms - 1))
+        ms++;
+    return ms;
+}
+
+// Function to check a reflowed grid against the same drag reflowed from
+// the grid at drag start; returns the problem, or NULL
+static const char* CheckReflowedGrid(const GridGeometry& start, const GridGeometry& grid, int row, int column,
+    const TestRect& startRect, const TestRect& rect)
+{
+    GridGeometry expected = start;
+    ReflowLinkedGrid(start, expected, row, column, startRect, rect);
+    if (grid.columnX != expected.columnX || grid.columnWidths != expected.columnWidths ||
+        grid.rowY != expected.rowY || grid.rowHeights != expected.rowHeights)
+        return "grid differs from a reflow of the grid at drag start";
+    for (int c = 0; c + 1 < grid.columns; ++c)
+    {
+        if (grid.columnX[c] + grid.columnWidths[c] != grid.columnX[c + 1])
+            return "columns no longer meet";
+    }
+    for (int r = 0; r + 1 < grid.rows; ++r)
+    {
+        if (grid.rowY[r] + grid.rowHeights[r] != grid.rowY[r + 1])
+            return "rows no longer meet";
+    }
+    if (grid.columnX.back() + grid.columnWidths.back() != start.columnX.back() + start.columnWidths.back() ||
+        grid.rowY.back() + grid.rowHeights.back() != start.rowY.back() + start.rowHeights.back())
+        return "grid no longer fills the work area";
+    return NULL;
+}
+
+int main()
+{
+    LayoutInputs<TestRect> params;
+    params.workArea = MakeLayoutRect<TestRect>(0, 0, 3840, 2160);
+    params.pixelFixX = 0;
+    params.pixelFixY = 0;
+    params.minSpacingY = 0;
+    params.layoutMode = LAYOUT_GRID;
+    params.allMonitors = false;
+    GridGeometry start;
+    std::vector<TestRect> cells;
+    if (!ComputeGridLayout(params, TEST_WINDOWS, cells, &start))
+    {
+        printf("FAIL: %d windows do not fit the work area\n", TEST_WINDOWS);
+        return 1;
+    }
+
+    std::mt19937 random(20240607);
+    std::uniform_int_distribution<int> cellDistribution(0, TEST_WINDOWS - 1);
+    std::uniform_int_distribution<int> edgeDistribution(0, 3);
+    std::uniform_int_distribution<int> reachDistribution(-TEST_MAX_REACH, TEST_MAX_REACH);
+    std::exponential_distribution<double> applyDistribution(1.0 / TEST_APPLY_WINDOW_US);
+    const double framePeriodMs = 1000.0 / TEST_REFRESH_RATE;
+
+    GridGeometry grid;
+    std::vector<int> positions;
+    std::vector<TestRect> oldCells;
+    std::vector<double> samples;
+    long long frames = 0, dropped = 0, movedWindows = 0;
+    const char* problem = NULL;
+    for (int drag = 0; drag < TEST_DRAGS && !problem; ++drag)
+    {
+        int position = cellDistribution(random);
+        int row = position / start.columns;
+        int column = position % start.columns;
+        TestRect startRect = GetGridCell<TestRect>(start, row, column);
+        int edge = edgeDistribution(random);
+        int reach = reachDistribution(random);
+        grid = start;
+        GetLinkedReflowPositions(grid, row, column, positions);
+
+        // The drag starts between two timer ticks
+        double tick = std::uniform_real_distribution<double>(0.0, TEST_TIMER_MS)(random);
+        double now = 0.0, busyUntil = 0.0;
+        int lastRead = 0;
+        long long lastFrame = -1;
+        while (!problem)
+        {
+            // The next location change or tick; one due while the thread
+            // was busy is delivered when it is free
+            int nextChange = GetNextDragChange(reach, static_cast<int>(now));
+            int changeMs = GetNextDragChange(reach, lastRead);
+            if (changeMs > TEST_DRAG_MS)
+                break;
+            double next = (std::min)(tick, static_cast<double>(nextChange));
+            now = (std::max)(next, busyUntil);
+            if (next == tick)
+                tick = (static_cast<long long>(now / TEST_TIMER_MS) + 1) * TEST_TIMER_MS;
+            int nowMs = (std::min)(static_cast<int>(now), TEST_DRAG_MS);
+
+            // Commit if the window moved since the last commit read it
+            if (changeMs > nowMs)
+                continue;
+            long long frame = static_cast<long long>(now / framePeriodMs);
+            if (frame == lastFrame)
+                continue;
+
+            TestRect rect = startRect;
+            int* edges[] = { &rect.left, &rect.top, &rect.right, &rect.bottom };
+            *edges[edge] += GetDragOffset(reach, nowMs);
+
+            // The frame's work: reflow in place and list the windows whose cells changed
+            auto workStart = std::chrono::steady_clock::now();
+            oldCells.clear();
+            for (int affected : positions)
+            {
+                oldCells.push_back(GetGridCell<TestRect>(grid, affected / grid.columns, affected % grid.columns));
+            }
+            int moved = 0;
+            if (ReflowLinkedGrid(start, grid, row, column, startRect, rect))
+            {
+                for (size_t i = 0; i < positions.size(); ++i)
+                {
+                    TestRect newCell = GetGridCell<TestRect>(grid, positions[i] / grid.columns, positions[i] % grid.columns);
+                    if (positions[i] < TEST_WINDOWS && positions[i] != position && !LayoutRectsEqual(oldCells[i], newCell))
+                        moved++;
+                }
+            }
+            double workUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - workStart).count();
+            samples.push_back(workUs);
+            problem = CheckReflowedGrid(start, grid, row, column, startRect, rect);
+
+            double applyUs = TEST_APPLY_BATCH_US;
+            for (int i = 0; i < moved; ++i)
+                applyUs += applyDistribution(random);
+            busyUntil = now + (workUs + applyUs) / 1000.0;
+            dropped += CountMissedFrames(changeMs, busyUntil, framePeriodMs);
+            frames++;
+            movedWindows += moved;
+            lastRead = nowMs;
+            lastFrame = frame;
+        }
+    }
+
+    std::sort(samples.begin(), samples.end());
+    double p99 = Percentile(samples, 0.99);
+    double droppedPercent = frames ? 100.0 * dropped / frames : 0.0;
+    printf("linked resize, %d windows in %dx%d: %lld frames, %.1f windows moved per frame\n",
+        TEST_WINDOWS, start.rows, start.columns, frames, frames ? static_cast<double>(movedWindows) / frames : 0.0);
+    printf("reflow per frame: p50 %.2f us, p99 %.2f us, max %.2f us; %lld frames dropped (%.2f%%)\n",
+        Percentile(samples, 0.5), p99, samples.empty() ? 0.0 : samples.back(), dropped, droppedPercent);
+
+    if (problem)
+    {
+        printf("FAIL: %s\n", problem);
+        return 1;
+    }
+    if (frames == 0)
+    {
+        printf("FAIL: no drag committed a frame\n");
+        return 1;
+    }
+    if (p99 > TEST_REFLOW_BUDGET_US)
+    {
+        printf("FAIL: reflow p99 %.2f us over the budget of %.0f us\n", p99, TEST_REFLOW_BUDGET_US);
+        return 1;
+    }
+    if (droppedPercent > TEST_MAX_DROPPED_PERCENT)
+    {
+        printf("FAIL: %.2f%% of the frames dropped, more than %.0f%%\n", droppedPercent, TEST_MAX_DROPPED_PERCENT);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
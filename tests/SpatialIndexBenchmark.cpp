@@ -0,0 +1,194 @@
+// Benchmark and check of the spatial index, run on Linux:
+//   g++ -std=c++14 -O2 tests/SpatialIndexBenchmark.cpp -o SpatialIndexBenchmark && ./SpatialIndexBenchmark
+// A synthetic desktop of TEST_WINDOWS windows on an 8K virtual screen is
+// indexed, then churned the way window events do: windows move, are
+// raised, and close while others open, so TEST_WINDOWS stay live and the
+// queries are timed on a desktop of the stated size. Lasso queries and hit
+// tests run against it and are compared with a scan of every window. A
+// wrong answer fails the test, as does a query 99th percentile over
+// TEST_QUERY_BUDGET_US, the budget of the self-check's lasso benchmark.
+
+#include "../Window Management Tool/SpatialIndex.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#define TEST_WINDOWS 5000
+#define TEST_CHURN_EVENTS 20000
+#define TEST_QUERIES 10000
+#define TEST_HIT_TESTS 10000
+#define TEST_QUERY_BUDGET_US 100.0
+
+struct TestRect
+{
+    int left, top, right, bottom;
+};
+
+// What the index should hold for one window; zOrder 0 = not shown
+struct TestWindow
+{
+    TestRect rect;
+    unsigned int zOrder;
+};
+
+typedef SpatialGrid<unsigned int, TestRect> TestIndex;
+
+static TestIndex spatialIndex;
+static std::vector<TestWindow> windows(1);  // Indexed by handle; handle 0 = none
+static unsigned int topZOrder = 0;
+
+// Function to make a random window rectangle starting on the screen
+static TestRect RandomRect(std::mt19937& random)
+{
+    std::uniform_int_distribution<int> xDistribution(0, 7679);
+    std::uniform_int_distribution<int> yDistribution(0, 4319);
+    std::uniform_int_distribution<int> widthDistribution(200, 1920);
+    std::uniform_int_distribution<int> heightDistribution(150, 1080);
+    TestRect rect;
+    rect.left = xDistribution(random);
+    rect.top = yDistribution(random);
+    rect.right = rect.left + widthDistribution(random);
+    rect.bottom = rect.top + heightDistribution(random);
+    return rect;
+}
+
+// Function to show or move a window in both the index and the expectation;
+// a new handle is a window that opens
+static void Place(unsigned int hWnd, const TestRect& rect)
+{
+    if (hWnd >= windows.size())
+        windows.resize(hWnd + 1, TestWindow());
+    PlaceSpatialEntry(spatialIndex, hWnd, rect);
+    if (windows[hWnd].zOrder == 0)
+        windows[hWnd].zOrder = ++topZOrder;
+    windows[hWnd].rect = rect;
+}
+
+// Function to list the windows a rectangle touches by scanning all of them
+static void ScanQuery(const TestRect& rect, std::vector<unsigned int>& result)
+{
+    result.clear();
+    for (unsigned int hWnd = 1; hWnd < windows.size(); ++hWnd)
+    {
+        if (windows[hWnd].zOrder != 0 && SpatialRectsOverlap(windows[hWnd].rect, rect))
+            result.push_back(hWnd);
+    }
+}
+
+// Function to find the topmost window containing a point by scanning all of them
+static unsigned int ScanHitTest(int x, int y)
+{
+    unsigned int hTop = 0;
+    unsigned int zOrder = 0;
+    for (unsigned int hWnd = 1; hWnd < windows.size(); ++hWnd)
+    {
+        const TestWindow& window = windows[hWnd];
+        if (window.zOrder > zOrder && x >= window.rect.left && x < window.rect.right &&
+            y >= window.rect.top && y < window.rect.bottom)
+        {
+            hTop = hWnd;
+            zOrder = window.zOrder;
+        }
+    }
+    return hTop;
+}
+
+// Function to get a percentile of sorted samples
+static double Percentile(const std::vector<double>& sorted, double fraction)
+{
+    return sorted[static_cast<size_t>(fraction * (sorted.size() - 1))];
+}
+
+int main()
+{
+    std::mt19937 random(20240607);
+    TestRect bounds = { 0, 0, 7680, 4320 };
+    ResetSpatialIndex(spatialIndex, bounds);
+    std::vector<unsigned int> live;             // Handles of the open windows
+    for (unsigned int hWnd = 1; hWnd <= TEST_WINDOWS; ++hWnd)
+    {
+        Place(hWnd, RandomRect(random));
+        live.push_back(hWnd);
+    }
+
+    // Window events: moves, activations, and a window closing while a new
+    // one opens under a new handle, so the live count stays at TEST_WINDOWS
+    unsigned int nextHandle = TEST_WINDOWS + 1;
+    std::uniform_int_distribution<size_t> windowDistribution(0, TEST_WINDOWS - 1);
+    std::uniform_int_distribution<int> eventDistribution(0, 3);
+    for (int event = 0; event < TEST_CHURN_EVENTS; ++event)
+    {
+        size_t position = windowDistribution(random);
+        unsigned int hWnd = live[position];
+        switch (eventDistribution(random))
+        {
+        case 0:
+            RemoveSpatialEntry(spatialIndex, hWnd);
+            windows[hWnd].zOrder = 0;
+            live[position] = nextHandle++;
+            Place(live[position], RandomRect(random));
+            break;
+        case 1:
+            RaiseSpatialEntry(spatialIndex, hWnd);
+            windows[hWnd].zOrder = ++topZOrder;
+            break;
+        default:
+            Place(hWnd, RandomRect(random));
+            break;
+        }
+    }
+
+    // The churn must leave the desktop the queries are budgeted for
+    if (spatialIndex.entryOf.size() != TEST_WINDOWS)
+    {
+        printf("FAIL: %d windows indexed after the churn, expected %d\n", static_cast<int>(spatialIndex.entryOf.size()), TEST_WINDOWS);
+        return 1;
+    }
+
+    int wrongQueries = 0;
+    std::vector<double> samples;
+    std::vector<unsigned int> found, expected;
+    for (int query = 0; query < TEST_QUERIES; ++query)
+    {
+        TestRect lasso = RandomRect(random);
+        auto start = std::chrono::steady_clock::now();
+        QuerySpatialIndex(spatialIndex, lasso, found);
+        auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+
+        ScanQuery(lasso, expected);
+        std::sort(found.begin(), found.end());
+        if (found != expected)
+            wrongQueries++;
+    }
+
+    int wrongHits = 0;
+    std::uniform_int_distribution<int> xDistribution(0, 7679);
+    std::uniform_int_distribution<int> yDistribution(0, 4319);
+    for (int hit = 0; hit < TEST_HIT_TESTS; ++hit)
+    {
+        int x = xDistribution(random);
+        int y = yDistribution(random);
+        if (HitTestSpatialIndex(spatialIndex, x, y) != ScanHitTest(x, y))
+            wrongHits++;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    double p99 = Percentile(samples, 0.99);
+    printf("%d lasso queries over %d windows: p50 %.2f us, p99 %.2f us, max %.2f us\n",
+        TEST_QUERIES, static_cast<int>(spatialIndex.entryOf.size()), Percentile(samples, 0.5), p99, samples.back());
+
+    if (wrongQueries != 0 || wrongHits != 0)
+    {
+        printf("FAIL: %d queries and %d hit tests differ from a scan of every window\n", wrongQueries, wrongHits);
+        return 1;
+    }
+    if (p99 > TEST_QUERY_BUDGET_US)
+    {
+        printf("FAIL: query p99 %.2f us over the budget of %.0f us\n", p99, TEST_QUERY_BUDGET_US);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,289 @@
+// Headless test of the apply pipelines, run on Linux:
+//   g++ -std=c++14 -O2 tests/WindowApplyTest.cpp -o WindowApplyTest && ./WindowApplyTest [arranges] [seed]
+// A simulated desktop stands in for the Win32 backend: windows with a
+// rectangle, a place in the z-order and a foreground window, where a
+// batch is refused as a whole if one of its windows closed. Each arrange
+// plans moves for TEST_MAX_WINDOWS windows at most, closes some of them,
+// and applies the moves through ApplyArrangeMoves. The survivors must be
+// in their cells and stacked in list order, the last on top, after one
+// batch or one pass of single moves, with exactly one activation and one
+// step aside of the tool per arrange. Reflows through ApplyWindowMoves
+// must keep the z-order and activate nothing, and undo them exactly.
+
+#include "../Window Management Tool/WindowApply.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#define TEST_ARRANGES 10000
+#define TEST_SEED 20240607
+#define TEST_MAX_WINDOWS 32
+#define TEST_OTHER_WINDOWS 8        // Windows of other programs on the desktop, never moved
+
+struct TestRect
+{
+    int left, top, right, bottom;
+};
+
+struct TestMove
+{
+    unsigned int hWnd;
+    TestRect before;
+    TestRect after;
+};
+
+static bool SameRect(const TestRect& a, const TestRect& b)
+{
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+// Simulated desktop and the backend calls made on it. Handle 0 is none,
+// and as an insert-after window it means the top of the z-order.
+struct TestBackend
+{
+    typedef unsigned int Window;
+    typedef int Batch;              // Number of the open batch, 0 = none
+
+    struct Deferred
+    {
+        Window window;
+        bool stack;
+        Window insertAfter;
+        TestRect target;
+    };
+
+    std::vector<TestRect> rects;    // Indexed by handle
+    std::vector<bool> open;
+    std::vector<bool> shown;
+    std::vector<Window> zOrder;     // Top first
+    std::vector<Deferred> deferred;
+    Window foreground = 0;
+    int openBatch = 0;
+    int nextBatch = 1;
+
+    int batches = 0;                // EndBatch calls
+    int singleMoves = 0;            // Place calls
+    int activations = 0;
+    int stepAsides = 0;
+
+    Window CreateWindow(const TestRect& rect)
+    {
+        rects.push_back(rect);
+        open.push_back(true);
+        shown.push_back(false);
+        Window window = static_cast<Window>(rects.size() - 1);
+        zOrder.push_back(window);
+        return window;
+    }
+
+    void CloseWindow(Window window)
+    {
+        open[window] = false;
+        zOrder.erase(std::find(zOrder.begin(), zOrder.end(), window));
+        if (foreground == window)
+            foreground = 0;
+    }
+
+    void Move(Window window, bool stack, Window insertAfter, const TestRect& target)
+    {
+        rects[window] = target;
+        if (!stack)
+            return;
+        shown[window] = true;
+        zOrder.erase(std::find(zOrder.begin(), zOrder.end(), window));
+        auto below = insertAfter ? std::find(zOrder.begin(), zOrder.end(), insertAfter) + 1 : zOrder.begin();
+        zOrder.insert(below, window);
+    }
+
+    Batch BeginBatch(int count)
+    {
+        deferred.clear();
+        deferred.reserve(count);
+        openBatch = nextBatch++;
+        return openBatch;
+    }
+
+    bool Defer(Batch& batch, Window window, bool stack, Window insertAfter, const TestRect& target)
+    {
+        if (batch != openBatch || !open[window] || (insertAfter && !open[insertAfter]))
+        {
+            openBatch = 0;
+            batch = 0;
+            return false;
+        }
+        Deferred move = { window, stack, insertAfter, target };
+        deferred.push_back(move);
+        return true;
+    }
+
+    void EndBatch(Batch batch)
+    {
+        batches++;
+        if (batch != openBatch)
+            return;
+        for (const Deferred& move : deferred)
+            Move(move.window, move.stack, move.insertAfter, move.target);
+        openBatch = 0;
+    }
+
+    void Place(Window window, bool stack, Window insertAfter, const TestRect& target)
+    {
+        singleMoves++;
+        if (!open[window])
+            return;
+        Move(window, stack, insertAfter && open[insertAfter] ? insertAfter : 0, target);
+    }
+
+    bool IsWindow(Window window)
+    {
+        return window < open.size() && open[window];
+    }
+
+    void Activate(Window window)
+    {
+        activations++;
+        if (IsWindow(window))
+            foreground = window;
+    }
+
+    void StepAside()
+    {
+        stepAsides++;
+    }
+};
+
+// Function to make a random window rectangle
+static TestRect RandomRect(std::mt19937& random)
+{
+    std::uniform_int_distribution<int> positionDistribution(0, 3000);
+    std::uniform_int_distribution<int> sizeDistribution(100, 1000);
+    TestRect rect;
+    rect.left = positionDistribution(random);
+    rect.top = positionDistribution(random);
+    rect.right = rect.left + sizeDistribution(random);
+    rect.bottom = rect.top + sizeDistribution(random);
+    return rect;
+}
+
+// Function to run one arrange and one reflow with its undo on a fresh
+// desktop; returns the problem, or NULL
+static const char* CheckArrange(std::mt19937& random, int& activations)
+{
+    std::uniform_int_distribution<int> countDistribution(1, TEST_MAX_WINDOWS);
+    std::uniform_int_distribution<int> closeDistribution(0, 3);
+    TestBackend backend;
+    backend.CreateWindow(TestRect());           // Handle 0
+    backend.open[0] = false;
+    backend.zOrder.clear();
+    for (int i = 0; i < TEST_OTHER_WINDOWS; ++i)
+        backend.CreateWindow(RandomRect(random));
+
+    // Plan the moves, then close some windows before they are applied
+    std::vector<TestMove> moves;
+    int count = countDistribution(random);
+    for (int i = 0; i < count; ++i)
+    {
+        TestMove move;
+        move.before = RandomRect(random);
+        move.after = RandomRect(random);
+        move.hWnd = backend.CreateWindow(move.before);
+        moves.push_back(move);
+    }
+    bool closed = false;
+    for (const TestMove& move : moves)
+    {
+        if (closeDistribution(random) == 0)
+        {
+            backend.CloseWindow(move.hWnd);
+            closed = true;
+        }
+    }
+
+    ApplyArrangeMoves(backend, moves);
+    activations += backend.activations;
+    if (backend.activations != 1)
+        return "an arrange did not activate exactly one window";
+    if (backend.stepAsides != 1)
+        return "an arrange did not step the tool aside exactly once";
+    if (backend.batches > 1 || (backend.batches == 1 && backend.singleMoves > 0))
+        return "an arrange placed its windows in more than one pass";
+    if (backend.singleMoves > static_cast<int>(moves.size()))
+        return "an arrange placed a window more than once";
+    if (!closed && backend.batches != 1)
+        return "an arrange with every window open did not use one batch";
+    if (backend.IsWindow(moves.back().hWnd) && backend.foreground != moves.back().hWnd)
+        return "the last window of an arrange is not in the foreground";
+
+    // Survivors in their cells, shown, and stacked in list order on top
+    std::vector<unsigned int> survivors;
+    for (size_t i = moves.size(); i-- > 0; )
+    {
+        unsigned int hWnd = moves[i].hWnd;
+        if (!backend.IsWindow(hWnd))
+            continue;
+        if (!SameRect(backend.rects[hWnd], moves[i].after) || !backend.shown[hWnd])
+            return "an arranged window did not reach its cell after another closed";
+        survivors.push_back(hWnd);
+    }
+    if (!std::equal(survivors.begin(), survivors.end(), backend.zOrder.begin()))
+        return "arranged windows are not stacked in list order on top";
+
+    // A reflow of the survivors and its undo: no activation, z-order kept
+    std::vector<TestMove> reflow;
+    for (unsigned int hWnd : survivors)
+    {
+        TestMove move = { hWnd, backend.rects[hWnd], RandomRect(random) };
+        reflow.push_back(move);
+    }
+    std::vector<unsigned int> zOrder = backend.zOrder;
+    ApplyWindowMoves(backend, reflow, true);
+    for (const TestMove& move : reflow)
+    {
+        if (!SameRect(backend.rects[move.hWnd], move.after))
+            return "a reflowed window did not reach its rectangle";
+    }
+    ApplyWindowMoves(backend, reflow, false);
+    for (const TestMove& move : reflow)
+    {
+        if (!SameRect(backend.rects[move.hWnd], move.before))
+            return "an undone reflow did not put a window back";
+    }
+    if (backend.activations != 1 || backend.zOrder != zOrder)
+        return "a reflow activated a window or changed the z-order";
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    int arranges = (argc > 1) ? atoi(argv[1]) : TEST_ARRANGES;
+    unsigned int seed = (argc > 2) ? static_cast<unsigned int>(strtoul(argv[2], NULL, 10)) : TEST_SEED;
+    if (arranges <= 0)
+        arranges = TEST_ARRANGES;
+
+    std::mt19937 random(seed);
+    int activations = 0;
+    for (int arrange = 0; arrange < arranges; ++arrange)
+    {
+        const char* problem = CheckArrange(random, activations);
+        if (problem)
+        {
+            printf("FAIL arrange %d (seed %u): %s\n", arrange, seed, problem);
+            return 1;
+        }
+    }
+
+    // An empty arrange still steps aside but activates nothing
+    TestBackend backend;
+    ApplyArrangeMoves(backend, std::vector<TestMove>());
+    if (backend.activations != 0 || backend.batches != 0 || backend.singleMoves != 0)
+    {
+        printf("FAIL: an arrange without moves placed or activated a window\n");
+        return 1;
+    }
+
+    printf("%d arranges of up to %d windows (seed %u): %d activations\n", arranges, TEST_MAX_WINDOWS, seed, activations);
+    printf("PASS\n");
+    return 0;
+}